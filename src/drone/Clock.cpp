@@ -0,0 +1,58 @@
+#include "Clock.h"
+
+///Whether the cycle counter has been started
+static bool clockStarted = false;
+///CPU cycles in a microsecond
+static uint32_t cyclesPerMicro;
+///Cycle count the clock was last advanced to, the cycles after it are the part of a microsecond not yet counted
+static uint32_t lastCycles;
+///Time of the clock at lastCycles (μs)
+static micros_t clockTime;
+///millis() when the clock was last advanced, to count the wraps of the cycle counter since then
+static uint32_t lastMillis;
+
+/** Starts the cycle counter, from the time since power on so the clock agrees with micros() */
+static void startClock() {
+  #ifdef ARM_DWT_CTRL_CYCCNTENA
+    ARM_DEMCR |= ARM_DEMCR_TRCENA;
+    ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
+  #endif
+  cyclesPerMicro = F_CPU_ACTUAL / 1000000;
+  lastCycles = cycleCount();
+  lastMillis = millis();
+  clockTime = micros();
+  clockStarted = true;
+}
+
+micros_t clockMicros() {
+  if (!clockStarted) {
+    startClock();
+  }
+
+  //Unsigned subtraction gives the cycles since the last call modulo 2^32
+  uint32_t nowMillis = millis();
+  uint64_t cycles = (uint32_t)(cycleCount() - lastCycles);
+  //The cycle counter wraps every 7.2 s, so add the whole wraps which millis() shows were missed, e.g. during a long setup
+  uint64_t expected = (uint64_t)(uint32_t)(nowMillis - lastMillis) * cyclesPerMicro * 1000;
+  if (expected > cycles + (1ULL << 31)) {
+    cycles += (expected - cycles + (1ULL << 31)) >> 32 << 32;
+  }
+  lastMillis = nowMillis;
+
+  //Count the whole microseconds, the rest of a microsecond is counted on the next call
+  uint64_t elapsed = cycles / cyclesPerMicro;
+  lastCycles += (uint32_t)(elapsed * cyclesPerMicro);
+  clockTime += elapsed;
+  return clockTime;
+}
+
+micros_t cyclesToMicros(uint32_t cycles) {
+  if (!clockStarted) {
+    startClock();
+  }
+
+  //Negative if the count is from before lastCycles, rounded down so it is not put in the microsecond after it was read
+  int64_t offset = (int32_t)(cycles - lastCycles);
+  int64_t perMicro = cyclesPerMicro;
+  return clockTime + (offset >= 0 ? offset / perMicro : -((-offset + perMicro - 1) / perMicro));
+}
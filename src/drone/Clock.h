@@ -0,0 +1,93 @@
+#ifndef __Clock_H__
+#define __Clock_H__
+
+//Import libraries
+#include <Arduino.h>
+#include <stdint.h>
+
+///Time of the clock (μs), 64 bits so it does not wrap
+typedef uint64_t micros_t;
+
+/** Reads the CPU's cycle counter. Safe in interrupts, which use it to stamp events for cyclesToMicros() */
+inline uint32_t cycleCount() {
+  return ARM_DWT_CYCCNT;
+}
+
+/** Gets the time since the clock started (μs)
+ *
+ *  The clock counts the cycles of the CPU, keeping the part of a microsecond left over between reads so it does not
+ *  drift. The cycle counter is 32 bits and wraps every 2^32 cycles (7.2 s at 600 MHz), the wraps between calls are
+ *  counted with millis(), so the gap between calls can be up to 49 days. Not safe in interrupts.
+ *
+ *  @returns Time which never goes back or wraps (μs)
+ */
+micros_t clockMicros();
+
+/** Converts a cycle count read with cycleCount() to the time of the clock
+ *
+ *  The count can be from up to 2^31 cycles (3.6 s at 600 MHz) either side of the last clockMicros().
+ *
+ *  @param[in] cycles Cycle count, e.g. read in an interrupt
+ *  @returns Time of the clock when it was read (μs)
+ */
+micros_t cyclesToMicros(uint32_t cycles);
+
+/** Converts a length of time from the clock to milliseconds */
+inline float microsToMillis(micros_t time) {
+  return time / 1000.0f;
+}
+/** Converts a length of time from the clock to seconds */
+inline float microsToSeconds(micros_t time) {
+  return time / 1000000.0f;
+}
+
+
+/**
+ * @class FlightClock
+ * @brief Time since the flight started, which stops while the drone is on standby
+ */
+class FlightClock {
+  public:
+    /** Starts the flight
+     *
+     *  @param[in] now Time of the clock (μs)
+     */
+    void start(micros_t now) {
+      startTime = now;
+      pausedTime = 0;
+      paused = false;
+    }
+    /** Stops the flight time, e.g. going on standby. Ignored if it is already stopped */
+    void pause(micros_t now) {
+      if (!paused) {
+        pauseStart = now;
+        paused = true;
+      }
+    }
+    /** Continues the flight time from where it stopped. Ignored if it is not stopped */
+    void resume(micros_t now) {
+      if (paused) {
+        pausedTime += now - pauseStart;
+        paused = false;
+      }
+    }
+    /** Gets the time of the flight
+     *
+     *  @param[in] now Time of the clock (μs)
+     *  @returns Time since the flight started, excluding the time it was stopped (μs)
+     */
+    micros_t flightTime(micros_t now) const {
+      return (paused ? pauseStart : now) - startTime - pausedTime;
+    }
+
+  private:
+    ///Time of the clock the flight started at (μs)
+    micros_t startTime = 0;
+    ///Time of the clock the flight time stopped at (μs)
+    micros_t pauseStart = 0;
+    ///Time the flight time has been stopped for, not counting the current stop (μs)
+    micros_t pausedTime = 0;
+    ///Whether the flight time is stopped
+    bool paused = false;
+};
+#endif
@@ -0,0 +1,120 @@
+#include "DShot.h"
+
+///Nibble of each 5 bit GCR code, 0xFF if the code is not used
+static const uint8_t gcrDecode[32] = {
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF,  0x9,  0xA,  0xB, 0xFF,  0xD,  0xE,  0xF,
+  0xFF, 0xFF,  0x2,  0x3, 0xFF,  0x5,  0x6,  0x7,
+  0xFF,  0x0,  0x8,  0x1, 0xFF,  0x4,  0xC, 0xFF
+};
+
+uint16_t dshotThrottle(float power) {
+  if (power <= 0) {
+    return 0;
+  }
+  if (power >= 1000) {
+    return 2047;
+  }
+  //Map 0 - 1000 to 48 - 2047
+  return 48 + (uint16_t)(power * 1999 / 1000 + .5f);
+}
+
+uint16_t dshotFrame(uint16_t value, bool telemetry, bool inverted) {
+  uint16_t data = (value << 1) | telemetry;
+  uint16_t crc = data ^ (data >> 4) ^ (data >> 8);
+  if (inverted) {
+    crc = ~crc;
+  }
+  return (data << 4) | (crc & 0xF);
+}
+
+void dshotFillBuffer(const uint16_t frames[], const uint32_t masks[], int count, uint32_t buffer[]) {
+  uint32_t all = 0;
+  for (int i=0; i<count; i++) {
+    all |= masks[i];
+  }
+
+  for (int bit=0; bit<16; bit++) {
+    uint32_t ones = 0;
+    for (int i=0; i<count; i++) {
+      if (frames[i] & (0x8000 >> bit)) {
+        ones |= masks[i];
+      }
+    }
+    uint32_t *word = &buffer[bit * dshotWordsPerBit];
+    word[0] = all; //Start of the bit
+    word[1] = all & ~ones; //End of a 0
+    word[2] = ones; //End of a 1
+  }
+}
+
+uint32_t dshotReadReply(const uint32_t samples[], int count, uint32_t mask) {
+  //The line idles high, the reply starts at the first falling edge
+  int start = 0;
+  while (start < count and (samples[start] & mask)) {
+    start++;
+  }
+  if (start == count) {
+    return dshotInvalid;
+  }
+
+  //Each edge is a 1, the number of bits between edges is found from the number of samples between them
+  uint32_t reply = 1;
+  int bits = 1;
+  int lastEdge = start;
+  bool level = false;
+  for (int i=start+1; i<count; i++) {
+    bool sample = samples[i] & mask;
+    if (sample != level) {
+      int run = (i - lastEdge + dshotSamplesPerBit/2) / dshotSamplesPerBit;
+      //The line going back to idle after the last bit is not part of the reply
+      if (bits + run > dshotReplyBits) {
+        break;
+      }
+      reply = (reply << run) | 1;
+      bits += run;
+      lastEdge = i;
+      level = sample;
+    }
+  }
+  if (bits < dshotReplyBits) {
+    reply <<= dshotReplyBits - bits;
+  }
+  return reply;
+}
+
+uint32_t dshotDecodeReply(uint32_t reply) {
+  if (reply == dshotInvalid) {
+    return dshotInvalid;
+  }
+
+  //Decode the 4 GCR nibbles after the start edge
+  uint32_t value = 0;
+  for (int i=3; i>=0; i--) {
+    uint8_t nibble = gcrDecode[(reply >> (i*5)) & 0x1F];
+    if (nibble == 0xFF) {
+      return dshotInvalid;
+    }
+    value = (value << 4) | nibble;
+  }
+
+  //The CRC is inverted, so all nibbles xor to 0xF
+  uint32_t crc = value ^ (value >> 4) ^ (value >> 8) ^ (value >> 12);
+  if ((crc & 0xF) != 0xF) {
+    return dshotInvalid;
+  }
+  return value >> 4;
+}
+
+uint32_t dshotToErpm(uint32_t value) {
+  //The longest period means the motor is stopped
+  if (value == dshotInvalid or value == 0xFFF) {
+    return 0;
+  }
+  //Period (μs) is the mantissa shifted by the exponent
+  uint32_t period = (value & 0x1FF) << (value >> 9);
+  if (period == 0) {
+    return 0;
+  }
+  return (60000000 + period/2) / period;
+}
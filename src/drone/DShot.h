@@ -0,0 +1,75 @@
+#ifndef __DShot_H__
+#define __DShot_H__
+
+//Import libraries
+#include <stdint.h>
+
+/*
+ * DShot digital ESC protocol.
+ *
+ * A frame is 16 bits sent MSB first: 11 bit throttle, 1 telemetry request bit and a 4 bit CRC.
+ * Throttle 0 stops the motor, 1 - 47 are commands and 48 - 2047 is the throttle range.
+ * With bidirectional DShot the signal is inverted (idles high), the CRC is inverted and the ESC replies
+ * with its eRPM about 30 μs after each frame. The reply is 21 bits at 5/4 of the bit rate, where each 1 is
+ * an edge: a start edge followed by 4 GCR encoded nibbles (3 bit exponent, 9 bit period mantissa, 4 bit CRC).
+ *
+ * The functions here only deal with the bits, so they have no hardware dependencies. See DShotOutput.h for the output.
+ */
+
+///Number of DMA words per bit of a frame. Each bit is split in thirds: start, end of a 0, end of a 1
+const int dshotWordsPerBit = 3;
+///Number of DMA words in the buffer of a frame
+const int dshotBufferLength = 16 * dshotWordsPerBit;
+///Number of samples per bit of a reply
+const int dshotSamplesPerBit = 3;
+///Number of bits in a reply, including the start edge
+const int dshotReplyBits = 21;
+///Returned when a reply could not be read or failed its CRC
+const uint32_t dshotInvalid = 0xFFFFFFFF;
+
+/** Converts motor power to a DShot throttle value
+ *
+ *  @param[in] power Motor power, 0 - 1000
+ *  @returns 0 (motor stopped) if the power is 0, otherwise 48 - 2047
+ */
+uint16_t dshotThrottle(float power);
+/** Creates a DShot frame
+ *
+ *  @param[in] value Throttle (48 - 2047) or command (0 - 47)
+ *  @param[in] telemetry Whether to request telemetry
+ *  @param[in] inverted Whether bidirectional DShot is used, which inverts the CRC
+ *  @returns Frame to send, MSB first
+ */
+uint16_t dshotFrame(uint16_t value, bool telemetry, bool inverted);
+/** Fills a DMA buffer which sends a frame to each motor at the same time.
+ *
+ *  Each word is written to the GPIO port's toggle register, so every pin is toggled at the start of each bit
+ *  and again after a third (bit is 0) or two thirds (bit is 1) of the bit.
+ *
+ *  @param[in] frames Frame of each motor, see dshotFrame()
+ *  @param[in] masks GPIO port bit of each motor
+ *  @param[in] count Number of motors
+ *  @param[out] buffer Buffer of dshotBufferLength words
+ */
+void dshotFillBuffer(const uint16_t frames[], const uint32_t masks[], int count, uint32_t buffer[]);
+/** Finds the edges of a reply in the samples of a GPIO port
+ *
+ *  @param[in] samples Samples of the GPIO port, dshotSamplesPerBit per bit of the reply
+ *  @param[in] count Number of samples
+ *  @param[in] mask GPIO port bit of the motor
+ *  @returns The 21 bits of the reply, 1 where there was an edge, or dshotInvalid if no reply was found
+ */
+uint32_t dshotReadReply(const uint32_t samples[], int count, uint32_t mask);
+/** Decodes the GCR of a reply and checks its CRC
+ *
+ *  @param[in] reply Reply from dshotReadReply()
+ *  @returns The 12 bit value (3 bit exponent, 9 bit mantissa) or dshotInvalid
+ */
+uint32_t dshotDecodeReply(uint32_t reply);
+/** Converts a decoded reply to eRPM
+ *
+ *  @param[in] value Value from dshotDecodeReply()
+ *  @returns Electrical RPM, divide by the number of pole pairs to get the motor RPM
+ */
+uint32_t dshotToErpm(uint32_t value);
+#endif
@@ -0,0 +1,142 @@
+//The DMA output is only available on the Teensy 4, other builds only use DShot.cpp
+#if defined(__IMXRT1062__)
+#include "DShotOutput.h"
+
+DShotOutput *DShotOutput::active = nullptr;
+
+bool DShotOutput::init(const int pins[], int count, uint32_t rate, bool useBidirectional) {
+  motorCount = min(count, dshotMaxMotors);
+  bitRate = rate;
+  bidirectional = useBidirectional;
+  active = this;
+
+  //Check every pin before changing any, so a bad pin does not leave some motors set up
+  for (int i=0; i<motorCount; i++) {
+    if (digitalPinToPortReg(pins[i]) != &GPIO6_DR) {
+      return false;
+    }
+  }
+
+  //Use the normal GPIO1 instead of the fast GPIO6 for the motor pins, DMA cannot reach GPIO6
+  allMask = 0;
+  for (int i=0; i<motorCount; i++) {
+    pinMode(pins[i], OUTPUT);
+    if (bidirectional) {
+      //The line idles high, keep it high with a pull up while the ESC is not replying
+      *portConfigRegister(pins[i]) |= IOMUXC_PAD_PKE | IOMUXC_PAD_PUE | IOMUXC_PAD_PUS(3);
+    }
+    masks[i] = digitalPinToBitMask(pins[i]);
+    allMask |= masks[i];
+  }
+  if (bidirectional) {
+    GPIO1_DR_SET = allMask;
+  } else {
+    GPIO1_DR_CLEAR = allMask;
+  }
+  GPIO1_GDIR |= allMask;
+  IOMUXC_GPR_GPR26 &= ~allMask;
+
+  //Wait for the ESC's reply (about 30 μs) then sample 21 bits at 5/4 of the bit rate, with some margin
+  float replyRate = bitRate * 5.0f / 4.0f;
+  int windowBits = (int)(45e-6f * replyRate + .5f) + dshotReplyBits + 2;
+  sampleCount = dshotSamplesPerBit * min(windowBits, dshotMaxReplyWindow);
+
+  //FlexPWM2 submodule 0 requests a DMA transfer every time it reloads
+  FLEXPWM2_MCTRL &= ~FLEXPWM_MCTRL_RUN(1);
+  FLEXPWM2_SM0CTRL2 = FLEXPWM_SMCTRL2_INDEP | FLEXPWM_SMCTRL2_CLK_SEL(0);
+  FLEXPWM2_SM0CTRL = FLEXPWM_SMCTRL_FULL;
+  FLEXPWM2_SM0INIT = 0;
+  FLEXPWM2_SM0DMAEN = FLEXPWM_SMDMAEN_VALDE;
+
+  //Each frame is written to the toggle register, one word per third of a bit
+  frameDma.begin(true);
+  frameDma.sourceBuffer(frameBuffer, sizeof(frameBuffer));
+  frameDma.destination(GPIO1_DR_TOGGLE);
+  frameDma.triggerAtHardwareEvent(DMAMUX_SOURCE_FLEXPWM2_WRITE0);
+  frameDma.disableOnCompletion();
+  frameDma.interruptAtCompletion();
+  frameDma.attachInterrupt(frameSent);
+
+  //The replies are read by sampling the pin states of GPIO1
+  if (bidirectional) {
+    replyDma.begin(true);
+    replyDma.source(GPIO1_PSR);
+    replyDma.destinationBuffer(replySamples, sampleCount * sizeof(uint32_t));
+    replyDma.triggerAtHardwareEvent(DMAMUX_SOURCE_FLEXPWM2_WRITE0);
+    replyDma.disableOnCompletion();
+    replyDma.interruptAtCompletion();
+    replyDma.attachInterrupt(repliesReceived);
+  }
+  return true;
+}
+
+bool DShotOutput::send(const uint16_t values[]) {
+  if (busy) {
+    return false;
+  }
+
+  uint16_t frames[dshotMaxMotors];
+  for (int i=0; i<motorCount; i++) {
+    frames[i] = dshotFrame(values[i], false, bidirectional);
+  }
+  dshotFillBuffer(frames, masks, motorCount, frameBuffer);
+
+  //The pins were inputs while reading the replies
+  if (bidirectional) {
+    GPIO1_DR_SET = allMask;
+    GPIO1_GDIR |= allMask;
+  }
+
+  //Start the frame on all motors
+  busy = true;
+  repliesReady = false;
+  setTimerRate(bitRate * dshotWordsPerBit);
+  frameDma.sourceBuffer(frameBuffer, sizeof(frameBuffer));
+  frameDma.enable();
+  FLEXPWM2_SM0CTRL2 |= FLEXPWM_SMCTRL2_FORCE;
+  FLEXPWM2_MCTRL |= FLEXPWM_MCTRL_RUN(1);
+  return true;
+}
+
+bool DShotOutput::readReplies(uint32_t erpm[]) {
+  if (!repliesReady) {
+    return false;
+  }
+  for (int i=0; i<motorCount; i++) {
+    erpm[i] = dshotDecodeReply(dshotReadReply(replySamples, sampleCount, masks[i]));
+    if (erpm[i] != dshotInvalid) {
+      erpm[i] = dshotToErpm(erpm[i]);
+    }
+  }
+  repliesReady = false;
+  return true;
+}
+
+void DShotOutput::frameSent() {
+  active->frameDma.clearInterrupt();
+  if (!active->bidirectional) {
+    FLEXPWM2_MCTRL &= ~FLEXPWM_MCTRL_RUN(1);
+    active->busy = false;
+    return;
+  }
+
+  //Let the ESCs drive the line and sample it at 5/4 of the bit rate
+  GPIO1_GDIR &= ~active->allMask;
+  setTimerRate(active->bitRate * 5.0f / 4.0f * dshotSamplesPerBit);
+  active->replyDma.destinationBuffer(active->replySamples, active->sampleCount * sizeof(uint32_t));
+  active->replyDma.enable();
+}
+
+void DShotOutput::repliesReceived() {
+  active->replyDma.clearInterrupt();
+  FLEXPWM2_MCTRL &= ~FLEXPWM_MCTRL_RUN(1);
+  active->repliesReady = true;
+  active->busy = false;
+}
+
+void DShotOutput::setTimerRate(float rate) {
+  FLEXPWM2_MCTRL |= FLEXPWM_MCTRL_CLDOK(1);
+  FLEXPWM2_SM0VAL1 = (uint16_t)(F_BUS_ACTUAL / rate + .5f) - 1;
+  FLEXPWM2_MCTRL |= FLEXPWM_MCTRL_LDOK(1);
+}
+#endif
@@ -0,0 +1,89 @@
+#ifndef __DShotOutput_H__
+#define __DShotOutput_H__
+
+//Import libraries
+#include <Arduino.h>
+#include <DMAChannel.h>
+
+//Import files
+#include "DShot.h"
+
+///Maximum number of motors
+const int dshotMaxMotors = 8;
+///Maximum number of bits sampled while waiting for and reading a reply
+const int dshotMaxReplyWindow = 64;
+
+
+/**
+ * @class DShotOutput
+ * @brief Sends DShot frames to all motors at the same time using DMA and reads the bidirectional DShot replies (Teensy 4 only)
+ *
+ * The frame of every motor is sent by one DMA channel writing to the GPIO toggle register, so the CPU only fills the buffer.
+ * With bidirectional DShot the pins are switched to inputs after the frame and a second DMA channel samples the GPIO port.
+ * All motor pins must be on the same GPIO port, pins 20 - 23 are all on GPIO1.
+ * FlexPWM2 submodule 0 is used to time the DMA transfers.
+ */
+class DShotOutput {
+  public:
+    /** Set up the pins, timer and DMA channels
+     *
+     *  @param[in] pins Pin of each motor
+     *  @param[in] count Number of motors
+     *  @param[in] bitRate DShot bit rate (150000, 300000 or 600000)
+     *  @param[in] bidirectional Whether to use bidirectional DShot and read the eRPM of each motor
+     *  @returns false if the pins are not all on GPIO1
+     */
+    bool init(const int pins[], int count, uint32_t bitRate, bool bidirectional);
+    /** Start sending a frame to each motor. Returns straight away, the frame is sent by DMA
+     *
+     *  @param[in] values Throttle or command of each motor, see dshotThrottle()
+     *  @returns false if the last frame or reply has not finished, so nothing was sent
+     */
+    bool send(const uint16_t values[]);
+    /** Read the replies to the last frame
+     *
+     *  @param[out] erpm eRPM of each motor, dshotInvalid if its reply could not be read
+     *  @returns true if the replies have been received
+     */
+    bool readReplies(uint32_t erpm[]);
+
+  private:
+    /** Interrupt at the end of the frame, starts sampling the replies */
+    static void frameSent();
+    /** Interrupt at the end of the replies, stops the timer */
+    static void repliesReceived();
+    /** Sets the period of the timer which triggers the DMA transfers
+     *
+     *  @param[in] rate Transfers per second
+     */
+    static void setTimerRate(float rate);
+
+    ///The output being used, for the interrupts
+    static DShotOutput *active;
+    ///GPIO1 bit of each motor
+    uint32_t masks[dshotMaxMotors];
+    ///GPIO1 bits of all motors
+    uint32_t allMask = 0;
+    ///Number of motors
+    int motorCount = 0;
+    ///Whether bidirectional DShot is used
+    bool bidirectional = false;
+    ///DShot bit rate (bits per second)
+    uint32_t bitRate;
+    ///Number of samples taken while waiting for and reading the replies
+    int sampleCount;
+    ///Whether a frame or reply is being transferred
+    volatile bool busy = false;
+    ///Whether the replies to the last frame have been received
+    volatile bool repliesReady = false;
+
+    ///DMA channel sending the frames
+    DMAChannel frameDma;
+    ///DMA channel sampling the replies
+    DMAChannel replyDma;
+    ///Words written to the GPIO1 toggle register
+    uint32_t frameBuffer[dshotBufferLength];
+    ///Samples of GPIO1 taken during the replies
+    uint32_t replySamples[dshotSamplesPerBit * dshotMaxReplyWindow];
+};
+#endif
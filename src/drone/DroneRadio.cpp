@@ -1,66 +1,152 @@
 #include "DroneRadio.h"
 
-void DroneRadio::init() {
+DroneRadio *DroneRadio::active = nullptr;
+
+void DroneRadio::init(SharedState<TelemetryState> &telemetry) {
+  this->telemetry = &telemetry;
+
   radio.begin();
   radio.setRadiation(RF24_PA_MAX, RF24_2MBPS);
   radio.setChannel(124);
-  radio.setPayloadSize(7);
+  //Telemetry frames are sent back in the ACK payloads, which need dynamic payloads
+  radio.enableDynamicPayloads();
+  radio.enableAckPayload();
   
   //Open pipe
   radio.openWritingPipe(addresses[1]);
   radio.openReadingPipe(1, addresses[0]);
   
-  //Ready drone
-  data[0] = 0b01010101;
-  for (int i=0; i<10; i++){
+}
+
+bool DroneRadio::updateReady() {
+  if (readySignals == 10) {
+    return true;
+  }
+
+  //Send the ready signal 10 times, 5ms apart
+  if (readySignals == 0 or millis() - lastReadyTime >= 5) {
+    data[0] = 0b01010101;
     radio.write(&data, 1);
-    delay(5);
+    lastReadyTime = millis();
+    readySignals++;
+  }
+
+  if (readySignals == 10) {
+    radio.startListening();
+    //The ACK payload is sent with the next packet, so there is always one waiting
+    loadTelemetry();
+
+    //Only interrupt when a packet is received
+    if (irqPin >= 0) {
+      active = this;
+      radio.maskIRQ(true, true, false);
+      pinMode(irqPin, INPUT_PULLUP);
+      SPI.usingInterrupt(digitalPinToInterrupt(irqPin));
+      attachInterrupt(digitalPinToInterrupt(irqPin), radioInterrupt, FALLING);
+
+      //A packet received before the interrupt was attached holds the IRQ line low without an edge, so clear the flag and
+      //read it here. With interrupts off, a packet arriving meanwhile is read now and its edge runs the interrupt after
+      noInterrupts();
+      bool txOk, txFail, rxReady;
+      radio.whatHappened(txOk, txFail, rxReady);
+      receive();
+      interrupts();
+    }
+    return true;
   }
-  radio.startListening();
+  return false;
 }
 
-void DroneRadio::getInput() {
-  if (radio.available()) {
-    //Lower the counter for loss of connection after receiving radio
-    radioReceived = true;
-    //Get data from controller
-    while (radio.available()) {
-      radio.read(&data, sizeof(char[7]));
+void DroneRadio::radioInterrupt() {
+  bool txOk, txFail, rxReady;
+  active->radio.whatHappened(txOk, txFail, rxReady);
+  active->receive();
+}
+
+void DroneRadio::receive() {
+  while (radio.available()) {
+    //The payload size is set by the sender with dynamic payloads, 0 if the radio flushed a corrupt one
+    uint8_t length = radio.getDynamicPayloadSize();
+    if (length == 0) {
+      continue;
+    }
+    RadioPacket packet;
+    if (length == radioPacketSize) {
+      radio.read(packet.data, radioPacketSize);
+      packet.cycles = cycleCount();
+      if (!packets.push(packet)) {
+        droppedPackets++;
+      }
+    } else {
+      //Read it to clear it from the RX FIFO, it is not a packet from the controller
+      uint8_t discard[32];
+      radio.read(discard, min(length, (uint8_t)sizeof(discard)));
+      droppedPackets++;
     }
-    
+    packetsReceived++;
+
+    //Every packet took the oldest ACK payload, so replace it
+    loadTelemetry();
+  }
+}
+
+void DroneRadio::loadTelemetry() {
+  //read() is used as this can run in the interrupt
+  TelemetryState state = telemetry->read();
+  state.packetsReceived = packetsReceived;
+  state.droppedPackets = droppedPackets;
+
+  uint8_t frame[telemetryMaxLength];
+  int length = encodeTelemetry(state, telemetrySchedule[telemetryIndex], telemetrySequence, frame);
+  //Stay on this frame if the TX FIFO is full
+  if (!radio.writeAckPayload(1, frame, length)) {
+    return;
+  }
+  telemetryIndex = (telemetryIndex + 1) % telemetryScheduleLen;
+  telemetrySequence = (telemetrySequence + 1) & 0xF;
+}
+
+void DroneRadio::getInput(SharedState<RcCommand> &rc) {
+  if (irqPin < 0) {
+    receive();
+  }
+
+  RadioPacket packet;
+  bool received = false;
+  while (packets.pop(packet)) {
     //Abort button
-    if (bitRead(data[6], 0)) {
+    if (decodePacket(packet, command)) {
       ABORT();
     }
-    
-    //Get analog info from packet
-    for (int i=0; i<4; i++) {
-      xyzr[i] = data[i] - 127;
-      if (abs(xyzr[i]) < 5) { //Joystick deadzone
-       xyzr[i] = 0;
-      }
-    }
-    xyzr[1] = -xyzr[1]; //Correct pitch
-    potPercent = data[4]/255.0; //Put between 0-1
-    //Get binary info from packet
-    light = bitRead(data[6], 2);
+    command.timestamp = cyclesToMicros(packet.cycles);
+    link.addPacket(command.sequence, command.timestamp);
+    received = true;
+  }
 
-    standbyButton = bitRead(data[6], 1);
+  if (received) {
+    //Lower the counter for loss of connection after receiving radio
+    radioReceived = true;
+    rc.publish(command);
   }
+  //Also keeps the clock up with the cycle counter, as this runs every loop including on standby
+  link.update(clockMicros());
 }
 
-void DroneRadio::checkSignal(unsigned long loopTime, unsigned long currentTime) {
-  //On the first loop set lastRadioTime to the current time to avoid a large spike
-  if (lastRadioTime == 0) {
+void DroneRadio::checkSignal(micros_t currentTime) {
+  //On the first check start from the current time to avoid a large spike
+  if (!signalChecked) {
+    lastCheckTime = currentTime;
     lastRadioTime = currentTime;
+    signalChecked = true;
   }
 
-  //Add the loop time in microseconds to the timer
-  timer += loopTime;
+  //Add the time since the last check to the timer
+  timer += currentTime - lastCheckTime;
+  lastCheckTime = currentTime;
 
   if (radioReceived) {
     //No penalty if delay less than maximum
-    if (currentTime - lastRadioTime <= maxRadioDelay) {
+    if (currentTime - lastRadioTime <= (micros_t)maxRadioDelay) {
       timer = max(timer-maxRadioDelay, 0);
     }
 
@@ -4,10 +4,12 @@
 //Import libraries
 #include <RF24.h>
 
-extern int xyzr[4];
-extern float potPercent;
-extern bool light;
-extern bool standbyButton;
+//Import files
+#include "LinkQuality.h"
+#include "RadioPacket.h"
+#include "SpscQueue.h"
+#include "StateBus.h"
+#include "Telemetry.h"
 
 extern void ABORT();
 
@@ -17,34 +19,81 @@ extern void ABORT();
  */
 class DroneRadio {
   public:
-    /** Initialise the radio. */
-    void init();
-    /** Recieves the input from the controller, if any was received. */
-    void getInput();
+    /** Initialise the radio.
+     *  
+     *  @param[in] telemetry State to send to the controller in the ACK payloads
+     */
+    void init(SharedState<TelemetryState> &telemetry);
+    /** Sends the ready signal to the controller without blocking, then starts listening for input.
+     *  
+     *  Once listening, packets are received by the radio's IRQ interrupt (or by getInput() if irqPin is -1).
+     *  
+     *  @returns true once the ready signal has been sent
+     */
+    bool updateReady();
+    /** Decodes the packets received since the last call, if any. Does not use SPI unless the radio is polled
+     *  
+     *  @param[out] rc State to publish the newest input to
+     */
+    void getInput(SharedState<RcCommand> &rc);
     /** Checks the radio signal is being recieved at a fast enough rate.
      *  
-     *  @param[in] loopTime length of time to complete previous loop (milliseconds)
-     *  @param[in] currentTime uptime of device in milliseconds (excluding standby)
+     *  @param[in] currentTime Time since the flight started, excluding standby (μs, see FlightClock)
      */
-    void checkSignal(unsigned long loopTime, unsigned long currentTime);
+    void checkSignal(micros_t currentTime);
 
     ///Keeps track of loss of communication
     int timer;
+    ///Packet rate, loss and jitter of the link
+    LinkMonitor link;
+    ///Number of packets received from the controller
+    volatile uint32_t packetsReceived = 0;
+    ///Number of packets dropped because the queue was full or they were not radioPacketSize bytes
+    volatile uint32_t droppedPackets = 0;
 
   private:
+    /** Reads every packet waiting in the radio into the queue, stamped with the cycle count as this runs in the interrupt */
+    void receive();
+    /** Loads the next telemetry frame in the schedule as the ACK payload of the next packet. Call once per packet read */
+    void loadTelemetry();
+    /** Interrupt for the radio's IRQ line */
+    static void radioInterrupt();
+
+    ///The radio used by the interrupt
+    static DroneRadio *active;
     ///Sets CE and CSN pins of the radio
     RF24 radio{25, 10};
+    ///Pin connected to the radio's IRQ line, -1 if it is not connected and the radio is polled in getInput()
+    const int irqPin = 24;
+    ///Packets received but not yet decoded
+    SpscQueue<RadioPacket, 8> packets;
     ///Addresses of the controller and device
     byte addresses[2][6] = {"C", "D"};
-    ///Raw input data
-    char data[7];
+    ///Telemetry sent to the controller
+    SharedState<TelemetryState> *telemetry = nullptr;
+    ///Position in telemetrySchedule of the next frame
+    int telemetryIndex = 0;
+    ///Sequence number of the next frame
+    uint8_t telemetrySequence = 0;
+    ///Raw data of the ready signal
+    char data[1];
+    ///Input decoded from the latest packet
+    RcCommand command = {};
     ///Minimum wanted rate of the radio (Hz)
     const int minRadioRate = 50;
     ///Maximum acceptable delay of the radio (μs)
     const int maxRadioDelay = 1000000/minRadioRate;
     ///Whether the radio signal has been received this loop
     bool radioReceived = false;
-    ///Time since the last radio signal (μs)
-    unsigned long lastRadioTime = 0;
+    ///Time of the check which last found a radio signal (μs since the flight started)
+    micros_t lastRadioTime = 0;
+    ///Time of the last call to checkSignal() (μs since the flight started)
+    micros_t lastCheckTime = 0;
+    ///Whether checkSignal() has been called
+    bool signalChecked = false;
+    ///Number of ready signals sent to the controller
+    int readySignals = 0;
+    ///Time the last ready signal was sent (ms)
+    unsigned long lastReadyTime = 0;
 };
 #endif
@@ -0,0 +1,156 @@
+#ifndef __FixedPoint_H__
+#define __FixedPoint_H__
+
+//Different number formats of the control path defined here
+#define FLOAT_MATH 0
+#define FIXED_MATH 1
+
+//Select which number format the PID controller and motor mixer use
+#ifndef CONTROL_MATH
+  #define CONTROL_MATH FLOAT_MATH
+#endif
+
+//Import libraries
+#include <stdint.h>
+
+
+///Fixed point number between -1 and 1 with 15 fractional bits
+typedef int16_t q15_t;
+///Fixed point number between -1 and 1 with 31 fractional bits
+typedef int32_t q31_t;
+
+#if CONTROL_MATH == FIXED_MATH
+  ///Number type used by the control path
+  typedef q31_t ctrl_t;
+#else
+  ///Number type used by the control path
+  typedef float ctrl_t;
+#endif
+
+/* Settings */
+///Full scale of angles (degrees) and rotation rates (degrees per second) in the fixed point control path
+const float rateScale = 2048;
+/* Settings */
+
+/**
+ * @struct qGain
+ * @brief A gain stored as a Q31 mantissa and a power of two exponent, so gains above 1 can be used
+ */
+struct qGain {
+  ///Mantissa of the gain, between -1 and 1
+  q31_t mantissa;
+  ///The gain is mantissa * 2^shift, between -31 and 31
+  int8_t shift;
+};
+
+/** Limits a 64 bit value to the range of a Q31 number */
+constexpr q31_t qSat(int64_t x) {
+  if (x > INT32_MAX) {
+    return INT32_MAX;
+  } else if (x < INT32_MIN) {
+    return INT32_MIN;
+  }
+  return (q31_t)x;
+}
+
+/** Saturating addition of two Q31 numbers */
+inline q31_t qAdd(q31_t a, q31_t b) {
+  return qSat((int64_t)a + b);
+}
+
+/** Saturating subtraction of two Q31 numbers */
+inline q31_t qSub(q31_t a, q31_t b) {
+  return qSat((int64_t)a - b);
+}
+
+/** Saturating negation of a Q31 number */
+inline q31_t qNeg(q31_t a) {
+  return qSat(-(int64_t)a);
+}
+
+/** Saturating multiplication of two Q31 numbers */
+inline q31_t qMul(q31_t a, q31_t b) {
+  return qSat(((int64_t)a * b) >> 31);
+}
+
+/** Limits a Q31 number between min and max */
+inline q31_t qClamp(q31_t a, q31_t min, q31_t max) {
+  return a < min ? min : (a > max ? max : a);
+}
+
+/** Saturating multiplication of a Q31 number by a gain */
+inline q31_t qScale(q31_t a, qGain gain) {
+  int64_t product = (int64_t)a * gain.mantissa;
+  int shift = 31 - gain.shift;
+  if (shift < 0) {
+    return a == 0 or gain.mantissa == 0 ? 0 : (product > 0 ? INT32_MAX : INT32_MIN);
+  }
+  return qSat(product >> shift);
+}
+
+/** Multiplies two gains */
+inline qGain qGainMul(qGain a, qGain b) {
+  return {qMul(a.mantissa, b.mantissa), (int8_t)(a.shift + b.shift)};
+}
+
+/** Converts joystick input (-127 - 128) to a Q31 number with a full scale of 128, saturating at 128 */
+inline q31_t stickToQ31(int stick) {
+  return qSat((int64_t)stick << 24);
+}
+
+/** Converts a Q31 number to a Q15 number */
+inline q15_t toQ15(q31_t a) {
+  return (q15_t)(a >> 16);
+}
+
+/** Converts a float to a Q31 number
+ *
+ *  @param[in] f Number to convert
+ *  @param[in] fullScale The value of f which is converted to 1
+ */
+constexpr q31_t toQ31(float f, float fullScale=1) {
+  f /= fullScale;
+  if (f >= 1) {
+    return INT32_MAX;
+  } else if (f <= -1) {
+    return INT32_MIN;
+  }
+  return (q31_t)(f * 2147483648.0f);
+}
+
+/** Converts a Q31 number to a float
+ *
+ *  @param[in] a Number to convert
+ *  @param[in] fullScale The value 1 is converted to
+ */
+inline float qToFloat(q31_t a, float fullScale=1) {
+  return a / 2147483648.0f * fullScale;
+}
+
+/** Returns the number unchanged, so logging works the same with either control number type */
+inline float qToFloat(float f, float fullScale=1) {
+  return f;
+}
+
+/** Converts a float to a gain */
+inline qGain toGain(float g) {
+  qGain gain = {0, 0};
+  if (g == 0) {
+    return gain;
+  }
+  //Find the power of two which keeps the mantissa between 0.5 and 1 for the best precision
+  float absGain = g < 0 ? -g : g;
+  while (absGain >= 1 and gain.shift < 31) {
+    absGain /= 2;
+    g /= 2;
+    gain.shift++;
+  }
+  while (absGain < .5 and gain.shift > -31) {
+    absGain *= 2;
+    g *= 2;
+    gain.shift--;
+  }
+  gain.mantissa = toQ31(g);
+  return gain;
+}
+#endif
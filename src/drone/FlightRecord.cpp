@@ -0,0 +1,59 @@
+#include "FlightRecord.h"
+
+void logColumns(Logger &logger) {
+  logger.logString("Time (μs),Loop time (μs),Roll input,Pitch input,Vertical input,Yaw input,Pot,roll,pitch,Pr,Pp,Ir,Ip,Dr,Dp,radio,yaw,Packet rate (Hz),Packet loss (%),Jitter (μs),Latency (μs),Accel x,Accel y,Accel z,Gyro x,Gyro y,Gyro z,New sample,Resumed,Saturated,Throttle,Battery (V),P scale,I scale,D scale,D cutoff scale,Auto-tune,Degradation");
+  #if DSHOT_ESC
+    for (int i=0; i<motorCount; i++) {
+      logger.logString(",RPM " + String(i));
+    }
+  #endif
+}
+
+void logRecord(Logger &logger, const FlightRecord &record) {
+  //Log the loop's timestamp so the loop time used by the PID controller can be recreated
+  logger.logTime(record.time);
+  for (int i=0; i<4; i++) {
+    logger.logData(record.xyzr[i], typeID.int16);
+  }
+  logger.logData(record.pot, typeID.uint8);
+  for (int i=0; i<2; i++) {
+    logger.logData(record.angle[i], typeID.float32);
+  }
+  for (int i=0; i<3; i++) {
+    for (int j=0; j<2; j++) {
+      logger.logData(qToFloat(record.PIDchange[i][j]), typeID.float16k);
+    }
+  }
+  logger.logData(record.radio, typeID.uint16);
+  logger.logData(record.yaw, typeID.float16);
+  logger.logData(record.packetRate, typeID.uint16);
+  logger.logData(record.packetLoss, typeID.float16);
+  logger.logData(record.jitter, typeID.uint16);
+  logger.logData(record.latency, typeID.uint16);
+  //Raw IMU readings, with the sticks and timestamps these are enough to recalculate the angle and PID output
+  for (int i=0; i<3; i++) {
+    logger.logData(record.rawAccel[i], typeID.int16);
+  }
+  for (int i=0; i<3; i++) {
+    logger.logData(record.rawGyro[i], typeID.int16);
+  }
+  logger.logData(record.newSample, typeID.uint8);
+  logger.logData(record.resumed, typeID.uint8);
+  logger.logData(record.saturated, typeID.uint8);
+  //The inputs and outputs of the gain schedule, the inputs unrounded so replay.cpp gets the same gains
+  logger.logData(record.throttle, typeID.float32);
+  logger.logData(record.voltage, typeID.float32);
+  logger.logData(record.gainScale.P, typeID.float16k);
+  logger.logData(record.gainScale.I, typeID.float16k);
+  logger.logData(record.gainScale.D, typeID.float16k);
+  logger.logData(record.gainScale.dCutoff, typeID.float16k);
+  logger.logData(record.autoTuneStage, typeID.uint8);
+  logger.logData(record.degradation, typeID.uint8);
+  #if DSHOT_ESC
+    for (int i=0; i<motorCount; i++) {
+      logger.logData(record.rpm[i], typeID.uint16);
+    }
+  #endif
+
+  logger.write();
+}
@@ -0,0 +1,78 @@
+#ifndef __FlightRecord_H__
+#define __FlightRecord_H__
+
+//Import files
+#include "FixedPoint.h"
+#include "GainSchedule.h"
+#include "Logger.h"
+#include "MotorController.h"
+#include "SpscQueue.h"
+
+/* Settings */
+///Number of records the queue between the control loop and the log writer holds, a power of two
+const int logQueueLength = 64;
+///Time that has to be left before the next loop to write a queued record (μs)
+const int logWriteTime = 100;
+/* Settings */
+
+
+/**
+ * @struct FlightRecord
+ * @brief Everything logged in one loop, copied as it is so the control loop does not have to encode it
+ *
+ * Each value has the type it is logged with, except the ones logged as float16 or float16k, which are rounded by
+ * logRecord. The order is the order of the columns (see logColumns).
+ */
+struct FlightRecord {
+  ///Time of the loop (μs since the flight started)
+  uint32_t time;
+  ///Roll, pitch, vertical and yaw input
+  int16_t xyzr[4];
+  ///Potentiometer, 0 - 255
+  uint8_t pot;
+  ///Roll and pitch (degrees)
+  float angle[2];
+  ///P, I and D change of roll and pitch, [P/I/D][roll/pitch]
+  ctrl_t PIDchange[3][2];
+  ///Time since the last packet (ms)
+  uint16_t radio;
+  ///Yaw (degrees)
+  float yaw;
+  ///Packet rate (Hz)
+  uint16_t packetRate;
+  ///Packet loss (%)
+  float packetLoss;
+  ///Jitter and latency of the radio link (μs)
+  uint16_t jitter, latency;
+  ///Raw accelerometer and gyroscope readings
+  int16_t rawAccel[3], rawGyro[3];
+  ///Whether the IMU had a new reading, whether this is the first loop after standby, and whether the mixer scaled down
+  ///the output the PID controller saw (see MotorController::desaturated)
+  uint8_t newSample, resumed, saturated;
+  ///Inputs of the gain schedule, throttle (0 - 1) and battery voltage (V)
+  float throttle, voltage;
+  ///Multipliers from the gain schedule
+  GainScale gainScale;
+  ///Auto-tune stage (see PIDcontroller::autoTuneStage) and degradation level (see LoopWatchdog)
+  uint8_t autoTuneStage, degradation;
+  #if DSHOT_ESC
+    ///RPM of each motor
+    uint16_t rpm[motorCount];
+  #endif
+};
+
+/** Queue of records from the control loop to the log writer */
+typedef SpscQueue<FlightRecord, logQueueLength> RecordQueue;
+
+/** Logs the names of the columns of a record, after the settings
+ *
+ *  @param[in] logger Logger to write the names with
+ */
+void logColumns(Logger &logger);
+/** Encodes a record into the log buffer and writes it
+ *
+ *  @param[in] logger Logger to write the record with
+ *  @param[in] record Record to write
+ */
+void logRecord(Logger &logger, const FlightRecord &record);
+#endif
@@ -0,0 +1,209 @@
+#ifndef __GainSchedule_H__
+#define __GainSchedule_H__
+
+//Import libraries
+#include "FixedPoint.h"
+
+/* Settings */
+///Number of throttle breakpoints in the gain schedule
+const int scheduleThrottlePoints = 4;
+///Number of battery voltage breakpoints in the gain schedule
+const int scheduleVoltagePoints = 3;
+///Multipliers of the fixed point gain schedule are limited to 2^scheduleScaleShift
+const int scheduleScaleShift = 2;
+///Full scale of the battery voltage (V) in the fixed point gain schedule
+const float scheduleVoltageScale = 32;
+/* Settings */
+
+static_assert(scheduleThrottlePoints >= 2 and scheduleVoltagePoints >= 2, "The gain schedule needs two breakpoints of each");
+
+
+/**
+ * @struct GainScale
+ * @brief Multipliers of the PID gains and the derivative filter cutoff
+ */
+struct GainScale {
+  ///Multiplier of Pgain
+  float P;
+  ///Multiplier of Igain
+  float I;
+  ///Multiplier of Dgain
+  float D;
+  ///Multiplier of dCutoff
+  float dCutoff;
+};
+
+#if CONTROL_MATH == FIXED_MATH
+  /**
+   * @struct GainScaleQ
+   * @brief Multipliers of the PID gains and the derivative filter cutoff, as Q31 mantissas of 2^scheduleScaleShift
+   */
+  struct GainScaleQ {
+    ///Multiplier of Pgain
+    q31_t P;
+    ///Multiplier of Igain
+    q31_t I;
+    ///Multiplier of Dgain
+    q31_t D;
+    ///Multiplier of dCutoff
+    q31_t dCutoff;
+  };
+#endif
+
+/**
+ * @class GainSchedule
+ * @brief Gain multipliers interpolated over throttle and battery voltage
+ *
+ * The schedule is set as a table of multipliers at breakpoints of throttle and voltage, which may be unevenly spaced.
+ * get() finds the breakpoints either side of the throttle and voltage and interpolates between the four multipliers
+ * around them, so the multipliers at the breakpoints are exactly the ones set. build() stores the span between each pair
+ * of breakpoints as a reciprocal, so get() only multiplies. The fixed point control path reads the same schedule with
+ * getQ(), which only uses integer arithmetic.
+ */
+class GainSchedule {
+  public:
+    /** Set the tables of multipliers
+     *
+     *  Each table has one row of scheduleThrottlePoints multipliers per voltage breakpoint.
+     *
+     *  @param[in] throttle Throttle breakpoints (0 - 1), increasing
+     *  @param[in] voltage Battery voltage breakpoints (V), increasing
+     *  @param[in] P Multipliers of the proportional gain
+     *  @param[in] I Multipliers of the integral gain
+     *  @param[in] D Multipliers of the derivative gain
+     *  @param[in] dCutoff Multipliers of the derivative filter cutoff
+     */
+    void build(const float *throttle, const float *voltage, const float *P, const float *I, const float *D, const float *dCutoff) {
+      setAxis(throttle, scheduleThrottlePoints, throttlePoints, throttleInvSpan);
+      setAxis(voltage, scheduleVoltagePoints, voltagePoints, voltageInvSpan);
+      for (int i=0; i<scheduleVoltagePoints*scheduleThrottlePoints; i++) {
+        table[i] = {P[i], I[i], D[i], dCutoff[i]};
+      }
+
+      #if CONTROL_MATH == FIXED_MATH
+        setAxisQ(throttle, scheduleThrottlePoints, 1, throttlePointsQ, throttleInvSpanQ);
+        setAxisQ(voltage, scheduleVoltagePoints, scheduleVoltageScale, voltagePointsQ, voltageInvSpanQ);
+        const float scaleMax = 1 << scheduleScaleShift;
+        for (int i=0; i<scheduleVoltagePoints*scheduleThrottlePoints; i++) {
+          tableQ[i] = {toQ31(P[i], scaleMax), toQ31(I[i], scaleMax), toQ31(D[i], scaleMax), toQ31(dCutoff[i], scaleMax)};
+        }
+      #endif
+    }
+
+    /** Read the schedule, a throttle or voltage outside the breakpoints is limited to the nearest one
+     *
+     *  @param[in] throttle Throttle (0 - 1)
+     *  @param[in] voltage Battery voltage (V)
+     *  @returns Interpolated multipliers
+     */
+    GainScale get(float throttle, float voltage) const {
+      int t, v;
+      float fx, fy;
+      locate(throttlePoints, throttleInvSpan, scheduleThrottlePoints, throttle, t, fx);
+      locate(voltagePoints, voltageInvSpan, scheduleVoltagePoints, voltage, v, fy);
+
+      const GainScale &a = table[v*scheduleThrottlePoints + t];
+      const GainScale &b = table[v*scheduleThrottlePoints + t+1];
+      const GainScale &c = table[(v+1)*scheduleThrottlePoints + t];
+      const GainScale &d = table[(v+1)*scheduleThrottlePoints + t+1];
+      auto mix = [fx, fy](float a, float b, float c, float d) {
+        float low = a + (b - a) * fx;
+        float high = c + (d - c) * fx;
+        return low + (high - low) * fy;
+      };
+      return {mix(a.P, b.P, c.P, d.P), mix(a.I, b.I, c.I, d.I), mix(a.D, b.D, c.D, d.D),
+              mix(a.dCutoff, b.dCutoff, c.dCutoff, d.dCutoff)};
+    }
+
+    #if CONTROL_MATH == FIXED_MATH
+      /** Read the schedule in fixed point, a throttle or voltage outside the breakpoints is limited to the nearest one
+       *
+       *  @param[in] throttle Throttle (Q31, 0 - 1)
+       *  @param[in] voltage Battery voltage (Q31 of scheduleVoltageScale)
+       *  @returns Interpolated multipliers
+       */
+      GainScaleQ getQ(q31_t throttle, q31_t voltage) const {
+        int t, v;
+        q31_t fx, fy;
+        locateQ(throttlePointsQ, throttleInvSpanQ, scheduleThrottlePoints, throttle, t, fx);
+        locateQ(voltagePointsQ, voltageInvSpanQ, scheduleVoltagePoints, voltage, v, fy);
+
+        const GainScaleQ &a = tableQ[v*scheduleThrottlePoints + t];
+        const GainScaleQ &b = tableQ[v*scheduleThrottlePoints + t+1];
+        const GainScaleQ &c = tableQ[(v+1)*scheduleThrottlePoints + t];
+        const GainScaleQ &d = tableQ[(v+1)*scheduleThrottlePoints + t+1];
+        //The multipliers are positive, so the differences between them fit in Q31
+        auto mix = [fx, fy](q31_t a, q31_t b, q31_t c, q31_t d) {
+          q31_t low = a + qMul(b - a, fx);
+          q31_t high = c + qMul(d - c, fx);
+          return low + qMul(high - low, fy);
+        };
+        return {mix(a.P, b.P, c.P, d.P), mix(a.I, b.I, c.I, d.I), mix(a.D, b.D, c.D, d.D),
+                mix(a.dCutoff, b.dCutoff, c.dCutoff, d.dCutoff)};
+      }
+    #endif
+
+  private:
+    /** Copies the breakpoints of one side of the table and the reciprocal of the span between each pair */
+    static void setAxis(const float *points, int count, float *stored, float *invSpan) {
+      for (int i=0; i<count; i++) {
+        stored[i] = points[i];
+      }
+      for (int i=0; i<count-1; i++) {
+        float span = points[i+1] - points[i];
+        invSpan[i] = span > 0 ? 1 / span : 0;
+      }
+    }
+    /** Finds the breakpoints either side of x, and how far x is between them (0 - 1) */
+    static void locate(const float *points, const float *invSpan, int count, float x, int &i, float &fraction) {
+      i = 0;
+      while (i < count-2 and x >= points[i+1]) {
+        i++;
+      }
+      fraction = (x - points[i]) * invSpan[i];
+      fraction = fraction <= 0 ? 0 : (fraction >= 1 ? 1 : fraction);
+    }
+
+    #if CONTROL_MATH == FIXED_MATH
+      /** Fixed point version of setAxis, the reciprocal spans are per full scale of the breakpoints */
+      static void setAxisQ(const float *points, int count, float fullScale, q31_t *stored, qGain *invSpan) {
+        for (int i=0; i<count; i++) {
+          stored[i] = toQ31(points[i], fullScale);
+        }
+        for (int i=0; i<count-1; i++) {
+          float span = points[i+1] - points[i];
+          invSpan[i] = span > 0 ? toGain(fullScale / span) : qGain{0, 0};
+        }
+      }
+      /** Fixed point version of locate, the fraction is Q31 */
+      static void locateQ(const q31_t *points, const qGain *invSpan, int count, q31_t x, int &i, q31_t &fraction) {
+        i = 0;
+        while (i < count-2 and x >= points[i+1]) {
+          i++;
+        }
+        fraction = qScale(qSub(x, points[i]), invSpan[i]);
+        fraction = fraction < 0 ? 0 : fraction;
+      }
+    #endif
+
+    ///Throttle breakpoints, and the reciprocal of the span to the next one
+    float throttlePoints[scheduleThrottlePoints] = {};
+    float throttleInvSpan[scheduleThrottlePoints-1] = {};
+    ///Voltage breakpoints (V), and the reciprocal of the span to the next one
+    float voltagePoints[scheduleVoltagePoints] = {};
+    float voltageInvSpan[scheduleVoltagePoints-1] = {};
+    ///Multipliers at each breakpoint, one row of throttle breakpoints per voltage breakpoint
+    GainScale table[scheduleVoltagePoints*scheduleThrottlePoints] = {};
+
+    #if CONTROL_MATH == FIXED_MATH
+      ///Throttle breakpoints (Q31), and the reciprocal of the span to the next one
+      q31_t throttlePointsQ[scheduleThrottlePoints] = {};
+      qGain throttleInvSpanQ[scheduleThrottlePoints-1] = {};
+      ///Voltage breakpoints (Q31 of scheduleVoltageScale), and the reciprocal of the span to the next one
+      q31_t voltagePointsQ[scheduleVoltagePoints] = {};
+      qGain voltageInvSpanQ[scheduleVoltagePoints-1] = {};
+      ///Multipliers at each breakpoint in fixed point
+      GainScaleQ tableQ[scheduleVoltagePoints*scheduleThrottlePoints] = {};
+    #endif
+};
+#endif
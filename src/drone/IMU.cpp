@@ -6,6 +6,24 @@
 int IMU::init(Logger &logger) {
   //Load settings from the SD card
   logger.loadSetting("angleOffset", angleOffset, 3);
+  logger.loadSetting("forceCalibration", forceCalibration);
+  logger.loadSetting("calibrateAccel", calibrateAccel);
+  logger.loadSetting("maxStillRate", maxStillRate);
+  logger.loadSetting("maxCalibrationTempDiff", maxCalibrationTempDiff);
+  #if IMU_TYPE == IMU_MPU6050 or IMU_TYPE == NO_IMU
+    logger.loadSetting("beta", beta);
+    logger.loadSetting("zeta", zeta);
+    logger.loadSetting("kalmanParams", kalmanParams, 3);
+    rollKalman = SimpleKalmanFilter(kalmanParams[0], kalmanParams[1], kalmanParams[2]);
+    pitchKalman = SimpleKalmanFilter(kalmanParams[0], kalmanParams[1], kalmanParams[2]);
+  #endif
+  #if IMU_TYPE == IMU_MPU6050
+    logger.loadSetting("imuCount", imuCount);
+    logger.loadSetting("imuAddress", imuAddress, maxImuCount);
+    logger.loadSetting("maxDisagreement", maxDisagreement, 2);
+    logger.loadSetting("healthSmoothing", healthSmoothing);
+    imuCount = min(max(imuCount, 1), maxImuCount);
+  #endif
 
   digitalWrite(lightPin, HIGH);
   #if IMU_TYPE == IMU_MPU6050
@@ -15,23 +33,124 @@ int IMU::init(Logger &logger) {
     pinMode(intPin, INPUT);
     digitalWrite(intPin, LOW);
     
-    if (mpu.readByte(MPU6050_ADDRESS, WHO_AM_I_MPU6050) != 0x68) {
-      return 1;
+    if (imuCount == 1) {
+      if (mpu.readByte(MPU6050_ADDRESS, WHO_AM_I_MPU6050) != 0x68) {
+        return 1;
+      }
+      mpu.initMPU6050();
+    } else {
+      for (int s=0; s<imuCount; s++) {
+        sensors[s].address = imuAddress[s];
+        if (!initSensor(sensors[s].address)) {
+          return 1;
+        }
+      }
     }
-    mpu.calibrateGyro();
-    mpu.initMPU6050();
     
     aRes = mpu.getAres();
     gRes = mpu.getGres();
+  #elif IMU_TYPE == IMU_MPU6050_DMP
+    Wire.begin();
+    Wire.setClock(400000);
     
-    //Get the current angle from an average of 10 readings
-    for (int i=0; i<10; i++) {
-      //Give time for the MPU6050 to update
-      delay(1);
-      //Get the accelerometer data
-      mpu.readAccelData(accelData);
-      for (int j=0; j<3; j++) {
-        accelVal[j] = (float)accelData[j]*aRes;
+    //Set up MPU 6050
+    mpu.initialize();
+    int devStatus = mpu.dmpInitialize();
+    if (devStatus != 0) {
+      return devStatus;
+    }
+  #endif
+
+  //Reuse the stored calibration if possible, otherwise recalibrate
+  #if IMU_TYPE == IMU_MPU6050 or IMU_TYPE == IMU_MPU6050_DMP
+    if (loadCalibration(logger)) {
+      calibrationStage = 0;
+    } else {
+      calibrationStage = 1;
+    }
+  #else
+    calibrationStage = 4;
+    digitalWrite(lightPin, LOW);
+  #endif
+  sampleCount = 0;
+  lastSampleTime = clockMicros();
+
+  return 0;
+}
+
+bool IMU::updateCalibration(Logger &logger) {
+  if (calibrationStage == 4) {
+    return true;
+  }
+
+  //Wait for the IMU to have a new reading
+  if (clockMicros() - lastSampleTime < calibrationSampleTime) {
+    return false;
+  }
+  lastSampleTime = clockMicros();
+
+  #if IMU_TYPE == IMU_MPU6050
+    if (calibrationStage == 0) {
+      //Check the IMUs are still, the rotation rate after removing the bias should be close to zero
+      for (int s=0; s<imuCount; s++) {
+        readSensor(s, accelData, gyroData);
+        for (int i=0; i<3; i++) {
+          if (abs((float)gyroData[i]*gRes - sensorCalibration(s).gyroBias[i]) > maxStillRate) {
+            calibrationStage = 1;
+            sampleCount = 0;
+            return false;
+          }
+        }
+      }
+
+      sampleCount++;
+      if (sampleCount == stillSamples) {
+        calibrationReused = true;
+        calibrationStage = 2;
+        sampleCount = 0;
+      }
+    } else if (calibrationStage == 1) {
+      //Average the sensor readings while the IMU is level and still
+      for (int s=0; s<imuCount; s++) {
+        if (sampleCount == 0) {
+          for (int i=0; i<3; i++) {
+            gyroSum[s][i] = 0;
+            accelSum[s][i] = 0;
+          }
+        }
+        readSensor(s, accelData, gyroData);
+        for (int i=0; i<3; i++) {
+          accelSum[s][i] += (float)accelData[i]*aRes;
+          gyroSum[s][i] += (float)gyroData[i]*gRes;
+        }
+      }
+
+      sampleCount++;
+      if (sampleCount == calibrationSamples) {
+        for (int s=0; s<imuCount; s++) {
+          IMUcalibration &sensor = sensorCalibration(s);
+          for (int i=0; i<3; i++) {
+            sensor.gyroBias[i] = gyroSum[s][i] / calibrationSamples;
+          }
+          //The accelerometer offsets assume the drone is level, so they are only measured when asked for
+          if (calibrateAccel) {
+            for (int i=0; i<3; i++) {
+              sensor.accelOffset[i] = accelSum[s][i] / calibrationSamples;
+            }
+            //Gravity should only be measured on the z axis
+            sensor.accelOffset[2] -= 1;
+          }
+        }
+        saveCalibration(logger);
+
+        calibrationStage = 2;
+        sampleCount = 0;
+      }
+    } else if (calibrationStage == 2) {
+      //Get the current angle from an average of 10 readings of the first IMU
+      readSensor(0, accelData, gyroData);
+      for (int i=0; i<3; i++) {
+        accelVal[i] = (float)accelData[i]*aRes - calibration.accelOffset[i];
       }
       
       //Calculate the angle from the accelerometer
@@ -39,60 +158,137 @@ int IMU::init(Logger &logger) {
       currentAngle[1] += atan(-accelVal[0] / sqrt(accelVal[1]*accelVal[1] + accelVal[2]*accelVal[2]));
       
       //Get the initial value for the kalman filter
-      rollKalman.updateEstimate((-currentAngle[0] * 180/PI) / (i+1));
-      pitchKalman.updateEstimate((currentAngle[1] * 180/PI) / (i+1));
+      sampleCount++;
+      rollKalman.updateEstimate((-currentAngle[0] * 180/PI) / sampleCount);
+      pitchKalman.updateEstimate((currentAngle[1] * 180/PI) / sampleCount);
+
+      if (sampleCount == 10) {
+        //Get the average from the ten readings
+        currentAngle[0] /= 10;
+        currentAngle[1] /= 10;
+        
+        //Set the quaternion to the current angle
+        eulerToQuat(currentAngle[0], currentAngle[1], PI);
+        calibrationStage = 4;
+        for (int s=0; s<imuCount; s++) {
+          sensors[s].lastReading = clockMicros();
+        }
+      }
     }
-    //Get the average from the ten readings
-    currentAngle[0] /= 10;
-    currentAngle[1] /= 10;
-    
-    //Set the quaternion to the current angle
-    eulerToQuat(currentAngle[0], currentAngle[1], PI);
   #elif IMU_TYPE == IMU_MPU6050_DMP
-    Wire.begin();
-    Wire.setClock(400000);
-    
-    //Set up MPU 6050
-    mpu.initialize();
-    int devStatus = mpu.dmpInitialize();
-    mpu.setXAccelOffset(-5054);
-    mpu.setYAccelOffset(297);
-    mpu.setZAccelOffset(1024);
-    mpu.setXGyroOffset(122);
-    mpu.setYGyroOffset(-101);
-    mpu.setZGyroOffset(22);
-    
-    if (devStatus == 0) {
-      mpu.setDMPEnabled(true);
-      //Let the MPU run for a bit to allow for values to stabilise
-      for (int i=0; i<1000; i++) {
-        delay(4);
-        if (mpu.dmpGetCurrentFIFOPacket(fifoBuffer)) {
-          mpu.dmpGetQuaternion(&q, fifoBuffer);
-          mpu.dmpGetGravity(&gravity, &q);
-          mpu.dmpGetYawPitchRoll(ypr, &q, &gravity);
+    if (calibrationStage == 0) {
+      //Check the IMU is still, the stored offsets are applied so the rotation rate should be close to zero
+      mpu.getRotation(&gyroData[0], &gyroData[1], &gyroData[2]);
+      for (int i=0; i<3; i++) {
+        if (abs(gyroData[i] * 2000.0/32768.0) > maxStillRate) {
+          calibrationStage = 1;
+          sampleCount = 0;
+          return false;
         }
       }
-    } else {
-      return devStatus;
+
+      sampleCount++;
+      if (sampleCount == stillSamples) {
+        calibrationReused = true;
+        calibrationStage = 3;
+        sampleCount = 0;
+        mpu.setDMPEnabled(true);
+      }
+    } else if (calibrationStage == 1) {
+      //Average the raw readings, one per call so it does not block like the library's CalibrateGyro()
+      if (sampleCount == 0) {
+        for (int i=0; i<3; i++) {
+          gyroSum[i] = 0;
+          accelSum[i] = 0;
+        }
+      }
+      mpu.getMotion6(&accelData[0], &accelData[1], &accelData[2], &gyroData[0], &gyroData[1], &gyroData[2]);
+      for (int i=0; i<3; i++) {
+        gyroSum[i] += gyroData[i];
+        accelSum[i] += accelData[i];
+      }
+
+      sampleCount++;
+      if (sampleCount == calibrationSamples) {
+        //Move the offset registers by the average
+        //Gyroscope offsets are in steps of 1/32.8 and readings of 1/16.4 degrees per second
+        int16_t gyroOffset[3] = {mpu.getXGyroOffset(), mpu.getYGyroOffset(), mpu.getZGyroOffset()};
+        for (int i=0; i<3; i++) {
+          gyroOffset[i] -= (int16_t)round(2.0f * gyroSum[i] / calibrationSamples);
+        }
+        mpu.setXGyroOffset(gyroOffset[0]);
+        mpu.setYGyroOffset(gyroOffset[1]);
+        mpu.setZGyroOffset(gyroOffset[2]);
+        //Accelerometer offsets are in steps of 1/2048 and readings of 1/16384 G, and assume the drone is level
+        if (calibrateAccel) {
+          const int32_t expected[3] = {0, 0, 16384};
+          int16_t accelOffset[3] = {mpu.getXAccelOffset(), mpu.getYAccelOffset(), mpu.getZAccelOffset()};
+          for (int i=0; i<3; i++) {
+            int16_t change = (int16_t)round((accelSum[i] / (float)calibrationSamples - expected[i]) / 8);
+            //Bit 0 of the accelerometer offsets is reserved
+            accelOffset[i] = ((accelOffset[i] - change) & ~1) | (accelOffset[i] & 1);
+          }
+          mpu.setXAccelOffset(accelOffset[0]);
+          mpu.setYAccelOffset(accelOffset[1]);
+          mpu.setZAccelOffset(accelOffset[2]);
+        }
+
+        calibration.accelOffset[0] = mpu.getXAccelOffset();
+        calibration.accelOffset[1] = mpu.getYAccelOffset();
+        calibration.accelOffset[2] = mpu.getZAccelOffset();
+        calibration.gyroBias[0] = mpu.getXGyroOffset();
+        calibration.gyroBias[1] = mpu.getYGyroOffset();
+        calibration.gyroBias[2] = mpu.getZGyroOffset();
+        saveCalibration(logger);
+
+        calibrationStage = 3;
+        sampleCount = 0;
+        mpu.setDMPEnabled(true);
+      }
+    } else if (calibrationStage == 3) {
+      //Let the MPU run for a bit to allow for values to stabilise, less time is needed with a known calibration
+      if (mpu.dmpGetCurrentFIFOPacket(fifoBuffer)) {
+        mpu.dmpGetQuaternion(&q, fifoBuffer);
+        mpu.dmpGetGravity(&gravity, &q);
+        mpu.dmpGetYawPitchRoll(ypr, &q, &gravity);
+      }
+
+      sampleCount++;
+      if (sampleCount == (calibrationReused ? 250 : 1000)) {
+        calibrationStage = 4;
+      }
     }
   #endif
 
-  digitalWrite(lightPin, LOW);
-  return 0;
+  if (calibrationStage == 4) {
+    digitalWrite(lightPin, LOW);
+    return true;
+  }
+  return false;
 }
 
-void IMU::updateAngle() {
+void IMU::updateAngle(SharedState<AttitudeState> &attitude) {
   #if IMU_TYPE == IMU_MPU6050
-    if (mpu.readByte(MPU6050_ADDRESS, INT_STATUS) & 0x01) {
-      //Read data from MPU6050
-      mpu.readAccelData(accelData);
-      mpu.readGyroData(gyroData);
+    if (imuCount > 1) {
+      newSample = fuseSensors();
+    } else {
+      newSample = mpu.readByte(MPU6050_ADDRESS, INT_STATUS) & 0x01;
+      if (newSample) {
+        //Read data from MPU6050
+        mpu.readAccelData(accelData);
+        mpu.readGyroData(gyroData);
+      }
+    }
+    if (newSample) {
+      for (int i=0; i<3; i++) {
+        rawAccel[i] = accelData[i];
+        rawGyro[i] = gyroData[i];
+      }
 
-      //Calculate values into usable units
+      //Calculate values into usable units and remove the calibrated offsets
       for (int i=0; i<3; i++) {
-        accelVal[i] = (float)accelData[i]*aRes;
-        gyroVal[i] = (float)gyroData[i]*gRes;
+        accelVal[i] = (float)accelData[i]*aRes - calibration.accelOffset[i];
+        gyroVal[i] = (float)gyroData[i]*gRes - calibration.gyroBias[i];
       }
     }
 
@@ -111,13 +307,15 @@ void IMU::updateAngle() {
     currentAngle[0] = rollKalman.updateEstimate(currentAngle[0]);
     currentAngle[1] = pitchKalman.updateEstimate(currentAngle[1]);
 
-    //Get rotation rate
+    //Get rotation rate, the roll angle above is reversed so the roll rate is too
     for (int i=0; i<3; i++) {
       rRate[i] = gyroVal[i];
     }
+    rRate[0] = -rRate[0];
   #elif IMU_TYPE == IMU_MPU6050_DMP
     //Get current angle and acceleration
-    if (mpu.dmpGetCurrentFIFOPacket(fifoBuffer)) {
+    newSample = mpu.dmpGetCurrentFIFOPacket(fifoBuffer);
+    if (newSample) {
       mpu.dmpGetQuaternion(&q, fifoBuffer);
       mpu.dmpGetGravity(&gravity, &q);
       mpu.dmpGetYawPitchRoll(ypr, &q, &gravity);
@@ -132,6 +330,7 @@ void IMU::updateAngle() {
       rRate[i] = gyroData[i] * 2000.0/32768.0;;
     }
   #elif IMU_TYPE == NO_IMU
+    newSample = true;
     for (int i=0; i<3; i++) {
       gyroVal[i] = i*.0;
     }
@@ -159,6 +358,179 @@ void IMU::updateAngle() {
       rRate[i] = gyroVal[i];
     }
   #endif
+
+  //Publish the new attitude
+  AttitudeState state;
+  for (int i=0; i<3; i++) {
+    state.angle[i] = currentAngle[i];
+    state.rate[i] = rRate[i];
+  }
+  state.newSample = newSample;
+  state.timestamp = clockMicros();
+  attitude.publish(state);
+}
+
+bool IMU::loadCalibration(Logger &logger) {
+  #if IMU_TYPE == IMU_MPU6050 or IMU_TYPE == IMU_MPU6050_DMP
+    //One calibration for each IMU which can be used, files from before there could be several are too short
+    IMUcalibration stored[maxImuCount];
+    if (!logger.readFile(calibrationFile, stored, sizeof(stored))) {
+      return false;
+    }
+    #if IMU_TYPE == IMU_MPU6050
+      const int count = imuCount;
+    #else
+      const int count = 1;
+    #endif
+    for (int s=0; s<count; s++) {
+      if (stored[s].version != calibrationVersion + IMU_TYPE) {
+        return false;
+      }
+    }
+
+    //Keep the accelerometer offsets even if the gyroscope bias is measured again
+    for (int s=0; s<count; s++) {
+      for (int i=0; i<3; i++) {
+        sensorCalibration(s).accelOffset[i] = stored[s].accelOffset[i];
+      }
+    }
+    #if IMU_TYPE == IMU_MPU6050_DMP
+      mpu.setXAccelOffset(stored[0].accelOffset[0]);
+      mpu.setYAccelOffset(stored[0].accelOffset[1]);
+      mpu.setZAccelOffset(stored[0].accelOffset[2]);
+    #endif
+    if (forceCalibration or calibrateAccel) {
+      return false;
+    }
+
+    for (int s=0; s<count; s++) {
+      //The gyroscope bias changes with temperature
+      if (abs(readTemperature(s) - stored[s].temperature) > maxCalibrationTempDiff) {
+        return false;
+      }
+    }
+
+    #if IMU_TYPE == IMU_MPU6050_DMP
+      //Apply the stored gyroscope offsets to the offset registers
+      mpu.setXGyroOffset(stored[0].gyroBias[0]);
+      mpu.setYGyroOffset(stored[0].gyroBias[1]);
+      mpu.setZGyroOffset(stored[0].gyroBias[2]);
+    #endif
+
+    for (int s=0; s<count; s++) {
+      sensorCalibration(s) = stored[s];
+    }
+    return true;
+  #else
+    return false;
+  #endif
+}
+
+void IMU::saveCalibration(Logger &logger) {
+  #if IMU_TYPE == IMU_MPU6050 or IMU_TYPE == IMU_MPU6050_DMP
+    #if IMU_TYPE == IMU_MPU6050
+      const int count = imuCount;
+    #else
+      const int count = 1;
+    #endif
+    IMUcalibration stored[maxImuCount];
+    for (int s=0; s<count; s++) {
+      IMUcalibration &sensor = sensorCalibration(s);
+      sensor.temperature = readTemperature(s);
+      sensor.version = calibrationVersion + IMU_TYPE;
+      stored[s] = sensor;
+    }
+    logger.writeFile(calibrationFile, stored, sizeof(stored));
+  #endif
+}
+
+void IMU::saveEstimator(Logger &logger) {
+  EstimatorState state;
+  state.version = calibrationVersion + IMU_TYPE;
+  state.calibration = calibration;
+  #if IMU_TYPE == IMU_MPU6050 or IMU_TYPE == NO_IMU
+    for (int i=0; i<3; i++) {
+      state.accelVal[i] = accelVal[i];
+      state.gyroVal[i] = gyroVal[i];
+    }
+    for (int i=0; i<4; i++) {
+      state.q[i] = q[i];
+    }
+    memcpy(state.rollKalman, &rollKalman, sizeof(rollKalman));
+    memcpy(state.pitchKalman, &pitchKalman, sizeof(pitchKalman));
+  #endif
+  logger.writeFile(estimatorFile, &state, sizeof(state));
+}
+
+bool IMU::loadEstimator(Logger &logger) {
+  EstimatorState state;
+  if (!logger.readFile(estimatorFile, &state, sizeof(state)) or state.version != calibrationVersion + IMU_TYPE) {
+    return false;
+  }
+  calibration = state.calibration;
+  #if IMU_TYPE == IMU_MPU6050
+    //The logged readings are already averaged in the counts of the first IMU, so they are replayed as one IMU
+    imuCount = 1;
+  #endif
+  #if IMU_TYPE == IMU_MPU6050 or IMU_TYPE == NO_IMU
+    for (int i=0; i<3; i++) {
+      accelVal[i] = state.accelVal[i];
+      gyroVal[i] = state.gyroVal[i];
+    }
+    for (int i=0; i<4; i++) {
+      q[i] = state.q[i];
+    }
+    memcpy(&rollKalman, state.rollKalman, sizeof(rollKalman));
+    memcpy(&pitchKalman, state.pitchKalman, sizeof(pitchKalman));
+    //Keep the stored estimates but use the current settings, so a log can be replayed with other settings
+    rollKalman.setMeasurementError(kalmanParams[0]);
+    rollKalman.setProcessNoise(kalmanParams[2]);
+    pitchKalman.setMeasurementError(kalmanParams[0]);
+    pitchKalman.setProcessNoise(kalmanParams[2]);
+  #endif
+  calibrationStage = 4;
+  return true;
+}
+
+float IMU::readTemperature(int sensor) {
+  #if IMU_TYPE == IMU_MPU6050
+    if (imuCount > 1) {
+      uint8_t data[2];
+      mpu.readBytes(sensors[sensor].address, TEMP_OUT_H, 2, data);
+      return (int16_t)((data[0] << 8) | data[1]) / 340.0 + 36.53;
+    }
+    return mpu.readTempData() / 340.0 + 36.53;
+  #elif IMU_TYPE == IMU_MPU6050_DMP
+    return mpu.getTemperature() / 340.0 + 36.53;
+  #else
+    return 0;
+  #endif
+}
+
+String IMU::summary() const {
+  #if IMU_TYPE == IMU_MPU6050
+    String text = "IMUs," + String(imuCount);
+    if (imuCount == 1) {
+      return text;
+    }
+    //Share of the average each IMU had at the end, from the same weights as fuseSensors()
+    float weight[maxImuCount];
+    float weightSum = 0;
+    for (int s=0; s<imuCount; s++) {
+      weight[s] = sensors[s].healthy ? 1 / (sensors[s].gyroVariance + gRes*gRes) : 0;
+      weightSum += weight[s];
+    }
+    text += "\nIMU,Address,Readings,Left out,Gyroscope noise (°/s),Accelerometer noise (G),Gyroscope weight (%)";
+    for (int s=0; s<imuCount; s++) {
+      const IMUsensor &sensor = sensors[s];
+      text += "\n," + String(sensor.address) + "," + String(sensor.readings) + "," + String(sensor.rejected) + ","
+              + String(sqrt(sensor.gyroVariance), 3) + "," + String(sqrt(sensor.accelVariance), 4) + ","
+              + String(weightSum > 0 ? weight[s] / weightSum * 100 : 0, 1);
+    }
+    return text;
+  #else
+    return "IMUs,1";
+  #endif
 }
 
 //Functions for specific setups
@@ -180,7 +552,8 @@ void IMU::updateAngle() {
     float J_11or24, J_12or23, J_13or22, J_14or21, J_32, J_33; //objective function Jacobian elements
     float qDot1, qDot2, qDot3, qDot4;
     float hatDot1, hatDot2, hatDot3, hatDot4;
-    float gerrx, gerry, gerrz, gbiasx, gbiasy, gbiasz;        //gyro bias error
+    float gerrx, gerry, gerrz;                                //gyro bias error
+    float gbiasx = 0, gbiasy = 0, gbiasz = 0;                 //gyro bias
 
     //Auxiliary variables to avoid repeated arithmetic
     float _halfq1 = 0.5f * q1;
@@ -274,3 +647,159 @@ void IMU::updateAngle() {
     q[3] *= norm;
   }
 #endif
+
+#if IMU_TYPE == IMU_MPU6050
+  /** Median of a few values, sorts them */
+  static float median(float *values, int count) {
+    for (int i=1; i<count; i++) {
+      float value = values[i];
+      int j = i;
+      for (; j>0 and values[j-1] > value; j--) {
+        values[j] = values[j-1];
+      }
+      values[j] = value;
+    }
+    return count % 2 ? values[count/2] : (values[count/2 - 1] + values[count/2]) / 2;
+  }
+
+  /** Rounds a reading to raw counts, clipped to the full scale */
+  static int16_t toCounts(float counts) {
+    return (int16_t)min(max(roundf(counts), -32768.0f), 32767.0f);
+  }
+
+  bool IMU::initSensor(uint8_t address) {
+    if (mpu.readByte(address, WHO_AM_I_MPU6050) != 0x68) {
+      return false;
+    }
+    //Wake up and use the gyroscope's clock
+    mpu.writeByte(address, PWR_MGMT_1, 0x00);
+    delay(100);
+    mpu.writeByte(address, PWR_MGMT_1, 0x01);
+    delay(200);
+    //Same low pass filter, sample rate and full scale (±2 G, ±250°/s) as initMPU6050()
+    mpu.writeByte(address, CONFIG, 0x03);
+    mpu.writeByte(address, SMPLRT_DIV, 0x04);
+    mpu.writeByte(address, GYRO_CONFIG, 0x00);
+    mpu.writeByte(address, ACCEL_CONFIG, 0x00);
+    //Latch the data ready flag until INT_STATUS is read
+    mpu.writeByte(address, INT_PIN_CFG, 0x22);
+    mpu.writeByte(address, INT_ENABLE, 0x01);
+    return true;
+  }
+
+  void IMU::readSensor(int sensor, int16_t accel[3], int16_t gyro[3]) {
+    if (imuCount == 1) {
+      mpu.readAccelData(accel);
+      mpu.readGyroData(gyro);
+      return;
+    }
+    //The accelerometer, temperature and gyroscope registers follow each other, high byte first
+    uint8_t data[14];
+    mpu.readBytes(sensors[sensor].address, ACCEL_XOUT_H, 14, data);
+    for (int i=0; i<3; i++) {
+      accel[i] = (int16_t)((data[i*2] << 8) | data[i*2 + 1]);
+      gyro[i] = (int16_t)((data[8 + i*2] << 8) | data[9 + i*2]);
+    }
+  }
+
+  bool IMU::fuseSensors() {
+    //Check every IMU before reading any, so the readings are as close together as the bus allows
+    bool fresh[maxImuCount];
+    bool anyFresh = false;
+    for (int s=0; s<imuCount; s++) {
+      fresh[s] = mpu.readByte(sensors[s].address, INT_STATUS) & 0x01;
+      anyFresh |= fresh[s];
+    }
+    if (!anyFresh) {
+      return false;
+    }
+    micros_t now = clockMicros();
+    for (int s=0; s<imuCount; s++) {
+      if (!fresh[s]) {
+        continue;
+      }
+      IMUsensor &sensor = sensors[s];
+      const IMUcalibration &sensorCal = sensorCalibration(s);
+      readSensor(s, accelData, gyroData);
+      for (int i=0; i<3; i++) {
+        sensor.accel[i] = (float)accelData[i]*aRes - sensorCal.accelOffset[i];
+        sensor.gyro[i] = (float)gyroData[i]*gRes - sensorCal.gyroBias[i];
+      }
+      sensor.lastReading = now;
+      sensor.readings++;
+    }
+
+    //Median of each axis of the IMUs which are still sending readings
+    int live[maxImuCount];
+    int liveCount = 0;
+    for (int s=0; s<imuCount; s++) {
+      sensors[s].healthy = false;
+      if (now - sensors[s].lastReading <= maxReadingAge) {
+        live[liveCount++] = s;
+      }
+    }
+    float accelMedian[3], gyroMedian[3];
+    for (int i=0; i<3; i++) {
+      float accel[maxImuCount], gyro[maxImuCount];
+      for (int k=0; k<liveCount; k++) {
+        accel[k] = sensors[live[k]].accel[i];
+        gyro[k] = sensors[live[k]].gyro[i];
+      }
+      accelMedian[i] = median(accel, liveCount);
+      gyroMedian[i] = median(gyro, liveCount);
+    }
+
+    //Leave out the IMUs which are too far from the median. If they all are, use the one which has been closest to it
+    float accelDiff[maxImuCount], gyroDiff[maxImuCount];
+    bool anyHealthy = false;
+    int closest = live[0];
+    for (int k=0; k<liveCount; k++) {
+      IMUsensor &sensor = sensors[live[k]];
+      accelDiff[k] = 0;
+      gyroDiff[k] = 0;
+      for (int i=0; i<3; i++) {
+        accelDiff[k] += (sensor.accel[i] - accelMedian[i]) * (sensor.accel[i] - accelMedian[i]);
+        gyroDiff[k] += (sensor.gyro[i] - gyroMedian[i]) * (sensor.gyro[i] - gyroMedian[i]);
+      }
+      sensor.healthy = gyroDiff[k] <= maxDisagreement[0]*maxDisagreement[0]
+                       and accelDiff[k] <= maxDisagreement[1]*maxDisagreement[1];
+      anyHealthy |= sensor.healthy;
+      if (sensor.gyroVariance < sensors[closest].gyroVariance) {
+        closest = live[k];
+      }
+    }
+    if (!anyHealthy) {
+      sensors[closest].healthy = true;
+    }
+
+    //Average the others, weighted by the inverse of their variance from the median, which is at least one count
+    float accelWeight = 0, gyroWeight = 0;
+    float accel[3] = {0, 0, 0}, gyro[3] = {0, 0, 0};
+    for (int k=0; k<liveCount; k++) {
+      IMUsensor &sensor = sensors[live[k]];
+      if (!sensor.healthy) {
+        sensor.rejected += fresh[live[k]];
+        continue;
+      }
+      if (fresh[live[k]]) {
+        sensor.accelVariance += healthSmoothing * (accelDiff[k]/3 - sensor.accelVariance);
+        sensor.gyroVariance += healthSmoothing * (gyroDiff[k]/3 - sensor.gyroVariance);
+      }
+      float accelScale = 1 / (sensor.accelVariance + aRes*aRes);
+      float gyroScale = 1 / (sensor.gyroVariance + gRes*gRes);
+      for (int i=0; i<3; i++) {
+        accel[i] += sensor.accel[i] * accelScale;
+        gyro[i] += sensor.gyro[i] * gyroScale;
+      }
+      accelWeight += accelScale;
+      gyroWeight += gyroScale;
+    }
+
+    //Round the average to the counts of the first IMU, so it is logged and replayed with its calibration
+    for (int i=0; i<3; i++) {
+      accelData[i] = toCounts((accel[i] / accelWeight + calibration.accelOffset[i]) / aRes);
+      gyroData[i] = toCounts((gyro[i] / gyroWeight + calibration.gyroBias[i]) / gRes);
+    }
+    return true;
+  }
+#endif
@@ -7,7 +7,9 @@
 #define IMU_MPU6050_DMP 1 //200 Hz max
 
 //Select which IMU setup to use
-#define IMU_TYPE IMU_MPU6050
+#ifndef IMU_TYPE
+  #define IMU_TYPE IMU_MPU6050
+#endif
 
 
 //Import libraries
@@ -24,65 +26,294 @@
 #endif
 
 //Import files
+#include "Clock.h"
 #include "Logger.h"
+#include "StateBus.h"
 
 extern const int lightPin;
 extern float loopTime();
 
 
+/* Settings */
+///Name of the file the IMU calibration is stored in
+const char calibrationFile[] = "imuCal.bin";
+///Version of the calibration data, stored calibrations with a different version are ignored
+const uint32_t calibrationVersion = 1;
+///Name of the file the state of the angle estimate is stored in when the flight starts, used to replay the log
+const char estimatorFile[] = "imuState.bin";
+///Largest number of IMUs which can be averaged (see IMU::imuCount)
+const int maxImuCount = 4;
+///Time without a new reading after which an IMU is left out of the average (μs)
+const unsigned long maxReadingAge = 20000;
+/* Settings */
+
+/**
+ * @struct IMUcalibration
+ * @brief Calibration values of the IMU which are stored so they can be reused on the next startup
+ *
+ * For IMU_MPU6050 the values are in degrees per second and Gs.
+ * For IMU_MPU6050_DMP the values are the raw offsets stored in the MPU6050's offset registers.
+ */
+struct IMUcalibration {
+  ///Should be equal to calibrationVersion + IMU_TYPE, otherwise the calibration is invalid
+  uint32_t version = 0;
+  ///Gyroscope bias of roll, pitch and yaw
+  float gyroBias[3] = {0, 0, 0};
+  ///Accelerometer offset of x, y and z
+  float accelOffset[3] = {0, 0, 0};
+  ///Temperature of the IMU when it was calibrated (degrees celsius)
+  float temperature = 0;
+};
+
+/**
+ * @struct EstimatorState
+ * @brief State of the angle estimate, stored when the flight starts so the logged samples can be replayed from it
+ */
+struct EstimatorState {
+  ///Should be equal to calibrationVersion + IMU_TYPE, otherwise the state is invalid
+  uint32_t version = 0;
+  ///Calibration being used
+  IMUcalibration calibration;
+  #if IMU_TYPE == IMU_MPU6050 or IMU_TYPE == NO_IMU
+    ///Quaternion of the current angle
+    float q[4];
+    ///Last accelerometer (Gs) and gyroscope (degrees per second) values
+    float accelVal[3];
+    float gyroVal[3];
+    ///Roll and pitch kalman filters, the library has no way to set their estimate so they are copied
+    uint8_t rollKalman[sizeof(SimpleKalmanFilter)];
+    uint8_t pitchKalman[sizeof(SimpleKalmanFilter)];
+  #endif
+};
+
+#if IMU_TYPE == IMU_MPU6050
+  /**
+   * @struct IMUsensor
+   * @brief One of several IMUs which are averaged, and how well it has been agreeing with the others
+   */
+  struct IMUsensor {
+    ///I2C address
+    uint8_t address = MPU6050_ADDRESS;
+    ///Calibration of this IMU, the first one uses IMU::calibration
+    IMUcalibration calibration;
+    ///Last reading after removing the calibration, accelerometer (Gs) and gyroscope (degrees per second)
+    float accel[3] = {0, 0, 1};
+    float gyro[3] = {0, 0, 0};
+    ///Running mean of the squared difference from the median of the IMUs, accelerometer (G²) and gyroscope ((degrees per second)²)
+    float accelVariance = 0;
+    float gyroVariance = 0;
+    ///Time of the last new reading (μs)
+    micros_t lastReading = 0;
+    ///Whether the last reading was used in the average
+    bool healthy = true;
+    ///New readings taken, and the ones left out because they disagreed with the other IMUs
+    uint32_t readings = 0;
+    uint32_t rejected = 0;
+  };
+#endif
+
 /**
  * @class IMU
  * @brief Handes the inertial measurement unit(s) and other sensors of the device
  */
 class IMU {
   public:
-    /** Initialise the sensors.
+    /** Initialise the sensors and start calibrating them.
+     *  
+     *  The calibration is run by updateCalibration(), which must be called until it returns true.
      *  
      *  @param[in] logger Logger object to read the settings from
      *  @returns Status of IMU. 0 for no error
      */
     int init(Logger &logger);
-    /** Reads the sensors and updates the current angle and other measurements */
-    void updateAngle();
+    /** Runs the next step of the calibration without blocking.
+     *  
+     *  Each call takes at most one reading from the sensors.
+     *  
+     *  @param[in] logger Logger object to store the calibration with
+     *  @returns true once the calibration has finished
+     */
+    bool updateCalibration(Logger &logger);
+    /** Reads the sensors and updates the current angle and other measurements
+     *  
+     *  @param[out] attitude State to publish the new attitude to
+     */
+    void updateAngle(SharedState<AttitudeState> &attitude);
+    /** Stores the state of the angle estimate. Called when the flight starts
+     *  
+     *  @param[in] logger Logger object to store the state with
+     */
+    void saveEstimator(Logger &logger);
+    /** Continues the angle estimate from a stored state instead of calibrating, used to replay logs
+     *  
+     *  The current settings are kept, so a log can be replayed with different settings.
+     *  
+     *  @param[in] logger Logger object to load the state with
+     *  @returns true if the stored state was loaded
+     */
+    bool loadEstimator(Logger &logger);
+    #if IMU_TYPE == IMU_MPU6050 or IMU_TYPE == NO_IMU
+      /** Calculates the current angle (in quaternions) using the accelerometer and gyroscope. Called by updateAngle()
+       *  
+       *  Public so the host benchmarks can time it on its own (see src/host/bench/hotPathBench.cpp).
+       *  
+       *  @param[in] accel accelerometer data (Gs)
+       *  @param[in] gyro gyroscope data (degrees/second)
+       */
+      void MadgwickQuaternionUpdate(float *accel, float *gyro);
+    #endif
+    /** Summary of each IMU for the end of the log, how often it was left out of the average and its noise
+     *
+     *  Uses the heap, so should only be called once the flight is over (see Memory.h).
+     */
+    String summary() const;
     
     ///Current angle of roll, pitch and yaw (in degrees)
     float currentAngle[3] = {0, 0, 0};
-    ///Rotation rate (degrees per millisecond) of roll, pitch and yaw
+    ///Rotation rate (degrees per second) of roll, pitch and yaw
     float rRate[3] = {0, 0, 0};
+    ///Raw accelerometer and gyroscope readings of the last sample, logged so the flight can be replayed. With several
+    ///IMUs this is their average in the counts of the first one, so it can be replayed with the first one's calibration
+    int16_t rawAccel[3] = {0, 0, 0};
+    int16_t rawGyro[3] = {0, 0, 0};
+    ///True if the last updateAngle() had a new sample
+    bool newSample = false;
+
+    ///Calibration currently being used by the IMU, the first one if there are several
+    IMUcalibration calibration;
+    ///True if the stored calibration was reused, false if a full calibration was run
+    bool calibrationReused = false;
 
     /* Settings */
     ///IMU angle offset {roll, pitch and yaw}. Can be set via SD card
     float angleOffset[3] = {8, 1.1, 0};
+    ///Always run a full calibration on startup if true. Can be set via SD card
+    bool forceCalibration = false;
+    ///Also measure the accelerometer offsets in the full calibration, the drone must be level. Otherwise the stored offsets
+    ///are kept. A full calibration runs on every startup while set. Can be set via SD card
+    bool calibrateAccel = false;
+    ///Maximum rotation (degrees per second) allowed during the stillness check. Can be set via SD card
+    float maxStillRate = 1.0;
+    ///Maximum difference in temperature (degrees celsius) from the stored calibration. Can be set via SD card
+    float maxCalibrationTempDiff = 8.0;
+    #if IMU_TYPE == IMU_MPU6050 or IMU_TYPE == NO_IMU
+      ///Gain of the accelerometer correction in MadgwickQuaternionUpdate. Can be set via SD card
+      float beta = sqrt(.05) * PI * (5.0 / 180.0);
+      ///Gain of the gyroscope bias correction in MadgwickQuaternionUpdate. Can be set via SD card
+      float zeta = sqrt(.75) * PI * (2.0 / 180.0);
+      ///Roll and pitch kalman filters {measurement error, starting estimate error, process noise}. Can be set via SD card
+      float kalmanParams[3] = {.5, 1, .5};
+    #endif
+    #if IMU_TYPE == IMU_MPU6050
+      ///Number of IMUs averaged, up to maxImuCount. Can be set via SD card
+      int imuCount = 1;
+      ///I2C address of each IMU on Wire, the MPU6050 can be at 0x68 or 0x69 (AD0 pin) so more need an address
+      ///translator. Only used with more than one IMU. Can be set via SD card
+      int imuAddress[maxImuCount] = {0x68, 0x69, 0x6A, 0x6B};
+      ///Largest difference from the median of the IMUs of the gyroscope (degrees per second) and accelerometer (Gs)
+      ///before an IMU is left out of the average. Can be set via SD card
+      float maxDisagreement[2] = {10, .25};
+      ///Weight of each new reading in the running variance of each IMU. Can be set via SD card
+      float healthSmoothing = .005;
+    #endif
     /* Settings */
 
   private:
+    /** Loads the stored calibration if it can be used.
+     *  
+     *  The IMU must be at a similar temperature to when the calibration was stored.
+     *  updateCalibration() then checks the IMU is still before using it.
+     *  The stored accelerometer offsets are kept even if the rest of the calibration cannot be used, as the full
+     *  calibration only measures them when calibrateAccel is set.
+     *  
+     *  @param[in] logger Logger object to load the stored calibration with
+     *  @returns true if the whole stored calibration was loaded
+     */
+    bool loadCalibration(Logger &logger);
+    /** Stores the current calibration so it can be used on the next startup
+     *  
+     *  @param[in] logger Logger object to store the calibration with
+     */
+    void saveCalibration(Logger &logger);
+    /** Gets the calibration of one of the IMUs, the first one's is calibration */
+    IMUcalibration &sensorCalibration(int sensor) {
+      #if IMU_TYPE == IMU_MPU6050
+        return sensor == 0 ? calibration : sensors[sensor].calibration;
+      #else
+        return calibration;
+      #endif
+    }
+    /** Gets the temperature of the IMU (degrees celsius)
+     *
+     *  @param[in] sensor Which IMU to read, if there are several
+     */
+    float readTemperature(int sensor=0);
+
+    ///Number of readings taken during a full calibration
+    const int calibrationSamples = 1000;
+    ///Number of readings taken to check the IMU is still
+    const int stillSamples = 50;
+    ///Calibration step. 0: checking stillness, 1: full calibration of the gyroscope bias (and the accelerometer offsets if
+    ///calibrateAccel is set), 2: initial angle, 3: letting the DMP settle, 4: finished
+    uint8_t calibrationStage = 0;
+    ///The number of readings taken in the current calibration step
+    int sampleCount = 0;
+    ///Timestamp of the last calibration reading (μs)
+    micros_t lastSampleTime = 0;
+    #if IMU_TYPE == IMU_MPU6050_DMP
+      ///Minimum time between calibration readings (μs)
+      const unsigned long calibrationSampleTime = 4000;
+    #else
+      ///Minimum time between calibration readings (μs)
+      const unsigned long calibrationSampleTime = 1000;
+    #endif
+
     //Define variables specific to setups
     #if IMU_TYPE == IMU_MPU6050 or IMU_TYPE == NO_IMU
       ///Accelerometer value in Gs
       float accelVal[3];
       ///Gyroscope value in degrees per seconds
       float gyroVal[3];
-      ///Kalman filter for the roll axis
+      ///Kalman filter for the roll axis, set up with kalmanParams by init()
       SimpleKalmanFilter rollKalman{.5, 1, 0.5};
-      ///Kalman filter for the pitch axis
+      ///Kalman filter for the pitch axis, set up with kalmanParams by init()
       SimpleKalmanFilter pitchKalman{.5, 1, 0.5};
       ///Quaternion container
       float q[4] = {1, 0, 0, 0};
-      ///beta parameter for MadgwickQuaternionUpdate calculations
-      const float beta = sqrt(.05) * PI * (5.0 / 180.0);
-      ///beta parameter for MadgwickQuaternionUpdate calculations
-      const float zeta = sqrt(.75) * PI * (2.0 / 180.0);
 
-      /** Calculates the current angle (in quaternions) using the accelerometer and gyroscope
-       *  
-       *  @param[in] accel accelerometer data (Gs)
-       *  @param[in] gyro gyroscope data (degrees/second)
-       */
-      void MadgwickQuaternionUpdate(float *accel, float *gyro);
       /** Converts roll, pitch and yaw to quaternions */
       void eulerToQuat(float roll, float pitch, float yaw);
 
       #if IMU_TYPE == IMU_MPU6050
+        /** Sets up an IMU at another address the way initMPU6050() does
+         *
+         *  @param[in] address I2C address of the IMU
+         *  @returns true if the IMU answered
+         */
+        bool initSensor(uint8_t address);
+        /** Reads the accelerometer and gyroscope of one IMU, in a single transfer when there are several
+         *
+         *  @param[in] sensor Which IMU to read
+         *  @param[out] accel Raw accelerometer reading
+         *  @param[out] gyro Raw gyroscope reading
+         */
+        void readSensor(int sensor, int16_t accel[3], int16_t gyro[3]);
+        /** Reads the IMUs which have a new reading, and averages them into accelData and gyroData. Called by updateAngle()
+         *
+         *  Each axis is compared with the median of the IMUs which are still sending readings. IMUs which are too far
+         *  from it are left out, the others are weighted by the inverse of their running variance from it, so noisier
+         *  IMUs count for less.
+         *
+         *  @returns true if any IMU had a new reading
+         */
+        bool fuseSensors();
+
+        ///Each IMU, only the first imuCount are used
+        IMUsensor sensors[maxImuCount];
+        ///Sum of the gyroscope readings of each IMU during calibration
+        float gyroSum[maxImuCount][3];
+        ///Sum of the accelerometer readings of each IMU during calibration
+        float accelSum[maxImuCount][3];
         ///MPU6050 object
         MPU6050lib mpu;
         ///Interrupt pin
@@ -113,8 +344,14 @@ class IMU {
       float ypr[3];
       ///Constant used to convert from MPU6050 data to degrees
       const float MPUmult = 180 / M_PI;
+      ///Accelerometer sensor output
+      int16_t accelData[3];
       ///Gyroscope sensor output
       int16_t gyroData[3];
+      ///Sum of the raw gyroscope readings during calibration
+      int32_t gyroSum[3];
+      ///Sum of the raw accelerometer readings during calibration
+      int32_t accelSum[3];
     #endif
 };
 #endif
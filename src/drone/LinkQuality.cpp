@@ -0,0 +1,100 @@
+#include "LinkQuality.h"
+
+void LinkMonitor::addPacket(uint8_t sequence, micros_t timestamp) {
+  if (started) {
+    //Gaps of over half the sequence are duplicate or reordered packets, not losses
+    uint8_t gap = sequence - lastSequence - 1;
+    if (gap < 128) {
+      windowLost += gap;
+    }
+
+    //Welford's update, so jitter much smaller than the interval is not lost to rounding
+    float interval = timestamp - lastPacketTime;
+    intervals++;
+    float deviation = interval - intervalMean;
+    intervalMean += deviation / intervals;
+    intervalSquareDeviation += deviation * (interval - intervalMean);
+  } else {
+    windowStart = timestamp;
+    started = true;
+  }
+  lastSequence = sequence;
+  lastPacketTime = timestamp;
+  windowReceived++;
+}
+
+bool LinkMonitor::update(micros_t currentTime) {
+  if (!started or currentTime - windowStart < window) {
+    return false;
+  }
+
+  float windowLength = microsToSeconds(currentTime - windowStart);
+  packetRate = windowReceived / windowLength;
+  packetLoss = windowReceived + windowLost > 0 ? 100.0f * windowLost / (windowReceived + windowLost) : 100;
+  if (intervals > 1) {
+    jitter = sqrtf(intervalSquareDeviation / intervals);
+  }
+
+  //Keep the worst estimates for the summary
+  minPacketRate = windows == 0 ? packetRate : min(minPacketRate, packetRate);
+  maxPacketLoss = max(maxPacketLoss, packetLoss);
+  maxJitter = max(maxJitter, jitter);
+  windows++;
+  totalReceived += windowReceived;
+  totalLost += windowLost;
+
+  windowStart = currentTime;
+  windowReceived = windowLost = intervals = 0;
+  intervalMean = intervalSquareDeviation = 0;
+  return true;
+}
+
+String LinkMonitor::summary() const {
+  uint32_t total = totalReceived + totalLost;
+  String s = "Radio link";
+  s += ",Packets received," + String(totalReceived);
+  s += ",Packets lost," + String(totalLost);
+  s += ",Packet loss (%)," + String(total > 0 ? 100.0f * totalLost / total : 0.0f, 2);
+  s += ",Min packet rate (Hz)," + String(minPacketRate, 1);
+  s += ",Max packet loss (%)," + String(maxPacketLoss, 1);
+  s += ",Max jitter (μs)," + String(maxJitter, 0);
+  return s;
+}
+
+void LatencyTrace::begin(micros_t inputTime, micros_t currentTime) {
+  this->inputTime = inputTime;
+  stageStart = inputTime;
+  tracing = true;
+  mark(0, currentTime);
+}
+
+void LatencyTrace::mark(int stage, micros_t currentTime) {
+  if (!tracing) {
+    return;
+  }
+
+  uint32_t stageTime = currentTime - stageStart;
+  stageSum[stage] += stageTime;
+  stageMax[stage] = max(stageMax[stage], stageTime);
+  stageStart = currentTime;
+
+  if (stage == latencyStages-1) {
+    latency = currentTime - inputTime;
+    latencySum += latency;
+    latencyMax = max(latencyMax, latency);
+    count++;
+    tracing = false;
+  }
+}
+
+String LatencyTrace::summary() const {
+  const char *names[latencyStages] = {"IRQ to getInput", "IMU and calcPID", "Mixer", "ESC commit"};
+  String s = "Latency (μs),Inputs traced," + String(count);
+  for (int i=0; i<latencyStages; i++) {
+    s += "," + String(names[i]) + " mean," + String(count > 0 ? stageSum[i] / (float)count : 0.0f, 1);
+    s += "," + String(names[i]) + " max," + String(stageMax[i]);
+  }
+  s += ",Total mean," + String(count > 0 ? latencySum / (float)count : 0.0f, 1);
+  s += ",Total max," + String(latencyMax);
+  return s;
+}
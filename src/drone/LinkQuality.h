@@ -0,0 +1,112 @@
+#ifndef __LinkQuality_H__
+#define __LinkQuality_H__
+
+//Import libraries
+#include <Arduino.h>
+#include <stdint.h>
+
+//Import files
+#include "Clock.h"
+
+/**
+ * @class LinkMonitor
+ * @brief Estimates the packet rate, loss and jitter of the radio link once per second
+ *
+ * Lost packets are found from gaps in the sequence numbers of the packets. This includes packets dropped
+ * by the drone as well as packets lost over the air. Jitter is the standard deviation of the time between packets.
+ */
+class LinkMonitor {
+  public:
+    /** Records a packet from the controller
+     *  
+     *  @param[in] sequence Sequence number of the packet
+     *  @param[in] timestamp Time the packet arrived (μs)
+     */
+    void addPacket(uint8_t sequence, micros_t timestamp);
+    /** Updates the estimates once a second has passed since the last update
+     *  
+     *  @param[in] currentTime Current time (μs)
+     *  @returns true if the estimates were updated
+     */
+    bool update(micros_t currentTime);
+    /** Summary of the whole flight, in the same format as the log settings */
+    String summary() const;
+
+    ///Packets received per second
+    float packetRate = 0;
+    ///Percentage of packets lost
+    float packetLoss = 0;
+    ///Standard deviation of the time between packets (μs)
+    float jitter = 0;
+
+  private:
+    ///Length of each estimate (μs)
+    static const uint32_t window = 1000000;
+    ///Sequence number of the last packet
+    uint8_t lastSequence = 0;
+    ///Time of the last packet (μs)
+    micros_t lastPacketTime = 0;
+    ///Whether a packet has been received
+    bool started = false;
+    ///Time the current window started (μs)
+    micros_t windowStart = 0;
+    ///Packets received and lost in the current window
+    uint32_t windowReceived = 0, windowLost = 0;
+    ///Mean of the time between packets in the current window, and the sum of the squares of its deviations from the mean
+    float intervalMean = 0, intervalSquareDeviation = 0;
+    ///Number of intervals in the current window
+    uint32_t intervals = 0;
+
+    ///Packets received and lost over the whole flight
+    uint32_t totalReceived = 0, totalLost = 0;
+    ///Worst estimates over the whole flight
+    float minPacketRate = 0, maxPacketLoss = 0, maxJitter = 0;
+    ///Number of windows estimated
+    uint32_t windows = 0;
+};
+
+///Stages of the main loop input goes through before reaching the motors
+const int latencyStages = 4;
+
+/**
+ * @class LatencyTrace
+ * @brief Measures the time from a packet's IRQ to the ESC commit of the loop that used it, split into stages
+ *
+ * Stages: 0 IRQ to getInput(), 1 the IMU update, loop wait and calcPID(), 2 the mixer (MotorController::write()),
+ * 3 MotorController::commit().
+ */
+class LatencyTrace {
+  public:
+    /** Starts tracing new input
+     *  
+     *  @param[in] inputTime Time the packet arrived (μs)
+     *  @param[in] currentTime Time the input was decoded (μs)
+     */
+    void begin(micros_t inputTime, micros_t currentTime);
+    /** Records the end of a stage. Ignored if no input is being traced
+     *  
+     *  @param[in] stage Stage which has ended, 1 - latencyStages-1. Ending the last stage ends the trace
+     *  @param[in] currentTime Current time (μs)
+     */
+    void mark(int stage, micros_t currentTime);
+    /** Summary of the whole flight, in the same format as the log settings */
+    String summary() const;
+
+    ///Latency of the last input traced (μs)
+    uint32_t latency = 0;
+
+  private:
+    ///Whether input is being traced
+    bool tracing = false;
+    ///Time the input being traced arrived (μs)
+    micros_t inputTime;
+    ///Time the current stage started (μs)
+    micros_t stageStart;
+    ///Sum and max time of each stage (μs)
+    uint32_t stageSum[latencyStages] = {}, stageMax[latencyStages] = {};
+    ///Sum and max of the total latency (μs)
+    uint32_t latencySum = 0, latencyMax = 0;
+    ///Number of inputs traced
+    uint32_t count = 0;
+};
+#endif
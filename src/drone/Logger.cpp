@@ -3,11 +3,7 @@
 void Logger::init(){
   #if STORAGE_TYPE == SD_CARD
     checkSD(sd.begin(SdioConfig(FIFO_SDIO)));
-    checkLog(0);
-  
-    sd.remove("log.bin");
-    logFileBin.open("log.bin", O_WRITE | O_CREAT | O_TRUNC);
-    checkSD(logFileBin.preAllocate(logFileSize));
+    checkLog();
   
     //Get settings file
     if (sd.exists("settings.json")) {
@@ -23,6 +19,14 @@ void Logger::init(){
   #endif
 }
 
+void Logger::initLogFile() {
+  #if STORAGE_TYPE == SD_CARD
+    sd.remove("log.bin");
+    logFileBin.open("log.bin", O_WRITE | O_CREAT | O_TRUNC);
+    checkSD(logFileBin.preAllocate(logFileSize));
+  #endif
+}
+
 void Logger::checkSD(bool condition) {
   if (!condition) {
     for (;;) {
@@ -31,17 +35,22 @@ void Logger::checkSD(bool condition) {
   }
 }
 
-void Logger::checkLog(int fileNum) {
+void Logger::checkLog() {
   #if STORAGE_TYPE == SD_CARD
-    char fileName[10];
-    String("log_" + String(fileNum) + ".csv").toCharArray(fileName, sizeof(fileName));
-    if (sd.exists(fileName)) {
-      char nextFile[10];
-      String("log_" + String(fileNum+1) + ".csv").toCharArray(nextFile, sizeof(nextFile));
-      if (sd.exists(nextFile)) {
-        checkLog(fileNum+1);
-      }
-  
+    //Find the first unused log number
+    char fileName[20];
+    char nextFile[20];
+    int fileCount = 0;
+    snprintf(fileName, sizeof(fileName), "log_%d.csv", fileCount);
+    while (sd.exists(fileName)) {
+      fileCount++;
+      snprintf(fileName, sizeof(fileName), "log_%d.csv", fileCount);
+    }
+
+    //Move each log up by one, newest first so none are overwritten
+    for (int i=fileCount-1; i>=0; i--) {
+      snprintf(fileName, sizeof(fileName), "log_%d.csv", i);
+      snprintf(nextFile, sizeof(nextFile), "log_%d.csv", i+1);
       logFile.open(fileName, O_WRITE);
       logFile.rename(nextFile);
       logFile.close();
@@ -72,13 +81,12 @@ void Logger::logSetting(String name, const float *arr, int len, int decimals, bo
 }
 
 bool Logger::checkLogReady() {
+  loopsSinceLog++;
   if (loopsSinceLog >= logDiv) {
     loopsSinceLog = 0;
     return true;
-  } else {
-    loopsSinceLog++;
-    return false;
   }
+  return false;
 }
 
 void Logger::logArray(const float *arr, int len, int decimals) {
@@ -90,6 +98,10 @@ void Logger::logArray(const float *arr, int len, int decimals) {
 }
 
 void Logger::logString(String s) {
+  logString(s.c_str());
+}
+
+void Logger::logString(const char *s) {
   #if STORAGE_TYPE == SD_CARD
     logFile.open("log_0.csv", O_CREAT | O_WRITE | O_APPEND);
     logFile.print(s);
@@ -109,9 +121,16 @@ void Logger::write() {
 
   //Write to log file
   #if STORAGE_TYPE == SD_CARD
+    //Start the file with the type of each variable so it can be read without the firmware, e.g. to replay the flight
+    if (firstLog) {
+      uint8_t header[4] = {'L', 'O', 'G', varCount};
+      logFileBin.write(header, sizeof(header));
+      logFileBin.write(varID, varCount);
+    }
     logFileBin.write(&buf, (bufOffset+7)/8);
   #endif
   firstLog = false;
+  bufferFill = bufOffset * 100 / (logBufferLen * 32);
 
   //Reset the buffer
   for (uint8_t i=0; i<sizeof(buf)/4; i++) {
@@ -122,7 +141,7 @@ void Logger::write() {
 
 void Logger::calcSectionTime() {
   if (timerIndex < maxLoopTimerSections) {
-    loopTimings[timerIndex] = micros();
+    loopTimings[timerIndex] = clockMicros();
     timerIndex++;
   }
 }
@@ -150,7 +169,7 @@ void Logger::storeSectionTime() {
   calcSectionTime();
 }
 
-void Logger::closeFile() {
+void Logger::closeFile(const String &summary) {
   #if STORAGE_TYPE == SD_CARD
     //Close the binary file
     logFileBin.flush();
@@ -162,9 +181,35 @@ void Logger::closeFile() {
     logFile.open("log_0.csv", O_WRITE | O_APPEND);
     binToStr();
     logFileBin.close();
+    logFile.print("\n\n" + summary);
     logFile.close();
   #elif STORAGE_TYPE == RAM
      binToStr();
+     Serial.print("\n\n" + summary);
+  #endif
+}
+
+bool Logger::readFile(const char *fileName, void *data, size_t len) {
+  #if STORAGE_TYPE == SD_CARD
+    if (!sd.exists(fileName)) {
+      return false;
+    }
+    FsFile file;
+    file.open(fileName, O_READ);
+    bool success = file.read(data, len) == (int)len;
+    file.close();
+    return success;
+  #elif STORAGE_TYPE == RAM
+    return false;
+  #endif
+}
+
+void Logger::writeFile(const char *fileName, const void *data, size_t len) {
+  #if STORAGE_TYPE == SD_CARD
+    FsFile file;
+    file.open(fileName, O_WRITE | O_CREAT | O_TRUNC);
+    file.write(data, len);
+    file.close();
   #endif
 }
 
@@ -182,14 +227,20 @@ void Logger::binToStr() {
   for (int i=0; i<varCount; i++) {
     logSize += (varID[i]%50) / 8;
   }
-  char buf[logSize * 100];
-  uint16_t bufIndex = 0;
+  //Convert 100 records per read. The buffer fits the largest record (logBufferLen) so the stack used is fixed
+  char buf[logBufferLen*4 * 100];
+  const uint32_t bufLen = logSize * 100;
+  uint32_t bufIndex = 0;
   
   uint32_t prevTime = 0;
   String s;
   bool partialBuffer = false;
   bool eof = false;
-  #if STORAGE_TYPE == RAM
+  #if STORAGE_TYPE == SD_CARD
+    //Skip the header, the types are already known
+    uint8_t header[4 + maxVarCount];
+    logFileBin.read(header, 4 + varCount);
+  #elif STORAGE_TYPE == RAM
     uint32_t bigBufIndex = 0;
   #endif
   while (!eof or partialBuffer) {
@@ -198,8 +249,8 @@ void Logger::binToStr() {
         break;
       }
       #if STORAGE_TYPE == SD_CARD
-        if (sizeof(buf) < logFileBin.size() - logFileBin.position()) {
-          logFileBin.read(&buf, sizeof(buf));
+        if (bufLen < logFileBin.size() - logFileBin.position()) {
+          logFileBin.read(&buf, bufLen);
         } else {
           logFileBin.read(&buf, logFileBin.available());
           partialBuffer = true;
@@ -207,10 +258,10 @@ void Logger::binToStr() {
         eof = logFileBin.position() >= logFileBin.size();
       #elif STORAGE_TYPE == RAM
         //clear buffer
-        for (int i=0; i<logSize * 100; i++) {
+        for (uint32_t i=0; i<bufLen; i++) {
           buf[i] = 0;
         }
-        for (int i=0; i<sizeof(buf) * 8; i++) {
+        for (uint32_t i=0; i<bufLen * 8; i++) {
           if (bigBufIndex == bigBufLen) {
             eof = true;
             break;
@@ -277,6 +328,6 @@ void Logger::binToStr() {
     #elif STORAGE_TYPE == RAM
       Serial.print(s);
     #endif
-    bufIndex %= sizeof(buf) * 8;
+    bufIndex %= bufLen * 8;
   }
 }
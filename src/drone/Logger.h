@@ -6,7 +6,9 @@
 #define SD_CARD 0
 
 //Select which storage to use
-#define STORAGE_TYPE SD_CARD
+#ifndef STORAGE_TYPE
+  #define STORAGE_TYPE SD_CARD
+#endif
 
 //Import libraries
 #if STORAGE_TYPE == SD_CARD
@@ -16,6 +18,9 @@
   #include "Arduino.h"
 #endif
 
+//Import files
+#include "Clock.h"
+
 extern void blink(int);
 extern const int loopRate;
 
@@ -30,7 +35,7 @@ const int logFileSize = 10*60 * logBufferLen*4 * loopRate/logDiv;
 ///The maximum times calcSectionTime can be called per loop
 const int maxLoopTimerSections = 8;
 ///The maximum number of variables that can be stored in the log
-const int maxVarCount = 32;
+const int maxVarCount = 48;
 /* Settings */
 
 /** 
@@ -66,10 +71,12 @@ constexpr struct TypeID {
  */
 class Logger {
   public:
-    /** Move/remove old logs, allocate space for the current log, read the settings file
+    /** Move/remove old logs, read the settings file
      *  @brief Setup storage for logging
      */
     void init();
+    /** Allocate space for the binary log. Must be called before any data is written */
+    void initLogFile();
     /** Log setting (integer) to the current flight log
      *  
      *  @param[in] name Name of the setting
@@ -110,6 +117,11 @@ class Logger {
      *  @param[in] s String to log
      */
     void logString(String s);
+    /** Log a string without making a String, so it can be used after setup() (see Memory.h)
+     *  
+     *  @param[in] s String to log
+     */
+    void logString(const char *s);
     /** Log a timestamp. Used at the start of each entry
      *  
      *  @param[in] t Timestamp to log
@@ -121,8 +133,29 @@ class Logger {
     void calcSectionTime();
     /** Stores the min, max and average time of each section of the main loop */
     void storeSectionTime();
-    /** Write to and close the binary file then run binToStr() */
-    void closeFile();
+    /** Write to and close the binary file then run binToStr()
+     *  
+     *  @param[in] summary Text added after the log, e.g. statistics of the whole flight
+     */
+    void closeFile(const String &summary="");
+    /** Read raw data from a file in storage
+     *  
+     *  @param[in] fileName Name of the file to read
+     *  @param[out] data Buffer to read the file into
+     *  @param[in] len Number of bytes to read
+     *  @returns true if the file exists and len bytes were read
+     */
+    bool readFile(const char *fileName, void *data, size_t len);
+    /** Write raw data to a file in storage, replacing the file if it already exists
+     *  
+     *  @param[in] fileName Name of the file to write
+     *  @param[in] data Data to write
+     *  @param[in] len Number of bytes to write
+     */
+    void writeFile(const char *fileName, const void *data, size_t len);
+
+    ///Percentage of the log buffer used by the last log entry
+    uint8_t bufferFill = 0;
 
     /** Load a setting from storage
      *  
@@ -202,21 +235,17 @@ class Logger {
      *  @param[in] condition Condition to check
      */
     void checkSD(bool condition);
-    /** A recursive function to free up the name 'log_0.csv' (the current log).
-     *  
-     *  Checks if a certain log exists, if it does then check if the next file exists.
-     *  If the next file exists run checkLog on that file.
-     *  
-     *  Then increment the logs number
+    /** Frees up the name 'log_0.csv' (the current log).
      *  
-     *  @param[in] fileNum File number to check
+     *  Finds the first unused log number, then increments the number of each log before it.
+     *  This is a loop rather than recursion, so the stack used does not depend on the number of logs.
      */
-    void checkLog(int fileNum);
+    void checkLog();
     /** Converts the binary log 'log.bin' to the readable file 'log_0.csv' */
     void binToStr();
 
     ///The number of loops since data has been logged
-    uint8_t loopsSinceLog = 255;
+    uint8_t loopsSinceLog = 0;
     //File variables
     #if STORAGE_TYPE == SD_CARD
       ///SD card object
@@ -225,8 +254,8 @@ class Logger {
       FsFile logFile;
       ///Binary log file object
       FsFile logFileBin;
-      ///JSON document holding all the settings
-      StaticJsonDocument<512> sdSettings;
+      ///JSON document holding all the settings, large enough for every setting including the gain schedule tables
+      StaticJsonDocument<3072> sdSettings;
     #elif STORAGE_TYPE == RAM
       ///Buffer that holds all of the data in RAM mode
       uint32_t bigBuf[2100*36/4];
@@ -235,7 +264,7 @@ class Logger {
     #endif
     //Section timer variables
     ///Timestamps of when sections of the current loop has been completed (μs)
-    unsigned long loopTimings[maxLoopTimerSections];
+    micros_t loopTimings[maxLoopTimerSections];
     ///The next free index of loopTimings
     uint8_t timerIndex;
     //Buffer variables
@@ -0,0 +1,85 @@
+#ifndef __LookupTable_H__
+#define __LookupTable_H__
+
+//Import files
+#include "FixedPoint.h"
+
+
+/**
+ * @class LookupTable
+ * @brief A function sampled at evenly spaced points, read with linear interpolation
+ *
+ * The table is built once (e.g. at init from the settings) so functions which are slow to calculate,
+ * like square roots, only cost a table read and a multiply in the control loop.
+ *
+ * @tparam bits The table has 2^bits segments
+ */
+template <int bits> class LookupTable {
+  public:
+    ///Number of segments in the table
+    static constexpr int segments = 1 << bits;
+
+    /** Sample a function into the table
+     *
+     *  @param[in] func Function to sample, takes and returns a float
+     *  @param[in] minInput Smallest input of the table
+     *  @param[in] maxInput Largest input of the table
+     */
+    template <typename F> void build(F func, float minInput, float maxInput) {
+      inputMin = minInput;
+      inputScale = segments / (maxInput - minInput);
+      for (int i=0; i<=segments; i++) {
+        value[i] = func(minInput + (maxInput - minInput) * i / segments);
+        #if CONTROL_MATH == FIXED_MATH
+          valueQ[i] = toQ31(value[i]);
+        #endif
+      }
+    }
+
+    /** Read the table, inputs outside the table are limited to its range
+     *
+     *  @param[in] x Input
+     *  @returns Interpolated value of the function
+     */
+    float get(float x) const {
+      float pos = (x - inputMin) * inputScale;
+      if (pos <= 0) {
+        return value[0];
+      }
+      if (pos >= segments) {
+        return value[segments];
+      }
+      int i = (int)pos;
+      return value[i] + (value[i+1] - value[i]) * (pos - i);
+    }
+
+    #if CONTROL_MATH == FIXED_MATH
+      /** Read a table built over 0 - 1 with a Q31 input. The values must be in the Q31 range
+       *
+       *  @param[in] x Input (0 - 1)
+       *  @returns Interpolated value of the function
+       */
+      q31_t get(q31_t x) const {
+        if (x <= 0) {
+          return valueQ[0];
+        }
+        //The top bits are the segment, the rest is the position in the segment
+        int i = x >> (31 - bits);
+        q31_t fraction = (uint32_t)x << bits & INT32_MAX;
+        return qAdd(valueQ[i], qMul(qSub(valueQ[i+1], valueQ[i]), fraction));
+      }
+    #endif
+
+  private:
+    ///Input at the start of the table
+    float inputMin = 0;
+    ///Segments per unit of input
+    float inputScale = segments;
+    ///Value of the function at the start of each segment, and the end of the last
+    float value[segments + 1] = {};
+    #if CONTROL_MATH == FIXED_MATH
+      ///Value of the function in Q31
+      q31_t valueQ[segments + 1] = {};
+    #endif
+};
+#endif
@@ -0,0 +1,93 @@
+#include "LoopWatchdog.h"
+
+void LoopWatchdog::init(Logger &logger) {
+  logger.loadSetting("watchdog", watchdog);
+  logger.loadSetting("stepDownOverrun", stepDownOverrun);
+  logger.loadSetting("stepUpMargin", stepUpMargin);
+  logger.loadSetting("stepUpWindows", stepUpWindows);
+  logger.loadSetting("shedLogDiv", shedLogDiv);
+  logger.loadSetting("reducedLoopRate", reducedLoopRate);
+  shedLogDiv = max(shedLogDiv, 1);
+  reducedLoopRate = min(max(reducedLoopRate, 1), loopRate);
+  level = 0;
+  loopPeriod = 1000000/loopRate;
+}
+
+bool LoopWatchdog::update(unsigned long workTime, unsigned long late, micros_t now) {
+  changed = false;
+  if (lastTime != 0) {
+    levelTime[level] += microsToSeconds(now - lastTime);
+  }
+  lastTime = now;
+  //A wait which ran late made the last loop take longer than the loop time
+  unsigned long busy = max(workTime, late > 0 ? loopPeriod + late : 0);
+  slowestEver = max(slowestEver, busy);
+  if (!watchdog) {
+    return false;
+  }
+
+  //Count the time the loop and the last wait ran past their ticks
+  overrunSum += late;
+  if (workTime > loopPeriod) {
+    overrunSum += workTime - loopPeriod;
+  }
+  slowest = max(slowest, busy);
+  windowLoops++;
+  if (windowLoops < watchdogWindow * rate()) {
+    return false;
+  }
+
+  //At the end of each window go down a level if too much time was lost, or up once enough windows had room to spare
+  unsigned long windowTime = windowLoops * loopPeriod;
+  uint8_t overrun = min(overrunSum * 100 / windowTime, 255UL);
+  if (overrunSum * 100 > stepDownOverrun * windowTime) {
+    goodWindows = 0;
+    if (level < 3) {
+      setLevel(level + 1, now, overrun);
+    }
+  } else if (level > 0) {
+    unsigned long abovePeriod = level == 3 ? 1000000/loopRate : loopPeriod;
+    goodWindows = overrunSum == 0 and slowest * 100 <= stepUpMargin * abovePeriod ? goodWindows + 1 : 0;
+    if (goodWindows >= stepUpWindows) {
+      goodWindows = 0;
+      setLevel(level - 1, now, overrun);
+    }
+  }
+  windowLoops = 0;
+  overrunSum = 0;
+  slowest = 0;
+  return changed;
+}
+
+void LoopWatchdog::setLevel(uint8_t to, micros_t now, uint8_t overrun) {
+  if (eventCount < maxWatchdogEvents) {
+    events[eventCount] = {now, level, to, overrun};
+  }
+  eventCount++;
+  level = to;
+  loopPeriod = 1000000/rate();
+  changed = true;
+}
+
+bool LoopWatchdog::logDue() {
+  skippedLogs++;
+  if (level == 0 or changed or skippedLogs >= shedLogDiv) {
+    skippedLogs = 0;
+    return true;
+  }
+  return false;
+}
+
+String LoopWatchdog::summary() const {
+  String text = "Watchdog,Level changes," + String(eventCount) + ",Slowest loop (μs)," + String(slowestEver);
+  text += ",Time at each level (s)";
+  for (int i=0; i<4; i++) {
+    text += "," + String(levelTime[i], 2);
+  }
+  text += "\nLevel changes,Time (s),From,To,Overrun (%)";
+  for (uint32_t i=0; i<eventCount and i<maxWatchdogEvents; i++) {
+    const WatchdogEvent &event = events[i];
+    text += "\n," + String(microsToSeconds(event.time), 3) + "," + String(event.from) + "," + String(event.to) + "," + String(event.overrun);
+  }
+  return text;
+}
@@ -0,0 +1,123 @@
+#ifndef __LoopWatchdog_H__
+#define __LoopWatchdog_H__
+
+//Import files
+#include "Logger.h"
+
+/* Settings */
+///Length of the windows loop overruns are counted over (seconds)
+const float watchdogWindow = 0.1;
+///Number of level changes kept for the summary at the end of the flight
+const int maxWatchdogEvents = 32;
+/* Settings */
+
+
+/**
+ * @struct WatchdogEvent
+ * @brief A change of the degradation level
+ */
+struct WatchdogEvent {
+  ///Time of the loop the level changed in (μs since the flight started)
+  micros_t time;
+  ///Level before and after the change
+  uint8_t from, to;
+  ///Loop time lost to overruns in the window before the change (%)
+  uint8_t overrun;
+};
+
+/**
+ * @class LoopWatchdog
+ * @brief Notices loops that take longer than the loop time, and sheds work until they fit
+ *
+ * Each loop reports how long its work took before it waits for the next tick, and how far the last wait ran past its
+ * tick (e.g. writing the log). Over each window the time by which loops ran past the loop time is added up, and when it is more than stepDownOverrun percent of the window the watchdog
+ * goes down one level of the ladder:
+ *   0: everything runs
+ *   1: the log only records every shedLogDiv loops
+ *   2: telemetry is not updated either
+ *   3: the loop rate drops to reducedLoopRate
+ *
+ * It only goes back up one level after stepUpWindows windows in a row without an overrun, in which the slowest loop
+ * also fitted in stepUpMargin percent of the loop time of the level above. At level 1 the slowest loop is one that logs,
+ * so it shows whether full logging would fit again. The gap between the margin and the overrun that steps down keeps
+ * the level from flapping when the loop time is close to the limit.
+ */
+class LoopWatchdog {
+  public:
+    /** Loads the settings and starts at level 0
+     *
+     *  @param[in] logger Logger to load the settings with
+     */
+    void init(Logger &logger);
+    /** Accounts for one loop
+     *
+     *  @param[in] workTime Time the loop took before waiting for the next tick (μs)
+     *  @param[in] late Time the last wait ran past its tick (μs)
+     *  @param[in] now Time of the loop (μs since the flight started)
+     *  @returns true if the level changed
+     */
+    bool update(unsigned long workTime, unsigned long late, micros_t now);
+    /** Whether this loop should be logged, always true in the loop the level changes in so every change is in the log */
+    bool logDue();
+    /** Whether telemetry should be updated */
+    bool telemetryDue() const {
+      return level < 2;
+    }
+    /** Loop rate of the current level (Hz) */
+    int rate() const {
+      return level < 3 ? loopRate : reducedLoopRate;
+    }
+    /** Summary of the flight for the end of the log, the time at each level and every change
+     *
+     *  Uses the heap, so should only be called once the flight is over (see Memory.h).
+     */
+    String summary() const;
+
+    ///Degradation level, 0 - 3
+    uint8_t level = 0;
+    ///Loop time of the current level (μs)
+    unsigned long loopPeriod = 1000000/loopRate;
+
+    /* Settings */
+    ///Whether loop overruns shed work
+    bool watchdog = true;
+    ///Loop time lost to overruns in a window which steps down a level (%)
+    float stepDownOverrun = 5;
+    ///Slowest loop allowed in a window to step up, as a part of the loop time of the level above (%)
+    float stepUpMargin = 80;
+    ///Windows in a row which have to allow it before stepping up
+    int stepUpWindows = 10;
+    ///Only every shedLogDiv loops are logged from level 1
+    int shedLogDiv = 4;
+    ///Loop rate at level 3 (Hz)
+    int reducedLoopRate = 1000;
+    /* Settings */
+
+  private:
+    /** Changes the level and records the change */
+    void setLevel(uint8_t to, micros_t now, uint8_t overrun);
+
+    ///Loops counted in the current window
+    int windowLoops = 0;
+    ///Loop time lost to overruns in the current window (μs)
+    unsigned long overrunSum = 0;
+    ///Slowest loop in the current window (μs)
+    unsigned long slowest = 0;
+    ///Windows in a row which allow stepping up
+    int goodWindows = 0;
+    ///Whether the level changed in the last loop
+    bool changed = false;
+    ///Loops since the last logged loop
+    int skippedLogs = 0;
+    ///Time of the last loop (μs since the flight started)
+    micros_t lastTime = 0;
+    ///Time spent at each level (seconds)
+    float levelTime[4] = {};
+    ///Slowest loop of the flight (μs)
+    unsigned long slowestEver = 0;
+    ///Changes of the level, the first maxWatchdogEvents are kept
+    WatchdogEvent events[maxWatchdogEvents];
+    ///Number of changes, including the ones not kept
+    uint32_t eventCount = 0;
+};
+#endif
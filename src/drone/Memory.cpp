@@ -0,0 +1,60 @@
+//The Teensy 4 version, the host build gets these from src/host/hal/HostMemory.cpp
+#if defined(__IMXRT1062__)
+#include "Memory.h"
+
+#include <Arduino.h>
+
+//Set by the Teensy 4 linker script, the stack grows down from _estack towards the end of the variables in DTCM
+extern unsigned long _ebss;
+extern unsigned long _estack;
+
+///Value the free stack is filled with
+const uint32_t stackPattern = 0xA5A5A5A5;
+
+///True between lockHeap() and unlockHeap()
+static bool heapLocked = false;
+///Heap calls made while the heap was locked
+static volatile uint32_t heapCalls = 0;
+///Top of the painted stack, the stack pointer when paintStack() was called
+static uint32_t *paintTop = nullptr;
+
+//newlib calls these around every malloc, realloc and free
+extern "C" void __malloc_lock(struct _reent *) {
+  if (heapLocked) {
+    heapCalls++;
+  }
+}
+extern "C" void __malloc_unlock(struct _reent *) {}
+
+void lockHeap() {
+  heapLocked = true;
+}
+
+void unlockHeap() {
+  heapLocked = false;
+}
+
+uint32_t heapViolations() {
+  return heapCalls;
+}
+
+void paintStack() {
+  //Leave some room below the frame for this function's variables
+  uint32_t *top = (uint32_t *)__builtin_frame_address(0) - 16;
+  for (uint32_t *word = &_ebss; word < top; word++) {
+    *word = stackPattern;
+  }
+  paintTop = top;
+}
+
+uint32_t stackHighWater() {
+  if (!paintTop) {
+    return 0;
+  }
+  uint32_t *word = &_ebss;
+  while (word < paintTop and *word == stackPattern) {
+    word++;
+  }
+  return (paintTop - word) * sizeof(uint32_t);
+}
+#endif
@@ -0,0 +1,28 @@
+#ifndef __Memory_H__
+#define __Memory_H__
+
+/*
+ * The main loop only uses static memory. Everything which needs the heap (settings, log file names, the Teensy_PWM
+ * objects) is set up by setup(), which then calls lockHeap(). Heap use after that is counted on the Teensy and aborts
+ * the host build (see src/host/hal/HostMemory.cpp), so a new String in the loop is found by the simulator.
+ *
+ * The stack is painted with a pattern at the same time, the deepest word which no longer holds the pattern gives the
+ * most stack the loop has used. Static RAM and flash of each module are reported by `make footprint` in src/host.
+ */
+
+//Import libraries
+#include <stdint.h>
+
+/** Stops heap use from here on. Called at the end of setup() */
+void lockHeap();
+/** Allows heap use again, used after the flight to write the log */
+void unlockHeap();
+/** Gets the number of heap calls (allocations and frees) since lockHeap() */
+uint32_t heapViolations();
+
+/** Fills the free stack below the caller with a pattern, so stackHighWater() can find how deep the stack goes */
+void paintStack();
+/** Gets the most stack used (bytes) below the painted top since paintStack() was called. The top is a little below the
+ *  caller of paintStack(), as its own variables are not painted */
+uint32_t stackHighWater();
+#endif
@@ -0,0 +1,231 @@
+#ifndef __Mixer_H__
+#define __Mixer_H__
+
+//Different frame types defined here
+#define QUAD_X 0
+#define QUAD_PLUS 1
+#define HEX_X 2
+#define OCTO_X 3
+
+//Select which frame to use
+#ifndef FRAME_TYPE
+  #define FRAME_TYPE QUAD_X
+#endif
+
+//Import files
+#include "FixedPoint.h"
+
+
+/**
+ * @struct MixerMatrix
+ * @brief How much each motor changes per unit of roll, pitch and yaw, and which pin controls it
+ */
+template <int N> struct MixerMatrix {
+  ///Change per unit of roll of each motor
+  float roll[N];
+  ///Change per unit of pitch of each motor
+  float pitch[N];
+  ///Change per unit of yaw of each motor
+  float yaw[N];
+  ///Which pin controls each motor
+  int pins[N];
+};
+
+/**
+ * @struct Frame
+ * @brief Mixing matrix of a frame type, specialised for each frame
+ */
+template <int frameType> struct Frame;
+
+/** Quad in X configuration. Order: {FL, FR, BL, BR} */
+template <> struct Frame<QUAD_X> {
+  static constexpr int motorCount = 4;
+  static constexpr MixerMatrix<4> matrix() {
+    return {{ 1, -1,  1, -1},
+            { 1,  1, -1, -1},
+            { 1, -1, -1,  1},
+            {23, 22, 21, 20}};
+  }
+};
+
+/** Quad in + configuration. Order: {F, R, B, L} */
+template <> struct Frame<QUAD_PLUS> {
+  static constexpr int motorCount = 4;
+  static constexpr MixerMatrix<4> matrix() {
+    return {{ 0, -1,  0,  1},
+            { 1,  0, -1,  0},
+            { 1, -1,  1, -1},
+            {23, 22, 21, 20}};
+  }
+};
+
+/** Hexacopter in X configuration. Order (clockwise): {FL, FR, R, BR, BL, L} */
+template <> struct Frame<HEX_X> {
+  static constexpr int motorCount = 6;
+  static constexpr MixerMatrix<6> matrix() {
+    return {{  .5f,   -.5f, -1,   -.5f,    .5f, 1},
+            {.866f,  .866f,  0, -.866f, -.866f, 0},
+            {    1,     -1,  1,     -1,      1, -1},
+            {   23,     22, 21,     20,     19, 18}};
+  }
+};
+
+/** Octocopter in X configuration. Order (clockwise): {FFL, FFR, RFR, RBR, BBR, BBL, LBL, LFL} */
+template <> struct Frame<OCTO_X> {
+  static constexpr int motorCount = 8;
+  static constexpr MixerMatrix<8> matrix() {
+    return {{.414f, -.414f,    -1,     -1, -.414f,  .414f,      1,     1},
+            {    1,      1, .414f, -.414f,     -1,     -1, -.414f, .414f},
+            {    1,     -1,     1,     -1,      1,     -1,      1,    -1},
+            {   23,     22,    21,     20,     19,     18,     17,    16}};
+  }
+};
+
+/**
+ * @class Mixer
+ * @brief Mixes the throttle, roll, pitch and yaw into the power of each motor
+ *
+ * The loops over the motors are unrolled at compile time using the frame's mixing matrix.
+ * If a motor would go above maxPower or below zero power the throttle is shifted to keep the roll, pitch and yaw differences
+ * (airmode). If the differences are larger than the power range they are scaled down together.
+ */
+template <int frameType> class Mixer {
+  public:
+    ///Number of motors on the frame
+    static constexpr int motorCount = Frame<frameType>::motorCount;
+
+    /** Mix the throttle and the change in roll, pitch and yaw (floating point)
+     *
+     *  @param[in] throttle Base power of all motors (0 - 1)
+     *  @param[in] axis Change in motor power of roll, pitch & yaw
+     *  @param[in] offset Base power difference of each motor
+     *  @param[out] motorPower Power of each motor (0 - maxPower)
+     *  @param[in] maxPower Highest power a motor can give (0 - 1)
+     *  @returns true if the roll, pitch and yaw had to be scaled down
+     */
+    static bool mix(float throttle, const float axis[3], const float offset[], float motorPower[], float maxPower = 1) {
+      float minChange, maxChange;
+      Unroll<motorCount>::change(axis, offset, motorPower, minChange, maxChange);
+
+      //Scale the change down if it cannot fit in the motor power range
+      bool scaled = maxChange - minChange > maxPower;
+      if (scaled) {
+        float scale = maxPower / (maxChange - minChange);
+        Unroll<motorCount>::scale(scale, motorPower);
+        minChange *= scale;
+        maxChange *= scale;
+      }
+
+      //Shift the throttle so no motor goes above maxPower or below zero power
+      if (throttle > maxPower - maxChange) {
+        throttle = maxPower - maxChange;
+      }
+      if (throttle < -minChange) {
+        throttle = -minChange;
+      }
+      Unroll<motorCount>::add(throttle, maxPower, motorPower);
+      return scaled;
+    }
+
+    /** Mix the throttle and the change in roll, pitch and yaw (fixed point)
+     *
+     *  @param[in] throttle Base power of all motors (0 - 1)
+     *  @param[in] axis Change in motor power of roll, pitch & yaw
+     *  @param[in] offset Base power difference of each motor
+     *  @param[out] motorPower Power of each motor (0 - maxPower)
+     *  @param[in] maxPower Highest power a motor can give (0 - 1)
+     *  @returns true if the roll, pitch and yaw had to be scaled down
+     */
+    static bool mix(q31_t throttle, const q31_t axis[3], const q31_t offset[], q31_t motorPower[],
+                    q31_t maxPower = INT32_MAX) {
+      q31_t minChange, maxChange;
+      Unroll<motorCount>::change(axis, offset, motorPower, minChange, maxChange);
+
+      //Scale the change down if it cannot fit in the motor power range
+      int64_t range = (int64_t)maxChange - minChange;
+      bool scaled = range > maxPower;
+      if (scaled) {
+        q31_t scale = ((int64_t)maxPower << 31) / range;
+        Unroll<motorCount>::scale(scale, motorPower);
+        minChange = qMul(minChange, scale);
+        maxChange = qMul(maxChange, scale);
+      }
+
+      //Shift the throttle so no motor goes above maxPower or below zero power
+      throttle = qClamp(throttle, qNeg(minChange), qSub(maxPower, maxChange));
+      Unroll<motorCount>::add(throttle, maxPower, motorPower);
+      return scaled;
+    }
+
+  private:
+    /**
+     * @struct Unroll
+     * @brief Runs an operation on motors 0 to I-1, unrolled at compile time
+     */
+    template <int I, int dummy=0> struct Unroll {
+      ///Mixing coefficients of motor I-1
+      static constexpr float roll = Frame<frameType>::matrix().roll[I-1];
+      static constexpr float pitch = Frame<frameType>::matrix().pitch[I-1];
+      static constexpr float yaw = Frame<frameType>::matrix().yaw[I-1];
+
+      /** Calculates the change of each motor and the smallest and largest change */
+      static inline void change(const float axis[3], const float offset[], float out[], float &minChange, float &maxChange) {
+        Unroll<I-1>::change(axis, offset, out, minChange, maxChange);
+        out[I-1] = axis[0]*roll + axis[1]*pitch + axis[2]*yaw + offset[I-1];
+        if (I == 1 or out[I-1] < minChange) {
+          minChange = out[I-1];
+        }
+        if (I == 1 or out[I-1] > maxChange) {
+          maxChange = out[I-1];
+        }
+      }
+      static inline void change(const q31_t axis[3], const q31_t offset[], q31_t out[], q31_t &minChange, q31_t &maxChange) {
+        Unroll<I-1>::change(axis, offset, out, minChange, maxChange);
+        constexpr q31_t rollQ = toQ31(roll);
+        constexpr q31_t pitchQ = toQ31(pitch);
+        constexpr q31_t yawQ = toQ31(yaw);
+        out[I-1] = qAdd(qAdd(qAdd(qMul(axis[0], rollQ), qMul(axis[1], pitchQ)), qMul(axis[2], yawQ)), offset[I-1]);
+        if (I == 1 or out[I-1] < minChange) {
+          minChange = out[I-1];
+        }
+        if (I == 1 or out[I-1] > maxChange) {
+          maxChange = out[I-1];
+        }
+      }
+      /** Multiplies the power of each motor by scale */
+      static inline void scale(float scale, float out[]) {
+        Unroll<I-1>::scale(scale, out);
+        out[I-1] *= scale;
+      }
+      static inline void scale(q31_t scale, q31_t out[]) {
+        Unroll<I-1>::scale(scale, out);
+        out[I-1] = qMul(out[I-1], scale);
+      }
+      /** Adds the throttle to the power of each motor, keeping it between 0 and maxPower */
+      static inline void add(float throttle, float maxPower, float out[]) {
+        Unroll<I-1>::add(throttle, maxPower, out);
+        out[I-1] += throttle;
+        out[I-1] = out[I-1] < 0 ? 0 : (out[I-1] > maxPower ? maxPower : out[I-1]);
+      }
+      static inline void add(q31_t throttle, q31_t maxPower, q31_t out[]) {
+        Unroll<I-1>::add(throttle, maxPower, out);
+        out[I-1] = qClamp(qAdd(out[I-1], throttle), 0, maxPower);
+      }
+    };
+    template <int dummy> struct Unroll<0, dummy> {
+      static inline void change(const float axis[3], const float offset[], float out[], float &minChange, float &maxChange) {}
+      static inline void change(const q31_t axis[3], const q31_t offset[], q31_t out[], q31_t &minChange, q31_t &maxChange) {}
+      static inline void scale(float scale, float out[]) {}
+      static inline void scale(q31_t scale, q31_t out[]) {}
+      static inline void add(float throttle, float maxPower, float out[]) {}
+      static inline void add(q31_t throttle, q31_t maxPower, q31_t out[]) {}
+    };
+};
+
+///Mixer of the selected frame
+typedef Mixer<FRAME_TYPE> FrameMixer;
+///Number of motors on the selected frame
+constexpr int motorCount = FrameMixer::motorCount;
+///Mixing matrix of the selected frame
+constexpr MixerMatrix<motorCount> frameMatrix = Frame<FRAME_TYPE>::matrix();
+#endif
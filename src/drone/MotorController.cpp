@@ -5,91 +5,348 @@ int toInt(float f){
   return int(f + .5);
 }
 
+#if SYNC_ESC
+  IntervalTimer MotorController::pulseTimer;
+  uint8_t MotorController::pulsePins[motorCount];
+  uint8_t MotorController::groupSize[motorCount];
+  float MotorController::groupGap[motorCount];
+  uint8_t MotorController::groupCount = 0;
+  volatile uint8_t MotorController::nextGroup = 0;
+  uint8_t MotorController::nextPulse = 0;
+#endif
+
 void MotorController::init(Logger &logger) {
   //Load settings from the SD card
-  logger.loadSetting("motorOffset", offset, 4);
+  logger.loadSetting("motorOffset", offset, motorCount);
   logger.loadSetting("defaultZ", defaultZ);
   logger.loadSetting("maxZdiff", maxZdiff, 2);
   logger.loadSetting("potMaxDiff", potMaxDiff);
+  logger.loadSetting("thrustCurve", thrustCurve);
+  logger.loadSetting("batteryPin", batteryPin);
+  logger.loadSetting("voltageScale", voltageScale);
+  logger.loadSetting("nominalVoltage", nominalVoltage);
   #if ESC_TYPE == ONESHOT125
     logger.loadSetting("signalFreq", signalFreq);
     maxDutyCycle = signalFreq/40.0f;
+    dutyCyclePerMille = maxDutyCycle/2.0f/1000.0f;
+  #elif DSHOT_ESC
+    logger.loadSetting("bidirectional", bidirectional);
+    logger.loadSetting("motorPoles", motorPoles);
   #endif
 
-  //Arm ESCs
-  while (millis() < 2500); //Wait for ESC startup
-  digitalWrite(lightPin, HIGH);
-  for (int i=0; i<4; i++){
-    #if ESC_TYPE == PWM
-      ESCsignal[i].attach(motors[i], 1000, 2000);
-    #elif ESC_TYPE == ONESHOT125
-      ESCsignal[i] = new Teensy_PWM(motors[i], signalFreq, 0.0f);
-    #endif
-    writeToMotor(i, 0);
+  #if CONTROL_MATH == FIXED_MATH
+    //Convert the settings to fixed point
+    defaultZQ = toQ31(defaultZ);
+    potMaxDiffQ = toQ31(potMaxDiff);
+    for (int i=0; i<2; i++) {
+      zDiffGain[i] = toGain(maxZdiff[i] * 128/127);
+    }
+    for (int i=0; i<motorCount; i++) {
+      offsetChange[i] = toQ31(offset[i]/100);
+    }
+  #else
+    for (int i=0; i<motorCount; i++) {
+      offsetChange[i] = offset[i]/100;
+    }
+  #endif
+
+  //Thrust is modelled as (1-thrustCurve)*command + thrustCurve*command^2, the table holds the inverse
+  float k = thrustCurve;
+  thrustTable.build([k](float thrust) {
+    if (k <= 0) {
+      return thrust;
+    }
+    return (sqrtf((1-k)*(1-k) + 4*k*thrust) - (1-k)) / (2*k);
+  }, 0, 1);
+
+  //Motor speed is roughly proportional to voltage times command, so scale the command by the voltage drop
+  float nominal = nominalVoltage;
+  voltageTable.build([nominal](float voltage) {
+    return nominal / voltage;
+  }, nominalVoltage * .7f, nominalVoltage * 1.2f);
+  if (batteryPin >= 0) {
+    pinMode(batteryPin, INPUT);
+    updateVoltage();
   }
-  delay(2000);
-  digitalWrite(lightPin, LOW);
-
-  //Test spin motors
-  for (int i=0; i<4; i++){
-    delay(100);
-    digitalWrite(lightPin, HIGH);
-    writeToMotor(i, 55);
-    delay(300);
-    writeToMotor(i, 0);
-    digitalWrite(lightPin, LOW);
+
+  //Arming is run by updateArming()
+  armingStage = 0;
+  stageStartTime = millis();
+}
+
+bool MotorController::updateArming(bool allowTestSpin) {
+  unsigned long stageTime = millis() - stageStartTime;
+
+  switch (armingStage) {
+    case 0:
+      //Wait for ESC startup
+      if (millis() >= 2500) {
+        for (int i=0; i<motorCount; i++){
+          #if ESC_TYPE == PWM
+            ESCsignal[i].attach(frameMatrix.pins[i], 1000, 2000);
+          #elif ESC_TYPE == ONESHOT125
+            //The constructor only stores the settings, setPWM() starts the carrier
+            ESCsignal[i] = new Teensy_PWM(frameMatrix.pins[i], signalFreq, 0.0f);
+            ESCsignal[i]->setPWM(frameMatrix.pins[i], signalFreq, 0.0f);
+            sentDutyCycle[i] = 0;
+          #elif SYNC_ESC
+            pinMode(frameMatrix.pins[i], OUTPUT);
+            digitalWriteFast(frameMatrix.pins[i], LOW);
+          #endif
+          writeToMotor(i, 0);
+        }
+        #if DSHOT_ESC
+          //A motor pin the DMA cannot drive would leave that motor without a signal, so arming stops
+          if (!dshot.init(frameMatrix.pins, motorCount, dshotBitRate, bidirectional)) {
+            outputFailed = true;
+            return false;
+          }
+        #endif
+        nextStage();
+      }
+      break;
+    case 1:
+      //Arm ESCs
+      if (stageTime >= 2000) {
+        nextStage();
+      }
+      break;
+    case 2:
+      //Do not test spin the motors until the other startup tasks are finished, the vibration would affect the IMU calibration
+      if (allowTestSpin and stageTime >= 100) {
+        digitalWrite(lightPin, HIGH);
+        writeToMotor(testMotor, 55);
+        nextStage();
+      }
+      break;
+    case 3:
+      //Test spin each motor in turn
+      if (stageTime >= 300) {
+        writeToMotor(testMotor, 0);
+        digitalWrite(lightPin, LOW);
+        testMotor++;
+        if (testMotor < motorCount) {
+          armingStage = 2;
+          stageStartTime = millis();
+        } else {
+          nextStage();
+        }
+      }
+      break;
+    case 4:
+      //Give the motor some time to stop spinning before continuing with the program
+      if (stageTime >= 250) {
+        nextStage();
+      }
+      break;
   }
 
-  //Give the motor some time to stop spinning before continuing with the program
-  delay(250);
+  //Keep sending the signal to the ESCs, they need it to arm
+  if (armingStage > 0) {
+    commit();
+  }
+  return armingStage == 5;
+}
+
+void MotorController::nextStage() {
+  armingStage++;
+  stageStartTime = millis();
+}
+
+void MotorController::addChange(ctrl_t PIDchange[3][3]) {
+  for (int i=0; i<3; i++) {
+    #if CONTROL_MATH == FIXED_MATH
+      axisChange[i] = qAdd(qAdd(PIDchange[0][i], PIDchange[1][i]), PIDchange[2][i]);
+    #else
+      axisChange[i] = PIDchange[0][i] + PIDchange[1][i] + PIDchange[2][i];
+    #endif
+  }
 }
 
-void MotorController::addChange(float PIDchange[3][3], int axis, int pA, int pB, int nA, int nB) {
-  float change = PIDchange[0][axis] + PIDchange[1][axis] + PIDchange[2][axis];
+void MotorController::write(const RcCommand &rc, SharedState<MotorOutput> &output) {
+  //The battery voltage changes slowly so it does not need to be read every loop
+  if (batteryPin >= 0 and ++voltageReadCount >= voltageReadDiv) {
+    voltageReadCount = 0;
+    updateVoltage();
+  }
+
+  #if CONTROL_MATH == FIXED_MATH
+    //Set initial motor power
+    q31_t power = qAdd(defaultZQ, qMul(toQ31(rc.potPercent), potMaxDiffQ));
+    power = qAdd(power, qScale(stickToQ31(rc.xyzr[2]), rc.xyzr[2] < 0 ? zDiffGain[0] : zDiffGain[1]));
+    initialPower = qToFloat(power);
+
+    //Mix the roll, pitch and yaw into each motor
+    q31_t mixed[motorCount];
+    desaturated = FrameMixer::mix(power, axisChange, offsetChange, mixed, maxThrustQ);
+    for (int i=0; i<motorCount; i++){
+      //Convert thrust to a motor command
+      q31_t command = qScale(thrustTable.get(mixed[i]), voltageGainQ);
+      //Convert to 0 - 1000, rounded
+      motorPower[i] = (toQ15(command) * 1000 + (1 << 14)) >> 15;
+    }
+  #else
+    //Set initial motor power
+    if (rc.xyzr[2] < 0) {
+      initialPower = defaultZ + (rc.potPercent*potMaxDiff) + (maxZdiff[0] * rc.xyzr[2]/127);
+    } else {
+      initialPower = defaultZ + (rc.potPercent*potMaxDiff) + (maxZdiff[1] * rc.xyzr[2]/127);
+    }
 
-  if (abs(change) > .001) {
-    dynamicChange[pA] += change;
-    dynamicChange[pB] += change;
+    //Mix the roll, pitch and yaw into each motor
+    float mixed[motorCount];
+    desaturated = FrameMixer::mix(initialPower, axisChange, offsetChange, mixed, maxThrust);
+    for (int i=0; i<motorCount; i++){
+      //Convert thrust to a motor command
+      float command = thrustTable.get(mixed[i]) * voltageGain;
+      motorPower[i] = min(command, 1.0f) * 1000;
+    }
+  #endif
 
-    dynamicChange[nA] -= change - .001;
-    dynamicChange[nB] -= change - .001;
+  //Stage the output, it is sent to the motors by commit()
+  MotorOutput state;
+  for (int i=0; i<motorCount; i++){
+    writeToMotor(i, motorPower[i]);
+    state.motorPower[i] = motorPower[i];
+    state.rpm[i] = rpm[i];
   }
+
+  //Publish the motor output
+  state.timestamp = clockMicros();
+  output.publish(state);
 }
 
-void MotorController::write() {
-  //Set initial motor power
-  if (xyzr[2] < 0) {
-    initialPower = defaultZ + (potPercent*potMaxDiff) + (maxZdiff[0] * xyzr[2]/127);
+void MotorController::updateVoltage() {
+  float voltage = analogRead(batteryPin) * voltageScale;
+  if (batteryVoltage == 0) {
+    batteryVoltage = voltage;
   } else {
-    initialPower = defaultZ + (potPercent*potMaxDiff) + (maxZdiff[1] * xyzr[2]/127);
+    batteryVoltage += (voltage - batteryVoltage) * .1f;
   }
 
-  //Apply output to motor
-  for (int i=0; i<4; i++){
-    motorPower[i] = initialPower;
-    motorPower[i] += dynamicChange[i];
-    motorPower[i] += offset[i]/100;
-    motorPower[i] = min(max(0.0f, motorPower[i]*1000), 1000.0f); //Limit values to 0 - 1000
+  voltageGain = voltageTable.get(batteryVoltage);
 
-    //Round motor power and apply it to the ESC
-    writeToMotor(i, motorPower[i]);
+  //Below nominal voltage the command is scaled up, so full command is reached before full thrust. Mixing into the
+  //thrust which needs full command makes the mixer desaturate instead of the command being clipped
+  float command = min(1 / voltageGain, 1.0f);
+  float k = max(thrustCurve, 0.0f);
+  maxThrust = (1-k)*command + k*command*command;
+  #if CONTROL_MATH == FIXED_MATH
+    voltageGainQ = toGain(voltageGain);
+    maxThrustQ = toQ31(maxThrust);
+  #endif
+}
+
+bool MotorController::commit() {
+  #if ESC_TYPE == PWM
+    for (int i=0; i<motorCount; i++){
+      ESCsignal[i].writeMicroseconds(1000 + toInt(stagedValue[i]));
+    }
+  #elif ESC_TYPE == ONESHOT125
+    for (int i=0; i<motorCount; i++){
+      //Map 0 - 1000 to half of maxDutyCycle - maxDutyCycle
+      float dutyCycle = maxDutyCycle/2.0f + stagedValue[i]*dutyCyclePerMille;
+      //Only change the duty cycle, setting the frequency again would reconfigure the timer
+      if (dutyCycle != sentDutyCycle[i]) {
+        ESCsignal[i]->setPWM_DCPercentage_manual(frameMatrix.pins[i], dutyCycle);
+        sentDutyCycle[i] = dutyCycle;
+      }
+    }
+  #elif SYNC_ESC
+    //Wait for the last pulses to end, and leave a gap before the next ones
+    if (nextGroup < groupCount or clockMicros() - pulseStartTime < lastPulseLength + minPulse) {
+      return false;
+    }
+
+    //Sort the pulses by length, shortest first
+    float length[motorCount];
+    for (int i=0; i<motorCount; i++){
+      float pulse = minPulse + stagedValue[i]*pulsePerMille;
+      int j = i;
+      for (; j > 0 and length[j-1] > pulse; j--) {
+        length[j] = length[j-1];
+        pulsePins[j] = pulsePins[j-1];
+      }
+      length[j] = pulse;
+      pulsePins[j] = frameMatrix.pins[i];
+    }
+
+    //Pulses ending too close together to use separate interrupts are ended by the same one
+    float lastEnd = 0;
+    groupCount = 0;
+    for (int i=0; i<motorCount; i++){
+      if (groupCount > 0 and length[i] - lastEnd < minPulseGap) {
+        groupSize[groupCount-1]++;
+      } else {
+        groupGap[groupCount] = length[i] - lastEnd;
+        groupSize[groupCount] = 1;
+        lastEnd = length[i];
+        groupCount++;
+      }
+    }
+    lastPulseLength = length[motorCount-1];
 
-    dynamicChange[i] = 0;
+    //Start all pulses at the same time
+    noInterrupts();
+    nextGroup = 0;
+    nextPulse = 0;
+    for (int i=0; i<motorCount; i++){
+      digitalWriteFast(frameMatrix.pins[i], HIGH);
+    }
+    pulseTimer.begin(endPulses, groupGap[0]);
+    if (groupCount > 1) {
+      pulseTimer.update(groupGap[1]);
+    }
+    interrupts();
+    pulseStartTime = clockMicros();
+  #elif DSHOT_ESC
+    if (outputFailed) {
+      return false;
+    }
+
+    //Read the RPM replies to the last frames
+    uint32_t erpm[motorCount];
+    if (bidirectional and dshot.readReplies(erpm)) {
+      for (int i=0; i<motorCount; i++){
+        if (erpm[i] != dshotInvalid) {
+          rpm[i] = erpm[i] / (motorPoles / 2.0f);
+        }
+      }
+    }
+
+    uint16_t values[motorCount];
+    for (int i=0; i<motorCount; i++){
+      values[i] = dshotThrottle(stagedValue[i]);
+    }
+    return dshot.send(values);
+  #endif
+  return true;
+}
+
+#if SYNC_ESC
+void MotorController::endPulses() {
+  for (int i=0; i<groupSize[nextGroup]; i++) {
+    digitalWriteFast(pulsePins[nextPulse], LOW);
+    nextPulse++;
+  }
+  nextGroup++;
+
+  if (nextGroup == groupCount) {
+    pulseTimer.end();
+  } else if (nextGroup+1 < groupCount) {
+    //The interval to the next interrupt was loaded when this one fired, so load the one after it
+    pulseTimer.update(groupGap[nextGroup+1]);
   }
 }
+#endif
 
 void MotorController::writeZero() {
-  for (int i=0; i<4; i++){
+  for (int i=0; i<motorCount; i++){
     writeToMotor(i, 0);
   }
+  commit();
 }
 
 void MotorController::writeToMotor(int index, float value) {
-  value = max(0.0f min(value, 1000.0f));
-  #if ESC_TYPE == PWM
-    ESCsignal[index].writeMicroseconds(1000 + toInt(value));
-  #elif ESC_TYPE == ONESHOT125
-    value = map(value, 0.0f, 1000.0f, maxDutyCycle/2.0f, maxDutyCycle);
-    ESCsignal[index]->setPWM(motors[index], signalFreq, value);
-  #endif
+  stagedValue[index] = max(0.0f, min(value, 1000.0f));
 }
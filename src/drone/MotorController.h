@@ -4,9 +4,21 @@
 //ESC signal type defenitions
 #define PWM 1 //1000 to 2000 μs pulse length
 #define ONESHOT125 2 //125 to 250 μs pulse length
+#define ONESHOT125_SYNC 3 //125 to 250 μs pulse length, one pulse per loop started on all motors at once
+#define MULTISHOT 4 //5 to 25 μs pulse length, one pulse per loop started on all motors at once
+#define DSHOT150 5 //Digital, 150 kbit/s
+#define DSHOT300 6 //Digital, 300 kbit/s
+#define DSHOT600 7 //Digital, 600 kbit/s
 
 //Set ESC signal type
-#define ESC_TYPE ONESHOT125
+#ifndef ESC_TYPE
+  #define ESC_TYPE ONESHOT125
+#endif
+
+//Whether the ESC signal is sent as one pulse per loop
+#define SYNC_ESC (ESC_TYPE == ONESHOT125_SYNC || ESC_TYPE == MULTISHOT)
+//Whether the ESC signal is DShot
+#define DSHOT_ESC (ESC_TYPE == DSHOT150 || ESC_TYPE == DSHOT300 || ESC_TYPE == DSHOT600)
 
 
 //Import libraries
@@ -14,14 +26,20 @@
   #include <Servo.h>
 #elif ESC_TYPE == ONESHOT125
   #include <Teensy_PWM.h>
+#elif SYNC_ESC
+  #include <IntervalTimer.h>
+#elif DSHOT_ESC
+  #include "DShotOutput.h"
 #endif
 
 //Import files
+#include "FixedPoint.h"
 #include "Logger.h"
+#include "LookupTable.h"
+#include "Mixer.h"
+#include "StateBus.h"
 
 extern const int lightPin;
-extern int xyzr[4];
-extern float potPercent;
 
 
 /** Rounds a float to the nearest integer */
@@ -33,68 +51,179 @@ int toInt(float f);
  */
 class MotorController {
   public:
-    /** Load settings from storage. Arm ESCs and test spin the motors
+    /** Load settings from storage and start arming the ESCs
      *  
      *  @param[in] logger Logger object to read the settings from
      */
     void init(Logger &logger);
-    /** Use the PID controls to add a change per motor on a certain axis.
+    /** Runs the next step of arming the ESCs and test spinning the motors without blocking.
      *  
-     *  The axis is split in two (positive and negative).
-     *  The positive side adds the change and the negative side subtracts the change.
+     *  @param[in] allowTestSpin Whether the motors are allowed to be test spun yet
+     *  @returns true once the motors are armed and have been test spun, never if outputFailed is set
+     */
+    bool updateArming(bool allowTestSpin);
+    /** Use the PID controls to set the change in roll, pitch and yaw, which is mixed into each motor by write()
      *  
      *  @param[in] PIDchange See PIDcontroller::PIDchange
-     *  @param[in] axis Which axis to add change to (0: roll, 1: pitch, 2:yaw)
-     *  @param[in] pA Index of motor A of the positive side
-     *  @param[in] pB Index of motor B of the positive side
-     *  @param[in] nA Index of motor A of the negative side
-     *  @param[in] nB Index of motor B of the negative side
      */
-    void addChange(float PIDchange[3][3], int axis, int pA, int pB, int nA, int nB);
-    /** Calculate motor percentages and write to ESC */
-    void write();
+    void addChange(ctrl_t PIDchange[3][3]);
+    /** Calculate motor percentages and stage them to be sent to the ESCs by commit()
+     *  
+     *  The change in roll, pitch and yaw is mixed into the motors using the frame's mixing matrix (see Mixer.h).
+     *  The mixed thrust of each motor is then converted to a motor command using the thrust and battery voltage tables.
+     *  
+     *  @param[in] rc Current input from the controller
+     *  @param[out] output State to publish the motor powers to
+     */
+    void write(const RcCommand &rc, SharedState<MotorOutput> &output);
+    /** Send the staged motor powers to all ESCs in one update. Call once at the end of each loop
+     *  
+     *  With ONESHOT125_SYNC and MULTISHOT a pulse is started on all motors at the same time.
+     *  Nothing is sent if the previous pulses have not finished, or finished less than a minimum pulse length ago.
+     *  
+     *  @returns true if the motor powers were sent
+     */
+    bool commit();
     /** Turns off all motors */
     void writeZero();
     
-    ///Percentage of each motor. Order: {FL, FR, BL, BR}
-    float motorPower[4];
+    ///Power of each motor, 0 - 1000. Order is set by the frame in Mixer.h
+    float motorPower[motorCount];
+    ///True if the roll, pitch and yaw had to be scaled down to fit in the motor power range in the last write. The range
+    ///ends at maxThrust, so this includes motors held back by the voltage compensation
+    bool desaturated = false;
+    ///True if the ESC signal could not be set up (a DShot motor pin the DMA cannot reach), nothing is sent to the motors
+    bool outputFailed = false;
+    ///RPM of each motor, from bidirectional DShot. 0 if it is not available
+    float rpm[motorCount] = {};
+    ///Filtered battery voltage (V). 0 if there is no battery pin
+    float batteryVoltage = 0;
+    ///Base motor power (0 - 1) of the last write, before the roll, pitch and yaw are mixed in
+    float initialPower = 0;
 
     /* Settings */
     ///Base percentage difference per motor. Can be set via SD card
-    float offset[4] = {0, 0, 0, 0};
+    float offset[motorCount] = {};
     ///Default motor percentage. Can be set via SD card
     float defaultZ = .35;
     ///Percentage z difference for joystick down & up, respectively. Can be set via SD card
     float maxZdiff[2] = {.1, .18};
     ///Max percentage difference of potentiometer which acts like a trim for the base motor power. Can be set via SD card
     float potMaxDiff = .1;
+    ///How much of the thrust rises with the square of the motor command, 0 (linear) - 1 (quadratic). Can be set via SD card
+    float thrustCurve = 0;
+    ///Pin reading the battery voltage through a divider, -1 if there is none. Can be set via SD card
+    int batteryPin = -1;
+    ///Battery voltage per ADC count (V). Can be set via SD card
+    float voltageScale = 3.3 * 11 / 1023;
+    ///Battery voltage the PID gains were tuned at (V), motor commands are scaled to give the same thrust at other voltages. Can be set via SD card
+    float nominalVoltage = 11.1;
+    #if DSHOT_ESC
+      ///Whether to use bidirectional DShot to read the RPM of each motor. Can be set via SD card
+      bool bidirectional = true;
+      ///Number of magnets in each motor, used to convert eRPM to RPM. Can be set via SD card
+      int motorPoles = 14;
+    #endif
     /* Settings */
 
   private:
-    /** Write to a motor with a certain value
+    /** Stage a value to be written to a motor by commit()
      * 
-     *  @param[in] index Index of the motor in the motors array
+     *  @param[in] index Index of the motor in the frame (see Mixer.h)
      *  @param[in] value Speed of motor, 0 - 1000
      */
     void writeToMotor(int index, float value);
+    /** Moves on to the next arming stage */
+    void nextStage();
+    /** Read and filter the battery voltage, then update the voltage compensation gain */
+    void updateVoltage();
 
-    ///Which pin controls which motor. Order: {FL, FR, BL, BR}
-    const int motors[4] = {23, 22, 21, 20};
-    ///Base motor power percentage at the start of each loop
-    float initialPower;
-    ///Percentage change of each motor. Usually from the PID controller
-    float dynamicChange[4];
+    ///Change in motor power of roll, pitch and yaw. Usually from the PID controller
+    ctrl_t axisChange[3] = {0, 0, 0};
+    ///Base motor power difference of each motor, from offset
+    ctrl_t offsetChange[motorCount];
+    ///Motor command (0 - 1) for each thrust (0 - 1)
+    LookupTable<6> thrustTable;
+    ///Motor command scale for each battery voltage
+    LookupTable<4> voltageTable;
+    ///Motor command scale for the current battery voltage
+    float voltageGain = 1;
+    ///Thrust (0 - 1) which needs full command at the current battery voltage, the mixer keeps the motors below it
+    float maxThrust = 1;
+    ///Number of writes since the battery voltage was read
+    int voltageReadCount = 0;
+    ///Number of writes between battery voltage reads
+    const int voltageReadDiv = 20;
+    ///Arming step. 0: waiting for ESC startup, 1: arming, 2: waiting to test spin, 3: test spinning, 4: stopping, 5: armed
+    uint8_t armingStage = 0;
+    ///Time the current arming step started (ms)
+    unsigned long stageStartTime;
+    ///Index of the motor being test spun
+    int testMotor = 0;
+    ///Value staged for each motor, 0 - 1000
+    float stagedValue[motorCount] = {};
     
     #if ESC_TYPE == PWM
       ///Holds the PWM signal being sent to each motor
-      Servo ESCsignal[4];
+      Servo ESCsignal[motorCount];
     #elif ESC_TYPE == ONESHOT125
       ///Holds the OneShot125 signal being sent to each motor
-      Teensy_PWM* ESCsignal[4];
+      Teensy_PWM* ESCsignal[motorCount];
       //Frequency of the signal being sent to the ESC (Hz)
       float signalFreq = 3500.0f;
       //Maximum duty cycle allowed to be sent to the ESC, depends on signalFreq
       float maxDutyCycle = signalFreq/40.0f;
+      //Duty cycle per 1/1000 of motor power
+      float dutyCyclePerMille = maxDutyCycle/2.0f/1000.0f;
+      ///Duty cycle last sent to each motor
+      float sentDutyCycle[motorCount];
+    #elif SYNC_ESC
+      /** Interrupt which ends the pulses due at this time and loads the interval after the next one */
+      static void endPulses();
+
+      ///Pulse length at zero power (μs)
+      const float minPulse = ESC_TYPE == MULTISHOT ? 5 : 125;
+      ///Pulse length per 1/1000 of motor power (μs)
+      const float pulsePerMille = ESC_TYPE == MULTISHOT ? .02 : .125;
+      ///Pulses ending closer together than this are ended in the same interrupt (μs)
+      const float minPulseGap = .5;
+      ///Time the last pulses were started (μs)
+      micros_t pulseStartTime = 0;
+      ///Length of the longest of the last pulses (μs)
+      float lastPulseLength = 0;
+
+      ///Timer which ends the pulses
+      static IntervalTimer pulseTimer;
+      ///Pins of the motors in the order their pulses end
+      static uint8_t pulsePins[motorCount];
+      ///Number of pulses ended by each interrupt
+      static uint8_t groupSize[motorCount];
+      ///Time from the previous interrupt (or the start of the pulses) to each interrupt (μs)
+      static float groupGap[motorCount];
+      ///Number of interrupts needed to end all pulses
+      static uint8_t groupCount;
+      ///Index of the next interrupt
+      static volatile uint8_t nextGroup;
+      ///Index of the next pin in pulsePins to end
+      static uint8_t nextPulse;
+    #elif DSHOT_ESC
+      ///Sends the DShot frames to the motors
+      DShotOutput dshot;
+      ///DShot bit rate (bits per second)
+      const uint32_t dshotBitRate = ESC_TYPE == DSHOT150 ? 150000 : (ESC_TYPE == DSHOT300 ? 300000 : 600000);
+    #endif
+
+    #if CONTROL_MATH == FIXED_MATH
+      ///Default motor power
+      q31_t defaultZQ;
+      ///Maximum motor power difference of the potentiometer
+      q31_t potMaxDiffQ;
+      ///Motor power per joystick input for down & up, respectively
+      qGain zDiffGain[2];
+      ///Motor command scale for the current battery voltage
+      qGain voltageGainQ = toGain(1);
+      ///Thrust which needs full command at the current battery voltage
+      q31_t maxThrustQ = INT32_MAX;
     #endif
 };
 #endif
@@ -3,34 +3,415 @@
 void PIDcontroller::init(Logger &logger) {
   //Load settings from the SD card
   logger.loadSetting("maxAngle", maxAngle);
+  logger.loadSetting("maxRate", maxRate, 3);
+  logger.loadSetting("angleGain", angleGain, 2);
+  logger.loadSetting("FFgain", FFgain, 2);
   logger.loadSetting("Pgain", Pgain, 3);
   logger.loadSetting("Igain", Igain, 3);
   logger.loadSetting("Dgain", Dgain, 3);
+  logger.loadSetting("dCutoff", dCutoff);
+  logger.loadSetting("Ilimit", Ilimit);
+  logger.loadSetting("outerLoopDiv", outerLoopDiv);
+  logger.loadSetting("scheduleThrottle", scheduleThrottle, scheduleThrottlePoints);
+  logger.loadSetting("scheduleVoltage", scheduleVoltage, scheduleVoltagePoints);
+  logger.loadSetting("Pschedule", Pschedule, scheduleVoltagePoints*scheduleThrottlePoints);
+  logger.loadSetting("Ischedule", Ischedule, scheduleVoltagePoints*scheduleThrottlePoints);
+  logger.loadSetting("Dschedule", Dschedule, scheduleVoltagePoints*scheduleThrottlePoints);
+  logger.loadSetting("dCutoffSchedule", dCutoffSchedule, scheduleVoltagePoints*scheduleThrottlePoints);
+  logger.loadSetting("autoTune", autoTune);
+  logger.loadSetting("useTunedGains", useTunedGains);
+  logger.loadSetting("autoTuneDelay", autoTuneDelay);
+  logger.loadSetting("autoTuneRelay", autoTuneRelay, 3);
+  logger.loadSetting("autoTuneHysteresis", autoTuneHysteresis);
+  logger.loadSetting("autoTuneCycles", autoTuneCycles);
+  logger.loadSetting("autoTuneTimeout", autoTuneTimeout);
+  logger.loadSetting("autoTuneMaxAngle", autoTuneMaxAngle);
+  logger.loadSetting("autoTuneMaxStick", autoTuneMaxStick);
+
+  //Gains stored by the last auto-tune replace the ones in the settings
+  TunedGains stored;
+  if (useTunedGains and logger.readFile(autoTuneFile, &stored, sizeof(stored)) and stored.version == autoTuneVersion) {
+    for (int i=0; i<3; i++) {
+      Pgain[i] = stored.Pgain[i];
+      Igain[i] = stored.Igain[i];
+      Dgain[i] = stored.Dgain[i];
+    }
+    tunedGainsLoaded = true;
+  }
+  autoTuneStage = autoTune ? 1 : 0;
 
   maxAngle = 127.0/maxAngle;
+  outerLoopDiv = max(outerLoopDiv, 1);
+  updateGains();
+}
+
+void PIDcontroller::updateGains() {
+  schedule.build(scheduleThrottle, scheduleVoltage, Pschedule, Ischedule, Dschedule, dCutoffSchedule);
+  scaleGains();
+}
+
+void PIDcontroller::scaleGains() {
+  //Scale the gains from per mille to a fraction of the motor power
+  for (int i=0; i<3; i++) {
+    Pscaled[i] = Pgain[i]/1000;
+    Iscaled[i] = Igain[i]/1000;
+    Dscaled[i] = Dgain[i]/1000;
+  }
+
+  #if CONTROL_MATH == FIXED_MATH
+    //The fixed point path runs at a fixed loop time
+    float dt = fixedDt;
+    float outerDt = dt * outerLoopDiv;
+
+    //Joystick input is converted to Q31 by stickToQ31(), so full scale is 128
+    stickAngleGain = toGain(-128/maxAngle/rateScale);
+    stickYawGain = toGain(-128*maxRate[2]/127/rateScale);
+    for (int i=0; i<2; i++) {
+      angleGainQ[i] = toGain(angleGain[i]);
+      FFgainQ[i] = toGain(FFgain[i]/outerDt);
+    }
+    for (int i=0; i<3; i++) {
+      baseGainQ[0][i] = toGain(Pscaled[i]*rateScale);
+      baseGainQ[1][i] = toGain(Iscaled[i]*rateScale*dt);
+      baseGainQ[2][i] = toGain(Dscaled[i]*rateScale/dt);
+      maxRateQ[i] = toQ31(maxRate[i], rateScale);
+    }
+    dStepBaseQ = toGain(2*PI*dCutoff*dt);
+    IlimitQ = toQ31(Ilimit);
+    applyGainScale();
+  #endif
+}
+
+void PIDcontroller::setLoopRate(int rate) {
+  #if CONTROL_MATH == FIXED_MATH
+    fixedDt = 1.0f/rate;
+    scaleGains();
+  #endif
+}
+
+void PIDcontroller::scheduleGains(float throttle, float voltage) {
+  #if CONTROL_MATH == FIXED_MATH
+    //Read and applied in integer arithmetic, the multipliers are only converted back to log them
+    gainScaleQ = schedule.getQ(toQ31(throttle), toQ31(voltage, scheduleVoltageScale));
+    applyGainScale();
+    const float scaleMax = 1 << scheduleScaleShift;
+    gainScale = {qToFloat(gainScaleQ.P, scaleMax), qToFloat(gainScaleQ.I, scaleMax), qToFloat(gainScaleQ.D, scaleMax),
+                 qToFloat(gainScaleQ.dCutoff, scaleMax)};
+  #else
+    gainScale = schedule.get(throttle, voltage);
+  #endif
+}
+
+void PIDcontroller::calcPID(const AttitudeState &attitude, const RcCommand &rc, bool saturated) {
+  #if CONTROL_MATH == FIXED_MATH
+    calcPIDfixed(attitude, rc, saturated);
+  #else
+    float dt = loopTime()/1000;
+    if (dt <= 0) {
+      return;
+    }
+
+    //Outer angle loop
+    outerLoopTime += dt;
+    outerLoopCount++;
+    if (outerLoopCount >= outerLoopDiv or firstLoop) {
+      calcAngleLoop(attitude, rc, outerLoopTime);
+      outerLoopCount = 0;
+      outerLoopTime = 0;
+    }
+
+    //The gyroscope is slower than the loop, so the derivative only changes with a new sample, over the time since the last
+    sampleTime += dt;
+    bool newSample = attitude.newSample or firstLoop;
+    float dAlpha = sampleTime / (sampleTime + 1/(2*PI*dCutoff*gainScale.dCutoff));
+
+    //Inner rate loop
+    for (int i=0; i<3; i++) {
+      float rateError = rateSetpoint[i] - attitude.rate[i];
+
+      //Get proportional change
+      PIDchange[0][i] = rateError * Pscaled[i] * gainScale.P;
+
+      //Get derivative change, on the measurement so setpoint changes do not cause a spike
+      if (firstLoop) {
+        lastRate[i] = attitude.rate[i];
+      }
+      if (newSample) {
+        dFiltered[i] += dAlpha * ((attitude.rate[i] - lastRate[i])/sampleTime - dFiltered[i]);
+        lastRate[i] = attitude.rate[i];
+      }
+      PIDchange[2][i] = dFiltered[i] * -Dscaled[i] * gainScale.D;
+
+      //Get integral change, stop integrating while the motors are saturated if it would only push the output further
+      float output = PIDchange[0][i] + Isum[i] * Iscaled[i] + PIDchange[2][i];
+      bool windup = saturated and (output > 0) == (rateError > 0);
+      if (!windup and Igain[i] != 0 and i != autoTuneAxis) {
+        //The schedule scales what is added rather than the sum, so a change of the multiplier does not step the output
+        Isum[i] += rateError * dt * gainScale.I;
+        //Clamp the sum so the integral change cannot exceed Ilimit
+        float maxIsum = Ilimit / Iscaled[i];
+        Isum[i] = min(max(Isum[i], -maxIsum), maxIsum);
+      }
+      PIDchange[1][i] = Isum[i] * Iscaled[i];
+    }
+
+    //The motors yaw the opposite way to the gyroscope
+    for (int i=0; i<3; i++) {
+      PIDchange[i][2] = -PIDchange[i][2];
+    }
+
+    if (newSample) {
+      sampleTime = 0;
+    }
+    firstLoop = false;
+  #endif
+  if (autoTuneStage > 0) {
+    runAutoTune(attitude, rc);
+  }
+}
+
+void PIDcontroller::reset() {
+  for (int i=0; i<3; i++) {
+    Isum[i] = 0;
+    dFiltered[i] = 0;
+    #if CONTROL_MATH == FIXED_MATH
+      Iterm[i] = 0;
+      dFilteredQ[i] = 0;
+    #endif
+    rateSetpoint[i] = 0;
+    for (int j=0; j<3; j++) {
+      PIDchange[j][i] = 0;
+    }
+  }
+  outerLoopCount = 0;
+  outerLoopTime = 0;
+  sampleTime = 0;
+  sampleLoops = 0;
+  firstLoop = true;
+
+  //An auto-tune which was running starts again once the drone is hovering
+  if (autoTuneStage >= 1 and autoTuneStage <= 4) {
+    autoTuneStage = 1;
+    autoTuneAxis = -1;
+    autoTuneWait = 0;
+  }
 }
 
-void PIDcontroller::calcPID(IMU imu) {
-  //Calculate the change in motor power per axis
-  for (int i=0; i<2; i++) {
-    //Get difference between wanted and current angle
-    rpDiff[i] = (-xyzr[i]/maxAngle) - imu.currentAngle[i];
+void PIDcontroller::runAutoTune(const AttitudeState &attitude, const RcCommand &rc) {
+  if (autoTuneStage >= 5) {
+    return;
+  }
+  float dt = loopTime()/1000;
 
-    //Get proportional change
-    PIDchange[0][i] = rpDiff[i] * Pgain[i]/1000.0;
+  //Give the drone back to the pilot if they move the sticks or it tilts too far, before it starts this only delays it
+  bool sticksMoved = abs(rc.xyzr[0]) > autoTuneMaxStick or abs(rc.xyzr[1]) > autoTuneMaxStick or abs(rc.xyzr[3]) > autoTuneMaxStick;
+  bool tilted = abs(attitude.angle[0]) > autoTuneMaxAngle or abs(attitude.angle[1]) > autoTuneMaxAngle;
+  if (sticksMoved or tilted) {
+    if (autoTuneStage == 1) {
+      autoTuneWait = 0;
+    } else {
+      autoTuneStage = 6;
+      autoTuneAxis = -1;
+    }
+    return;
+  }
+  if (autoTuneStage == 1) {
+    autoTuneWait += dt;
+    if (autoTuneWait >= autoTuneDelay) {
+      autoTuneStage = 2;
+      autoTuneAxis = 0;
+      tuner.start(autoTuneRelay[0], autoTuneHysteresis, autoTuneCycles);
+    }
+    return;
+  }
 
-    //Get integral change
-    Isum[i] += rpDiff[i] * loopTime();
-    PIDchange[1][i] = Isum[i] * Igain[i]/1000.0;
+  //The relay replaces the P and D change, the held integral keeps the trim the axis had
+  int axis = autoTuneAxis;
+  float relay = tuner.update(attitude.rate[axis], dt);
+  #if CONTROL_MATH == FIXED_MATH
+    ctrl_t change = toQ31(relay/1000);
+  #else
+    ctrl_t change = relay/1000;
+  #endif
+  PIDchange[0][axis] = axis == 2 ? -change : change;
+  PIDchange[2][axis] = 0;
+
+  if (tuner.done()) {
+    //Yaw has little damping to add and a noisy derivative, so it gets a PI controller like the defaults
+    tuner.gains(axis < 2, tuned.Pgain[axis], tuned.Igain[axis], tuned.Dgain[axis]);
+    tuned.ultimateGain[axis] = tuner.ultimateGain();
+    tuned.ultimatePeriod[axis] = tuner.ultimatePeriod();
+    if (axis < 2) {
+      autoTuneStage++;
+      autoTuneAxis++;
+      tuner.start(autoTuneRelay[autoTuneAxis], autoTuneHysteresis, autoTuneCycles);
+    } else {
+      //Use the new gains once every axis is measured, scaling them is a few divisions so it fits in this loop
+      for (int i=0; i<3; i++) {
+        Pgain[i] = tuned.Pgain[i];
+        Igain[i] = tuned.Igain[i];
+        Dgain[i] = tuned.Dgain[i];
+      }
+      scaleGains();
+      tuned.version = autoTuneVersion;
+      autoTuneStage = 5;
+      autoTuneAxis = -1;
+    }
+  } else if (tuner.time > autoTuneTimeout) {
+    //The axis did not settle into an oscillation
+    autoTuneStage = 6;
+    autoTuneAxis = -1;
+  }
+}
 
-    //Get derivative change
-    PIDchange[2][i] = imu.rRate[i] * -Dgain[i];
+void PIDcontroller::saveAutoTune(Logger &logger) {
+  if (autoTuneStage == 5) {
+    logger.writeFile(autoTuneFile, &tuned, sizeof(tuned));
   }
+}
 
-  //Yaw control
-  if (xyzr[3] == 0) {
-    PIDchange[2][2] = imu.rRate[2] * Dgain[2]; //Stabilise yaw rotation
-  } else {
-    PIDchange[0][2] = xyzr[3] * Pgain[2]; //Joystick control
+String PIDcontroller::autoTuneSummary() const {
+  const char *stages[] = {"off", "not started", "unfinished on roll", "unfinished on pitch", "unfinished on yaw", "finished", "stopped"};
+  String s = "Auto-tune," + String(stages[autoTuneStage]);
+  const char *names[] = {"Pgain", "Igain", "Dgain", "Ultimate gain", "Ultimate period (s)"};
+  const float *values[] = {tuned.Pgain, tuned.Igain, tuned.Dgain, tuned.ultimateGain, tuned.ultimatePeriod};
+  for (int v=0; v<5; v++) {
+    s += "," + String(names[v]);
+    for (int i=0; i<3; i++) {
+      s += "," + String(values[v][i], 4);
+    }
   }
+  return s;
 }
+
+#if CONTROL_MATH == FLOAT_MATH
+  void PIDcontroller::calcAngleLoop(const AttitudeState &attitude, const RcCommand &rc, float dt) {
+    for (int i=0; i<2; i++) {
+      //Get wanted angle and how fast it is changing
+      float angleSetpoint = -rc.xyzr[i]/maxAngle;
+      if (firstLoop) {
+        lastAngleSetpoint[i] = angleSetpoint;
+      }
+      float feedforward = FFgain[i] * (angleSetpoint - lastAngleSetpoint[i])/dt;
+      lastAngleSetpoint[i] = angleSetpoint;
+
+      //Get wanted rotation rate from the difference between the wanted and current angle
+      rateSetpoint[i] = (angleSetpoint - attitude.angle[i]) * angleGain[i] + feedforward;
+      rateSetpoint[i] = min(max(rateSetpoint[i], -maxRate[i]), maxRate[i]);
+    }
+
+    //Yaw is controlled by rate only
+    rateSetpoint[2] = -rc.xyzr[3] * maxRate[2]/127;
+  }
+#endif
+
+#if CONTROL_MATH == FIXED_MATH
+  /** Gets the constant of the derivative's low pass filter, x / (1 + x) where x = 2 pi * cutoff * time since the last sample
+   *
+   *  @param[in] step x per loop
+   *  @param[in] loops Loops since the last gyroscope sample
+   *  @returns Filter constant (Q31)
+   */
+  static q31_t filterAlpha(qGain step, int loops) {
+    if (step.mantissa <= 0) {
+      return 0;
+    } else if (step.shift >= 31) {
+      return INT32_MAX;
+    }
+    //x = num / 2^(31 - shift), so the constant is num / (num + 2^(31 - shift))
+    int64_t num = (int64_t)loops * step.mantissa;
+    int64_t den = num + (1LL << (31 - step.shift));
+    while (den >= (1LL << 32)) {
+      num >>= 1;
+      den >>= 1;
+    }
+    return qSat((num << 31) / den);
+  }
+
+  void PIDcontroller::applyGainScale() {
+    qGain scale[4] = {{gainScaleQ.P, scheduleScaleShift}, {gainScaleQ.I, scheduleScaleShift},
+                      {gainScaleQ.D, scheduleScaleShift}, {gainScaleQ.dCutoff, scheduleScaleShift}};
+    for (int i=0; i<3; i++) {
+      PgainQ[i] = qGainMul(baseGainQ[0][i], scale[0]);
+      IgainQ[i] = qGainMul(baseGainQ[1][i], scale[1]);
+      DgainQ[i] = qGainMul(baseGainQ[2][i], scale[2]);
+    }
+    dStepQ = qGainMul(dStepBaseQ, scale[3]);
+  }
+
+  void PIDcontroller::calcPIDfixed(const AttitudeState &attitude, const RcCommand &rc, bool saturated) {
+    //The attitude estimate is floating point, convert it once per loop
+    q31_t angle[2];
+    q31_t rate[3];
+    for (int i=0; i<3; i++) {
+      if (i < 2) {
+        angle[i] = toQ31(attitude.angle[i], rateScale);
+      }
+      rate[i] = toQ31(attitude.rate[i], rateScale);
+    }
+
+    //Outer angle loop
+    outerLoopCount++;
+    if (outerLoopCount >= outerLoopDiv or firstLoop) {
+      for (int i=0; i<2; i++) {
+        //Get wanted angle and how fast it is changing
+        q31_t angleSetpoint = qScale(stickToQ31(rc.xyzr[i]), stickAngleGain);
+        if (firstLoop) {
+          lastAngleSetpointQ[i] = angleSetpoint;
+        }
+        q31_t feedforward = qScale(qSub(angleSetpoint, lastAngleSetpointQ[i]), FFgainQ[i]);
+        lastAngleSetpointQ[i] = angleSetpoint;
+
+        //Get wanted rotation rate from the difference between the wanted and current angle
+        rateSetpoint[i] = qAdd(qScale(qSub(angleSetpoint, angle[i]), angleGainQ[i]), feedforward);
+        rateSetpoint[i] = qClamp(rateSetpoint[i], -maxRateQ[i], maxRateQ[i]);
+      }
+
+      //Yaw is controlled by rate only
+      rateSetpoint[2] = qScale(stickToQ31(rc.xyzr[3]), stickYawGain);
+      outerLoopCount = 0;
+    }
+
+    //The gyroscope is slower than the loop, so the derivative only changes with a new sample, per loop since the last
+    sampleLoops++;
+    bool newSample = attitude.newSample or firstLoop;
+    q31_t dAlpha = newSample ? filterAlpha(dStepQ, sampleLoops) : 0;
+
+    //Inner rate loop
+    for (int i=0; i<3; i++) {
+      q31_t rateError = qSub(rateSetpoint[i], rate[i]);
+
+      //Get proportional change
+      PIDchange[0][i] = qScale(rateError, PgainQ[i]);
+
+      //Get derivative change, on the measurement so setpoint changes do not cause a spike
+      if (firstLoop) {
+        lastRateQ[i] = rate[i];
+      }
+      if (newSample) {
+        q31_t change = qSub(rate[i], lastRateQ[i]) / sampleLoops;
+        dFilteredQ[i] = qAdd(dFilteredQ[i], qMul(dAlpha, qSub(change, dFilteredQ[i])));
+        lastRateQ[i] = rate[i];
+      }
+      PIDchange[2][i] = qNeg(qScale(dFilteredQ[i], DgainQ[i]));
+
+      //Get integral change, stop integrating while the motors are saturated if it would only push the output further
+      q31_t output = qAdd(qAdd(PIDchange[0][i], Iterm[i]), PIDchange[2][i]);
+      bool windup = saturated and (output > 0) == (rateError > 0);
+      if (!windup and i != autoTuneAxis) {
+        Iterm[i] = qClamp(qAdd(Iterm[i], qScale(rateError, IgainQ[i])), -IlimitQ, IlimitQ);
+      }
+      PIDchange[1][i] = Iterm[i];
+    }
+
+    //The motors yaw the opposite way to the gyroscope
+    for (int i=0; i<3; i++) {
+      PIDchange[i][2] = qNeg(PIDchange[i][2]);
+    }
+
+    if (newSample) {
+      sampleLoops = 0;
+    }
+    firstLoop = false;
+  }
+#endif
@@ -2,14 +2,49 @@
 #define __PIDcontroller_H__
 
 //Import files
-#include "IMU.h"
+#include "FixedPoint.h"
+#include "GainSchedule.h"
 #include "Logger.h"
+#include "RelayTuner.h"
+#include "StateBus.h"
 
-extern int xyzr[4];
+extern float loopTime();
+
+
+/* Settings */
+///Name of the file the gains found by the auto-tune are stored in
+const char autoTuneFile[] = "autoTune.bin";
+///Version of the stored gains, stored gains with a different version are ignored
+const uint32_t autoTuneVersion = 1;
+/* Settings */
+
+/**
+ * @struct TunedGains
+ * @brief Gains found by the auto-tune, stored so they are used from the next startup
+ */
+struct TunedGains {
+  ///Should be equal to autoTuneVersion, otherwise the gains are invalid
+  uint32_t version = 0;
+  ///Gains of roll, pitch & yaw, in the units of the settings of the same name
+  float Pgain[3] = {0, 0, 0};
+  float Igain[3] = {0, 0, 0};
+  float Dgain[3] = {0, 0, 0};
+  ///Ultimate gain (motor power per mille per degree per second) and period (seconds) measured on each axis
+  float ultimateGain[3] = {0, 0, 0};
+  float ultimatePeriod[3] = {0, 0, 0};
+};
 
 /** 
  * @class PIDcontroller
  * @brief Runs the PID calculations and stores the settings for it
+ *
+ * The controller is cascaded. The outer angle loop turns the difference from the wanted angle into a wanted rotation rate.
+ * The inner rate loop runs a PID on the rotation rate of each axis to get the change in motor power.
+ * The gains are scaled by a schedule over throttle and battery voltage (see scheduleGains).
+ *
+ * The gains can be tuned in flight: with autoTune set, once the drone has hovered for autoTuneDelay the rate loop of
+ * each axis in turn is replaced by a relay (see RelayTuner). The gains found are used once every axis is measured and
+ * stored to autoTuneFile by saveAutoTune(), which replaces Pgain, Igain and Dgain from the next startup.
  */
 class PIDcontroller {
   public:
@@ -20,30 +55,211 @@ class PIDcontroller {
     void init(Logger &logger);
     /** Calculate new PID values based on the IMU data.
      *  
-     *  @param[in] imu IMU object to read the data from
+     *  The inner rate loop runs every call, the outer angle loop runs every outerLoopDiv calls. The derivative is only
+     *  updated when the attitude has a new gyroscope sample, as the rate is held between samples.
+     *  
+     *  @param[in] attitude Current attitude of the device
+     *  @param[in] rc Current input from the controller
+     *  @param[in] saturated Whether the mixer had to scale down the roll, pitch and yaw of the last output (see
+     *                       MotorController::desaturated), the integral is held while it would only add to it
+     */
+    void calcPID(const AttitudeState &attitude, const RcCommand &rc, bool saturated);
+    /** Scales the gains used by calcPID from the gain schedule. Call before calcPID
+     *  
+     *  The response of the drone changes with the thrust of the motors and with the battery voltage, so gains which suit
+     *  hover can oscillate at full throttle or be sluggish on a low battery.
+     *  
+     *  @param[in] throttle Base motor power of the last loop, 0 - 1 (see MotorController::initialPower)
+     *  @param[in] voltage Battery voltage (V), the nominal voltage if it is not measured
      */
-    void calcPID(IMU imu);
+    void scheduleGains(float throttle, float voltage);
+    /** Stores the gains found by the auto-tune so they are used from the next startup. Does nothing unless it finished
+     *  
+     *  @param[in] logger Logger object to write the file with
+     */
+    void saveAutoTune(Logger &logger);
+    /** Summary of the auto-tune, in the same format as the log settings */
+    String autoTuneSummary() const;
+    /** Resets the integral sums and filters. Used when the device goes on standby */
+    void reset();
+    /** Calculates the scaled gains used by calcPID. Must be called after changing any of the settings */
+    void updateGains();
+    /** Sets the loop rate the fixed point gains are scaled for, when the loop watchdog changes it (see LoopWatchdog)
+     *  
+     *  @param[in] rate Loop rate (Hz)
+     */
+    void setLoopRate(int rate);
     
     ///The change from the P, I and D values that will be applied to the roll, pitch & yaw; PIDchange[P/I/D][roll/pitch/yaw]
-    float PIDchange[3][3] = {{0,0,0}, {0,0,0}, {0,0,0}};
+    ctrl_t PIDchange[3][3] = {{0,0,0}, {0,0,0}, {0,0,0}};
+    ///Wanted rotation rate of roll, pitch & yaw (degrees per second, or rateScale in fixed point)
+    ctrl_t rateSetpoint[3] = {0, 0, 0};
+    ///Multipliers of the gains and derivative cutoff from the gain schedule, used by calcPID
+    GainScale gainScale = {1, 1, 1, 1};
+    ///Auto-tune step. 0: off, 1: waiting for autoTuneDelay of hover, 2-4: tuning roll, pitch or yaw, 5: finished, 6: stopped
+    uint8_t autoTuneStage = 0;
+    ///True if the gains were loaded from autoTuneFile
+    bool tunedGainsLoaded = false;
 
     /* Settings */
     //User input
     ///Maximum wanted bank angle available to select by the user. Can be set via SD card
     float maxAngle = 15.0;
+    ///Maximum wanted rotation rate of roll, pitch & yaw (degrees per second), yaw is at full stick. Can be set via SD card
+    float maxRate[3] = {250, 250, 180};
     //Performance
-    ///Proportional gain for roll, pitch & yaw, percentage difference per ESC at 10 degrees. Can be set via SD card
-    float Pgain[3] = {2.0, 2.0, 0};
-    ///Integral gain for roll, pitch & yaw, changes motor performance over time. Can be set via SD card
+    ///Outer loop gain for roll & pitch, wanted rotation rate (degrees per second) per degree from the wanted angle. Can be set via SD card
+    float angleGain[2] = {4.0, 4.0};
+    ///Feedforward for roll & pitch, fraction of the wanted angle's rate of change added to the wanted rotation rate. Can be set via SD card
+    float FFgain[2] = {.5, .5};
+    ///Proportional gain for roll, pitch & yaw, motor power (per mille) per degree per second of rate error. Can be set via SD card
+    float Pgain[3] = {.5, .5, 1.0};
+    ///Integral gain for roll, pitch & yaw, motor power (per mille) per degree of accumulated rate error. Can be set via SD card
     float Igain[3] = {.0000, .0000, 0};
-    ///Differential gain for roll, pitch & yaw, helps control the rotation speed. Can be set via SD card
-    float Dgain[3] = {.33, .33, 0};
+    ///Differential gain for roll, pitch & yaw, motor power (per mille) per degree per second squared. Can be set via SD card
+    float Dgain[3] = {.005, .005, 0};
+    ///Cutoff frequency of the low pass filter on the derivative (Hz). Can be set via SD card
+    float dCutoff = 80;
+    ///Maximum change in motor power from the integral. Can be set via SD card
+    float Ilimit = .1;
+    ///The outer loop runs once every outerLoopDiv loops. Can be set via SD card
+    int outerLoopDiv = 4;
+    //Gain schedule
+    ///Throttle (base motor power, 0 - 1) of each column of the gain schedule, increasing. Can be set via SD card
+    float scheduleThrottle[scheduleThrottlePoints] = {0, .33, .67, 1};
+    ///Battery voltage (V) of each row of the gain schedule, increasing. Can be set via SD card
+    float scheduleVoltage[scheduleVoltagePoints] = {9.9, 11.1, 12.6};
+    ///Multiplier of Pgain at each throttle and voltage, one row per voltage. Can be set via SD card
+    float Pschedule[scheduleVoltagePoints*scheduleThrottlePoints] = {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1};
+    ///Multiplier of Igain at each throttle and voltage, one row per voltage. Can be set via SD card
+    float Ischedule[scheduleVoltagePoints*scheduleThrottlePoints] = {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1};
+    ///Multiplier of Dgain at each throttle and voltage, one row per voltage. Can be set via SD card
+    float Dschedule[scheduleVoltagePoints*scheduleThrottlePoints] = {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1};
+    ///Multiplier of dCutoff at each throttle and voltage, one row per voltage. Can be set via SD card
+    float dCutoffSchedule[scheduleVoltagePoints*scheduleThrottlePoints] = {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1};
+    //Auto-tune
+    ///Whether to tune the gains in flight, hold the sticks centred at hover until it finishes. Can be set via SD card
+    bool autoTune = false;
+    ///Whether to use the gains stored by the last auto-tune instead of Pgain, Igain and Dgain. Can be set via SD card
+    bool useTunedGains = true;
+    ///Time hovering before the auto-tune starts (seconds). Can be set via SD card
+    float autoTuneDelay = 3;
+    ///Motor power change of the relay on roll, pitch & yaw (per mille). Can be set via SD card
+    float autoTuneRelay[3] = {30, 30, 60};
+    ///Rotation rate the relay switches at (degrees per second). Can be set via SD card
+    float autoTuneHysteresis = 10;
+    ///Number of relay cycles measured on each axis. Can be set via SD card
+    int autoTuneCycles = 6;
+    ///Longest time the auto-tune may take on one axis (seconds). Can be set via SD card
+    float autoTuneTimeout = 5;
+    ///Roll or pitch (degrees) which stops the auto-tune, keeping the gains it started with. Can be set via SD card
+    float autoTuneMaxAngle = 30;
+    ///Roll, pitch or yaw input (from 0 to 127) which stops the auto-tune, so the pilot can take over. Can be set via SD card
+    int autoTuneMaxStick = 20;
     /* Settings */
 
   private:
-    ///Difference in roll & pitch from the wanted angle
-    float rpDiff[2] = {0,0};
-    ///The sum of the difference in angles used to calculate the integral change
-    float Isum[2];
+    #if CONTROL_MATH == FLOAT_MATH
+      /** Runs the angle loop for roll & pitch and sets the wanted rotation rate of each axis
+       *  
+       *  @param[in] attitude Current attitude of the device
+       *  @param[in] rc Current input from the controller
+       *  @param[in] dt Time since the outer loop last ran (seconds)
+       */
+      void calcAngleLoop(const AttitudeState &attitude, const RcCommand &rc, float dt);
+    #endif
+    /** Scales Pgain, Igain and Dgain to the units used by calcPID */
+    void scaleGains();
+    /** Runs the auto-tune for one loop, the relay replaces the P and D change of the axis being tuned
+     *  
+     *  @param[in] attitude Current attitude of the device
+     *  @param[in] rc Current input from the controller
+     */
+    void runAutoTune(const AttitudeState &attitude, const RcCommand &rc);
+
+    ///Gain schedule over throttle and battery voltage
+    GainSchedule schedule;
+    ///Proportional gain scaled to motor power per degree per second
+    float Pscaled[3];
+    ///Integral gain scaled to motor power per degree
+    float Iscaled[3];
+    ///Differential gain scaled to motor power per degree per second squared
+    float Dscaled[3];
+    ///The sum of the rate errors used to calculate the integral change
+    float Isum[3] = {0, 0, 0};
+    ///Low pass filtered rate of change of the rotation rate (degrees per second squared)
+    float dFiltered[3] = {0, 0, 0};
+    ///Rotation rate of the last gyroscope sample (degrees per second)
+    float lastRate[3] = {0, 0, 0};
+    ///Time since the last gyroscope sample (seconds)
+    float sampleTime = 0;
+    ///Loops since the last gyroscope sample
+    int sampleLoops = 0;
+    ///Wanted angle of roll & pitch from the last outer loop (degrees)
+    float lastAngleSetpoint[2] = {0, 0};
+    ///Loops since the outer loop last ran
+    int outerLoopCount = 0;
+    ///Time since the outer loop last ran (seconds)
+    float outerLoopTime = 0;
+    ///True if the filters have no previous values
+    bool firstLoop = true;
+    ///Measures the axis being tuned
+    RelayTuner tuner;
+    ///Axis being tuned, its integral is held while the relay runs. -1 if none
+    int autoTuneAxis = -1;
+    ///Time hovered while waiting for the auto-tune to start (seconds)
+    float autoTuneWait = 0;
+    ///Gains found by the auto-tune so far
+    TunedGains tuned;
+
+    #if CONTROL_MATH == FIXED_MATH
+      /** Fixed point version of calcPID. The loop time is assumed to be the nominal loop time (see setLoopRate)
+       *  
+       *  @param[in] attitude Current attitude of the device
+       *  @param[in] rc Current input from the controller
+       *  @param[in] saturated Whether the mixer had to scale down the last output
+       */
+      void calcPIDfixed(const AttitudeState &attitude, const RcCommand &rc, bool saturated);
+      /** Sets the fixed point gains and derivative filter step from the base gains and gainScaleQ */
+      void applyGainScale();
+
+      ///Nominal loop time the gains are scaled for (seconds)
+      float fixedDt = 1.0f/loopRate;
+      ///Wanted angle per joystick input (Q31 joystick input to rateScale)
+      qGain stickAngleGain;
+      ///Wanted yaw rate per joystick input (Q31 joystick input to rateScale)
+      qGain stickYawGain;
+      ///Outer loop gain for roll & pitch
+      qGain angleGainQ[2];
+      ///Feedforward for roll & pitch per outer loop
+      qGain FFgainQ[2];
+      ///Proportional, integral and differential gains before the gain schedule, [P/I/D][roll/pitch/yaw]
+      qGain baseGainQ[3][3];
+      ///Proportional gain, rate error to motor power
+      qGain PgainQ[3];
+      ///Integral gain, rate error to motor power per loop
+      qGain IgainQ[3];
+      ///Differential gain, change in rate per loop to motor power
+      qGain DgainQ[3];
+      ///Multipliers from the gain schedule
+      GainScaleQ gainScaleQ = {toQ31(1, 1 << scheduleScaleShift), toQ31(1, 1 << scheduleScaleShift),
+                               toQ31(1, 1 << scheduleScaleShift), toQ31(1, 1 << scheduleScaleShift)};
+      ///2 pi * dCutoff * loop time before the gain schedule, the derivative filter's step per loop
+      qGain dStepBaseQ;
+      ///Derivative filter's step per loop with the gain schedule
+      qGain dStepQ;
+      ///Maximum change in motor power from the integral
+      q31_t IlimitQ;
+      ///Maximum wanted rotation rate of roll, pitch & yaw
+      q31_t maxRateQ[3];
+      ///Change in motor power from the integral of each axis
+      q31_t Iterm[3] = {0, 0, 0};
+      ///Low pass filtered change in rotation rate per loop
+      q31_t dFilteredQ[3] = {0, 0, 0};
+      ///Rotation rate of the last gyroscope sample
+      q31_t lastRateQ[3] = {0, 0, 0};
+      ///Wanted angle of roll & pitch from the last outer loop
+      q31_t lastAngleSetpointQ[2] = {0, 0};
+    #endif
 };
 #endif
@@ -0,0 +1,22 @@
+#include "RadioPacket.h"
+
+bool decodePacket(const RadioPacket &packet, RcCommand &command) {
+  const uint8_t *data = packet.data;
+
+  //Get analog info from packet
+  for (int i=0; i<4; i++) {
+    command.xyzr[i] = data[i] - 127;
+    if (command.xyzr[i] > -5 and command.xyzr[i] < 5) { //Joystick deadzone
+      command.xyzr[i] = 0;
+    }
+  }
+  command.xyzr[1] = -command.xyzr[1]; //Correct pitch
+  command.potPercent = data[4]/255.0; //Put between 0-1
+  command.sequence = data[5];
+  //Get binary info from packet
+  command.light = (data[6] >> 2) & 1;
+  command.standbyButton = (data[6] >> 1) & 1;
+
+  //Abort button
+  return data[6] & 1;
+}
@@ -0,0 +1,34 @@
+#ifndef __RadioPacket_H__
+#define __RadioPacket_H__
+
+//Import libraries
+#include <stdint.h>
+
+//Import files
+#include "StateBus.h"
+
+///Number of bytes in a packet from the controller
+const int radioPacketSize = 7;
+
+/**
+ * @struct RadioPacket
+ * @brief Raw packet from the controller and when it arrived
+ *
+ * Bytes 0 - 3: x, y, z and rotation joysticks (0 - 254, centre 127), byte 4: potentiometer,
+ * byte 5: sequence number (increases by 1 each packet), byte 6: bit 0 abort, bit 1 standby, bit 2 light.
+ */
+struct RadioPacket {
+  ///Raw packet data
+  uint8_t data[radioPacketSize];
+  ///Cycle count when the packet arrived, read in the radio's interrupt (see cycleCount())
+  uint32_t cycles;
+};
+
+/** Decodes a packet from the controller
+ *
+ *  @param[in] packet Packet to decode
+ *  @param[out] command Input from the controller, the timestamp is left for the caller to convert from packet.cycles
+ *  @returns true if the abort button is pressed
+ */
+bool decodePacket(const RadioPacket &packet, RcCommand &command);
+#endif
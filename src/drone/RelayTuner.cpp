@@ -0,0 +1,71 @@
+#include "RelayTuner.h"
+
+#include <math.h>
+
+void RelayTuner::start(float relay, float hysteresis, int cycles) {
+  this->relay = relay;
+  this->hysteresis = hysteresis;
+  measureCycles = cycles;
+  output = 0;
+  rises = 0;
+  lastRise = 0;
+  measured = 0;
+  periodSum = 0;
+  amplitudeSum = 0;
+  time = 0;
+}
+
+float RelayTuner::update(float rate, float dt) {
+  time += dt;
+  if (output == 0) {
+    output = rate > 0 ? -relay : relay;
+    peak = trough = rate;
+  }
+  peak = fmaxf(peak, rate);
+  trough = fminf(trough, rate);
+
+  //Push against the rotation, switching once the rate is past the hysteresis
+  if (output > 0 and rate > hysteresis) {
+    output = -relay;
+  } else if (output < 0 and rate < -hysteresis) {
+    output = relay;
+
+    //A cycle ends each time the relay switches up
+    rises++;
+    if (rises > relaySettleCycles and !done()) {
+      periodSum += time - lastRise;
+      amplitudeSum += (peak - trough) / 2;
+      measured++;
+    }
+    lastRise = time;
+    peak = trough = rate;
+  }
+  return output;
+}
+
+float RelayTuner::ultimateGain() const {
+  if (measured == 0) {
+    return 0;
+  }
+  //The relay's first harmonic is 4/π of its output, the hysteresis delays the switch by part of the amplitude
+  float amplitude = amplitudeSum / measured;
+  float effective = amplitude > hysteresis ? sqrtf(amplitude*amplitude - hysteresis*hysteresis) : amplitude;
+  return effective > 0 ? 4 * relay / ((float)M_PI * effective) : 0;
+}
+
+float RelayTuner::ultimatePeriod() const {
+  return measured > 0 ? periodSum / measured : 0;
+}
+
+void RelayTuner::gains(bool useD, float &P, float &I, float &D) const {
+  float Ku = ultimateGain();
+  float Tu = ultimatePeriod();
+  if (Ku <= 0 or Tu <= 0) {
+    P = I = D = 0;
+    return;
+  }
+  //Tyreus-Luyben: Kp = Ku/2.2, Ti = 2.2 Tu, Td = Tu/6.3, or Kp = Ku/3.2 without the D term
+  P = useD ? Ku / 2.2f : Ku / 3.2f;
+  I = P / (2.2f * Tu);
+  D = useD ? P * Tu / 6.3f : 0;
+}
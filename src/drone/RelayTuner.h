@@ -0,0 +1,77 @@
+#ifndef __RelayTuner_H__
+#define __RelayTuner_H__
+
+/* Settings */
+///Relay cycles left out of the measurement while the oscillation settles
+const int relaySettleCycles = 2;
+/* Settings */
+
+
+/**
+ * @class RelayTuner
+ * @brief Measures the oscillation of one axis under relay feedback, and turns it into PID gains
+ *
+ * The rate loop of the axis is replaced by a relay, which pushes with a fixed motor power change against the rotation
+ * rate and switches direction when the rate crosses zero (with some hysteresis against noise). The axis settles into an
+ * oscillation at the frequency where the drone lags the relay by half a cycle, its ultimate period. The amplitude of
+ * the oscillation gives the ultimate gain, the gain at which a P controller would oscillate (Åström and Hägglund).
+ *
+ * Each call only compares, adds and tracks a peak, nothing is stored per sample, so it fits in every loop.
+ */
+class RelayTuner {
+  public:
+    /** Starts measuring
+     *
+     *  @param[in] relay Motor power change of the relay (per mille)
+     *  @param[in] hysteresis Rate the relay switches at (degrees per second)
+     *  @param[in] cycles Number of cycles to measure after settling
+     */
+    void start(float relay, float hysteresis, int cycles);
+    /** Runs the relay for one loop
+     *
+     *  @param[in] rate Rotation rate of the axis (degrees per second)
+     *  @param[in] dt Time since the last call (seconds)
+     *  @returns Motor power change of the relay (per mille)
+     */
+    float update(float rate, float dt);
+    /** Whether enough cycles have been measured */
+    bool done() const {
+      return measured >= measureCycles;
+    }
+    /** Ultimate gain, motor power (per mille) per degree per second of rate, 0 if nothing was measured */
+    float ultimateGain() const;
+    /** Ultimate period (seconds), 0 if nothing was measured */
+    float ultimatePeriod() const;
+    /** Calculates PID gains from the measurement with the Tyreus-Luyben rule, which overshoots less than Ziegler-Nichols
+     *
+     *  @param[in] useD Whether to use a D term, if not the P and I gains follow the PI version of the rule
+     *  @param[out] P Proportional gain, motor power (per mille) per degree per second
+     *  @param[out] I Integral gain, motor power (per mille) per degree
+     *  @param[out] D Differential gain, motor power (per mille) per degree per second squared
+     */
+    void gains(bool useD, float &P, float &I, float &D) const;
+
+    ///Time since start() (seconds)
+    float time = 0;
+
+  private:
+    ///Motor power change of the relay (per mille)
+    float relay = 0;
+    ///Rate the relay switches at (degrees per second)
+    float hysteresis = 0;
+    ///Number of cycles to measure
+    int measureCycles = 0;
+    ///Current output of the relay (per mille)
+    float output = 0;
+    ///Number of times the relay has switched from pushing down to pushing up
+    int rises = 0;
+    ///Time of the last switch up (seconds)
+    float lastRise = 0;
+    ///Highest and lowest rate since the last switch up (degrees per second)
+    float peak = 0, trough = 0;
+    ///Number of cycles measured
+    int measured = 0;
+    ///Sum of the measured periods (seconds) and of the amplitudes (degrees per second)
+    float periodSum = 0, amplitudeSum = 0;
+};
+#endif
@@ -0,0 +1,72 @@
+#ifndef __SpscQueue_H__
+#define __SpscQueue_H__
+
+//Import libraries
+#include <stdint.h>
+#include <atomic>
+
+
+/**
+ * @class SpscQueue
+ * @brief Lock free queue with one producer (e.g. an interrupt) and one consumer (e.g. loop())
+ *
+ * The producer only writes the head and the consumer only writes the tail, so neither has to turn off interrupts.
+ * The indexes count up forever and wrap around, the slot used is the index modulo the size.
+ *
+ * @tparam T Type of the items, copied in and out of the queue
+ * @tparam size Maximum number of items, must be a power of two
+ */
+template <typename T, uint32_t size> class SpscQueue {
+  static_assert(size > 0 and (size & (size - 1)) == 0, "SpscQueue size must be a power of two");
+
+  public:
+    /** @param[in] start Starting index, only needed to test the indexes wrapping around */
+    explicit SpscQueue(uint32_t start=0) : head(start), tail(start) {}
+
+    /** Add an item to the queue. Must only be called by the producer
+     *
+     *  @param[in] item Item to add
+     *  @returns false if the queue is full, the item is not added
+     */
+    bool push(const T &item) {
+      uint32_t h = head.load(std::memory_order_relaxed);
+      if (h - tail.load(std::memory_order_acquire) == size) {
+        return false;
+      }
+      buffer[h & (size - 1)] = item;
+      //Make sure the item is written before the consumer can see it
+      head.store(h + 1, std::memory_order_release);
+      return true;
+    }
+    /** Remove the oldest item from the queue. Must only be called by the consumer
+     *
+     *  @param[out] item The oldest item
+     *  @returns false if the queue is empty
+     */
+    bool pop(T &item) {
+      uint32_t t = tail.load(std::memory_order_relaxed);
+      if (head.load(std::memory_order_acquire) == t) {
+        return false;
+      }
+      item = buffer[t & (size - 1)];
+      //Make sure the item is read before the producer can overwrite it
+      tail.store(t + 1, std::memory_order_release);
+      return true;
+    }
+    /** Get the number of items in the queue. Only exact when called by the producer or consumer
+     *
+     *  @returns Number of items in the queue
+     */
+    uint32_t count() const {
+      return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+  private:
+    ///Items in the queue
+    T buffer[size];
+    ///Number of items ever added, written by the producer
+    std::atomic<uint32_t> head;
+    ///Number of items ever removed, written by the consumer
+    std::atomic<uint32_t> tail;
+};
+#endif
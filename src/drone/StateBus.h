@@ -0,0 +1,157 @@
+#ifndef __StateBus_H__
+#define __StateBus_H__
+
+//Import libraries
+#include <stdint.h>
+#include <atomic>
+
+//Import files
+#include "Clock.h"
+#include "Mixer.h"
+
+
+/**
+ * @struct AttitudeState
+ * @brief Attitude of the device. Published by IMU
+ */
+struct AttitudeState {
+  ///Current angle of roll, pitch and yaw (in degrees)
+  float angle[3];
+  ///Rotation rate of roll, pitch and yaw (degrees per second)
+  float rate[3];
+  ///Whether the rotation rate is from a new gyroscope sample, between samples it is held
+  bool newSample;
+  ///Time the sensors were read (μs of clockMicros())
+  micros_t timestamp;
+};
+
+/**
+ * @struct RcCommand
+ * @brief Input from the controller. Published by DroneRadio
+ */
+struct RcCommand {
+  ///Joystick inputs for x, y, z and rotation(yaw) (from -127 to 127)
+  int xyzr[4];
+  ///Percentage of the controllers potentiometer, used as a trim
+  float potPercent;
+  ///Whether the light should be on
+  bool light;
+  ///Whether the standby button is pressed
+  bool standbyButton;
+  ///Sequence number of the packet
+  uint8_t sequence;
+  ///Time the packet arrived (μs of clockMicros())
+  micros_t timestamp;
+};
+
+/**
+ * @struct MotorOutput
+ * @brief Power sent to each motor. Published by MotorController
+ */
+struct MotorOutput {
+  ///Power of each motor, 0 - 1000. Order is set by the frame in Mixer.h
+  float motorPower[motorCount];
+  ///RPM of each motor, 0 if it is not available (see MotorController::rpm)
+  float rpm[motorCount];
+  ///Time the output was written (μs of clockMicros())
+  micros_t timestamp;
+};
+
+/**
+ * @struct TelemetryState
+ * @brief State sent to the controller as telemetry. Published by the main loop
+ */
+struct TelemetryState {
+  ///Current angle of roll, pitch and yaw (in degrees)
+  float angle[3];
+  ///Rotation rate of roll, pitch and yaw (degrees per second)
+  float rate[3];
+  ///Power of each motor, 0 - 1000
+  float motorPower[motorCount];
+  ///Mean and max loop time over the last telemetry period (μs)
+  uint16_t loopTimeMean, loopTimeMax;
+  ///Number of loops which took longer than the maximum loop time
+  uint32_t deadlineMisses;
+  ///Number of packets received from the controller. Filled in by DroneRadio
+  uint32_t packetsReceived;
+  ///Number of packets from the controller dropped by the drone. Filled in by DroneRadio
+  uint32_t droppedPackets;
+  ///Percentage of the log buffer used by the last log entry
+  uint8_t logBufferFill;
+  ///Time of the loop the state was published in (μs since the flight started, see FlightClock)
+  micros_t timestamp;
+};
+
+/**
+ * @class SharedState
+ * @brief Holds the latest value of a state, which has one producer and any number of consumers
+ *
+ * The producer writes to the buffer not being read and then flips the buffers, so a value is never read while it is half written.
+ * A sequence number detects if the producer has published twice while a consumer was copying a value.
+ */
+template <typename T> class SharedState {
+  public:
+    /** Publish a new value. Must only be called by the producer
+     *
+     *  @param[in] value New value of the state
+     */
+    void publish(const T &value) {
+      buffer[(seq+1) & 1] = value;
+      //Make sure the value is written before the buffers are flipped
+      std::atomic_signal_fence(std::memory_order_seq_cst);
+      seq = seq + 1;
+    }
+    /** Get the latest value without copying it.
+     *
+     *  Only use this if the producer cannot interrupt the consumer, e.g. both run in loop().
+     *
+     *  @returns Reference to the latest value, valid until the producer publishes twice more
+     */
+    const T &get() const {
+      return buffer[seq & 1];
+    }
+    /** Get a copy of the latest value. Safe to use if the producer runs in an interrupt
+     *
+     *  @returns Copy of the latest value
+     */
+    T read() const {
+      T value;
+      uint32_t start;
+      do {
+        start = seq;
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        value = buffer[start & 1];
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+      } while (seq - start > 1); //Retry if the buffer being copied was overwritten
+      return value;
+    }
+    /** Get the number of values that have been published
+     *
+     *  @returns Sequence number of the latest value
+     */
+    uint32_t sequence() const {
+      return seq;
+    }
+
+  private:
+    ///Double buffer holding the latest and previous values
+    T buffer[2] = {};
+    ///Number of values published, the latest value is in buffer[seq & 1]
+    volatile uint32_t seq = 0;
+};
+
+/**
+ * @struct StateBus
+ * @brief All states shared between modules
+ */
+struct StateBus {
+  ///Attitude from the IMU
+  SharedState<AttitudeState> attitude;
+  ///Input from the controller
+  SharedState<RcCommand> rc;
+  ///Output to the motors
+  SharedState<MotorOutput> motors;
+  ///Telemetry for the controller
+  SharedState<TelemetryState> telemetry;
+};
+#endif
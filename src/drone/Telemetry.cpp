@@ -0,0 +1,108 @@
+#include "Telemetry.h"
+
+/** Calculates the CRC-8 (polynomial 0x07) of some bytes */
+static uint8_t crc8(const uint8_t data[], int length) {
+  uint8_t crc = 0;
+  for (int i=0; i<length; i++) {
+    crc ^= data[i];
+    for (int bit=0; bit<8; bit++) {
+      crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+/** Writes a little endian value and moves the position past it */
+static void put16(uint8_t frame[], int &pos, uint16_t value) {
+  frame[pos++] = value & 0xFF;
+  frame[pos++] = value >> 8;
+}
+static void put32(uint8_t frame[], int &pos, uint32_t value) {
+  put16(frame, pos, value & 0xFFFF);
+  put16(frame, pos, value >> 16);
+}
+/** Reads a little endian value and moves the position past it */
+static uint16_t get16(const uint8_t frame[], int &pos) {
+  uint16_t value = frame[pos] | (frame[pos+1] << 8);
+  pos += 2;
+  return value;
+}
+static uint32_t get32(const uint8_t frame[], int &pos) {
+  uint32_t low = get16(frame, pos);
+  return low | ((uint32_t)get16(frame, pos) << 16);
+}
+
+/** Converts a float to a scaled int16, limited to its range */
+static int16_t toInt16(float value, float scale) {
+  float scaled = value * scale;
+  scaled = scaled < -32768 ? -32768 : (scaled > 32767 ? 32767 : scaled);
+  return (int16_t)(scaled < 0 ? scaled - .5f : scaled + .5f);
+}
+
+int encodeTelemetry(const TelemetryState &state, uint8_t type, uint8_t sequence, uint8_t frame[]) {
+  int pos = 0;
+  frame[pos++] = (type << 4) | (sequence & 0xF);
+
+  if (type == telemetryID.attitude) {
+    for (int i=0; i<3; i++) {
+      put16(frame, pos, toInt16(state.angle[i], 100));
+    }
+    for (int i=0; i<3; i++) {
+      put16(frame, pos, toInt16(state.rate[i], 10));
+    }
+  } else if (type == telemetryID.motors) {
+    frame[pos++] = motorCount;
+    for (int i=0; i<motorCount; i++) {
+      put16(frame, pos, (uint16_t)(state.motorPower[i] * 10 + .5f));
+    }
+  } else if (type == telemetryID.loop) {
+    put16(frame, pos, state.loopTimeMean);
+    put16(frame, pos, state.loopTimeMax);
+    put32(frame, pos, state.deadlineMisses);
+  } else if (type == telemetryID.link) {
+    put32(frame, pos, state.packetsReceived);
+    put32(frame, pos, state.droppedPackets);
+    frame[pos++] = state.logBufferFill;
+  } else {
+    return 0;
+  }
+
+  frame[pos] = crc8(frame, pos);
+  return pos + 1;
+}
+
+bool decodeTelemetry(const uint8_t frame[], int length, TelemetryState &state, uint8_t &type, uint8_t &sequence) {
+  if (length < 2 or length > telemetryMaxLength or crc8(frame, length-1) != frame[length-1]) {
+    return false;
+  }
+  type = frame[0] >> 4;
+  sequence = frame[0] & 0xF;
+
+  //Check the length before reading the fields
+  int pos = 1;
+  int payload = length - 2;
+  if (type == telemetryID.attitude and payload == 12) {
+    for (int i=0; i<3; i++) {
+      state.angle[i] = (int16_t)get16(frame, pos) / 100.0f;
+    }
+    for (int i=0; i<3; i++) {
+      state.rate[i] = (int16_t)get16(frame, pos) / 10.0f;
+    }
+  } else if (type == telemetryID.motors and payload >= 1 and payload == 1 + 2*frame[1] and frame[1] <= motorCount) {
+    int count = frame[pos++];
+    for (int i=0; i<count; i++) {
+      state.motorPower[i] = get16(frame, pos) / 10.0f;
+    }
+  } else if (type == telemetryID.loop and payload == 8) {
+    state.loopTimeMean = get16(frame, pos);
+    state.loopTimeMax = get16(frame, pos);
+    state.deadlineMisses = get32(frame, pos);
+  } else if (type == telemetryID.link and payload == 9) {
+    state.packetsReceived = get32(frame, pos);
+    state.droppedPackets = get32(frame, pos);
+    state.logBufferFill = frame[pos++];
+  } else {
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,62 @@
+#ifndef __Telemetry_H__
+#define __Telemetry_H__
+
+//Import libraries
+#include <stdint.h>
+
+//Import files
+#include "StateBus.h"
+
+/*
+ * Telemetry frames sent to the controller in the nRF24 ACK payloads.
+ *
+ * Each frame holds one part of the TelemetryState, so it fits in one ACK payload. Byte 0 is the frame type (high nibble)
+ * and a sequence number (low nibble), the last byte is a CRC-8 of the rest. Values are little endian.
+ * One frame is sent per packet received, going through telemetrySchedule in turn.
+ */
+
+///Largest ACK payload the nRF24 can send (bytes)
+const int telemetryMaxLength = 32;
+
+/**
+ * @struct TelemetryID
+ * @brief Contains the IDs of the telemetry frame types
+ */
+constexpr struct TelemetryID {
+  ///Angle (0.01°) and rotation rate (0.1°/s) of roll, pitch and yaw, 6x int16
+  const uint8_t attitude = 1;
+  ///Number of motors (uint8), then power of each motor (0.1 of 1000) as uint16
+  const uint8_t motors = 2;
+  ///Mean and max loop time (μs) as uint16, deadline misses as uint32
+  const uint8_t loop = 3;
+  ///Packets received and dropped as uint32, log buffer fill (%) as uint8
+  const uint8_t link = 4;
+} telemetryID;
+
+///Order the frame types are sent in, the attitude is sent most often
+constexpr uint8_t telemetrySchedule[] = {
+  telemetryID.attitude, telemetryID.motors, telemetryID.attitude, telemetryID.loop, telemetryID.attitude, telemetryID.link
+};
+///Number of frames in the schedule
+const int telemetryScheduleLen = sizeof(telemetrySchedule);
+
+/** Encodes one part of the telemetry into a frame
+ *
+ *  @param[in] state Telemetry to encode
+ *  @param[in] type Type of frame, see TelemetryID
+ *  @param[in] sequence Sequence number (0 - 15)
+ *  @param[out] frame Buffer of at least telemetryMaxLength bytes
+ *  @returns Length of the frame (bytes), 0 if the type is unknown
+ */
+int encodeTelemetry(const TelemetryState &state, uint8_t type, uint8_t sequence, uint8_t frame[]);
+/** Decodes a telemetry frame. Only the fields in the frame are changed
+ *
+ *  @param[in] frame Frame to decode
+ *  @param[in] length Length of the frame (bytes)
+ *  @param[out] state Telemetry to put the decoded fields in
+ *  @param[out] type Type of the frame
+ *  @param[out] sequence Sequence number of the frame
+ *  @returns false if the frame is the wrong length, an unknown type or fails its CRC
+ */
+bool decodeTelemetry(const uint8_t frame[], int length, TelemetryState &state, uint8_t &type, uint8_t &sequence);
+#endif
@@ -1,35 +1,55 @@
+#include "Clock.h"
 #include "DroneRadio.h"
+#include "FlightRecord.h"
 #include "IMU.h"
+#include "LinkQuality.h"
 #include "Logger.h"
+#include "LoopWatchdog.h"
+#include "Memory.h"
 #include "MotorController.h"
 #include "PIDcontroller.h"
+#include "StateBus.h"
 
 /*** * * * DRONE SETTINGS * * * ***/
 const int loopRate = 2000; //Maxiumum loop rate (Hz)
 const int maxLoopTime = 1000000/loopRate; //Maximum loop time (us)
+const int telemetryDiv = 8; //Number of loops per telemetry update
 
 //IMU and sensor settings can be found in IMU.h
 //Log and SD card settings can be found in Logger.h
 //Motor settings can be found in MotorController.h
 //PID settings can be found in PIDcontroller.h
+//Loop overrun settings can be found in LoopWatchdog.h
 /*** * * * DRONE SETTINGS * * * ***/
 
 //Time vars
-unsigned long startTime;         //Start time of flight (in milliseconds)
-unsigned long loopTimestamp;     //Timestamp of the current loop
-unsigned long lastLoopTimestamp; //Timestamp of last loop
+FlightClock flightClock;         //Time of the flight, stopped while on standby
+micros_t loopTimestamp;          //Timestamp of the current loop (μs since the flight started, excluding standby)
+micros_t lastLoopTimestamp;      //Timestamp of last loop
+unsigned long bootTime;          //Time taken from power on to the end of setup (in milliseconds)
 //Standby
 int standbyStatus = 0; //0: not on standby, 1: starting standby, 2: on standby
-unsigned long standbyStartTime;
-unsigned long standbyOffset = 0;
+bool resumed = false; //True until the first loop after standby has been logged
 bool standbyLights = true;
 unsigned long lightChangeTime = 0;
-
-//Input vars
-int xyzr[4] = {0,0,0,0}; //Joystick inputs for x, y, z and rotation(yaw) (from -127 to 127)
-float potPercent = 0;    //Percentage of the controllers potentiometer, used as a trim
-bool light = false;
-bool standbyButton = false;
+//Telemetry
+int telemetryLoops = 0;
+unsigned long loopTimeSum = 0;
+unsigned long loopTimeMax = 0;
+uint32_t deadlineMisses = 0; //Loops more than 5% over the maximum loop time
+//Sheds work when loops overrun
+LoopWatchdog watchdog;
+//Log records waiting to be written while the loop is idle
+RecordQueue logQueue;
+uint32_t logQueueFull = 0;  //Loops which found the queue full and had to write a record themselves
+uint32_t logQueueMax = 0;   //Most records waiting at once
+unsigned long logOvershoot = 0; //Time the last wait ran past the next loop while writing the log (μs)
+//Time from a packet arriving to the motors changing
+LatencyTrace latency;
+micros_t lastInputTimestamp = 0;
+
+//States shared between modules (input, attitude, motor output and telemetry)
+StateBus bus;
 
 //Rotation vars
 IMU imu;
@@ -50,7 +70,7 @@ void blink(int d){
   delay(d);
 }
 
-//Return the loop time in milliseconds
+//Return the loop time in milliseconds, the host tools replace this to set the loop time of the modules they run
 float loopTime(){
   return (loopTimestamp - lastLoopTimestamp) / 1000.0;
 }
@@ -59,20 +79,58 @@ unsigned long loopTimeMicro(){
   return loopTimestamp - lastLoopTimestamp;
 }
 
+//Write the oldest queued log record, returns false if there are none
+bool writeQueuedRecord(){
+  FlightRecord record;
+  if (!logQueue.pop(record)) {
+    return false;
+  }
+  logRecord(logger, record);
+  return true;
+}
+
+//Publish the state sent to the controller as telemetry
+void publishTelemetry(const AttitudeState &attitude){
+  TelemetryState telemetry = {};
+  for (int i=0; i<3; i++) {
+    telemetry.angle[i] = attitude.angle[i];
+    telemetry.rate[i] = attitude.rate[i];
+  }
+  const MotorOutput &motors = bus.motors.get();
+  for (int i=0; i<motorCount; i++) {
+    telemetry.motorPower[i] = motors.motorPower[i];
+  }
+  telemetry.loopTimeMean = loopTimeSum / telemetryLoops;
+  telemetry.loopTimeMax = min(loopTimeMax, 65535UL);
+  telemetry.deadlineMisses = deadlineMisses;
+  telemetry.logBufferFill = logger.bufferFill;
+  telemetry.timestamp = loopTimestamp;
+  bus.telemetry.publish(telemetry);
+
+  telemetryLoops = 0;
+  loopTimeSum = 0;
+  loopTimeMax = 0;
+}
+
 void standby() {
+  //Turn off all motors, this is sent every loop as some ESC types need a signal each loop
+  ESC.writeZero();
+
   if (standbyStatus == 1) {
     standbyStatus = 2;
-    
-    //Turn off all motors
-    ESC.writeZero();
+
+    //Stop the integral building up while on standby
+    pid.reset();
   
     //Log the drone going into standby
     logger.logString("\n--- on standby ---\n");
 
-    standbyStartTime = micros();
+    flightClock.pause(clockMicros());
   }
 
   droneRadio.timer = 0;
+  //There is time to write the log while on standby
+  writeQueuedRecord();
   //Blink lights
   if (millis()-lightChangeTime > 750) {
     lightChangeTime = millis();
@@ -84,7 +142,14 @@ void standby() {
 void ABORT(){ //This is also used to turn off all the motors after landing
   ESC.writeZero();
 
-  logger.closeFile();
+  //The flight is over, write the rest of the log. Converting it uses the heap
+  while (writeQueuedRecord()) {}
+  unlockHeap();
+  pid.saveAutoTune(logger);
+  String memory = "Memory,Heap calls after setup," + String(heapViolations()) + ",Stack high water (bytes)," + String(stackHighWater());
+  memory += "\nLog queue,Loops finding it full," + String(logQueueFull) + ",Most waiting," + String(logQueueMax);
+  String autoTune = pid.autoTune ? pid.autoTuneSummary() + "\n" : "";
+  logger.closeFile(droneRadio.link.summary() + "\n" + latency.summary() + "\n" + memory + "\n" + watchdog.summary() + "\n" + imu.summary() + "\n" + autoTune);
   
   for (;;){
     ESC.writeZero();
@@ -97,118 +162,261 @@ void ABORT(){ //This is also used to turn off all the motors after landing
 void setup(){
   pinMode(lightPin, OUTPUT);
 
-  //Set up SD card
+  //Set up SD card and load the settings
   logger.init();
 
   //Set up PID controller
   pid.init(logger);
+  watchdog.init(logger);
 
-  //Set up inertial measurement unit
+  //Start setting up the inertial measurement unit
   if (imu.init(logger)) {
     logger.logString("IMU error");
     ABORT();
   }
 
-  //Set up motors
+  //Start arming the motors
   ESC.init(logger);
 
+  //Set up communication
+  droneRadio.init(bus.telemetry);
+
+  //Run the remaining startup tasks at the same time until they have all finished
+  bool logFileReady = false;
+  bool imuReady = false;
+  bool escReady = false;
+  bool radioReady = false;
+  while (!(logFileReady and imuReady and escReady and radioReady)) {
+    imuReady = imu.updateCalibration(logger);
+    escReady = ESC.updateArming(imuReady);
+    if (ESC.outputFailed) {
+      logger.logString("ESC error");
+      ABORT();
+    }
+    //Allocating the log file blocks for a while so do it while the ESCs are starting up
+    if (!logFileReady) {
+      logger.initLogFile();
+      logFileReady = true;
+    }
+    //Only tell the controller the drone is ready once everything else has finished
+    if (imuReady and escReady) {
+      radioReady = droneRadio.updateReady();
+    }
+  }
+
+  //Startup lights, keep sending zero power to the ESCs so they stay armed
+  unsigned long lightStartTime = millis();
+  while (millis() - lightStartTime < 610) {
+    unsigned long lightTime = millis() - lightStartTime;
+    digitalWrite(lightPin, lightTime >= 10 and (lightTime-10) % 200 < 100);
+    ESC.writeZero();
+  }
+  digitalWrite(lightPin, LOW);
+  bootTime = millis();
+
   //Log the settings
   logger.logString("User input\n");
   logger.logSetting("maxZdiff", ESC.maxZdiff, 2, 2, false);
   logger.logSetting("potMaxDiff", ESC.potMaxDiff);
   logger.logSetting("maxAngle", 127/pid.maxAngle);
+  logger.logSetting("maxRate", pid.maxRate, 3, 0);
   logger.logString("\nOffsets\n");
-  logger.logSetting("motorOffset", ESC.offset, 4, 3, false);
+  logger.logSetting("motorOffset", ESC.offset, motorCount, 3, false);
   logger.logSetting("angleOffset", imu.angleOffset, 3, 2);
   logger.logSetting("defaultZ", ESC.defaultZ);
+  logger.logSetting("thrustCurve", ESC.thrustCurve, 2);
+  logger.logSetting("nominalVoltage", ESC.nominalVoltage, 1);
+  logger.logSetting("batteryVoltage", ESC.batteryVoltage, 2);
+  logger.logSetting("calibrationReused", imu.calibrationReused);
+  logger.logSetting("gyroBias", imu.calibration.gyroBias, 3, 3);
+  logger.logSetting("accelOffset", imu.calibration.accelOffset, 3, 3);
+  logger.logSetting("calibrationTemp", imu.calibration.temperature, 1);
+  #if IMU_TYPE == IMU_MPU6050 or IMU_TYPE == NO_IMU
+    logger.logSetting("beta", imu.beta, 4);
+    logger.logSetting("zeta", imu.zeta, 4);
+    logger.logSetting("kalmanParams", imu.kalmanParams, 3, 3);
+  #endif
+  #if IMU_TYPE == IMU_MPU6050
+    logger.logSetting("imuCount", imu.imuCount);
+    logger.logSetting("maxDisagreement", imu.maxDisagreement, 2, 2);
+    logger.logSetting("healthSmoothing", imu.healthSmoothing, 4);
+  #endif
   logger.logString("\nPerformance\n");
   logger.logSetting("Loop rate", loopRate, false);
-  logger.logSetting("Pgain", pid.Pgain, 3, 2);
+  logger.logSetting("angleGain", pid.angleGain, 2, 2);
+  logger.logSetting("FFgain", pid.FFgain, 2, 2);
+  logger.logSetting("Pgain", pid.Pgain, 3, 3);
   logger.logSetting("Igain", pid.Igain, 3, 4);
-  logger.logSetting("Dgain", pid.Dgain, 3, 3);
+  logger.logSetting("Dgain", pid.Dgain, 3, 4);
+  logger.logSetting("dCutoff", pid.dCutoff, 1);
+  logger.logSetting("Ilimit", pid.Ilimit, 3);
+  logger.logSetting("outerLoopDiv", pid.outerLoopDiv);
+  logger.logSetting("scheduleThrottle", pid.scheduleThrottle, scheduleThrottlePoints, 2);
+  logger.logSetting("scheduleVoltage", pid.scheduleVoltage, scheduleVoltagePoints, 1);
+  logger.logSetting("Pschedule", pid.Pschedule, scheduleVoltagePoints*scheduleThrottlePoints, 2);
+  logger.logSetting("Ischedule", pid.Ischedule, scheduleVoltagePoints*scheduleThrottlePoints, 2);
+  logger.logSetting("Dschedule", pid.Dschedule, scheduleVoltagePoints*scheduleThrottlePoints, 2);
+  logger.logSetting("dCutoffSchedule", pid.dCutoffSchedule, scheduleVoltagePoints*scheduleThrottlePoints, 2);
+  logger.logSetting("tunedGainsLoaded", pid.tunedGainsLoaded);
+  logger.logSetting("autoTune", pid.autoTune);
+  logger.logSetting("watchdog", watchdog.watchdog);
+  logger.logSetting("stepDownOverrun", watchdog.stepDownOverrun, 1);
+  logger.logSetting("stepUpMargin", watchdog.stepUpMargin, 1);
+  logger.logSetting("stepUpWindows", watchdog.stepUpWindows);
+  logger.logSetting("shedLogDiv", watchdog.shedLogDiv);
+  logger.logSetting("reducedLoopRate", watchdog.reducedLoopRate);
+  logger.logSetting("Boot time (ms)", (int)bootTime);
+  #if DSHOT_ESC
+    logger.logSetting("bidirectional", ESC.bidirectional);
+    logger.logSetting("motorPoles", ESC.motorPoles);
+  #endif
   logger.logString("\nchangeLog,CHANGELOG GOES HERE\n");
-  logger.logString("Time (μs),Loop time (μs),Roll input,Pitch input,Vertical input,Yaw input,Pot,roll,pitch,Pr,Pp,Ir,Ip,Dr,Dp,radio,yaw");
-  
-  //Set up communication
-  droneRadio.init();
+  logColumns(logger);
 
-  //Startup lights
-  delay(10);
-  for (int i=0; i<3; i++){
-    blink(100);
-  }
+  //Store the starting state of the angle estimate so the log can be replayed (see src/host/sim/replay.cpp)
+  imu.saveEstimator(logger);
+
+  //From here on the loop only uses static memory and the stack (see Memory.h)
+  paintStack();
+  lockHeap();
 
   //Start the clock
-  startTime = micros();
-  loopTimestamp = startTime;
-  lastLoopTimestamp = startTime;
+  flightClock.start(clockMicros());
+  loopTimestamp = 0;
+  lastLoopTimestamp = 0;
 }
 
 
 void loop(){
   // Recieve input data
-  droneRadio.getInput();
+  droneRadio.getInput(bus.rc);
+  const RcCommand &rc = bus.rc.get();
+  //Trace new input through to the motors
+  if (rc.timestamp != lastInputTimestamp) {
+    lastInputTimestamp = rc.timestamp;
+    latency.begin(rc.timestamp, clockMicros());
+  }
 
   //Check standby status
-  if (standbyButton and standbyStatus == 0) {
+  if (rc.standbyButton and standbyStatus == 0) {
     standbyStatus = 1;
-  } else if (!standbyButton and standbyStatus == 2) {
-    standbyOffset += micros() - standbyStartTime;
+  } else if (!rc.standbyButton and standbyStatus == 2) {
+    flightClock.resume(clockMicros());
     standbyStatus = 0;
+    resumed = true;
   }
   
   if (standbyStatus > 0) {
     standby();
   } else {
     //Check radio signal
-    droneRadio.checkSignal(loopTimeMicro(), loopTimestamp);
+    droneRadio.checkSignal(loopTimestamp);
 
 
     /* Get current angle */
-    imu.updateAngle();
+    imu.updateAngle(bus.attitude);
+    const AttitudeState &attitude = bus.attitude.get();
     
     //Get loop time
     lastLoopTimestamp = loopTimestamp;
-    loopTimestamp = micros()-standbyOffset;
-    //Make sure the loop is executing no faster than the max loop time
-    while (loopTimeMicro() < maxLoopTime) {
-      delayMicroseconds(1);
-      loopTimestamp = micros()-standbyOffset;
+    loopTimestamp = flightClock.flightTime(clockMicros());
+    //Shed work if the loops are running past their tick, including the last wait if writing the log overran it
+    if (watchdog.update(loopTimeMicro(), logOvershoot, loopTimestamp)) {
+      pid.setLoopRate(watchdog.rate());
+    }
+    //Make sure the loop is executing no faster than the loop time of the watchdog's level, writing the log meanwhile
+    bool wrote = false;
+    while (loopTimeMicro() < watchdog.loopPeriod) {
+      wrote = watchdog.loopPeriod - loopTimeMicro() >= logWriteTime and writeQueuedRecord();
+      if (!wrote) {
+        delayMicroseconds(1);
+      }
+      loopTimestamp = flightClock.flightTime(clockMicros());
+    }
+    logOvershoot = wrote ? loopTimeMicro() - watchdog.loopPeriod : 0;
+    loopTimeSum += loopTimeMicro();
+    loopTimeMax = max(loopTimeMax, loopTimeMicro());
+    if (loopTimeMicro() > watchdog.loopPeriod + watchdog.loopPeriod/20) {
+      deadlineMisses++;
     }
 
 
     /* Calculate motor speeds */
-    pid.calcPID(imu);
+    //The base motor power is set by ESC.write, so the gains are scheduled with the last loop's
+    float throttle = ESC.initialPower;
+    float voltage = ESC.batteryVoltage > 0 ? ESC.batteryVoltage : ESC.nominalVoltage;
+    pid.scheduleGains(throttle, voltage);
+    //The integral is held while the last loop's output did not fit in the motor power range
+    bool saturated = ESC.desaturated;
+    pid.calcPID(attitude, rc, saturated);
+    latency.mark(1, clockMicros());
     
     //Apply the calculated roll, pitch and yaw change
-    ESC.addChange(pid.PIDchange, 0, 0,2, 1,3);
-    ESC.addChange(pid.PIDchange, 1, 0,1, 2,3);
-    ESC.addChange(pid.PIDchange, 2, 0,3, 1,2);
+    ESC.addChange(pid.PIDchange);
 
 
     /* Apply input to hardware */
-    digitalWrite(lightPin, light);
-    ESC.write();
+    digitalWrite(lightPin, rc.light);
+    ESC.write(rc, bus.motors);
+    latency.mark(2, clockMicros());
+    ESC.commit();
+    latency.mark(3, clockMicros());
+
+    /* Update telemetry */
+    telemetryLoops++;
+    if (telemetryLoops >= telemetryDiv and watchdog.telemetryDue()) {
+      publishTelemetry(attitude);
+    }
 
     /* Log flight info */
-    if (logger.checkLogReady()) {
-      logger.logTime(micros()-startTime-standbyOffset);
+    //Only a copy is made here, the record is written while waiting for a later loop
+    if (logger.checkLogReady() and watchdog.logDue()) {
+      FlightRecord record;
+      //Only the low 32 bits are logged, so the log's time wraps after 71 minutes of flight
+      record.time = (uint32_t)loopTimestamp;
       for (int i=0; i<4; i++) {
-        logger.logData(xyzr[i], typeID.uint8);
-      }
-      logger.logData((uint8_t)(potPercent*255), typeID.uint8);
-      for (int i=0; i<2; i++) {
-        logger.logData(imu.currentAngle[i], typeID.float32);
+        record.xyzr[i] = rc.xyzr[i];
       }
+      record.pot = rc.potPercent*255;
       for (int i=0; i<3; i++) {
         for (int j=0; j<2; j++) {
-          logger.logData(pid.PIDchange[i][j], typeID.float16k);
+          record.PIDchange[i][j] = pid.PIDchange[i][j];
         }
       }
-      logger.logData((uint16_t)(droneRadio.timer/1000), typeID.uint16);
-      logger.logData(imu.currentAngle[2], typeID.float16);
-
-      logger.write();
+      record.angle[0] = attitude.angle[0];
+      record.angle[1] = attitude.angle[1];
+      record.yaw = attitude.angle[2];
+      record.radio = droneRadio.timer/1000;
+      record.packetRate = droneRadio.link.packetRate;
+      record.packetLoss = droneRadio.link.packetLoss;
+      record.jitter = min(droneRadio.link.jitter, 65535.0f);
+      record.latency = min(latency.latency, 65535UL);
+      for (int i=0; i<3; i++) {
+        record.rawAccel[i] = imu.rawAccel[i];
+        record.rawGyro[i] = imu.rawGyro[i];
+      }
+      record.newSample = imu.newSample;
+      record.resumed = resumed;
+      record.saturated = saturated;
+      resumed = false;
+      record.throttle = throttle;
+      record.voltage = voltage;
+      record.gainScale = pid.gainScale;
+      record.autoTuneStage = pid.autoTuneStage;
+      record.degradation = watchdog.level;
+      #if DSHOT_ESC
+        const MotorOutput &motors = bus.motors.get();
+        for (int i=0; i<motorCount; i++) {
+          record.rpm[i] = min(motors.rpm[i], 65535.0f);
+        }
+      #endif
+      //If there was no time to write the queue the loop writes the oldest record, the watchdog sees the slower loop
+      if (!logQueue.push(record)) {
+        writeQueuedRecord();
+        logQueue.push(record);
+        logQueueFull++;
+      }
+      logQueueMax = max(logQueueMax, logQueue.count());
     }
   }
 }
@@ -0,0 +1,166 @@
+/*
+ * Checks the firmware's clock (Clock.h) against the simulated time of the HAL, and times reading it.
+ *
+ * The simulated cycle counter runs at F_CPU_ACTUAL from the HAL's clock, so it wraps every 7.2 s like the Teensy's. The
+ * clock is started just before micros() would wrap on the Teensy (2^32 μs) and read at random gaps up to just under a
+ * wrap of the cycle counter, checking it never goes back and stays within a microsecond of the HAL's time, then read
+ * after gaps of several wraps like a long setup step. Cycle counts read before and after the clock are converted back to
+ * times, rounding down, and the flight time is checked across a standby longer than a wrap. Exits with 1 if any check
+ * fails.
+ */
+#include "Clock.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+///Number of failed checks
+static int failures = 0;
+
+/** Records a failed check */
+static void check(bool ok, const char *name) {
+  if (!ok) {
+    printf("FAIL: %s\n", name);
+    failures++;
+  }
+}
+
+///Time the clock is started at, just before 32 bits of microseconds wrap (ns)
+static const uint64_t startNanos = ((1ULL << 32) - 60000000) * 1000;
+///Longest gap between reads of the clock, just under a wrap of the cycle counter (ns)
+static const uint64_t maxGapNanos = (1ULL << 32) / (F_CPU_ACTUAL / 1000000) * 1000 - 1000000;
+
+/** Simulated time (μs) */
+static micros_t halMicros() {
+  return hal::clockNanos / 1000;
+}
+
+/** Gets a random gap between reads of the clock, mostly loop times with a long gap now and then (ns) */
+static uint64_t randomGap() {
+  if (rand() % 1000 == 0) {
+    return maxGapNanos - rand() % 1000000;
+  }
+  return rand() % 2000000;
+}
+
+/** Checks the clock follows the simulated time across many wraps of the cycle counter and past 2^32 μs */
+static void checkWraps(int reads) {
+  micros_t last = clockMicros();
+  bool monotonic = true, agrees = true;
+  for (int i=0; i<reads; i++) {
+    hal::advanceNanos(randomGap());
+    micros_t now = clockMicros();
+    monotonic &= now >= last;
+    agrees &= now + 1 >= halMicros() and now <= halMicros() + 1;
+    last = now;
+  }
+  check(monotonic, "clock never goes back");
+  check(agrees, "clock within 1 μs of the simulated time");
+  check(last > (1ULL << 32), "clock past 2^32 μs");
+  check(hal::clockNanos - startNanos > 10 * maxGapNanos, "clock read across several wraps of the cycle counter");
+}
+
+/** Checks the clock follows the simulated time when it is not read for several wraps of the cycle counter */
+static void checkLongGaps() {
+  bool agrees = true;
+  for (int i=0; i<1000; i++) {
+    //From just over one wrap to about a minute and a half
+    hal::advanceNanos(maxGapNanos + 2000000 + rand() % 90000 * 1000000ULL);
+    micros_t now = clockMicros();
+    agrees &= now + 1 >= halMicros() and now <= halMicros() + 1;
+  }
+  check(agrees, "clock within 1 μs of the simulated time after gaps of several wraps");
+}
+
+/** Checks cycle counts from either side of the last read of the clock are converted back to their time */
+static void checkConversion() {
+  bool ok = true;
+  for (int i=0; i<1000; i++) {
+    //A count from before the last read, e.g. a packet which waited in the queue
+    uint32_t before = cycleCount();
+    micros_t beforeTime = halMicros();
+    hal::advanceNanos(rand() % 3000000000ULL);
+    micros_t now = clockMicros();
+    ok &= cyclesToMicros(before) + 1 >= beforeTime and cyclesToMicros(before) <= beforeTime + 1;
+    ok &= cyclesToMicros(cycleCount()) == now;
+
+    //A count from after it, e.g. an interrupt since the last loop
+    hal::advanceNanos(rand() % 3000000000ULL);
+    uint32_t after = cycleCount();
+    micros_t afterTime = halMicros();
+    ok &= cyclesToMicros(after) + 1 >= afterTime and cyclesToMicros(after) <= afterTime + 1;
+    ok &= clockMicros() >= cyclesToMicros(after);
+  }
+  check(ok, "cycle counts converted to the time of the clock");
+
+  //A count whole microseconds before the clock is in the microsecond it was read, not the one after
+  const uint32_t cyclesPerMicro = F_CPU_ACTUAL / 1000000;
+  bool roundsDown = true;
+  for (int i=0; i<1000; i++) {
+    hal::advanceNanos(rand() % 1000000);
+    micros_t now = clockMicros();
+    uint32_t cycles = cycleCount();
+    for (int n=1; n<=1000; n+=37) {
+      roundsDown &= cyclesToMicros(cycles - n * cyclesPerMicro) == now - n;
+    }
+  }
+  check(roundsDown, "cycle counts from before the clock rounded down");
+}
+
+/** Checks the flight time stops on standby, including a standby longer than a wrap of the cycle counter */
+static void checkStandby() {
+  FlightClock flight;
+  flight.start(clockMicros());
+  hal::advanceMicros(5000000);
+  check(flight.flightTime(clockMicros()) == 5000000, "flight time before standby");
+
+  //The loop keeps reading the clock on standby
+  flight.pause(clockMicros());
+  for (int i=0; i<20000; i++) {
+    hal::advanceMicros(1000);
+    clockMicros();
+    flight.pause(clockMicros());
+  }
+  check(flight.flightTime(clockMicros()) == 5000000, "flight time stopped on standby");
+  flight.resume(clockMicros());
+  flight.resume(clockMicros());
+  hal::advanceMicros(2500000);
+  check(flight.flightTime(clockMicros()) == 7500000, "flight time after standby");
+
+  //A second standby adds to the first
+  flight.pause(clockMicros());
+  hal::advanceMicros(4000000);
+  clockMicros();
+  flight.resume(clockMicros());
+  hal::advanceMicros(100);
+  check(flight.flightTime(clockMicros()) == 7500100, "flight time after a second standby");
+}
+
+int main(int argc, char **argv) {
+  int iterations = 10000000;
+  for (int i=1; i<argc-1; i++) {
+    if (!strcmp(argv[i], "--iterations")) {
+      iterations = atoi(argv[++i]);
+    }
+  }
+
+  srand(1);
+  hal::clockNanos = startNanos;
+  checkWraps(iterations / 100);
+  checkLongGaps();
+  checkConversion();
+  checkStandby();
+  printf("clock: %d checks failed\n", failures);
+
+  //Time reading the clock, the simulated cycle counter is slower to read than the Teensy's
+  volatile micros_t sink = 0;
+  auto startTime = std::chrono::steady_clock::now();
+  for (int i=0; i<iterations; i++) {
+    hal::clockNanos += 250;
+    sink = sink + clockMicros();
+  }
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - startTime).count() / iterations;
+  printf("clock: %.1f ns per read\n", ns);
+  return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,279 @@
+/*
+ * Runs the PID controller and motor mixer over a fixed sequence of attitudes and joystick inputs.
+ *
+ * The float build saves its outputs as a reference (--save), the fixed point build compares its outputs against them (--compare).
+ * Both report the time and cycles taken per control step. Every term of every axis is used, and part of the sequence holds a
+ * rate error until the integral reaches Ilimit, so the clamps are compared too. The gains follow an unevenly spaced gain
+ * schedule swept over throttle and battery voltage, and the sticks are sometimes at their ends (-127 and 128). Exits with
+ * 1 if the integral of an axis never reaches its clamp, or the schedule does not give the multipliers set at its
+ * breakpoints.
+ */
+#include "Arduino.h"
+#include "Logger.h"
+#include "MotorController.h"
+#include "PIDcontroller.h"
+#include "StateBus.h"
+
+#include <chrono>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+  #include <x86intrin.h>
+#endif
+
+//Definitions normally in drone.ino
+const int loopRate = 2000;
+///Loops per gyroscope sample, the MPU6050 is read at 200 Hz
+const int gyroLoops = loopRate / 200;
+const int lightPin = 5;
+///Pin the simulated battery voltage is read from
+const int batteryPin = 14;
+void blink(int d) {
+  delay(d);
+  delay(d);
+}
+float loopTime() {
+  return 1000.0f / loopRate;
+}
+
+///Number of outputs stored per control step, PIDcontroller::PIDchange then MotorController::motorPower
+const int outputsPerStep = 9 + motorCount;
+///Steps the rate error is held for to drive the integrals into their clamp, and the error (degrees per second)
+const int windupStart = 100000, windupSteps = 8000;
+const float windupError = 60;
+
+/** Small deterministic random number generator so every build sees the same inputs */
+struct XorShift {
+  uint32_t state = 2463534242u;
+  /** Returns a random number between -1 and 1 */
+  float next() {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return (state / 4294967296.0f) * 2 - 1;
+  }
+};
+
+/** Reads the CPU cycle counter if there is one */
+static uint64_t readCycles() {
+  #if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+  #else
+    return 0;
+  #endif
+}
+
+int main(int argc, char **argv) {
+  const char *saveFile = nullptr;
+  const char *compareFile = nullptr;
+  int steps = 200000;
+  float pidTolerance = .002;
+  float motorTolerance = 2;
+  for (int i=1; i<argc-1; i++) {
+    if (!strcmp(argv[i], "--save")) {
+      saveFile = argv[++i];
+    } else if (!strcmp(argv[i], "--compare")) {
+      compareFile = argv[++i];
+    } else if (!strcmp(argv[i], "--steps")) {
+      steps = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--tolerance")) {
+      pidTolerance = atof(argv[++i]);
+    }
+  }
+
+  //Set up the modules
+  Serial.redirect(nullptr, false);
+  Logger logger;
+  logger.init();
+  PIDcontroller pid;
+  pid.init(logger);
+  //The defaults have no integral and no yaw derivative, use gains which exercise every term
+  const float Igain[3] = {.2, .2, .3};
+  for (int i=0; i<3; i++) {
+    pid.Igain[i] = Igain[i];
+  }
+  pid.Dgain[2] = .002;
+  pid.Ilimit = .02;
+  //An uneven gain schedule, which is swept over below
+  const float scheduleThrottle[scheduleThrottlePoints] = {0, .2, .45, 1};
+  const float scheduleVoltage[scheduleVoltagePoints] = {9.6, 10.8, 12.6};
+  for (int i=0; i<scheduleThrottlePoints; i++) {
+    pid.scheduleThrottle[i] = scheduleThrottle[i];
+  }
+  for (int i=0; i<scheduleVoltagePoints; i++) {
+    pid.scheduleVoltage[i] = scheduleVoltage[i];
+  }
+  for (int i=0; i<scheduleVoltagePoints*scheduleThrottlePoints; i++) {
+    pid.Pschedule[i] = .7f + .05f*i;
+    pid.Ischedule[i] = 1.6f - .08f*i;
+    pid.Dschedule[i] = .5f + .25f*(i % 5);
+    pid.dCutoffSchedule[i] = .6f + .2f*(i % 4);
+  }
+  pid.updateGains();
+
+  //The schedule gives exactly the multipliers set at its breakpoints, to the precision of the fixed point path
+  const float scheduleTolerance = CONTROL_MATH == FIXED_MATH ? 1e-6 : 0;
+  bool scheduleExact = true;
+  for (int v=0; v<scheduleVoltagePoints; v++) {
+    for (int t=0; t<scheduleThrottlePoints; t++) {
+      int i = v*scheduleThrottlePoints + t;
+      pid.scheduleGains(scheduleThrottle[t], scheduleVoltage[v]);
+      scheduleExact &= fabs(pid.gainScale.P - pid.Pschedule[i]) <= scheduleTolerance;
+      scheduleExact &= fabs(pid.gainScale.I - pid.Ischedule[i]) <= scheduleTolerance;
+      scheduleExact &= fabs(pid.gainScale.D - pid.Dschedule[i]) <= scheduleTolerance;
+      scheduleExact &= fabs(pid.gainScale.dCutoff - pid.dCutoffSchedule[i]) <= scheduleTolerance;
+    }
+  }
+  if (!scheduleExact) {
+    fprintf(stderr, "The gain schedule does not give the multipliers set at its breakpoints\n");
+    return 1;
+  }
+  //Use the thrust and battery voltage tables, with the battery a little below the nominal voltage
+  MotorController ESC;
+  ESC.thrustCurve = .5;
+  ESC.batteryPin = batteryPin;
+  hal::analogValue[batteryPin] = 10.5 / ESC.voltageScale;
+  ESC.init(logger);
+  while (!ESC.updateArming(true)) {
+    delay(1);
+  }
+  StateBus bus;
+
+  //Generate the inputs, sine waves with noise and joystick steps
+  XorShift random;
+  std::vector<AttitudeState> attitudes(steps);
+  std::vector<RcCommand> commands(steps);
+  RcCommand rc = {};
+  for (int i=0; i<steps; i++) {
+    float t = (float)i / loopRate;
+    if (i % 2000 == 0) {
+      for (int j=0; j<4; j++) {
+        rc.xyzr[j] = (int)(random.next() * 127);
+      }
+      rc.potPercent = (random.next() + 1) / 2;
+      //Full stick now and then, the radio decodes sticks as -127 - 128
+      if (i % 8000 == 6000) {
+        for (int j=0; j<4; j++) {
+          rc.xyzr[j] = i % 16000 == 6000 ? 128 : -127;
+        }
+      }
+    }
+    commands[i] = rc;
+    //The gyroscope has a new sample every gyroLoops loops, the rate is held in between
+    attitudes[i].newSample = i % gyroLoops == 0;
+    for (int j=0; j<3; j++) {
+      float phase = t * 2*PI * (j+1);
+      attitudes[i].angle[j] = 10*sin(phase) + random.next()*.2f;
+      float rate = 10*2*PI*(j+1)*cos(phase) + random.next()*5;
+      attitudes[i].rate[j] = attitudes[i].newSample ? rate : attitudes[i-1].rate[j];
+    }
+
+    //Hold the drone level with centred sticks while it rotates steadily, so the integrals wind up to their clamp
+    if (i >= windupStart and i < windupStart + windupSteps) {
+      commands[i].xyzr[0] = commands[i].xyzr[1] = commands[i].xyzr[3] = 0;
+      for (int j=0; j<3; j++) {
+        attitudes[i].angle[j] = 0;
+        attitudes[i].rate[j] = -windupError;
+      }
+    }
+  }
+
+  //Run the control path
+  std::vector<float> outputs((size_t)steps * outputsPerStep);
+  int clamped[3] = {};
+  auto startTime = std::chrono::steady_clock::now();
+  uint64_t startCycles = readCycles();
+  for (int i=0; i<steps; i++) {
+    //Sweep the throttle and voltage past the ends of the schedule, the same in every build
+    float sweep = (float)i / steps;
+    pid.scheduleGains(1.2f*fabs(sin(sweep * 2*PI*7)) - .1f, 9 + 4*sweep);
+    pid.calcPID(attitudes[i], commands[i], ESC.desaturated);
+    ESC.addChange(pid.PIDchange);
+    ESC.write(commands[i], bus.motors);
+    ESC.commit();
+
+    float *out = &outputs[(size_t)i * outputsPerStep];
+    for (int j=0; j<9; j++) {
+      out[j] = qToFloat(pid.PIDchange[j/3][j%3]);
+    }
+    for (int j=0; j<3; j++) {
+      clamped[j] += fabs(out[3+j]) >= pid.Ilimit * .999f;
+    }
+    for (int j=0; j<motorCount; j++) {
+      out[9+j] = ESC.motorPower[j];
+    }
+  }
+  uint64_t cycles = readCycles() - startCycles;
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - startTime).count();
+
+  //Time the motor update on its own (mixing, thrust and voltage tables)
+  auto writeStartTime = std::chrono::steady_clock::now();
+  for (int i=0; i<steps; i++) {
+    ESC.write(commands[i], bus.motors);
+  }
+  double writeNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - writeStartTime).count();
+
+  const char *mathName = CONTROL_MATH == FIXED_MATH ? "fixed" : "float";
+  printf("%s: %d steps, %.1f ns/step", mathName, steps, ns / steps);
+  if (cycles) {
+    printf(", %.1f cycles/step", (double)cycles / steps);
+  }
+  printf(", motor update %.1f ns/motor\n", writeNs / steps / motorCount);
+  printf("  integral at its clamp in %d, %d and %d steps (roll, pitch, yaw)\n", clamped[0], clamped[1], clamped[2]);
+  if (!clamped[0] or !clamped[1] or !clamped[2]) {
+    fprintf(stderr, "The integral of an axis never reached Ilimit, its clamp was not exercised\n");
+    return 1;
+  }
+
+  if (saveFile) {
+    FILE *file = fopen(saveFile, "wb");
+    if (!file) {
+      fprintf(stderr, "Could not open %s\n", saveFile);
+      return 1;
+    }
+    fwrite(outputs.data(), sizeof(float), outputs.size(), file);
+    fclose(file);
+  }
+
+  if (compareFile) {
+    FILE *file = fopen(compareFile, "rb");
+    if (!file) {
+      fprintf(stderr, "Could not open %s\n", compareFile);
+      return 1;
+    }
+    std::vector<float> reference(outputs.size());
+    size_t count = fread(reference.data(), sizeof(float), reference.size(), file);
+    fclose(file);
+    if (count != reference.size()) {
+      fprintf(stderr, "%s has a different number of steps\n", compareFile);
+      return 1;
+    }
+
+    //Compare each output against the reference
+    float maxError[outputsPerStep] = {};
+    size_t exact = 0;
+    for (size_t i=0; i<outputs.size(); i++) {
+      float error = fabs(outputs[i] - reference[i]);
+      maxError[i % outputsPerStep] = max(maxError[i % outputsPerStep], error);
+      if (!memcmp(&outputs[i], &reference[i], sizeof(float))) {
+        exact++;
+      }
+    }
+    printf("%zu/%zu outputs bit exact\n", exact, outputs.size());
+
+    bool pass = true;
+    const char *axes[3] = {"roll", "pitch", "yaw"};
+    for (int i=0; i<outputsPerStep; i++) {
+      bool isPID = i < 9;
+      float tolerance = isPID ? pidTolerance : motorTolerance;
+      if (isPID) {
+        printf("  %c %-5s max error %.2e", "PID"[i/3], axes[i%3], maxError[i]);
+      } else {
+        printf("  motor %d max error %.3f  ", i-9, maxError[i]);
+      }
+      printf("%s\n", maxError[i] <= tolerance ? "" : "  FAIL");
+      pass &= maxError[i] <= tolerance;
+    }
+    return pass ? 0 : 1;
+  }
+  return 0;
+}
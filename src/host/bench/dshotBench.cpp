@@ -0,0 +1,248 @@
+/*
+ * Checks the DShot frame encoder, DMA buffer generation and reply decoder (DShot.h), and times them.
+ *
+ * Every throttle value is encoded and read back from the simulated toggle buffer, and every reply value is
+ * sent through simulated line samples with a clock mismatch between the ESC and the flight controller. Frames and
+ * replies are also checked against fixed values worked out from the DShot spec, so an error shared by the encoder and
+ * the bench's own round trip is still caught. Exits with 1 if any value does not survive the round trip or does not
+ * match its fixed value.
+ */
+#include "DShot.h"
+#include "Mixer.h"
+
+#include <chrono>
+#include <cmath>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+///5 bit GCR code of each nibble
+static const uint8_t gcrEncode[16] = {
+  0x19, 0x1B, 0x12, 0x13, 0x1D, 0x15, 0x16, 0x17, 0x1A, 0x09, 0x0A, 0x0B, 0x1E, 0x0D, 0x0E, 0x0F
+};
+
+/**
+ * @struct KnownFrame
+ * @brief A frame worked out by hand from the spec: the 11 bit value, the telemetry bit, then the CRC of the 3 nibbles
+ */
+struct KnownFrame {
+  uint16_t value;
+  bool telemetry;
+  ///Frame with the normal CRC, and with the inverted CRC of bidirectional DShot
+  uint16_t frame, invertedFrame;
+};
+///Known frames, throttle 1046 is the worked example of the "DShot - the missing handbook" guide (CRC 0110)
+static const KnownFrame knownFrames[] = {
+  {1046, false, 0x82C6, 0x82C9},
+  {0, false, 0x0000, 0x000F},
+  {48, false, 0x0606, 0x0609},
+  {1000, true, 0x7D1B, 0x7D14},
+  {5, true, 0x00BB, 0x00B4},
+  {2047, true, 0xFFFF, 0xFFF0},
+};
+
+/**
+ * @struct KnownReply
+ * @brief A bidirectional DShot reply worked out by hand from the spec's GCR table and eRPM format
+ */
+struct KnownReply {
+  ///Start edge then 4 GCR nibbles, 1 where the line changes level
+  uint32_t edges;
+  ///12 bit value, 3 bit exponent then 9 bit mantissa of the period (μs)
+  uint32_t value;
+  uint32_t erpm;
+};
+static const KnownReply knownReplies[] = {
+  {0x193D5A, 0x2FA, 120000}, //250 << 1 = 500 μs
+  {0x1CDBAD, 0x064, 600000}, //100 μs
+  {0x1BDEFA, 0x777, 20000},  //375 << 3 = 3000 μs
+  {0x17BDF9, 0xFFF, 0},      //Longest period, the motor is stopped
+};
+///Line levels of the first known reply, one per bit, idling high before the start edge
+static const char knownReplyLine[] = "011100010100110010011";
+
+/** Small deterministic random number generator so every build sees the same inputs */
+struct XorShift {
+  uint32_t state = 2463534242u;
+  uint32_t next() {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+  }
+};
+
+/** Reads the frame of each pin back from a toggle buffer, returns false if a bit was not a valid length */
+static bool readBuffer(const uint32_t buffer[], const uint32_t masks[], int count, bool idle, uint16_t frames[]) {
+  for (int i=0; i<count; i++) {
+    bool level = idle;
+    frames[i] = 0;
+    for (int bit=0; bit<16; bit++) {
+      //Count how many thirds of the bit the line is active for
+      int active = 0;
+      for (int word=0; word<dshotWordsPerBit; word++) {
+        if (buffer[bit*dshotWordsPerBit + word] & masks[i]) {
+          level = !level;
+        }
+        active += level != idle;
+      }
+      if (level != idle or (active != 1 and active != 2)) {
+        return false;
+      }
+      frames[i] = (frames[i] << 1) | (active == 2);
+    }
+  }
+  return true;
+}
+
+/** Creates the edges of a reply, the inverse of dshotReadReply() and dshotDecodeReply() */
+static uint32_t encodeReply(uint32_t value) {
+  uint32_t crc = ~(value ^ (value >> 4) ^ (value >> 8)) & 0xF;
+  uint32_t data = (value << 4) | crc;
+  uint32_t reply = 1;
+  for (int i=3; i>=0; i--) {
+    reply = (reply << 5) | gcrEncode[(data >> (i*4)) & 0xF];
+  }
+  return reply;
+}
+
+/** Samples the line during a reply
+ *
+ *  @param[in] reply Edges of the reply
+ *  @param[in] leadBits Time before the reply starts (bits)
+ *  @param[in] drift Clock mismatch between the ESC and flight controller (fraction)
+ */
+static void sampleReply(uint32_t reply, float leadBits, float drift, uint32_t mask, uint32_t samples[], int count) {
+  for (int j=0; j<count; j++) {
+    float t = (float)j / dshotSamplesPerBit * (1 + drift) - leadBits;
+    bool level = true;
+    if (t >= 0 and t < dshotReplyBits) {
+      //Count the edges up to this bit
+      int bit = (int)t;
+      for (int k=0; k<=bit; k++) {
+        if (reply & (1u << (dshotReplyBits-1-k))) {
+          level = !level;
+        }
+      }
+    }
+    samples[j] = level ? mask : 0;
+  }
+}
+
+int main(int argc, char **argv) {
+  int iterations = 1000000;
+  for (int i=1; i<argc-1; i++) {
+    if (!strcmp(argv[i], "--iterations")) {
+      iterations = atoi(argv[++i]);
+    }
+  }
+  bool pass = true;
+  XorShift random;
+
+  //Every frame has a valid CRC and survives the DMA buffer
+  uint32_t masks[motorCount];
+  for (int i=0; i<motorCount; i++) {
+    masks[i] = 1u << frameMatrix.pins[i];
+  }
+  int frameErrors = 0;
+  for (int inverted=0; inverted<2; inverted++) {
+    for (uint16_t value=0; value<2048; value++) {
+      uint16_t frames[motorCount], readBack[motorCount];
+      for (int i=0; i<motorCount; i++) {
+        frames[i] = dshotFrame(i == 0 ? value : random.next() & 0x7FF, random.next() & 1, inverted);
+      }
+      uint16_t crc = frames[0] ^ (frames[0] >> 4) ^ (frames[0] >> 8) ^ (frames[0] >> 12);
+      if (frames[0] >> 5 != value or (crc & 0xF) != (inverted ? 0xF : 0)) {
+        frameErrors++;
+      }
+
+      uint32_t buffer[dshotBufferLength];
+      dshotFillBuffer(frames, masks, motorCount, buffer);
+      if (!readBuffer(buffer, masks, motorCount, inverted, readBack) or memcmp(frames, readBack, sizeof(frames))) {
+        frameErrors++;
+      }
+    }
+  }
+  if (dshotThrottle(0) != 0 or dshotThrottle(.01f) != 48 or dshotThrottle(1000) != 2047) {
+    frameErrors++;
+  }
+  for (const KnownFrame &known : knownFrames) {
+    if (dshotFrame(known.value, known.telemetry, false) != known.frame or
+        dshotFrame(known.value, known.telemetry, true) != known.invertedFrame) {
+      printf("FAIL: frame of %d is not %04X\n", known.value, known.frame);
+      frameErrors++;
+    }
+  }
+  printf("dshot frames: %d errors\n", frameErrors);
+  pass &= frameErrors == 0;
+
+  //Every reply value can be read back with up to 5% clock mismatch
+  const int sampleCount = dshotSamplesPerBit * 48;
+  uint32_t samples[sampleCount];
+  int replyErrors = 0;
+  int corruptAccepted = 0;
+  for (uint32_t value=0; value<4096; value++) {
+    uint32_t reply = encodeReply(value);
+    float lead = 5 + (random.next() % 1000) / 100.0f;
+    float drift = ((int)(random.next() % 1001) - 500) / 10000.0f;
+    sampleReply(reply, lead, drift, masks[0], samples, sampleCount);
+    if (dshotDecodeReply(dshotReadReply(samples, sampleCount, masks[0])) != value) {
+      replyErrors++;
+    }
+
+    //A corrupted nibble is never accepted
+    uint32_t corrupt = reply ^ (gcrEncode[random.next() % 16] << (5 * (random.next() % 4)));
+    if (corrupt != reply and dshotDecodeReply(corrupt) == value) {
+      corruptAccepted++;
+    }
+  }
+  for (const KnownReply &known : knownReplies) {
+    if (dshotDecodeReply(known.edges) != known.value or dshotToErpm(dshotDecodeReply(known.edges)) != known.erpm) {
+      printf("FAIL: reply %06X is not %u eRPM\n", known.edges, known.erpm);
+      replyErrors++;
+    }
+  }
+  //The line of the first known reply, sampled from the levels rather than the edges
+  uint32_t lineSamples[sampleCount];
+  for (int j=0; j<sampleCount; j++) {
+    int bit = j / dshotSamplesPerBit - 4;
+    bool level = bit < 0 or bit >= dshotReplyBits or knownReplyLine[bit] == '1';
+    lineSamples[j] = level ? masks[0] : 0;
+  }
+  if (dshotReadReply(lineSamples, sampleCount, masks[0]) != knownReplies[0].edges) {
+    printf("FAIL: reply line not read as %06X\n", knownReplies[0].edges);
+    replyErrors++;
+  }
+  printf("dshot replies: %d errors, %d corrupted replies accepted\n", replyErrors, corruptAccepted);
+  pass &= replyErrors == 0 and corruptAccepted == 0;
+
+  //Time encoding the frames of all motors
+  volatile uint32_t sink = 0;
+  uint32_t buffer[dshotBufferLength];
+  auto startTime = std::chrono::steady_clock::now();
+  for (int n=0; n<iterations; n++) {
+    uint16_t frames[motorCount];
+    for (int i=0; i<motorCount; i++) {
+      frames[i] = dshotFrame(dshotThrottle((n + i*250) % 1001), false, true);
+    }
+    dshotFillBuffer(frames, masks, motorCount, buffer);
+    sink = sink + buffer[n % dshotBufferLength];
+  }
+  double encodeNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - startTime).count() / iterations;
+
+  //Time reading the replies of all motors
+  uint32_t replySamples[motorCount][sampleCount];
+  for (int i=0; i<motorCount; i++) {
+    sampleReply(encodeReply(random.next() & 0xFFF), 10, 0, masks[0], replySamples[i], sampleCount);
+  }
+  startTime = std::chrono::steady_clock::now();
+  for (int n=0; n<iterations; n++) {
+    for (int i=0; i<motorCount; i++) {
+      sink = sink + dshotToErpm(dshotDecodeReply(dshotReadReply(replySamples[i], sampleCount, masks[0])));
+    }
+  }
+  double decodeNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - startTime).count() / iterations;
+
+  printf("dshot: %d motors, %.1f ns to encode all frames, %.1f ns to decode all replies\n", motorCount, encodeNs, decodeNs);
+  return pass ? 0 : 1;
+}
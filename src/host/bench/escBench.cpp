@@ -0,0 +1,160 @@
+/*
+ * Measures when the motor outputs reach the ESCs, using the simulated pins and timers of the host HAL.
+ *
+ * Latency is the time from MotorController::commit() to the new value starting on a motor, skew is the
+ * largest difference in latency between the motors in one loop.
+ * For the loop synchronised types (ONESHOT125_SYNC, MULTISHOT) the length of each pulse is also checked.
+ * Exits with 1 if no new value ever reaches a motor.
+ */
+#include "Arduino.h"
+#include "Logger.h"
+#include "MotorController.h"
+#include "StateBus.h"
+#if ESC_TYPE == ONESHOT125
+  #include "Teensy_PWM.h"
+#endif
+
+//Definitions normally in drone.ino
+const int loopRate = 2000;
+const int lightPin = 5;
+void blink(int d) {
+  delay(d);
+  delay(d);
+}
+float loopTime() {
+  return 1000.0f / loopRate;
+}
+
+#if ESC_TYPE == ONESHOT125
+  const char *escName = "oneshot125";
+#elif ESC_TYPE == ONESHOT125_SYNC
+  const char *escName = "oneshot125 sync";
+  ///Pulse length at zero power and per 1/1000 of motor power (μs)
+  const float minPulse = 125, pulsePerMille = .125;
+#elif ESC_TYPE == MULTISHOT
+  const char *escName = "multishot";
+  const float minPulse = 5, pulsePerMille = .02;
+#endif
+
+/** Small deterministic random number generator so every build sees the same inputs */
+struct XorShift {
+  uint32_t state = 2463534242u;
+  /** Returns a random number between -1 and 1 */
+  float next() {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return (state / 4294967296.0f) * 2 - 1;
+  }
+};
+
+int main(int argc, char **argv) {
+  int loops = 20000;
+  for (int i=1; i<argc-1; i++) {
+    if (!strcmp(argv[i], "--loops")) {
+      loops = atoi(argv[++i]);
+    }
+  }
+
+  //Set up and arm the motors
+  Serial.redirect(nullptr, false);
+  Logger logger;
+  logger.init();
+  MotorController ESC;
+  ESC.init(logger);
+  while (!ESC.updateArming(true)) {
+    delay(1);
+  }
+  StateBus bus;
+
+  XorShift random;
+  RcCommand rc = {};
+  ctrl_t PIDchange[3][3] = {};
+  const uint64_t loopNanos = 1000000000ull / loopRate;
+  double latencySum = 0;
+  double maxLatency = 0;
+  double maxSkew = 0;
+  #if SYNC_ESC
+    double maxPulseError = 0;
+  #endif
+  int latencyCount = 0;
+  int skipped = 0;
+
+  for (int i=0; i<loops; i++) {
+    uint64_t loopStart = hal::clockNanos;
+
+    //Random control output
+    rc.xyzr[2] = (int)(random.next() * 127);
+    for (int j=0; j<3; j++) {
+      #if CONTROL_MATH == FIXED_MATH
+        PIDchange[0][j] = toQ31(random.next() * .2f);
+      #else
+        PIDchange[0][j] = random.next() * .2f;
+      #endif
+    }
+    ESC.addChange(PIDchange);
+    ESC.write(rc, bus.motors);
+
+    uint64_t commitTime = hal::clockNanos;
+    if (!ESC.commit()) {
+      skipped++;
+      hal::advanceNanos(loopNanos - (hal::clockNanos - loopStart));
+      continue;
+    }
+
+    //Find when the new value starts on each motor
+    uint64_t start[motorCount];
+    for (int j=0; j<motorCount; j++) {
+      #if ESC_TYPE == ONESHOT125
+        start[j] = hal::pwmApplyNanos[frameMatrix.pins[j]];
+      #else
+        start[j] = hal::pinChangeNanos[frameMatrix.pins[j]];
+      #endif
+    }
+    uint64_t firstStart = UINT64_MAX, lastStart = 0;
+    for (int j=0; j<motorCount; j++) {
+      //Motors whose value did not change are not written to
+      if (start[j] < commitTime) {
+        continue;
+      }
+      double latency = (start[j] - commitTime) / 1000.0;
+      latencySum += latency;
+      latencyCount++;
+      maxLatency = max(maxLatency, latency);
+      firstStart = min(firstStart, start[j]);
+      lastStart = max(lastStart, start[j]);
+    }
+    if (firstStart <= lastStart) {
+      maxSkew = max(maxSkew, (lastStart - firstStart) / 1000.0);
+    }
+
+    //Run the rest of the loop, the pulses end during it
+    hal::advanceNanos(loopNanos - (hal::clockNanos - loopStart));
+
+    #if SYNC_ESC
+      //Compare the length of each pulse to the motor power
+      for (int j=0; j<motorCount; j++) {
+        int pin = frameMatrix.pins[j];
+        if (hal::pinState[pin] != LOW) {
+          printf("%s: pulse on pin %d did not end\n", escName, pin);
+          return 1;
+        }
+        double length = (hal::pinChangeNanos[pin] - start[j]) / 1000.0;
+        double expected = minPulse + ESC.motorPower[j]*pulsePerMille;
+        maxPulseError = max(maxPulseError, fabs(length - expected));
+      }
+    #endif
+  }
+
+  printf("%s: %d loops, latency mean %.2f μs max %.2f μs, skew max %.2f μs", escName, loops,
+         latencySum / max(latencyCount, 1), maxLatency, maxSkew);
+  #if SYNC_ESC
+    printf(", pulse length error max %.3f μs", maxPulseError);
+  #endif
+  printf(", %d loops not sent\n", skipped);
+  if (latencyCount == 0) {
+    printf("%s: no motor output was started\n", escName);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,621 @@
+/*
+ * Times each function on the hot path of the main loop against the host HAL, and adds them up against the loop time.
+ *
+ * Every function is run in batches over fixed inputs, the median of several batches is reported as ns, cycles and
+ * instructions per call. Instructions are counted with the Linux performance counters when they are available, they
+ * hardly change between runs so they show small regressions that the time hides. The loop budget adds up one loop of
+ * drone.ino (angle, PID, motors and a log record) as a share of maxLoopTime. The times are of the host, not the Teensy.
+ * The stack used by each function is found by painting the stack before each batch (see Memory.h). The first 144 bytes
+ * below the caller are not painted on the host, so functions which use less show 0.
+ *
+ *   hotPathBench_<variant> [--dir scratch directory] [--ops n] [--repeats n] [--save file] [--baseline file]
+ *                          [--threshold fraction] [--time-threshold fraction]
+ *
+ * --save writes the results to a CSV file. --baseline compares the results with a file written by --save, or writes it
+ * if it does not exist yet. Exits with 1 if a function uses more than --threshold more instructions than the baseline,
+ * or more than --time-threshold more time when the instructions were not counted, if the loop does not fit in
+ * maxLoopTime, if queueing a log record is not much cheaper than writing it (minLogRatio), or if the cost of averaging
+ * several IMUs grows faster than the number of IMUs.
+ *
+ * Each variant builds the modules with different settings (see the Makefile). The logger is only timed with
+ * STORAGE_TYPE=SD_CARD, which writes the scratch directory, as the RAM log only holds a few hundred records.
+ */
+#include "Arduino.h"
+#include "FlightRecord.h"
+#include "IMU.h"
+#include "Logger.h"
+#include "LoopWatchdog.h"
+#include "Memory.h"
+#include "MotorController.h"
+#include "PIDcontroller.h"
+#include "StateBus.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <errno.h>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+  #include <x86intrin.h>
+#endif
+#ifdef __linux__
+  #include <linux/perf_event.h>
+  #include <sys/syscall.h>
+  #include <unistd.h>
+#endif
+
+///Writing a log record has to cost this many times more than queueing it, so the loop only copies the record
+const double minLogRatio = 20;
+
+//Definitions normally in drone.ino
+const int loopRate = 2000;
+///Loops per gyroscope sample, the MPU6050 is read at 200 Hz
+const int gyroLoops = loopRate / 200;
+const int maxLoopTime = 1000000/loopRate;
+const int lightPin = 5;
+///Pin the simulated battery voltage is read from
+const int batteryPin = 14;
+void blink(int d) {
+  delay(d);
+  delay(d);
+}
+float loopTime() {
+  return 1000.0f / loopRate;
+}
+
+#if IMU_TYPE == IMU_MPU6050
+  const char *imuName = "mpu6050";
+#else
+  const char *imuName = "no imu";
+#endif
+
+/** Small deterministic random number generator so every build sees the same inputs */
+struct XorShift {
+  uint32_t state = 2463534242u;
+  /** Returns a random number between -1 and 1 */
+  float next() {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return (state / 4294967296.0f) * 2 - 1;
+  }
+};
+
+/** Reads the CPU cycle counter if there is one */
+static uint64_t readCycles() {
+  #if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+  #else
+    return 0;
+  #endif
+}
+
+/**
+ * @class InstructionCounter
+ * @brief Counts the instructions run by this thread in user space, if the kernel allows it
+ */
+class InstructionCounter {
+  public:
+    InstructionCounter() {
+      #ifdef __linux__
+        perf_event_attr attr = {};
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+      #endif
+    }
+    ~InstructionCounter() {
+      #ifdef __linux__
+        if (fd >= 0) {
+          close(fd);
+        }
+      #endif
+    }
+    /** Returns true if instructions are being counted */
+    bool available() const {
+      return fd >= 0;
+    }
+    /** Gets the number of instructions run since the counter was opened */
+    uint64_t read() const {
+      uint64_t count = 0;
+      #ifdef __linux__
+        if (fd >= 0 and ::read(fd, &count, sizeof(count)) != sizeof(count)) {
+          count = 0;
+        }
+      #endif
+      return count;
+    }
+
+  private:
+    ///Performance counter, -1 if it could not be opened
+    int fd = -1;
+};
+
+/**
+ * @struct Sample
+ * @brief Cost of one call of a function
+ */
+struct Sample {
+  double ns = 0;
+  ///0 if there is no cycle counter
+  double cycles = 0;
+  ///-1 if instructions are not counted
+  double instructions = -1;
+  ///Most stack used by a call (bytes)
+  double stack = 0;
+};
+
+/**
+ * @struct Result
+ * @brief Cost of a function, and how many times it runs per loop of drone.ino
+ */
+struct Result {
+  std::string name;
+  Sample cost;
+  ///Calls per loop, 0 if it is not part of the loop or is already counted by another function
+  float perLoop;
+};
+
+static InstructionCounter instructions;
+
+//Modules, global like in drone.ino so the members without initialisers start at zero
+Logger logger;
+IMU imu;
+PIDcontroller pid;
+MotorController ESC;
+StateBus bus;
+
+/** Runs a batch of calls once and gets the cost of each call
+ *
+ *  @param[in] ops Number of calls made by run
+ *  @param[in] run Makes the calls
+ */
+template <typename F> static Sample timeOnce(int ops, F &&run) {
+  paintStack();
+  uint64_t startInstructions = instructions.read();
+  auto startTime = std::chrono::steady_clock::now();
+  uint64_t startCycles = readCycles();
+  run();
+  uint64_t cycles = readCycles() - startCycles;
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - startTime).count();
+  uint64_t count = instructions.read() - startInstructions;
+
+  Sample sample;
+  sample.stack = stackHighWater();
+  sample.ns = ns / ops;
+  sample.cycles = (double)cycles / ops;
+  if (instructions.available()) {
+    sample.instructions = (double)count / ops;
+  }
+  return sample;
+}
+
+/** Gets the median of each measurement, which ignores batches slowed down by the rest of the system */
+static Sample median(std::vector<Sample> samples) {
+  Sample result;
+  size_t middle = samples.size() / 2;
+  auto medianOf = [&](double Sample::*field) {
+    std::nth_element(samples.begin(), samples.begin() + middle, samples.end(),
+                     [&](const Sample &a, const Sample &b) { return a.*field < b.*field; });
+    return samples[middle].*field;
+  };
+  result.ns = medianOf(&Sample::ns);
+  result.cycles = medianOf(&Sample::cycles);
+  result.instructions = medianOf(&Sample::instructions);
+  result.stack = medianOf(&Sample::stack);
+  return result;
+}
+
+/** Runs a batch of calls several times after warming up, and gets the median cost of each call */
+template <typename F> static Sample timeMedian(int ops, int repeats, F &&run) {
+  run();
+  std::vector<Sample> samples;
+  for (int i=0; i<repeats; i++) {
+    samples.push_back(timeOnce(ops, run));
+  }
+  return median(samples);
+}
+
+/** Writes the results as CSV, returns false on failure */
+static bool saveResults(const char *fileName, const std::vector<Result> &results) {
+  FILE *file = fopen(fileName, "w");
+  if (!file) {
+    return false;
+  }
+  fprintf(file, "Function,ns/op,Cycles/op,Instructions/op,Stack (bytes)\n");
+  for (const Result &result : results) {
+    fprintf(file, "%s,%.2f,%.1f,%.1f,%.0f\n", result.name.c_str(), result.cost.ns, result.cost.cycles,
+            result.cost.instructions, result.cost.stack);
+  }
+  return fclose(file) == 0;
+}
+
+/** Reads results written by saveResults(), returns false if the file can not be opened */
+static bool loadResults(const char *fileName, std::vector<Result> &results) {
+  FILE *file = fopen(fileName, "r");
+  if (!file) {
+    return false;
+  }
+  char line[256];
+  while (fgets(line, sizeof(line), file)) {
+    char *comma = strchr(line, ',');
+    Result result;
+    if (!comma or sscanf(comma, ",%lf,%lf,%lf,%lf", &result.cost.ns, &result.cost.cycles, &result.cost.instructions,
+                         &result.cost.stack) < 3) {
+      continue; //Column names
+    }
+    result.name.assign(line, comma - line);
+    result.perLoop = 0;
+    results.push_back(result);
+  }
+  fclose(file);
+  return true;
+}
+
+/** Compares the results with a baseline and prints the change of each function
+ *
+ *  @returns true if no function regressed by more than the thresholds
+ */
+static bool compareResults(const std::vector<Result> &results, const std::vector<Result> &baseline,
+                           float threshold, float timeThreshold) {
+  bool pass = true;
+  for (const Result &result : results) {
+    auto base = std::find_if(baseline.begin(), baseline.end(), [&](const Result &r) { return r.name == result.name; });
+    if (base == baseline.end()) {
+      printf("  %-30s not in the baseline\n", result.name.c_str());
+      continue;
+    }
+    //Compare the instructions if both runs counted them, they are much steadier than the time
+    bool counted = result.cost.instructions >= 0 and base->cost.instructions >= 0;
+    double change = counted ? result.cost.instructions / base->cost.instructions - 1 : result.cost.ns / base->cost.ns - 1;
+    bool regressed = change > (counted ? threshold : timeThreshold);
+    printf("  %-30s %+6.1f%% %s%s\n", result.name.c_str(), change*100, counted ? "instructions" : "time",
+           regressed ? "  REGRESSION" : "");
+    pass &= !regressed;
+  }
+  return pass;
+}
+
+int main(int argc, char **argv) {
+  std::string dir = "hotPath_out";
+  const char *saveFile = nullptr;
+  const char *baselineFile = nullptr;
+  int ops = 20000;
+  int repeats = 11;
+  float threshold = .05;
+  float timeThreshold = .5;
+  for (int i=1; i<argc-1; i++) {
+    if (!strcmp(argv[i], "--dir")) {
+      dir = argv[++i];
+    } else if (!strcmp(argv[i], "--ops")) {
+      ops = max(atoi(argv[++i]), 1);
+    } else if (!strcmp(argv[i], "--repeats")) {
+      repeats = max(atoi(argv[++i]), 1);
+    } else if (!strcmp(argv[i], "--save")) {
+      saveFile = argv[++i];
+    } else if (!strcmp(argv[i], "--baseline")) {
+      baselineFile = argv[++i];
+    } else if (!strcmp(argv[i], "--threshold")) {
+      threshold = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--time-threshold")) {
+      timeThreshold = atof(argv[++i]);
+    }
+  }
+
+  //Set up the modules, the SD card is the scratch directory
+  Serial.redirect(nullptr, false);
+  #if STORAGE_TYPE == SD_CARD
+    if (mkdir(dir.c_str(), 0755) != 0 and errno != EEXIST) {
+      fprintf(stderr, "cannot create %s\n", dir.c_str());
+      return 1;
+    }
+    hal::storageDir = dir;
+  #endif
+  logger.init();
+  if (imu.init(logger)) {
+    fprintf(stderr, "IMU failed to start\n");
+    return 1;
+  }
+  #if IMU_TYPE == IMU_MPU6050
+    //Calibrate the simulated sensor while it lies still and level
+    const float level[3] = {0, 0, 1};
+    const float still[3] = {0, 0, 0};
+    for (int i=0; ; i++) {
+      hal::imuSample(level, still, 25);
+      hal::advanceMicros(1000);
+      if (imu.updateCalibration(logger)) {
+        break;
+      }
+      if (i == 100000) {
+        fprintf(stderr, "IMU calibration did not finish\n");
+        return 1;
+      }
+    }
+  #else
+    while (!imu.updateCalibration(logger)) {
+      delay(1);
+    }
+  #endif
+  pid.init(logger);
+  //Use the thrust and battery voltage tables, with the battery a little below the nominal voltage
+  ESC.thrustCurve = .5;
+  ESC.batteryPin = batteryPin;
+  hal::analogValue[batteryPin] = 10.5 / ESC.voltageScale;
+  ESC.init(logger);
+  while (!ESC.updateArming(true)) {
+    delay(1);
+  }
+
+  //Generate the inputs, a level hover with sensor noise, sine waves on the angles and joystick steps
+  XorShift random;
+  std::vector<std::array<int16_t, 6>> rawReadings(ops);
+  std::vector<std::array<float, 6>> readings(ops);
+  std::vector<AttitudeState> attitudes(ops);
+  std::vector<RcCommand> commands(ops);
+  RcCommand rc = {};
+  for (int i=0; i<ops; i++) {
+    float t = (float)i / loopRate;
+    for (int j=0; j<3; j++) {
+      float accel = (j == 2 ? 1 : 0) + random.next()*.05f;
+      float gyro = random.next()*2;
+      rawReadings[i][j] = (int16_t)(accel * 16384);
+      rawReadings[i][3+j] = (int16_t)(gyro * 131);
+      readings[i][j] = accel;
+      readings[i][3+j] = gyro;
+    }
+    if (i % 2000 == 0) {
+      for (int j=0; j<4; j++) {
+        rc.xyzr[j] = (int)(random.next() * 127);
+      }
+      rc.potPercent = (random.next() + 1) / 2;
+    }
+    commands[i] = rc;
+    //The gyroscope has a new sample every gyroLoops loops, the rate is held in between
+    attitudes[i].newSample = i % gyroLoops == 0;
+    for (int j=0; j<3; j++) {
+      float phase = t * 2*PI * (j+1);
+      attitudes[i].angle[j] = 10*sin(phase) + random.next()*.2f;
+      float rate = 10*2*PI*(j+1)*cos(phase) + random.next()*5;
+      attitudes[i].rate[j] = attitudes[i].newSample ? rate : attitudes[i-1].rate[j];
+    }
+  }
+
+  std::vector<Result> results;
+  results.push_back({"IMU::updateAngle", timeMedian(ops, repeats, [&]() {
+    for (int i=0; i<ops; i++) {
+      #if IMU_TYPE == IMU_MPU6050
+        hal::imuRaw(&rawReadings[i][0], &rawReadings[i][3], true);
+      #endif
+      imu.updateAngle(bus.attitude);
+    }
+  }), 1});
+  #if IMU_TYPE == IMU_MPU6050
+    //Averaging several IMUs, each with its own noise, not in the loop as the firmware reads one by default
+    for (int n=2; n<=maxImuCount; n++) {
+      IMU fused;
+      fused.imuCount = n;
+      if (fused.init(logger)) {
+        fprintf(stderr, "%d IMUs failed to start\n", n);
+        return 1;
+      }
+      for (int i=0; ; i++) {
+        for (int s=0; s<n; s++) {
+          hal::imuSample(level, still, 25, s);
+        }
+        hal::advanceMicros(1000);
+        if (fused.updateCalibration(logger)) {
+          break;
+        }
+        if (i == 100000) {
+          fprintf(stderr, "calibration of %d IMUs did not finish\n", n);
+          return 1;
+        }
+      }
+      results.push_back({"IMU::updateAngle, " + std::to_string(n) + " IMUs", timeMedian(ops, repeats, [&]() {
+        for (int i=0; i<ops; i++) {
+          for (int s=0; s<n; s++) {
+            const std::array<int16_t, 6> &reading = rawReadings[(i + s*101) % ops];
+            hal::imuRaw(&reading[0], &reading[3], true, s);
+          }
+          fused.updateAngle(bus.attitude);
+        }
+      }), 0});
+    }
+  #endif
+  //Runs inside updateAngle, so it is already counted in the loop
+  results.push_back({"IMU::MadgwickQuaternionUpdate", timeMedian(ops, repeats, [&]() {
+    for (int i=0; i<ops; i++) {
+      imu.MadgwickQuaternionUpdate(&readings[i][0], &readings[i][3]);
+    }
+  }), 0});
+  results.push_back({"PIDcontroller::scheduleGains", timeMedian(ops, repeats, [&]() {
+    for (int i=0; i<ops; i++) {
+      pid.scheduleGains(.35f + commands[i].xyzr[2] * .001f, 11.1f);
+    }
+  }), 1});
+  results.push_back({"PIDcontroller::calcPID", timeMedian(ops, repeats, [&]() {
+    for (int i=0; i<ops; i++) {
+      pid.calcPID(attitudes[i], commands[i], false);
+    }
+  }), 1});
+  results.push_back({"MotorController::addChange", timeMedian(ops, repeats, [&]() {
+    for (int i=0; i<ops; i++) {
+      ESC.addChange(pid.PIDchange);
+    }
+  }), 1});
+  results.push_back({"MotorController::write", timeMedian(ops, repeats, [&]() {
+    for (int i=0; i<ops; i++) {
+      ESC.write(commands[i], bus.motors);
+    }
+  }), 1});
+  results.push_back({"MotorController::commit", timeMedian(ops, repeats, [&]() {
+    for (int i=0; i<ops; i++) {
+      ESC.commit();
+    }
+  }), 1});
+
+  //Loop times around the loop time, so the windows end and the level changes now and then
+  LoopWatchdog watchdog;
+  uint32_t watchdogTime = 0;
+  results.push_back({"LoopWatchdog::update", timeMedian(ops, repeats, [&]() {
+    for (int i=0; i<ops; i++) {
+      watchdogTime += watchdog.loopPeriod;
+      watchdog.update(maxLoopTime - 100 + (i & 255), 0, watchdogTime);
+    }
+  }), 1});
+
+  //The loop only copies a record into the queue, it is encoded and written while waiting for the next loop
+  std::vector<FlightRecord> records(ops);
+  for (int i=0; i<ops; i++) {
+    FlightRecord &record = records[i];
+    record = {};
+    record.time = i * maxLoopTime;
+    for (int j=0; j<4; j++) {
+      record.xyzr[j] = commands[i].xyzr[j];
+    }
+    record.pot = commands[i].potPercent*255;
+    for (int j=0; j<2; j++) {
+      record.angle[j] = attitudes[i].angle[j];
+    }
+    for (int j=0; j<6; j++) {
+      #if CONTROL_MATH == FIXED_MATH
+        record.PIDchange[j/2][j%2] = toQ31(attitudes[i].rate[j%3] * .01f);
+      #else
+        record.PIDchange[j/2][j%2] = attitudes[i].rate[j%3] * .01f;
+      #endif
+    }
+    record.radio = i;
+    record.yaw = attitudes[i].angle[2];
+    record.packetRate = 500;
+    record.packetLoss = attitudes[i].rate[2];
+    record.jitter = i;
+    record.latency = i;
+    for (int j=0; j<3; j++) {
+      record.rawAccel[j] = rawReadings[i][j];
+      record.rawGyro[j] = rawReadings[i][3+j];
+    }
+    record.newSample = 1;
+    record.throttle = .35f;
+    record.voltage = 11.1f;
+    record.gainScale = {1, 1, 1, 1};
+  }
+  static RecordQueue queue;
+  FlightRecord popped;
+  //Popped as it is pushed so the queue never fills, the pop runs while waiting but is counted in the loop
+  results.push_back({"RecordQueue::push/pop", timeMedian(ops, repeats, [&]() {
+    for (int i=0; i<ops; i++) {
+      queue.push(records[i]);
+      queue.pop(popped);
+    }
+  }), 1.0f/logDiv});
+
+  #if STORAGE_TYPE == SD_CARD
+    //One record of drone.ino per call, which needs a new log to convert, so each repeat uses a new logger
+    std::vector<Sample> recordSamples;
+    std::vector<Sample> convertSamples;
+    for (int repeat=0; repeat<=repeats; repeat++) {
+      Logger *log = new Logger();
+      for (int i=0; i<3; i++) {
+        remove((dir + "/log_" + std::to_string(i) + ".csv").c_str());
+      }
+      log->init();
+      log->initLogFile();
+      logColumns(*log);
+      Sample record = timeOnce(ops, [&]() {
+        for (int i=0; i<ops; i++) {
+          logRecord(*log, records[i]);
+        }
+      });
+      Sample convert = timeOnce(ops, [&]() {
+        log->closeFile();
+      });
+      delete log;
+      //The first repeat warms up
+      if (repeat > 0) {
+        recordSamples.push_back(record);
+        convertSamples.push_back(convert);
+      }
+    }
+    //Runs while waiting for the next loop
+    results.push_back({"logRecord", median(recordSamples), 0});
+    //Runs after the flight, per record
+    results.push_back({"Logger::binToStr", median(convertSamples), 0});
+  #endif
+
+  //Print the cost of each function and its share of the loop
+  printf("hot path (%s, %s, %s): %d calls x %d repeats%s\n", imuName, STORAGE_TYPE == SD_CARD ? "sd card" : "ram",
+         CONTROL_MATH == FIXED_MATH ? "fixed" : "float", ops, repeats,
+         instructions.available() ? "" : ", instructions not counted (no performance counters)");
+  printf("  %-30s %9s %10s %10s %8s %8s\n", "function", "ns/op", "cycles/op", "instr/op", "stack B", "of loop");
+  double loopNs = 0;
+  for (const Result &result : results) {
+    printf("  %-30s %9.1f %10.0f ", result.name.c_str(), result.cost.ns, result.cost.cycles);
+    if (result.cost.instructions >= 0) {
+      printf("%10.0f ", result.cost.instructions);
+    } else {
+      printf("%10s ", "-");
+    }
+    printf("%8.0f ", result.cost.stack);
+    if (result.perLoop > 0) {
+      printf("%7.3f%%", result.cost.ns * result.perLoop / (maxLoopTime*1000.0) * 100);
+    }
+    printf("\n");
+    loopNs += result.cost.ns * result.perLoop;
+  }
+  printf("  loop total %.2f μs of %d μs (%.2f%%)\n", loopNs / 1000, maxLoopTime, loopNs / (maxLoopTime*1000.0) * 100);
+  bool pass = loopNs < maxLoopTime*1000.0;
+  #if IMU_TYPE == IMU_MPU6050 or STORAGE_TYPE == SD_CARD
+    auto find = [&](const std::string &name) {
+      return std::find_if(results.begin(), results.end(), [&](const Result &r) { return r.name == name; })->cost;
+    };
+  #endif
+  #if IMU_TYPE == IMU_MPU6050
+    //If each IMU adds the same cost, averaging maxImuCount costs at most maxImuCount/2 times averaging two
+    Sample two = find("IMU::updateAngle, 2 IMUs");
+    Sample all = find("IMU::updateAngle, " + std::to_string(maxImuCount) + " IMUs");
+    bool imusCounted = two.instructions >= 0 and all.instructions >= 0;
+    double growth = imusCounted ? all.instructions / fmax(two.instructions, 1) : all.ns / fmax(two.ns, 1e-3);
+    double perImu = imusCounted ? (all.instructions - two.instructions) : (all.ns - two.ns);
+    printf("  each IMU averaged adds %.0f %s, %d cost %.2fx two\n", perImu / (maxImuCount - 2),
+           imusCounted ? "instructions" : "ns", maxImuCount, growth);
+    if (growth > maxImuCount / 2.0 * (imusCounted ? 1 : 1 + timeThreshold)) {
+      fprintf(stderr, "Averaging %d IMUs costs more than %d times averaging two\n", maxImuCount, maxImuCount/2);
+      pass = false;
+    }
+  #endif
+  #if STORAGE_TYPE == SD_CARD
+    //The loop has to keep logging down to a copy, far cheaper than encoding and writing the record
+    Sample copy = find("RecordQueue::push/pop");
+    Sample encode = find("logRecord");
+    bool counted = copy.instructions >= 0 and encode.instructions >= 0;
+    double ratio = counted ? encode.instructions / fmax(copy.instructions, 1) : encode.ns / fmax(copy.ns, 1e-3);
+    printf("  logging in the loop is %.0fx cheaper than writing the record (%s)\n", ratio, counted ? "instructions" : "time");
+    if (ratio < minLogRatio) {
+      fprintf(stderr, "Queueing a log record costs more than 1/%.0f of writing it\n", minLogRatio);
+      pass = false;
+    }
+  #endif
+
+  if (saveFile and !saveResults(saveFile, results)) {
+    fprintf(stderr, "Could not write %s\n", saveFile);
+    return 1;
+  }
+  if (baselineFile) {
+    std::vector<Result> baseline;
+    if (loadResults(baselineFile, baseline)) {
+      printf("compared with %s:\n", baselineFile);
+      pass &= compareResults(results, baseline, threshold, timeThreshold);
+    } else if (saveResults(baselineFile, results)) {
+      printf("saved the baseline to %s\n", baselineFile);
+    } else {
+      fprintf(stderr, "Could not write %s\n", baselineFile);
+      return 1;
+    }
+  }
+  return pass ? 0 : 1;
+}
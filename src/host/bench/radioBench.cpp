@@ -0,0 +1,188 @@
+/*
+ * Checks the radio packet queue (SpscQueue.h) and packet decoder (RadioPacket.h), and times them.
+ *
+ * The queue is checked in order, when full, across the index wrapping around, and with a producer
+ * and consumer on separate threads. The link estimates and latency trace (LinkQuality.h) are checked
+ * against packets with known loss and timing. Exits with 1 if any check fails.
+ */
+#include "LinkQuality.h"
+#include "RadioPacket.h"
+#include "SpscQueue.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <thread>
+
+///Number of failed checks
+static int failures = 0;
+
+/** Records a failed check */
+static void check(bool ok, const char *name) {
+  if (!ok) {
+    printf("FAIL: %s\n", name);
+    failures++;
+  }
+}
+
+/** Checks items come out in order, and pushing fails once the queue is full */
+static void checkOrder(uint32_t start) {
+  SpscQueue<RadioPacket, 8> queue(start);
+  RadioPacket packet = {};
+  for (int round=0; round<3; round++) {
+    for (uint32_t i=0; i<8; i++) {
+      packet.cycles = round*100 + i;
+      check(queue.push(packet), "push while not full");
+    }
+    check(!queue.push(packet), "push while full");
+    check(queue.count() == 8, "count while full");
+    for (uint32_t i=0; i<8; i++) {
+      check(queue.pop(packet) and packet.cycles == round*100 + i, "pop in order");
+    }
+    check(!queue.pop(packet), "pop while empty");
+  }
+}
+
+/** Checks the decoded input of a packet */
+static void checkDecode() {
+  RadioPacket packet = {{127, 127, 127, 127, 0, 77, 0}, 1234};
+  RcCommand command;
+  check(!decodePacket(packet, command), "no abort");
+  check(command.xyzr[0] == 0 and command.potPercent == 0, "centre input");
+  check(command.sequence == 77, "sequence number");
+
+  for (int value=0; value<256; value++) {
+    for (int i=0; i<4; i++) {
+      packet.data[i] = value;
+    }
+    packet.data[4] = value;
+    packet.data[6] = value & 7;
+    bool abort = decodePacket(packet, command);
+    int expected = abs(value - 127) < 5 ? 0 : value - 127;
+    check(command.xyzr[0] == expected and command.xyzr[1] == -expected, "joystick input and deadzone");
+    check(command.potPercent == value/255.0f, "potentiometer");
+    check(abort == (value & 1) and command.standbyButton == ((value >> 1) & 1) and command.light == ((value >> 2) & 1), "buttons");
+  }
+}
+
+/** Checks the link estimates with packets of known timing and loss */
+static void checkLinkMonitor() {
+  //100 Hz with the time between packets alternating between 9 and 11ms, so 1ms of jitter
+  LinkMonitor link;
+  uint32_t time = 5000;
+  for (int i=0; i<500; i++) {
+    link.addPacket(i, time);
+    link.update(time);
+    time += i % 2 ? 11000 : 9000;
+  }
+  check(fabsf(link.packetRate - 100) < 1.5f, "packet rate");
+  check(link.packetLoss == 0, "no loss across the sequence wrapping around");
+  check(fabsf(link.jitter - 1000) < 20, "jitter");
+
+  //Jitter of 1μs an hour into the flight, which cancels out if it is found from the sum of squares
+  link = LinkMonitor();
+  micros_t hourTime = 3600000000ULL;
+  for (int i=0; i<500; i++) {
+    link.addPacket(i, hourTime);
+    link.update(hourTime);
+    hourTime += i % 2 ? 10001 : 9999;
+  }
+  check(fabsf(link.jitter - 1) < .05f, "small jitter");
+
+  //Every 10th packet lost, and a repeated packet which is not a loss
+  link = LinkMonitor();
+  time = 0;
+  for (int i=0; i<500; i++) {
+    if (i % 10 != 9) {
+      link.addPacket(i, time);
+    }
+    if (i == 250) {
+      link.addPacket(i, time);
+    }
+    link.update(time);
+    time += 10000;
+  }
+  check(fabsf(link.packetLoss - 10) < 1, "packet loss");
+  check(fabsf(link.packetRate - 90) < 1.5f, "packet rate with loss");
+  check(strstr(link.summary().c_str(), "Packets lost,40,") != nullptr, "link summary");
+
+  //Latency of each stage, marks without new input are ignored
+  LatencyTrace latency;
+  latency.mark(3, 50);
+  check(latency.latency == 0, "no latency without input");
+  latency.begin(100, 150);
+  latency.mark(1, 400);
+  latency.mark(2, 410);
+  latency.mark(3, 420);
+  latency.mark(3, 900);
+  check(latency.latency == 320, "latency");
+  check(strstr(latency.summary().c_str(), "IMU and calcPID max,250,") != nullptr, "latency summary stages");
+  check(strstr(latency.summary().c_str(), "Total mean,320.0,Total max,320") != nullptr, "latency summary total");
+}
+
+/** Passes packets between two threads, checking none are lost, repeated or torn */
+static void checkThreads(int count) {
+  static SpscQueue<RadioPacket, 8> queue;
+  std::thread producer([count]() {
+    RadioPacket packet;
+    for (int i=0; i<count; i++) {
+      packet.cycles = i;
+      memset(packet.data, i & 0xFF, sizeof(packet.data));
+      while (!queue.push(packet)) {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  RadioPacket packet;
+  int received = 0;
+  bool ok = true;
+  while (received < count) {
+    if (queue.pop(packet)) {
+      ok &= packet.cycles == (uint32_t)received;
+      for (int i=0; i<radioPacketSize; i++) {
+        ok &= packet.data[i] == (received & 0xFF);
+      }
+      received++;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  producer.join();
+  check(ok, "packets passed between threads");
+}
+
+int main(int argc, char **argv) {
+  int iterations = 10000000;
+  for (int i=1; i<argc-1; i++) {
+    if (!strcmp(argv[i], "--iterations")) {
+      iterations = atoi(argv[++i]);
+    }
+  }
+
+  checkOrder(0);
+  checkOrder(UINT32_MAX - 12); //Indexes wrap around during the check
+  checkDecode();
+  checkLinkMonitor();
+  checkThreads(iterations / 100);
+  printf("radio: %d checks failed\n", failures);
+
+  //Time a packet going through the queue and being decoded
+  SpscQueue<RadioPacket, 8> queue;
+  RadioPacket packet = {{10, 200, 127, 60, 128, 0, 4}, 0};
+  RcCommand command;
+  volatile int sink = 0;
+  auto startTime = std::chrono::steady_clock::now();
+  for (int i=0; i<iterations; i++) {
+    packet.cycles = i;
+    queue.push(packet);
+    RadioPacket received;
+    queue.pop(received);
+    decodePacket(received, command);
+    sink = sink + command.xyzr[0];
+  }
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - startTime).count() / iterations;
+  printf("radio: %.1f ns to queue and decode a packet\n", ns);
+  return failures ? 1 : 0;
+}
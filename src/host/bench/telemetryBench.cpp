@@ -0,0 +1,202 @@
+/*
+ * Checks the telemetry frames (Telemetry.h) and their delivery in the ACK payloads of the simulated radio (hal/RF24.h).
+ *
+ * Every frame type is encoded and decoded, and every single bit error must fail the CRC. Then DroneRadio sends its ready
+ * signals and receives packets from the simulated controller, which checks each ACK payload follows the schedule and
+ * holds the telemetry published before the previous packet, and that a packet of the wrong size is dropped. Exits with 1
+ * if any check fails.
+ */
+#include "DroneRadio.h"
+#include "Telemetry.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+///Number of failed checks
+static int failures = 0;
+///Number of times the firmware aborted
+static int aborts = 0;
+
+void ABORT() {
+  aborts++;
+}
+
+/** Records a failed check */
+static void check(bool ok, const char *name) {
+  if (!ok) {
+    printf("FAIL: %s\n", name);
+    failures++;
+  }
+}
+
+/** Creates a telemetry state which is different for every k */
+static TelemetryState makeState(int k) {
+  TelemetryState state = {};
+  for (int i=0; i<3; i++) {
+    state.angle[i] = ((k*37 + i*101) % 36000 - 18000) / 100.0f + .001f;
+    state.rate[i] = ((k*53 + i*211) % 40000 - 20000) / 10.0f + .01f;
+  }
+  for (int i=0; i<motorCount; i++) {
+    state.motorPower[i] = ((k*7 + i*131) % 10001) / 10.0f;
+  }
+  state.loopTimeMean = 500 + k % 30;
+  state.loopTimeMax = 500 + k % 3000;
+  state.deadlineMisses = k * 3;
+  state.logBufferFill = k % 101;
+  return state;
+}
+
+/** Checks the fields in a frame of a type match the state that was encoded */
+static bool matches(uint8_t type, const TelemetryState &decoded, const TelemetryState &state) {
+  bool ok = true;
+  if (type == telemetryID.attitude) {
+    for (int i=0; i<3; i++) {
+      ok &= fabsf(decoded.angle[i] - state.angle[i]) <= .0051f;
+      ok &= fabsf(decoded.rate[i] - state.rate[i]) <= .051f;
+    }
+  } else if (type == telemetryID.motors) {
+    for (int i=0; i<motorCount; i++) {
+      ok &= fabsf(decoded.motorPower[i] - state.motorPower[i]) <= .051f;
+    }
+  } else if (type == telemetryID.loop) {
+    ok &= decoded.loopTimeMean == state.loopTimeMean and decoded.loopTimeMax == state.loopTimeMax;
+    ok &= decoded.deadlineMisses == state.deadlineMisses;
+  } else if (type == telemetryID.link) {
+    ok &= decoded.packetsReceived == state.packetsReceived and decoded.droppedPackets == state.droppedPackets;
+    ok &= decoded.logBufferFill == state.logBufferFill;
+  } else {
+    ok = false;
+  }
+  return ok;
+}
+
+/** Checks every frame type survives encoding, and errors are detected */
+static void checkFrames() {
+  uint8_t frame[telemetryMaxLength];
+  TelemetryState decoded;
+  uint8_t type, sequence;
+  for (int k=0; k<2000; k++) {
+    TelemetryState state = makeState(k);
+    state.packetsReceived = k * 1000003;
+    state.droppedPackets = k;
+    for (int t=1; t<=4; t++) {
+      int length = encodeTelemetry(state, t, k, frame);
+      check(length > 1 and length <= telemetryMaxLength, "frame fits in an ACK payload");
+      decoded = {};
+      check(decodeTelemetry(frame, length, decoded, type, sequence), "frame decodes");
+      check(type == t and sequence == (k & 0xF), "type and sequence");
+      check(matches(type, decoded, state), "decoded values");
+
+      //Every single bit error and every wrong length must be rejected
+      for (int bit=0; bit<length*8; bit++) {
+        frame[bit/8] ^= 1 << (bit%8);
+        check(!decodeTelemetry(frame, length, decoded, type, sequence), "bit error detected");
+        frame[bit/8] ^= 1 << (bit%8);
+      }
+      check(!decodeTelemetry(frame, length-1, decoded, type, sequence), "short frame rejected");
+    }
+  }
+  check(encodeTelemetry(makeState(0), 0, 0, frame) == 0, "unknown type not encoded");
+}
+
+/** Runs DroneRadio against the simulated controller, checking the ACK payloads it sends back */
+static void checkLink(int packets) {
+  const int irqPin = 24;
+  hal::radioIrqPin = irqPin;
+  SharedState<TelemetryState> telemetry;
+  SharedState<RcCommand> rc;
+  DroneRadio droneRadio;
+
+  //The state published before listening is sent with the first packet
+  std::vector<TelemetryState> expected;
+  telemetry.publish(makeState(0));
+  droneRadio.init(telemetry);
+  while (!droneRadio.updateReady()) {
+    delay(1);
+  }
+  check(hal::radioSent.size() == 10, "10 ready signals sent");
+  expected.push_back(makeState(0));
+
+  uint8_t packet[radioPacketSize] = {127, 127, 127, 127, 0, 0, 0};
+  uint32_t dropped = 0;
+  for (int k=0; k<packets; k++) {
+    //Stop reading the input for a while so the queue of 8 packets fills up, the packet before reading again is dropped too
+    bool reading = k < 500 or k >= 520;
+    bool dropping = k >= 508 and k <= 520;
+    packet[0] = k & 0xFF;
+    check(hal::radioReceive(packet, radioPacketSize), "packet acknowledged");
+    dropped += dropping;
+    if (reading) {
+      droneRadio.getInput(rc);
+      int lastPacket = (dropping ? 507 : k) & 0xFF;
+      check(rc.get().xyzr[0] == (abs(lastPacket - 127) < 5 ? 0 : lastPacket - 127), "input received");
+    }
+    check(droneRadio.droppedPackets == dropped, "dropped packets counted");
+
+    //Each packet loads the frame for the next one from the latest state
+    TelemetryState state = makeState(k+1);
+    telemetry.publish(state);
+    state = makeState(k);
+    state.packetsReceived = k+1;
+    state.droppedPackets = dropped;
+    expected.push_back(state);
+    delayMicroseconds(2000);
+  }
+  check(aborts == 0, "no aborts");
+  check(hal::radioAcks.size() == (size_t)packets, "an ACK payload sent with every packet");
+
+  TelemetryState decoded = {};
+  int counts[5] = {};
+  for (size_t k=0; k<hal::radioAcks.size(); k++) {
+    const hal::RadioFrame &ack = hal::radioAcks[k];
+    uint8_t type, sequence;
+    bool ok = decodeTelemetry(ack.data, ack.length, decoded, type, sequence);
+    check(ok, "ACK payload decodes");
+    check(type == telemetrySchedule[k % telemetryScheduleLen] and sequence == (k & 0xF), "frames follow the schedule");
+    check(ok and matches(type, decoded, expected[k]), "ACK payload holds the previous state");
+    counts[ok ? type : 0]++;
+  }
+  printf("telemetry: %zu ACK payloads, attitude %d, motors %d, loop %d, link %d, bad %d\n",
+         hal::radioAcks.size(), counts[1], counts[2], counts[3], counts[4], counts[0]);
+
+  //A packet of the wrong size takes an ACK payload too, which is replaced, but it is dropped instead of decoded
+  micros_t lastTimestamp = rc.get().timestamp;
+  check(hal::radioReceive(packet, radioPacketSize-2), "wrong size packet acknowledged");
+  droneRadio.getInput(rc);
+  check(rc.get().timestamp == lastTimestamp, "wrong size packet not decoded");
+  check(droneRadio.droppedPackets == dropped+1, "wrong size packet dropped");
+  check(hal::radioReceive(packet, radioPacketSize), "packet acknowledged");
+  uint8_t type, sequence;
+  check(hal::radioAcks.size() == (size_t)packets + 2 and
+        decodeTelemetry(hal::radioAcks.back().data, hal::radioAcks.back().length, decoded, type, sequence),
+        "ACK payload replaced after a wrong size packet");
+}
+
+int main(int argc, char **argv) {
+  int iterations = 1000000;
+  for (int i=1; i<argc-1; i++) {
+    if (!strcmp(argv[i], "--iterations")) {
+      iterations = atoi(argv[++i]);
+    }
+  }
+
+  checkFrames();
+  checkLink(3000);
+  printf("telemetry: %d checks failed\n", failures);
+
+  //Time encoding the frames of one trip through the schedule
+  uint8_t frame[telemetryMaxLength];
+  TelemetryState state = makeState(1);
+  volatile int sink = 0;
+  auto startTime = std::chrono::steady_clock::now();
+  for (int i=0; i<iterations; i++) {
+    state.deadlineMisses = i;
+    int length = encodeTelemetry(state, telemetrySchedule[i % telemetryScheduleLen], i, frame);
+    sink = sink + frame[length-1];
+  }
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - startTime).count() / iterations;
+  printf("telemetry: %.1f ns to encode a frame\n", ns);
+  return failures ? 1 : 0;
+}
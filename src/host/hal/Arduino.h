@@ -0,0 +1,243 @@
+#ifndef __HostArduino_H__
+#define __HostArduino_H__
+
+/*
+ * Host (Linux) replacement for the Arduino core, so the flight controller modules can be built and run on a PC.
+ * Time is simulated: it only moves forward when delay() is called or the tool advances it with hal::advanceMicros().
+ * Interval timers (see IntervalTimer.h) and the tool's simulation step fire while the simulated time moves forward.
+ */
+
+//Import libraries
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <type_traits>
+
+using std::abs;
+
+typedef uint8_t byte;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define FALLING 2
+#define RISING 3
+#define CHANGE 4
+
+#ifndef PI
+  #define PI 3.1415926535897932384626433832795
+#endif
+
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+#define bitSet(value, bit) ((value) |= (1UL << (bit)))
+#define bitClear(value, bit) ((value) &= ~(1UL << (bit)))
+
+template <typename A, typename B> typename std::common_type<A, B>::type min(A a, B b) {
+  return a < b ? a : b;
+}
+template <typename A, typename B> typename std::common_type<A, B>::type max(A a, B b) {
+  return a > b ? a : b;
+}
+template <typename T, typename A, typename B, typename C, typename D> T map(T x, A inMin, B inMax, C outMin, D outMax) {
+  return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+/* Simulated hardware state */
+namespace hal {
+  ///Number of simulated digital pins
+  const int pinCount = 64;
+  ///Simulated time since power on (ns)
+  extern uint64_t clockNanos;
+  ///Value last written to each pin
+  extern int pinState[pinCount];
+  ///Time each pin last changed value (ns)
+  extern uint64_t pinChangeNanos[pinCount];
+  ///Value returned by analogRead() for each pin
+  extern int analogValue[pinCount];
+  ///Time each read of the clock takes (ns). 0 by default, simulators set it so polling loops move time forward
+  extern uint64_t clockReadNanos;
+  ///Called every simulationPeriodNanos of simulated time, used by tools to simulate the world outside the board
+  extern void (*simulationStep)();
+  ///Period of simulationStep (ns)
+  extern uint64_t simulationPeriodNanos;
+  /**
+   * @enum Device
+   * @brief Simulated devices whose transfers can be slowed down by transferLatency
+   */
+  enum Device {imuDevice, sdDevice};
+  ///Called on each transfer with a simulated device, returns the extra time the transfer takes (ns). nullptr by default,
+  ///tools set it to make the firmware's loops overrun
+  extern uint64_t (*transferLatency)(Device device);
+
+  /** Moves the simulated clock forward, running any interval timers which are due
+   *
+   *  @param[in] ns Time to advance by (ns)
+   */
+  void advanceNanos(uint64_t ns);
+  /** Moves the simulated clock forward, running any interval timers which are due
+   *
+   *  @param[in] us Time to advance by (μs)
+   */
+  void advanceMicros(uint64_t us);
+  /** Moves the simulated clock forward by the extra time transferLatency gives a transfer
+   *
+   *  @param[in] device Device the transfer is with
+   */
+  void stallTransfer(Device device);
+  /** Sets the level of an input pin, running its interrupt if the change matches the interrupt's mode
+   *
+   *  @param[in] pin Pin to drive
+   *  @param[in] value New level of the pin
+   */
+  void driveInput(uint8_t pin, int value);
+  /** Thrown by delay() once stop() has been called, used to leave the infinite loops in ABORT() */
+  struct Stopped {};
+  /** Requests the firmware to stop, the next delay() will throw hal::Stopped */
+  void stop();
+  /** Returns true if stop() has been called */
+  bool stopped();
+  ///Number of HeapAllowed scopes the program is in, heap use is not counted as the firmware's inside them
+  extern int heapAllowedDepth;
+  /**
+   * @struct HeapAllowed
+   * @brief Lets the simulated hardware and the tool use the heap while the firmware's heap is locked (see Memory.h)
+   */
+  struct HeapAllowed {
+    HeapAllowed() {
+      heapAllowedDepth++;
+    }
+    ~HeapAllowed() {
+      heapAllowedDepth--;
+    }
+  };
+}
+
+/* Time */
+unsigned long micros();
+unsigned long millis();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+///Clock of the simulated CPU (Hz)
+#define F_CPU_ACTUAL 600000000
+namespace hal {
+  /** Reads the simulated CPU cycle counter, counted from clockNanos at F_CPU_ACTUAL so it wraps every 2^32 cycles */
+  uint32_t readCycleCounter();
+}
+///Cycle counter of the CPU
+#define ARM_DWT_CYCCNT (hal::readCycleCounter())
+
+/* Interrupts */
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+/* Pin interrupts */
+inline int digitalPinToInterrupt(uint8_t pin) {
+  return pin;
+}
+void attachInterrupt(uint8_t pin, void (*func)(), int mode);
+void detachInterrupt(uint8_t pin);
+
+/* Digital pins */
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+inline void digitalWriteFast(uint8_t pin, uint8_t value) {
+  digitalWrite(pin, value);
+}
+
+/**
+ * @class String
+ * @brief Subset of the Arduino String class used by the firmware
+ */
+class String {
+  public:
+    String(const char *s="") : str(s) {}
+    String(const std::string &s) : str(s) {}
+    String(char c) : str(1, c) {}
+    String(int n) : str(std::to_string(n)) {}
+    String(unsigned int n) : str(std::to_string(n)) {}
+    String(long n) : str(std::to_string(n)) {}
+    String(unsigned long n) : str(std::to_string(n)) {}
+    String(float f, int decimals=2) : str(formatFloat(f, decimals)) {}
+    String(double f, int decimals=2) : str(formatFloat(f, decimals)) {}
+
+    String &operator+=(const String &s) {
+      str += s.str;
+      return *this;
+    }
+    friend String operator+(const String &a, const String &b) {
+      return String(a.str + b.str);
+    }
+    friend String operator+(const char *a, const String &b) {
+      return String(a + b.str);
+    }
+    friend String operator+(const String &a, const char *b) {
+      return String(a.str + b);
+    }
+    bool operator==(const String &s) const {
+      return str == s.str;
+    }
+
+    unsigned int length() const {
+      return str.size();
+    }
+    const char *c_str() const {
+      return str.c_str();
+    }
+    void toCharArray(char *buf, unsigned int len) const {
+      if (len == 0) {
+        return;
+      }
+      strncpy(buf, str.c_str(), len-1);
+      buf[len-1] = 0;
+    }
+
+  private:
+    static std::string formatFloat(double f, int decimals) {
+      char buf[64];
+      snprintf(buf, sizeof(buf), "%.*f", decimals, f);
+      return buf;
+    }
+
+    std::string str;
+};
+
+/**
+ * @class HostSerial
+ * @brief Serial port which writes to stdout, or to a file chosen by the tool
+ */
+class HostSerial {
+  public:
+    void begin(unsigned long baud) {}
+    /** Redirects the output to a file, nullptr discards the output */
+    void redirect(FILE *file, bool enable=true) {
+      out = file;
+      enabled = enable;
+    }
+    void print(const String &s) {
+      print(s.c_str());
+    }
+    void print(const char *s) {
+      if (enabled and out) {
+        fputs(s, out);
+      }
+    }
+    void println(const String &s="") {
+      print(s);
+      print("\n");
+    }
+
+  private:
+    FILE *out = stdout;
+    bool enabled = true;
+};
+extern HostSerial Serial;
+#endif
@@ -0,0 +1,154 @@
+#include "ArduinoJson.h"
+
+#include <ctype.h>
+
+namespace {
+  ///Value returned for missing keys and indexes
+  const JsonVariant nullVariant;
+
+  /**
+   * @class JsonParser
+   * @brief Recursive descent JSON parser
+   */
+  class JsonParser {
+    public:
+      explicit JsonParser(const std::string &text) : text(text) {}
+
+      /** Parses the whole text, returns false if it is not one valid value */
+      bool parse(JsonVariant &value) {
+        if (!parseValue(value)) {
+          return false;
+        }
+        skipSpace();
+        return pos == text.size();
+      }
+
+    private:
+      void skipSpace() {
+        while (pos < text.size() and isspace((unsigned char)text[pos])) {
+          pos++;
+        }
+      }
+      bool consume(char c) {
+        skipSpace();
+        if (pos < text.size() and text[pos] == c) {
+          pos++;
+          return true;
+        }
+        return false;
+      }
+      bool consumeWord(const char *word) {
+        size_t len = strlen(word);
+        if (text.compare(pos, len, word) == 0) {
+          pos += len;
+          return true;
+        }
+        return false;
+      }
+
+      bool parseString(std::string &s) {
+        if (!consume('"')) {
+          return false;
+        }
+        while (pos < text.size() and text[pos] != '"') {
+          if (text[pos] == '\\' and pos+1 < text.size()) {
+            pos++;
+          }
+          s += text[pos++];
+        }
+        return consume('"');
+      }
+
+      bool parseValue(JsonVariant &value) {
+        skipSpace();
+        if (pos >= text.size()) {
+          return false;
+        }
+        char c = text[pos];
+        if (c == '{') {
+          pos++;
+          value.type = JsonVariant::OBJECT;
+          if (consume('}')) {
+            return true;
+          }
+          do {
+            std::string key;
+            if (!parseString(key) or !consume(':') or !parseValue(value.object[key])) {
+              return false;
+            }
+          } while (consume(','));
+          return consume('}');
+        } else if (c == '[') {
+          pos++;
+          value.type = JsonVariant::ARRAY;
+          if (consume(']')) {
+            return true;
+          }
+          do {
+            value.array.emplace_back();
+            if (!parseValue(value.array.back())) {
+              return false;
+            }
+          } while (consume(','));
+          return consume(']');
+        } else if (c == '"') {
+          value.type = JsonVariant::STRING;
+          return parseString(value.str);
+        } else if (consumeWord("true") or consumeWord("false")) {
+          value.type = JsonVariant::BOOLEAN;
+          value.boolean = c == 't';
+          return true;
+        } else if (consumeWord("null")) {
+          return true;
+        }
+
+        const char *start = text.c_str() + pos;
+        char *end;
+        value.number = strtod(start, &end);
+        if (end == start) {
+          return false;
+        }
+        value.type = JsonVariant::NUMBER;
+        pos += end - start;
+        return true;
+      }
+
+      const std::string &text;
+      size_t pos = 0;
+  };
+}
+
+const JsonVariant &JsonVariant::operator[](const String &key) const {
+  if (type != OBJECT) {
+    return nullVariant;
+  }
+  auto it = object.find(key.c_str());
+  return it == object.end() ? nullVariant : it->second;
+}
+
+const JsonVariant &JsonVariant::operator[](int index) const {
+  if (type != ARRAY or index < 0 or index >= (int)array.size()) {
+    return nullVariant;
+  }
+  return array[index];
+}
+
+DeserializationError deserializeJson(JsonDocument &doc, const std::string &text) {
+  doc = JsonDocument();
+  JsonParser parser(text);
+  if (!parser.parse(doc)) {
+    doc = JsonDocument();
+    return true;
+  }
+  return false;
+}
+
+DeserializationError deserializeJson(JsonDocument &doc, FsFile &file) {
+  std::string text;
+  char buf[256];
+  int len;
+  while ((len = file.read(buf, sizeof(buf))) > 0) {
+    text.append(buf, len);
+  }
+  return deserializeJson(doc, text);
+}
@@ -0,0 +1,83 @@
+#ifndef __HostArduinoJson_H__
+#define __HostArduinoJson_H__
+
+/*
+ * Host replacement for the subset of ArduinoJson used to read settings.json:
+ * parsing a document from a file, checking for keys, indexing objects and arrays, and converting values to numbers.
+ */
+
+//Import libraries
+#include <map>
+#include <string>
+#include <vector>
+
+//Import files
+#include "Arduino.h"
+#include "SdFat.h"
+
+/**
+ * @class JsonVariant
+ * @brief Any JSON value. Missing values are null and convert to 0
+ */
+class JsonVariant {
+  public:
+    enum Type {NUL, BOOLEAN, NUMBER, STRING, ARRAY, OBJECT};
+
+    bool containsKey(const String &key) const {
+      return type == OBJECT and object.count(key.c_str());
+    }
+    const JsonVariant &operator[](const String &key) const;
+    const JsonVariant &operator[](const char *key) const {
+      return (*this)[String(key)];
+    }
+    const JsonVariant &operator[](int index) const;
+
+    bool operator==(const char *s) const {
+      return type == STRING and str == s;
+    }
+    bool operator!=(const char *s) const {
+      return !(*this == s);
+    }
+    template <typename T> operator T() const {
+      return (T)(type == BOOLEAN ? (boolean ? 1 : 0) : number);
+    }
+
+    Type type = NUL;
+    bool boolean = false;
+    double number = 0;
+    std::string str;
+    std::vector<JsonVariant> array;
+    std::map<std::string, JsonVariant> object;
+};
+
+/**
+ * @class JsonDocument
+ * @brief Parsed JSON document, the root value is usually an object
+ */
+class JsonDocument : public JsonVariant {};
+template <size_t capacity> class StaticJsonDocument : public JsonDocument {};
+
+/**
+ * @class DeserializationError
+ * @brief Result of parsing a document, true if there was an error
+ */
+class DeserializationError {
+  public:
+    DeserializationError(bool error) : error(error) {}
+    explicit operator bool() const {
+      return error;
+    }
+
+  private:
+    bool error;
+};
+
+/** Parses a JSON document
+ *
+ *  @param[out] doc Document to parse into, null if there is an error
+ *  @param[in] text JSON text
+ */
+DeserializationError deserializeJson(JsonDocument &doc, const std::string &text);
+/** Parses a JSON document from the rest of a file */
+DeserializationError deserializeJson(JsonDocument &doc, FsFile &file);
+#endif
@@ -0,0 +1,188 @@
+#include "Arduino.h"
+#include "IntervalTimer.h"
+#include "Teensy_PWM.h"
+
+HostSerial Serial;
+
+namespace hal {
+  uint64_t clockNanos = 0;
+  int pinState[pinCount];
+  uint64_t pinChangeNanos[pinCount];
+  int analogValue[pinCount];
+  float pwmDutyCycle[pinCount];
+  float pwmFrequency[pinCount];
+  uint64_t pwmStartNanos[pinCount];
+  uint64_t pwmApplyNanos[pinCount];
+  uint64_t pwmWrites = 0;
+  uint64_t clockReadNanos = 0;
+  void (*simulationStep)() = nullptr;
+  uint64_t simulationPeriodNanos = 0;
+  uint64_t (*transferLatency)(Device device) = nullptr;
+  ///Time simulationStep is next called (ns)
+  uint64_t nextSimulationNanos = 0;
+  ///Whether simulationStep is running, it is not run again if it reads the clock
+  bool simulationRunning = false;
+  ///True once stop() has been called
+  bool stopRequested = false;
+  ///Interval timers which are running, the Teensy 4 has four
+  IntervalTimer *timers[4] = {};
+  ///Interrupt attached to each pin
+  void (*pinInterrupt[pinCount])() = {};
+  ///Edges which run the interrupt of each pin (FALLING, RISING or CHANGE)
+  int pinInterruptMode[pinCount];
+
+  void advanceNanos(uint64_t ns) {
+    uint64_t target = clockNanos + ns;
+    for (;;) {
+      //Find the next timer due before the target time
+      IntervalTimer *next = nullptr;
+      for (IntervalTimer *timer : timers) {
+        if (timer and timer->nextNanos <= target and (!next or timer->nextNanos < next->nextNanos)) {
+          next = timer;
+        }
+      }
+
+      //Run the simulation step if it is due first
+      if (simulationStep and !simulationRunning and nextSimulationNanos <= target and (!next or nextSimulationNanos < next->nextNanos)) {
+        clockNanos = max(clockNanos, nextSimulationNanos);
+        nextSimulationNanos += simulationPeriodNanos;
+        simulationRunning = true;
+        HeapAllowed heapAllowed;
+        simulationStep();
+        simulationRunning = false;
+        continue;
+      }
+      if (!next) {
+        break;
+      }
+
+      //Load the next interval then run the interrupt
+      clockNanos = next->nextNanos;
+      next->periodNanos = next->loadNanos;
+      next->nextNanos += next->periodNanos;
+      next->callback();
+    }
+    clockNanos = target;
+  }
+
+  void advanceMicros(uint64_t us) {
+    advanceNanos(us * 1000);
+  }
+
+  void stallTransfer(Device device) {
+    if (transferLatency) {
+      advanceNanos(transferLatency(device));
+    }
+  }
+
+  void driveInput(uint8_t pin, int value) {
+    int last = pinState[pin];
+    digitalWrite(pin, value);
+    if (value == last or !pinInterrupt[pin]) {
+      return;
+    }
+    int mode = pinInterruptMode[pin];
+    if (mode == CHANGE or (mode == FALLING and value == LOW) or (mode == RISING and value == HIGH)) {
+      pinInterrupt[pin]();
+    }
+  }
+
+  void stop() {
+    stopRequested = true;
+  }
+
+  bool stopped() {
+    return stopRequested;
+  }
+}
+
+bool IntervalTimer::begin(void (*func)(), float microseconds) {
+  end();
+  for (IntervalTimer *&timer : hal::timers) {
+    if (!timer) {
+      timer = this;
+      callback = func;
+      periodNanos = loadNanos = max((uint64_t)(microseconds * 1000 + .5f), (uint64_t)1);
+      nextNanos = hal::clockNanos + periodNanos;
+      running = true;
+      return true;
+    }
+  }
+  return false;
+}
+
+void IntervalTimer::update(float microseconds) {
+  loadNanos = max((uint64_t)(microseconds * 1000 + .5f), (uint64_t)1);
+}
+
+void IntervalTimer::end() {
+  for (IntervalTimer *&timer : hal::timers) {
+    if (timer == this) {
+      timer = nullptr;
+    }
+  }
+  running = false;
+}
+
+unsigned long micros() {
+  if (hal::clockReadNanos) {
+    hal::advanceNanos(hal::clockReadNanos);
+  }
+  return (unsigned long)(hal::clockNanos / 1000);
+}
+
+unsigned long millis() {
+  if (hal::clockReadNanos) {
+    hal::advanceNanos(hal::clockReadNanos);
+  }
+  return (unsigned long)(hal::clockNanos / 1000000);
+}
+
+uint32_t hal::readCycleCounter() {
+  if (hal::clockReadNanos) {
+    hal::advanceNanos(hal::clockReadNanos);
+  }
+  return (uint32_t)(hal::clockNanos * (F_CPU_ACTUAL / 1000000) / 1000);
+}
+
+void delay(unsigned long ms) {
+  if (hal::stopRequested) {
+    throw hal::Stopped();
+  }
+  hal::advanceMicros(ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us) {
+  hal::advanceMicros(us);
+}
+
+void attachInterrupt(uint8_t pin, void (*func)(), int mode) {
+  hal::pinInterrupt[pin] = func;
+  hal::pinInterruptMode[pin] = mode;
+}
+
+void detachInterrupt(uint8_t pin) {
+  hal::pinInterrupt[pin] = nullptr;
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  //Pull ups hold the input high until it is driven low
+  if (mode == INPUT_PULLUP) {
+    hal::pinState[pin] = HIGH;
+  }
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  if (hal::pinState[pin] != value) {
+    hal::pinChangeNanos[pin] = hal::clockNanos;
+  }
+  hal::pinState[pin] = value;
+}
+
+int digitalRead(uint8_t pin) {
+  return hal::pinState[pin];
+}
+
+int analogRead(uint8_t pin) {
+  return hal::analogValue[pin];
+}
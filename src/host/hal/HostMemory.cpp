@@ -0,0 +1,98 @@
+/*
+ * Host version of the firmware's memory checks (see Memory.h).
+ *
+ * Heap use is trapped in operator new, which is what String and the standard containers use: once the firmware has
+ * locked the heap, an allocation outside a hal::HeapAllowed scope prints its size and aborts, so the simulator stops
+ * at the allocation in a debugger. The stack is painted for stackPaintBytes below the caller instead of down to the
+ * end of the variables like on the Teensy.
+ */
+#include "Arduino.h"
+#include "Memory.h"
+
+#include <new>
+
+namespace hal {
+  int heapAllowedDepth = 0;
+}
+
+///Bytes of stack painted below the caller of paintStack()
+const uint32_t stackPaintBytes = 64*1024;
+///Value the free stack is filled with
+const uint32_t stackPattern = 0xA5A5A5A5;
+
+///True between lockHeap() and unlockHeap()
+static bool heapLocked = false;
+///Heap calls made by the firmware while the heap was locked
+static uint32_t heapCalls = 0;
+///Top of the painted stack
+static volatile uint32_t *paintTop = nullptr;
+
+/** Counts a heap call and aborts if the firmware made it after locking the heap */
+static void checkHeap(size_t size) {
+  if (heapLocked and hal::heapAllowedDepth == 0) {
+    heapCalls++;
+    fprintf(stderr, "heap allocation of %zu bytes after setup() (see Memory.h)\n", size);
+    abort();
+  }
+}
+
+void *operator new(size_t size) {
+  checkHeap(size);
+  void *p = malloc(size ? size : 1);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void *operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void *p) noexcept {
+  free(p);
+}
+
+void operator delete[](void *p) noexcept {
+  free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+  free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+  free(p);
+}
+
+void lockHeap() {
+  heapLocked = true;
+}
+
+void unlockHeap() {
+  heapLocked = false;
+}
+
+uint32_t heapViolations() {
+  return heapCalls;
+}
+
+__attribute__((noinline)) void paintStack() {
+  //Leave this function's red zone alone, the compiler may keep its variables there
+  volatile uint32_t *top = (volatile uint32_t *)__builtin_frame_address(0) - 128/4;
+  for (volatile uint32_t *word = top - stackPaintBytes/4; word < top; word++) {
+    *word = stackPattern;
+  }
+  paintTop = top;
+}
+
+uint32_t stackHighWater() {
+  if (!paintTop) {
+    return 0;
+  }
+  volatile uint32_t *word = paintTop - stackPaintBytes/4;
+  while (word < paintTop and *word == stackPattern) {
+    word++;
+  }
+  return (paintTop - word) * sizeof(uint32_t);
+}
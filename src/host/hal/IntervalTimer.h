@@ -0,0 +1,49 @@
+#ifndef __HostIntervalTimer_H__
+#define __HostIntervalTimer_H__
+
+/*
+ * Host replacement for the Teensy IntervalTimer. Timers fire while the simulated clock is moved forward by hal::advanceNanos().
+ * Like the Teensy periodic interrupt timer, the next interval is loaded when the timer fires,
+ * so calling update() from the interrupt changes the interval after the one that has just started.
+ */
+
+//Import files
+#include "Arduino.h"
+
+/**
+ * @class IntervalTimer
+ * @brief Calls a function repeatedly at a fixed interval of simulated time
+ */
+class IntervalTimer {
+  public:
+    ~IntervalTimer() {
+      end();
+    }
+    /** Starts calling a function every interval
+     *
+     *  @param[in] func Function to call
+     *  @param[in] microseconds Interval (μs)
+     *  @returns true if the timer was started
+     */
+    bool begin(void (*func)(), float microseconds);
+    /** Changes the interval, takes effect once the current interval ends
+     *
+     *  @param[in] microseconds New interval (μs)
+     */
+    void update(float microseconds);
+    /** Stops the timer */
+    void end();
+    void priority(uint8_t n) {}
+
+    ///Function called when the timer fires
+    void (*callback)() = nullptr;
+    ///Interval currently being timed (ns)
+    uint64_t periodNanos = 0;
+    ///Interval loaded when the timer next fires (ns)
+    uint64_t loadNanos = 0;
+    ///Time the timer next fires (ns)
+    uint64_t nextNanos = 0;
+    ///Whether the timer is running
+    bool running = false;
+};
+#endif
@@ -0,0 +1,101 @@
+#include "MPU6050_kriswiner.h"
+#include "Wire.h"
+
+TwoWire Wire;
+
+namespace hal {
+  /**
+   * @struct SimulatedMPU6050
+   * @brief Registers of one simulated sensor
+   */
+  struct SimulatedMPU6050 {
+    ///Raw accelerometer, gyroscope and temperature registers
+    int16_t accel[3], gyro[3], temperature;
+    ///Data ready flag of INT_STATUS
+    bool dataReady;
+  };
+  static SimulatedMPU6050 imus[imuDevices];
+
+  /** Finds the sensor at an address, nullptr if there is none */
+  static SimulatedMPU6050 *findImu(uint8_t address) {
+    int device = address - MPU6050_ADDRESS;
+    return device >= 0 and device < imuDevices ? &imus[device] : nullptr;
+  }
+
+  /** Converts a reading to raw counts, clipped to the full scale */
+  static int16_t toCounts(float value, float fullScale) {
+    float counts = roundf(value / fullScale * 32768.0f);
+    return (int16_t)min(max(counts, -32768.0f), 32767.0f);
+  }
+
+  void imuSample(const float accel[3], const float gyro[3], float temperature, int device) {
+    SimulatedMPU6050 &imu = imus[device];
+    for (int i=0; i<3; i++) {
+      imu.accel[i] = toCounts(accel[i], 2);
+      imu.gyro[i] = toCounts(gyro[i], 250);
+    }
+    imu.temperature = (int16_t)roundf((temperature - 36.53f) * 340);
+    imu.dataReady = true;
+  }
+
+  void imuRaw(const int16_t accel[3], const int16_t gyro[3], bool fresh, int device) {
+    SimulatedMPU6050 &imu = imus[device];
+    for (int i=0; i<3; i++) {
+      imu.accel[i] = accel[i];
+      imu.gyro[i] = gyro[i];
+    }
+    imu.dataReady = fresh;
+  }
+}
+
+uint8_t MPU6050lib::readByte(uint8_t address, uint8_t subAddress) {
+  hal::SimulatedMPU6050 *imu = hal::findImu(address);
+  if (!imu) {
+    return 0;
+  }
+  if (subAddress == WHO_AM_I_MPU6050) {
+    return 0x68;
+  } else if (subAddress == INT_STATUS) {
+    //The status is read every loop, so a slow bus shows here
+    hal::stallTransfer(hal::imuDevice);
+    //Reading the status clears it
+    uint8_t status = imu->dataReady;
+    imu->dataReady = false;
+    return status;
+  }
+  return 0;
+}
+
+void MPU6050lib::readBytes(uint8_t address, uint8_t subAddress, uint8_t count, uint8_t *dest) {
+  //The data registers from ACCEL_XOUT_H, high byte first
+  hal::SimulatedMPU6050 *imu = hal::findImu(address);
+  int16_t words[7] = {};
+  if (imu) {
+    for (int i=0; i<3; i++) {
+      words[i] = imu->accel[i];
+      words[4 + i] = imu->gyro[i];
+    }
+    words[3] = imu->temperature;
+  }
+  for (int i=0; i<count; i++) {
+    int reg = subAddress + i - ACCEL_XOUT_H;
+    uint16_t word = reg >= 0 and reg < 14 ? words[reg/2] : 0;
+    dest[i] = reg % 2 ? word & 0xFF : word >> 8;
+  }
+}
+
+void MPU6050lib::readAccelData(int16_t *destination) {
+  for (int i=0; i<3; i++) {
+    destination[i] = hal::imus[0].accel[i];
+  }
+}
+
+void MPU6050lib::readGyroData(int16_t *destination) {
+  for (int i=0; i<3; i++) {
+    destination[i] = hal::imus[0].gyro[i];
+  }
+}
+
+int16_t MPU6050lib::readTempData() {
+  return hal::imus[0].temperature;
+}
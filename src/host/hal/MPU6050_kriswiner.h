@@ -0,0 +1,73 @@
+#ifndef __HostMPU6050_H__
+#define __HostMPU6050_H__
+
+/*
+ * Host replacement for Kris Winer's MPU6050 library, simulating the sensor's registers.
+ *
+ * The tool sets the next sample with hal::imuSample(), which sets the data ready flag in INT_STATUS like a new reading would.
+ * There are imuDevices sensors, at MPU6050_ADDRESS and the addresses after it, for several IMUs (see IMU::imuCount).
+ * Readings are converted to raw counts with the same full scale as initMPU6050() (±2 G, ±250°/s), so they clip and are quantised.
+ */
+
+//Import files
+#include "Arduino.h"
+
+//Registers used by the firmware
+#define MPU6050_ADDRESS 0x68
+#define SMPLRT_DIV 0x19
+#define CONFIG 0x1A
+#define GYRO_CONFIG 0x1B
+#define ACCEL_CONFIG 0x1C
+#define INT_PIN_CFG 0x37
+#define INT_ENABLE 0x38
+#define INT_STATUS 0x3A
+#define ACCEL_XOUT_H 0x3B
+#define TEMP_OUT_H 0x41
+#define GYRO_XOUT_H 0x43
+#define PWR_MGMT_1 0x6B
+#define WHO_AM_I_MPU6050 0x75
+
+/* Simulated sensor */
+namespace hal {
+  ///Number of simulated sensors, at MPU6050_ADDRESS + 0 - 3
+  const int imuDevices = 4;
+
+  /** Sets the next reading of a simulated MPU6050
+   *
+   *  @param[in] accel Acceleration of the x, y and z axes (G)
+   *  @param[in] gyro Rotation rate of the x, y and z axes (degrees per second)
+   *  @param[in] temperature Temperature of the sensor (degrees celsius)
+   *  @param[in] device Which sensor, 0 - imuDevices-1
+   */
+  void imuSample(const float accel[3], const float gyro[3], float temperature, int device=0);
+  /** Sets the raw registers of a simulated MPU6050, used to replay logged readings
+   *
+   *  @param[in] accel Raw accelerometer readings of the x, y and z axes
+   *  @param[in] gyro Raw gyroscope readings of the x, y and z axes
+   *  @param[in] fresh Whether the readings are new, sets the data ready flag
+   *  @param[in] device Which sensor, 0 - imuDevices-1
+   */
+  void imuRaw(const int16_t accel[3], const int16_t gyro[3], bool fresh, int device=0);
+}
+
+/**
+ * @class MPU6050lib
+ * @brief Simulated MPU6050
+ */
+class MPU6050lib {
+  public:
+    uint8_t readByte(uint8_t address, uint8_t subAddress);
+    void readBytes(uint8_t address, uint8_t subAddress, uint8_t count, uint8_t *dest);
+    void writeByte(uint8_t address, uint8_t subAddress, uint8_t data) {}
+    void initMPU6050() {}
+    float getAres() {
+      return 2.0f/32768.0f;
+    }
+    float getGres() {
+      return 250.0f/32768.0f;
+    }
+    void readAccelData(int16_t *destination);
+    void readGyroData(int16_t *destination);
+    int16_t readTempData();
+};
+#endif
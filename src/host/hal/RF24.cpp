@@ -0,0 +1,85 @@
+#include "RF24.h"
+
+SPIClass SPI;
+
+namespace hal {
+  int radioIrqPin = -1;
+  std::vector<RadioFrame> radioSent;
+  std::vector<RadioFrame> radioAcks;
+  ///The simulated radio
+  RF24 *radio = nullptr;
+
+  /** Copies a payload into a frame, truncated to 32 bytes */
+  static RadioFrame makeFrame(const void *data, uint8_t length) {
+    RadioFrame frame = {};
+    frame.length = min(length, (uint8_t)sizeof(frame.data));
+    memcpy(frame.data, data, frame.length);
+    frame.timestamp = micros();
+    return frame;
+  }
+
+  bool radioReceive(const void *data, uint8_t length) {
+    if (!radio or !radio->listening or radio->rxFifo.size() == 3) {
+      return false;
+    }
+    radio->rxFifo.push_back(makeFrame(data, radio->dynamicPayloads ? length : radio->payloadSize));
+    if (radio->ackPayloads and !radio->ackFifo.empty()) {
+      radioAcks.push_back(radio->ackFifo.front());
+      radioAcks.back().timestamp = micros();
+      radio->ackFifo.pop_front();
+    }
+
+    radio->rxReady = true;
+    if (!radio->maskRxReady and radioIrqPin >= 0) {
+      driveInput(radioIrqPin, LOW);
+    }
+    return true;
+  }
+}
+
+RF24::RF24(uint16_t cePin, uint16_t csnPin) {
+  hal::radio = this;
+}
+
+RF24::~RF24() {
+  if (hal::radio == this) {
+    hal::radio = nullptr;
+  }
+}
+
+bool RF24::write(const void *buf, uint8_t len) {
+  hal::HeapAllowed heapAllowed;
+  hal::radioSent.push_back(hal::makeFrame(buf, len));
+  return true;
+}
+
+void RF24::startListening() {
+  listening = true;
+  ackFifo.clear();
+}
+
+void RF24::read(void *buf, uint8_t len) {
+  if (rxFifo.empty()) {
+    return;
+  }
+  memcpy(buf, rxFifo.front().data, min(len, rxFifo.front().length));
+  rxFifo.pop_front();
+}
+
+void RF24::whatHappened(bool &txOk, bool &txFail, bool &rxReady) {
+  txOk = txFail = false;
+  rxReady = this->rxReady;
+  this->rxReady = false;
+  if (hal::radioIrqPin >= 0) {
+    hal::driveInput(hal::radioIrqPin, HIGH);
+  }
+}
+
+bool RF24::writeAckPayload(uint8_t pipe, const void *buf, uint8_t len) {
+  if (!ackPayloads or ackFifo.size() == 3) {
+    return false;
+  }
+  hal::HeapAllowed heapAllowed;
+  ackFifo.push_back(hal::makeFrame(buf, len));
+  return true;
+}
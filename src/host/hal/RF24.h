@@ -0,0 +1,117 @@
+#ifndef __HostRF24_H__
+#define __HostRF24_H__
+
+/*
+ * Host replacement for the RF24 library, simulating an nRF24L01+ talking to the controller.
+ *
+ * The tool plays the controller with hal::radioReceive(). Like the real radio, a received packet goes in the 3 packet RX FIFO,
+ * the oldest ACK payload is sent back with it and the IRQ pin (hal::radioIrqPin) is pulled low until whatHappened() is called.
+ * Ready signals sent with write() and ACK payloads sent to the controller are recorded for the tool to check.
+ */
+
+//Import libraries
+#include <deque>
+#include <vector>
+
+//Import files
+#include "Arduino.h"
+#include "SPI.h"
+
+enum rf24_pa_dbm_e {RF24_PA_MIN, RF24_PA_LOW, RF24_PA_HIGH, RF24_PA_MAX};
+enum rf24_datarate_e {RF24_1MBPS, RF24_2MBPS, RF24_250KBPS};
+
+/* Simulated radio link */
+namespace hal {
+  /**
+   * @struct RadioFrame
+   * @brief Payload sent over the simulated radio link
+   */
+  struct RadioFrame {
+    ///Payload data
+    uint8_t data[32];
+    ///Payload length (bytes)
+    uint8_t length;
+    ///Time the payload was sent (μs)
+    uint32_t timestamp;
+  };
+
+  ///Pin the radio's IRQ line is connected to, -1 if it is not connected
+  extern int radioIrqPin;
+  ///Payloads sent by write(), in order
+  extern std::vector<RadioFrame> radioSent;
+  ///ACK payloads sent back to the controller, in order
+  extern std::vector<RadioFrame> radioAcks;
+
+  /** Sends a packet from the controller to the simulated radio
+   *
+   *  @param[in] data Packet data
+   *  @param[in] length Packet length (bytes)
+   *  @returns false if the radio is not listening or its RX FIFO is full, so the packet is not acknowledged
+   */
+  bool radioReceive(const void *data, uint8_t length);
+}
+
+/**
+ * @class RF24
+ * @brief Simulated nRF24L01+, only one radio can exist at a time
+ */
+class RF24 {
+  public:
+    RF24(uint16_t cePin, uint16_t csnPin);
+    ~RF24();
+
+    bool begin() {
+      return true;
+    }
+    void setRadiation(uint8_t level, rf24_datarate_e speed) {}
+    void setChannel(uint8_t channel) {}
+    void setPayloadSize(uint8_t size) {
+      payloadSize = size;
+    }
+    void openWritingPipe(const uint8_t *address) {}
+    void openReadingPipe(uint8_t pipe, const uint8_t *address) {}
+    void enableDynamicPayloads() {
+      dynamicPayloads = true;
+    }
+    void enableAckPayload() {
+      ackPayloads = true;
+    }
+    void maskIRQ(bool txOk, bool txFail, bool rxReady) {
+      maskRxReady = rxReady;
+    }
+
+    /** Sends a payload, recorded in hal::radioSent */
+    bool write(const void *buf, uint8_t len);
+    void startListening();
+    bool available() {
+      return !rxFifo.empty();
+    }
+    /** Reads the oldest packet in the RX FIFO */
+    void read(void *buf, uint8_t len);
+    uint8_t getDynamicPayloadSize() {
+      return rxFifo.empty() ? 0 : rxFifo.front().length;
+    }
+    /** Clears the interrupt flags, releasing the IRQ pin */
+    void whatHappened(bool &txOk, bool &txFail, bool &rxReady);
+    /** Queues a payload to send back with the next packet received
+     *
+     *  @returns false if the 3 payload TX FIFO is full or ACK payloads are not enabled
+     */
+    bool writeAckPayload(uint8_t pipe, const void *buf, uint8_t len);
+
+    ///Packets received but not read yet
+    std::deque<hal::RadioFrame> rxFifo;
+    ///ACK payloads waiting to be sent
+    std::deque<hal::RadioFrame> ackFifo;
+    ///Whether the radio is listening for packets
+    bool listening = false;
+    ///Whether a packet has been received since whatHappened() was called
+    bool rxReady = false;
+    ///Whether the IRQ pin ignores received packets
+    bool maskRxReady = false;
+    ///Size of the payloads when dynamic payloads are disabled (bytes)
+    uint8_t payloadSize = 32;
+    bool dynamicPayloads = false;
+    bool ackPayloads = false;
+};
+#endif
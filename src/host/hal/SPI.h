@@ -0,0 +1,21 @@
+#ifndef __HostSPI_H__
+#define __HostSPI_H__
+
+/*
+ * Host replacement for the Arduino SPI library. Only the calls used alongside the simulated radio (see RF24.h) are provided.
+ */
+
+//Import files
+#include "Arduino.h"
+
+/**
+ * @class SPIClass
+ * @brief SPI bus, transfers are done by the simulated devices themselves
+ */
+class SPIClass {
+  public:
+    void begin() {}
+    void usingInterrupt(uint8_t interruptNumber) {}
+};
+extern SPIClass SPI;
+#endif
@@ -0,0 +1,80 @@
+#include "SdFat.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace hal {
+  std::string storageDir = ".";
+
+  /** Gets the path of a file on the simulated SD card, the paths are not part of the firmware's heap use */
+  static std::string storagePath(const char *name) {
+    HeapAllowed heapAllowed;
+    return storageDir + "/" + name;
+  }
+}
+
+bool FsFile::open(const char *name, int flags) {
+  hal::HeapAllowed heapAllowed;
+  close();
+  path = hal::storagePath(name);
+  int fd = ::open(path.c_str(), flags, 0644);
+  if (fd < 0) {
+    return false;
+  }
+
+  const char *mode = "r";
+  if ((flags & O_ACCMODE) == O_WRONLY) {
+    mode = flags & O_APPEND ? "a" : "w";
+  } else if ((flags & O_ACCMODE) == O_RDWR) {
+    mode = flags & O_APPEND ? "a+" : "r+";
+  }
+  file = fdopen(fd, mode);
+  return file != nullptr;
+}
+
+void FsFile::close() {
+  if (file) {
+    fclose(file);
+    file = nullptr;
+  }
+}
+
+bool FsFile::rename(const char *newName) {
+  hal::HeapAllowed heapAllowed;
+  std::string newPath = hal::storagePath(newName);
+  if (::rename(path.c_str(), newPath.c_str()) != 0) {
+    return false;
+  }
+  path = newPath;
+  return true;
+}
+
+bool FsFile::truncate() {
+  if (!file) {
+    return false;
+  }
+  fflush(file);
+  return ftruncate(fileno(file), ftell(file)) == 0;
+}
+
+uint64_t FsFile::size() {
+  if (!file) {
+    return 0;
+  }
+  fflush(file);
+  struct stat info;
+  return fstat(fileno(file), &info) == 0 ? info.st_size : 0;
+}
+
+bool SdFs::begin(SdioConfig config) {
+  struct stat info;
+  return stat(hal::storageDir.c_str(), &info) == 0 and S_ISDIR(info.st_mode);
+}
+
+bool SdFs::exists(const char *name) {
+  return access(hal::storagePath(name).c_str(), F_OK) == 0;
+}
+
+bool SdFs::remove(const char *name) {
+  return ::remove(hal::storagePath(name).c_str()) == 0;
+}
@@ -0,0 +1,101 @@
+#ifndef __HostSdFat_H__
+#define __HostSdFat_H__
+
+/*
+ * Host replacement for the SdFat library. Files are stored in a directory on the PC (hal::storageDir),
+ * so the logs, settings and calibration files of a simulated flight are the same as on the SD card.
+ */
+
+//Import libraries
+#include <fcntl.h>
+#include <stdio.h>
+#include <string>
+
+//Import files
+#include "Arduino.h"
+
+#ifndef O_READ
+  #define O_READ O_RDONLY
+  #define O_WRITE O_WRONLY
+#endif
+#define FIFO_SDIO 0
+
+namespace hal {
+  ///Directory holding the files of the simulated SD card
+  extern std::string storageDir;
+}
+
+/**
+ * @struct SdioConfig
+ * @brief SD card interface settings, unused on the host
+ */
+struct SdioConfig {
+  SdioConfig(int options) {}
+};
+
+/**
+ * @class FsFile
+ * @brief File on the simulated SD card
+ */
+class FsFile {
+  public:
+    ~FsFile() {
+      close();
+    }
+    bool open(const char *name, int flags=O_READ);
+    void close();
+    bool rename(const char *newName);
+    bool preAllocate(uint64_t length) {
+      return file != nullptr;
+    }
+    /** Truncates the file at the current position */
+    bool truncate();
+    void flush() {
+      if (file) {
+        fflush(file);
+      }
+    }
+
+    size_t write(const void *data, size_t len) {
+      hal::stallTransfer(hal::sdDevice);
+      return file ? fwrite(data, 1, len, file) : 0;
+    }
+    size_t print(const String &s) {
+      return write(s.c_str(), s.length());
+    }
+    size_t print(const char *s) {
+      return write(s, strlen(s));
+    }
+    int read(void *data, size_t len) {
+      return file ? (int)fread(data, 1, len, file) : -1;
+    }
+    uint64_t size();
+    uint64_t position() {
+      return file ? ftell(file) : 0;
+    }
+    int available() {
+      return (int)(size() - position());
+    }
+    explicit operator bool() const {
+      return file != nullptr;
+    }
+
+  private:
+    ///Open file, nullptr if closed
+    FILE *file = nullptr;
+    ///Path of the open file
+    std::string path;
+};
+
+/**
+ * @class SdFs
+ * @brief Simulated SD card
+ */
+class SdFs {
+  public:
+    /** Returns false if hal::storageDir is not a directory */
+    bool begin(SdioConfig config);
+    bool exists(const char *name);
+    bool remove(const char *name);
+};
+#endif
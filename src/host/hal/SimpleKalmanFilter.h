@@ -0,0 +1,49 @@
+#ifndef __HostSimpleKalmanFilter_H__
+#define __HostSimpleKalmanFilter_H__
+
+/*
+ * Host copy of the SimpleKalmanFilter library (https://github.com/denyssene/SimpleKalmanFilter).
+ * The library does not use any hardware, so it is reproduced here with the same arithmetic.
+ */
+
+//Import libraries
+#include <math.h>
+
+/**
+ * @class SimpleKalmanFilter
+ * @brief One dimensional Kalman filter
+ */
+class SimpleKalmanFilter {
+  public:
+    SimpleKalmanFilter(float mea_e, float est_e, float q) : _err_measure(mea_e), _err_estimate(est_e), _q(q) {}
+
+    float updateEstimate(float mea) {
+      _kalman_gain = _err_estimate / (_err_estimate + _err_measure);
+      _current_estimate = _last_estimate + _kalman_gain * (mea - _last_estimate);
+      _err_estimate = (1.0f - _kalman_gain) * _err_estimate + fabsf(_last_estimate - _current_estimate) * _q;
+      _last_estimate = _current_estimate;
+      return _current_estimate;
+    }
+
+    void setMeasurementError(float mea_e) {
+      _err_measure = mea_e;
+    }
+
+    void setEstimateError(float est_e) {
+      _err_estimate = est_e;
+    }
+
+    void setProcessNoise(float q) {
+      _q = q;
+    }
+
+  private:
+    //Same members in the same order as the library, so a stored filter (see IMU::saveEstimator) can be read by both
+    float _err_measure;
+    float _err_estimate;
+    float _q;
+    float _current_estimate = 0;
+    float _last_estimate = 0;
+    float _kalman_gain = 0;
+};
+#endif
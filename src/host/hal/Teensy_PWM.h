@@ -0,0 +1,57 @@
+#ifndef __HostTeensyPWM_H__
+#define __HostTeensyPWM_H__
+
+/*
+ * Host replacement for the Teensy_PWM library. The duty cycle written to each pin is recorded in hal::pwmDutyCycle.
+ * The PWM carrier runs freely from when the pin's frequency was set, so a new duty cycle only takes effect at the start of the next period.
+ * Like the library, the constructor only stores the settings and the carrier is started by setPWM(). A duty cycle written
+ * to a pin whose carrier was never started is not output.
+ */
+
+//Import files
+#include "Arduino.h"
+
+namespace hal {
+  ///Duty cycle (%) last written to each pin
+  extern float pwmDutyCycle[pinCount];
+  ///Frequency (Hz) last written to each pin
+  extern float pwmFrequency[pinCount];
+  ///Time the PWM carrier of each pin was started (ns)
+  extern uint64_t pwmStartNanos[pinCount];
+  ///Time the last duty cycle written to each pin takes effect (ns)
+  extern uint64_t pwmApplyNanos[pinCount];
+  ///Number of times setPWM has been called
+  extern uint64_t pwmWrites;
+}
+
+/**
+ * @class Teensy_PWM
+ * @brief Records the PWM signal written to a pin
+ */
+class Teensy_PWM {
+  public:
+    Teensy_PWM(const uint8_t &pin, const float &frequency, const float &dutycycle) {}
+    bool setPWM(const uint8_t &pin, const float &frequency, const float &dutycycle) {
+      //Changing the frequency restarts the carrier
+      if (hal::pwmFrequency[pin] != frequency) {
+        hal::pwmFrequency[pin] = frequency;
+        hal::pwmStartNanos[pin] = hal::clockNanos;
+      }
+      return setPWM_DCPercentage_manual(pin, dutycycle);
+    }
+    bool setPWM_DCPercentage_manual(const uint8_t &pin, const float &DCPercentage) {
+      //The timer of the pin is not set up until setPWM() is called
+      if (hal::pwmFrequency[pin] <= 0) {
+        return false;
+      }
+      hal::pwmDutyCycle[pin] = DCPercentage;
+      hal::pwmWrites++;
+
+      //The new duty cycle is used from the start of the next period
+      uint64_t period = 1e9 / hal::pwmFrequency[pin];
+      uint64_t elapsed = hal::clockNanos - hal::pwmStartNanos[pin];
+      hal::pwmApplyNanos[pin] = hal::pwmStartNanos[pin] + (elapsed + period - 1) / period * period;
+      return true;
+    }
+};
+#endif
@@ -0,0 +1,21 @@
+#ifndef __HostWire_H__
+#define __HostWire_H__
+
+/*
+ * Host replacement for the Arduino Wire library. Transfers are done by the simulated devices themselves (see MPU6050_kriswiner.h).
+ */
+
+//Import files
+#include "Arduino.h"
+
+/**
+ * @class TwoWire
+ * @brief I2C bus
+ */
+class TwoWire {
+  public:
+    void begin() {}
+    void setClock(uint32_t frequency) {}
+};
+extern TwoWire Wire;
+#endif
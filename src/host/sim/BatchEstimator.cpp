@@ -0,0 +1,282 @@
+#include "BatchEstimator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <math.h>
+#include <string.h>
+#include <thread>
+
+/* Settings */
+///Parameter sets run together in the lanes of one vector, the width of the target's vector registers
+#if defined(__AVX512F__)
+  const int estimatorLanes = 16;
+#elif defined(__AVX__)
+  const int estimatorLanes = 8;
+#else
+  const int estimatorLanes = 4; //SSE and NEON
+#endif
+/* Settings */
+
+///One value per parameter set, lowered to the widest vectors the target has
+typedef float Lanes __attribute__((vector_size(estimatorLanes * sizeof(float))));
+///Comparison results and integer views of Lanes
+typedef int32_t LaneInts __attribute__((vector_size(estimatorLanes * sizeof(float))));
+
+static const float pi = 3.14159265358979f;
+
+/** Gets a vector with every lane set to a value */
+static inline Lanes splat(float value) {
+  return Lanes{} + value;
+}
+
+/** Selects lanes of a where the mask is set, otherwise lanes of b */
+static inline Lanes select(LaneInts mask, Lanes a, Lanes b) {
+  return mask ? a : b;
+}
+
+/** Gets 1/sqrt(x), from the bit level estimate and two Newton-Raphson steps (relative error 5e-6) */
+static inline Lanes invSqrt(Lanes x) {
+  Lanes y = (Lanes)(0x5f3759df - ((LaneInts)x >> 1));
+  for (int i=0; i<2; i++) {
+    y = y * (1.5f - .5f * x * y * y);
+  }
+  return y;
+}
+
+/** Gets atan(x), Cephes' atanf range reduction and polynomial */
+static inline Lanes atanLanes(Lanes x) {
+  Lanes sign = select(x < 0, splat(-1), splat(1));
+  x *= sign;
+  LaneInts big = x > 2.414213562373095f;
+  LaneInts middle = ~big & (x > .4142135623730950f);
+  Lanes base = select(big, splat(pi/2), select(middle, splat(pi/4), splat(0)));
+  //-1/x, (x - 1)/(x + 1) or x, with one division
+  x = select(big, splat(-1), select(middle, x - 1, x)) / select(big, x, select(middle, x + 1, splat(1)));
+  Lanes z = x * x;
+  Lanes y = base + (((8.05374449538e-2f * z - 1.38776856032e-1f) * z + 1.99777106478e-1f) * z - 3.33329491539e-1f) * z * x + x;
+  return sign * y;
+}
+
+/** Gets atan2(y, x) */
+static inline Lanes atan2Lanes(Lanes y, Lanes x) {
+  LaneInts zero = x == 0;
+  Lanes angle = atanLanes(y / select(zero, splat(1), x));
+  angle += select(x < 0, select(y >= 0, splat(pi), splat(-pi)), splat(0));
+  return select(zero, select(y > 0, splat(pi/2), select(y < 0, splat(-pi/2), splat(0))), angle);
+}
+
+/** Gets asin(x), x is clipped to -1 - 1 */
+static inline Lanes asinLanes(Lanes x) {
+  x = select(x > 1, splat(1), select(x < -1, splat(-1), x));
+  Lanes cosine = 1 - x * x;
+  return atan2Lanes(x, select(cosine > 0, cosine * invSqrt(cosine), splat(0)));
+}
+
+bool makeEstimatorInput(const FlightLog &log, const EstimatorState &state, EstimatorInput &input, std::string &error) {
+  const char *names[] = {"Time (μs)", "Accel x", "Accel y", "Accel z", "Gyro x", "Gyro y", "Gyro z", "New sample", "roll", "pitch"};
+  int column[10];
+  for (int i=0; i<10; i++) {
+    column[i] = log.find(names[i]);
+    if (column[i] < 0) {
+      error = std::string("the log has no \"") + names[i] + "\" column, it was written by older firmware";
+      return false;
+    }
+  }
+
+  //Convert the readings like IMU::updateAngle(), readings are only taken when the IMU has a new sample
+  MPU6050lib mpu;
+  float aRes = mpu.getAres();
+  float gRes = mpu.getGres();
+  float accelVal[3], gyroVal[3];
+  for (int i=0; i<3; i++) {
+    accelVal[i] = state.accelVal[i];
+    gyroVal[i] = state.gyroVal[i];
+    input.accel[i].clear();
+    input.gyro[i].clear();
+  }
+  input.dt.clear();
+  for (int i=0; i<2; i++) {
+    input.reference[i].clear();
+  }
+  uint32_t lastTime = 0;
+  uint32_t lastLoopTime = 0;
+  for (size_t r=0; r<log.records; r++) {
+    if (log.raw(r, column[7])) {
+      for (int i=0; i<3; i++) {
+        accelVal[i] = (float)log.raw(r, column[1 + i])*aRes - state.calibration.accelOffset[i];
+        gyroVal[i] = (float)log.raw(r, column[4 + i])*gRes - state.calibration.gyroBias[i];
+      }
+    }
+    for (int i=0; i<3; i++) {
+      input.accel[i].push_back(accelVal[i]);
+      input.gyro[i].push_back(gyroVal[i]);
+    }
+    //The angle is updated before the loop's timestamp, so it uses the time of the loop before (see drone.ino)
+    float loopTime = lastLoopTime / 1000.0;
+    input.dt.push_back(loopTime/1000);
+    uint32_t time = log.raw(r, column[0]);
+    lastLoopTime = time - lastTime;
+    lastTime = time;
+    for (int i=0; i<2; i++) {
+      input.reference[i].push_back(log.value(r, column[8 + i]));
+    }
+  }
+  input.scored.assign(log.records, 1);
+
+  //The kalman filter stores {measurement error, estimate error, process noise, current estimate, last estimate, gain}
+  for (int i=0; i<4; i++) {
+    input.q[i] = state.q[i];
+  }
+  float kalman[6];
+  static_assert(sizeof(kalman) == sizeof(state.rollKalman), "unexpected SimpleKalmanFilter layout");
+  memcpy(kalman, state.rollKalman, sizeof(kalman));
+  input.kalmanEstimate[0] = kalman[4];
+  input.kalmanError[0] = kalman[1];
+  memcpy(kalman, state.pitchKalman, sizeof(kalman));
+  input.kalmanEstimate[1] = kalman[4];
+  input.kalmanError[1] = kalman[1];
+  return true;
+}
+
+/** Runs the estimate with estimatorLanes parameter sets */
+static void runLanes(const EstimatorInput &input, const EstimatorParams *params, EstimatorError *errors, float **angles) {
+  Lanes beta, zeta, measurementError, processNoise;
+  for (int l=0; l<estimatorLanes; l++) {
+    beta[l] = params[l].beta;
+    zeta[l] = params[l].zeta;
+    measurementError[l] = params[l].measurementError;
+    processNoise[l] = params[l].processNoise;
+  }
+  Lanes errorEstimate[2] = {splat(input.kalmanError[0]), splat(input.kalmanError[1])};
+  Lanes q1 = splat(input.q[0]), q2 = splat(input.q[1]), q3 = splat(input.q[2]), q4 = splat(input.q[3]);
+  Lanes lastEstimate[2] = {splat(input.kalmanEstimate[0]), splat(input.kalmanEstimate[1])};
+  Lanes errorSum[2] = {}, errorMax[2] = {};
+  long scoredCount = 0;
+
+  size_t loops = input.dt.size();
+  for (size_t t=0; t<loops; t++) {
+    float dt = input.dt[t];
+    float ax = input.accel[0][t], ay = input.accel[1][t], az = input.accel[2][t];
+    float gx = input.gyro[0][t] * pi / 180, gy = input.gyro[1][t] * pi / 180, gz = input.gyro[2][t] * pi / 180;
+    float norm = sqrtf(ax*ax + ay*ay + az*az);
+
+    //MadgwickQuaternionUpdate(), it does nothing without an accelerometer reading
+    if (norm != 0) {
+      ax /= norm;
+      ay /= norm;
+      az /= norm;
+      Lanes _2q1 = 2 * q1, _2q2 = 2 * q2, _2q3 = 2 * q3, _2q4 = 2 * q4;
+
+      //Gradient of the objective function
+      Lanes f1 = _2q2 * q4 - _2q1 * q3 - ax;
+      Lanes f2 = _2q1 * q2 + _2q3 * q4 - ay;
+      Lanes f3 = 1 - _2q2 * q2 - _2q3 * q3 - az;
+      Lanes hatDot1 = _2q2 * f2 - _2q3 * f1;
+      Lanes hatDot2 = _2q4 * f1 + _2q1 * f2 - 2 * _2q2 * f3;
+      Lanes hatDot3 = _2q4 * f2 - 2 * _2q3 * f3 - _2q1 * f1;
+      Lanes hatDot4 = _2q2 * f1 + _2q3 * f2;
+      Lanes inverse = invSqrt(hatDot1 * hatDot1 + hatDot2 * hatDot2 + hatDot3 * hatDot3 + hatDot4 * hatDot4);
+      hatDot1 *= inverse;
+      hatDot2 *= inverse;
+      hatDot3 *= inverse;
+      hatDot4 *= inverse;
+
+      //Remove the gyroscope bias, which only builds up over one update
+      Lanes biasGain = dt * zeta;
+      Lanes gyrox = gx - (_2q1 * hatDot2 - _2q2 * hatDot1 - _2q3 * hatDot4 + _2q4 * hatDot3) * biasGain;
+      Lanes gyroy = gy - (_2q1 * hatDot3 + _2q2 * hatDot4 - _2q3 * hatDot1 - _2q4 * hatDot2) * biasGain;
+      Lanes gyroz = gz - (_2q1 * hatDot4 - _2q2 * hatDot3 + _2q3 * hatDot2 - _2q4 * hatDot1) * biasGain;
+
+      //Integrate the quaternion derivative
+      Lanes qDot1 = .5f * (-q2 * gyrox - q3 * gyroy - q4 * gyroz);
+      Lanes qDot2 = .5f * ( q1 * gyrox + q3 * gyroz - q4 * gyroy);
+      Lanes qDot3 = .5f * ( q1 * gyroy - q2 * gyroz + q4 * gyrox);
+      Lanes qDot4 = .5f * ( q1 * gyroz + q2 * gyroy - q3 * gyrox);
+      q1 += (qDot1 - beta * hatDot1) * dt;
+      q2 += (qDot2 - beta * hatDot2) * dt;
+      q3 += (qDot3 - beta * hatDot3) * dt;
+      q4 += (qDot4 - beta * hatDot4) * dt;
+      inverse = invSqrt(q1 * q1 + q2 * q2 + q3 * q3 + q4 * q4);
+      q1 *= inverse;
+      q2 *= inverse;
+      q3 *= inverse;
+      q4 *= inverse;
+    }
+
+    //Roll and pitch in degrees, through the kalman filters
+    Lanes measured[2] = {
+      -atan2Lanes(2 * (q1 * q2 + q3 * q4), q1 * q1 - q2 * q2 - q3 * q3 + q4 * q4) * (180 / pi),
+      -asinLanes(2 * (q2 * q4 - q1 * q3)) * (180 / pi)
+    };
+    for (int axis=0; axis<2; axis++) {
+      Lanes gain = errorEstimate[axis] / (errorEstimate[axis] + measurementError);
+      Lanes estimate = lastEstimate[axis] + gain * (measured[axis] - lastEstimate[axis]);
+      Lanes change = estimate - lastEstimate[axis];
+      errorEstimate[axis] = (1 - gain) * errorEstimate[axis] + select(change < 0, -change, change) * processNoise;
+      lastEstimate[axis] = estimate;
+
+      if (input.scored[t]) {
+        Lanes error = estimate - input.reference[axis][t];
+        errorSum[axis] += error * error;
+        error = select(error < 0, -error, error);
+        errorMax[axis] = select(error > errorMax[axis], error, errorMax[axis]);
+      }
+      if (angles) {
+        for (int l=0; l<estimatorLanes; l++) {
+          if (angles[l]) {
+            angles[l][t*2 + axis] = estimate[l];
+          }
+        }
+      }
+    }
+    scoredCount += input.scored[t];
+  }
+
+  for (int l=0; l<estimatorLanes; l++) {
+    for (int axis=0; axis<2; axis++) {
+      errors[l].rms[axis] = scoredCount ? sqrtf(errorSum[axis][l] / scoredCount) : 0;
+      errors[l].max[axis] = errorMax[axis][l];
+    }
+    errors[l].cost = sqrtf((errors[l].rms[0]*errors[l].rms[0] + errors[l].rms[1]*errors[l].rms[1]) / 2);
+  }
+}
+
+std::vector<EstimatorError> runEstimators(const EstimatorInput &input, const std::vector<EstimatorParams> &params,
+                                          int threads, std::vector<std::vector<float>> *angles) {
+  //Fill the last group of lanes with copies of the last parameter set
+  size_t groups = (params.size() + estimatorLanes - 1) / estimatorLanes;
+  std::vector<EstimatorParams> padded = params;
+  if (!params.empty()) {
+    padded.resize(groups * estimatorLanes, params.back());
+  }
+  std::vector<EstimatorError> errors(padded.size());
+  if (angles) {
+    angles->assign(params.size(), std::vector<float>(input.dt.size() * 2));
+  }
+
+  //Each thread takes the next group of lanes until there are none left
+  std::atomic<size_t> nextGroup(0);
+  auto worker = [&]() {
+    for (size_t group=nextGroup++; group<groups; group=nextGroup++) {
+      float *laneAngles[estimatorLanes] = {};
+      for (int l=0; l<estimatorLanes; l++) {
+        size_t set = group*estimatorLanes + l;
+        if (angles and set < params.size()) {
+          laneAngles[l] = (*angles)[set].data();
+        }
+      }
+      runLanes(input, &padded[group*estimatorLanes], &errors[group*estimatorLanes], angles ? laneAngles : nullptr);
+    }
+  };
+  std::vector<std::thread> pool;
+  for (int i=1; i<std::min<int>(threads, groups); i++) {
+    pool.emplace_back(worker);
+  }
+  worker();
+  for (std::thread &thread : pool) {
+    thread.join();
+  }
+
+  errors.resize(params.size());
+  return errors;
+}
@@ -0,0 +1,96 @@
+#ifndef __BatchEstimator_H__
+#define __BatchEstimator_H__
+
+/*
+ * Runs the firmware's angle estimate (IMU_MPU6050: MadgwickQuaternionUpdate then a kalman filter on roll and pitch, see
+ * IMU.cpp) over a whole flight with many parameter sets at once, to choose beta, zeta and kalmanParams offline.
+ *
+ * The parameter sets run in lockstep, several at a time in the SIMD lanes of GCC vector types, so the same code
+ * uses SSE, AVX or NEON depending on the target. Groups of lanes are shared between threads. The estimate depends on
+ * the loop before, so a flight can not be split between threads without changing the result.
+ *
+ * The square roots and trigonometry are vectorised approximations with errors around 1e-6, so the angles are within
+ * about 0.001 degrees of the scalar code rather than identical (see refilter.cpp --check).
+ */
+
+//Import libraries
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//Import files
+#include "FlightLog.h"
+#include "IMU.h"
+
+/**
+ * @struct EstimatorParams
+ * @brief Settings of the angle estimate, see IMU.h
+ *
+ * The starting estimate error of the kalman filters is part of the stored state, as it changes while calibrating.
+ */
+struct EstimatorParams {
+  ///Gain of the accelerometer correction
+  float beta;
+  ///Gain of the gyroscope bias correction
+  float zeta;
+  ///Measurement error of the kalman filters
+  float measurementError;
+  ///Process noise of the kalman filters
+  float processNoise;
+};
+
+/**
+ * @struct EstimatorInput
+ * @brief Sensor values of each loop of a flight, the starting state of the estimate, and the angles to compare it to
+ */
+struct EstimatorInput {
+  ///Accelerometer (G) and gyroscope (degrees per second) values each loop, after removing the calibration
+  std::vector<float> accel[3];
+  std::vector<float> gyro[3];
+  ///Time step the estimate is integrated over each loop (s)
+  std::vector<float> dt;
+  ///Reference roll and pitch each loop (degrees)
+  std::vector<float> reference[2];
+  ///Whether the error of each loop is measured
+  std::vector<uint8_t> scored;
+  ///Starting quaternion
+  float q[4];
+  ///Starting estimate and estimate error of the roll and pitch kalman filters
+  float kalmanEstimate[2];
+  float kalmanError[2];
+};
+
+/**
+ * @struct EstimatorError
+ * @brief Difference between the estimated and reference angles over the scored loops
+ */
+struct EstimatorError {
+  ///RMS error of roll and pitch (degrees)
+  float rms[2] = {0, 0};
+  ///Largest error of roll and pitch (degrees)
+  float max[2] = {0, 0};
+  ///RMS error of roll and pitch together (degrees)
+  float cost = 0;
+};
+
+/** Gets the input of the estimate from a flight log
+ *
+ *  @param[in] log Log with the raw IMU readings (see drone.ino)
+ *  @param[in] state State of the estimate when the flight started, from IMU::saveEstimator()
+ *  @param[out] input Input with the reference set to the logged angles and every loop scored
+ *  @param[out] error Reason the input could not be made
+ *  @returns true if the log had the raw readings
+ */
+bool makeEstimatorInput(const FlightLog &log, const EstimatorState &state, EstimatorInput &input, std::string &error);
+
+/** Runs the estimate with every parameter set
+ *
+ *  @param[in] input Flight to run the estimate over
+ *  @param[in] params Parameter sets
+ *  @param[in] threads Number of threads to share the parameter sets between
+ *  @param[out] angles If not null, set to the estimated roll and pitch of each loop of each parameter set, one after the other
+ *  @returns Error of each parameter set
+ */
+std::vector<EstimatorError> runEstimators(const EstimatorInput &input, const std::vector<EstimatorParams> &params,
+                                          int threads, std::vector<std::vector<float>> *angles=nullptr);
+#endif
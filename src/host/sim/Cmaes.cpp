@@ -0,0 +1,187 @@
+#include "Cmaes.h"
+
+#include <algorithm>
+#include <math.h>
+#include <numeric>
+
+Cmaes::Cmaes(const std::vector<double> &mean, double sigma, int population, uint32_t seed) :
+    population(population > 0 ? population : 4 + (int)(3 * log(mean.size()))), mean(mean), sigma(sigma) {
+  n = mean.size();
+  randomState = seed * 0x9E3779B97F4A7C15ULL + 1;
+
+  //Weights of the best half of the candidates
+  mu = this->population / 2;
+  for (int i=0; i<mu; i++) {
+    weights.push_back(log(mu + .5) - log(i + 1));
+  }
+  double sum = std::accumulate(weights.begin(), weights.end(), 0.0);
+  double sumSquares = 0;
+  for (double &w : weights) {
+    w /= sum;
+    sumSquares += w * w;
+  }
+  muEff = 1 / sumSquares;
+
+  //Default learning rates
+  cc = (4 + muEff/n) / (n + 4 + 2*muEff/n);
+  cs = (muEff + 2) / (n + muEff + 5);
+  c1 = 2 / ((n + 1.3)*(n + 1.3) + muEff);
+  cmu = std::min(1 - c1, 2 * (muEff - 2 + 1/muEff) / ((n + 2)*(n + 2) + muEff));
+  damps = 1 + 2*std::max(0.0, sqrt((muEff - 1)/(n + 1)) - 1) + cs;
+  chiN = sqrt(n) * (1 - 1.0/(4*n) + 1.0/(21*n*n));
+
+  pc.assign(n, 0);
+  ps.assign(n, 0);
+  C.assign(n, std::vector<double>(n, 0));
+  B.assign(n, std::vector<double>(n, 0));
+  D.assign(n, 1);
+  for (int i=0; i<n; i++) {
+    C[i][i] = 1;
+    B[i][i] = 1;
+  }
+}
+
+double Cmaes::gaussian() {
+  //xorshift64 and the Box-Muller transform
+  double u[2];
+  for (int i=0; i<2; i++) {
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 7;
+    randomState ^= randomState << 17;
+    u[i] = ((randomState >> 11) + .5) / 9007199254740992.0;
+  }
+  return sqrt(-2 * log(u[0])) * cos(2*M_PI * u[1]);
+}
+
+const std::vector<std::vector<double>> &Cmaes::ask() {
+  candidates.assign(population, std::vector<double>(n));
+  for (auto &x : candidates) {
+    std::vector<double> z(n);
+    for (double &value : z) {
+      value = gaussian();
+    }
+    //x = mean + sigma * B * D * z
+    for (int i=0; i<n; i++) {
+      double y = 0;
+      for (int j=0; j<n; j++) {
+        y += B[i][j] * D[j] * z[j];
+      }
+      x[i] = mean[i] + sigma * y;
+    }
+  }
+  return candidates;
+}
+
+void Cmaes::tell(const std::vector<double> &costs) {
+  std::vector<int> order(population);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+    return costs[a] < costs[b];
+  });
+
+  //Move the mean to the weighted best candidates
+  std::vector<double> oldMean = mean;
+  std::vector<std::vector<double>> steps(mu, std::vector<double>(n));
+  std::vector<double> meanStep(n, 0);
+  for (int k=0; k<mu; k++) {
+    for (int i=0; i<n; i++) {
+      steps[k][i] = (candidates[order[k]][i] - oldMean[i]) / sigma;
+      meanStep[i] += weights[k] * steps[k][i];
+    }
+  }
+  for (int i=0; i<n; i++) {
+    mean[i] = oldMean[i] + sigma * meanStep[i];
+  }
+
+  //Step size path, using C^-1/2 = B D^-1 B^T
+  std::vector<double> whitened(n, 0);
+  for (int j=0; j<n; j++) {
+    double dot = 0;
+    for (int i=0; i<n; i++) {
+      dot += B[i][j] * meanStep[i];
+    }
+    dot /= D[j];
+    for (int i=0; i<n; i++) {
+      whitened[i] += B[i][j] * dot;
+    }
+  }
+  double psLength = 0;
+  for (int i=0; i<n; i++) {
+    ps[i] = (1 - cs)*ps[i] + sqrt(cs*(2 - cs)*muEff) * whitened[i];
+    psLength += ps[i] * ps[i];
+  }
+  psLength = sqrt(psLength);
+
+  //Covariance path, stalled while the step size is growing quickly
+  bool hsig = psLength / sqrt(1 - pow(1 - cs, 2*(generation + 1))) / chiN < 1.4 + 2.0/(n + 1);
+  for (int i=0; i<n; i++) {
+    pc[i] = (1 - cc)*pc[i] + (hsig ? sqrt(cc*(2 - cc)*muEff) * meanStep[i] : 0);
+  }
+
+  //Rank one and rank mu updates of the covariance
+  double correction = hsig ? 0 : c1 * cc*(2 - cc);
+  for (int i=0; i<n; i++) {
+    for (int j=0; j<=i; j++) {
+      double rankMu = 0;
+      for (int k=0; k<mu; k++) {
+        rankMu += weights[k] * steps[k][i] * steps[k][j];
+      }
+      C[i][j] = (1 - c1 - cmu + correction)*C[i][j] + c1*pc[i]*pc[j] + cmu*rankMu;
+      C[j][i] = C[i][j];
+    }
+  }
+
+  sigma *= exp((cs/damps) * (psLength/chiN - 1));
+  generation++;
+  decompose();
+}
+
+void Cmaes::decompose() {
+  //Cyclic Jacobi rotations, the covariance is small so this is quick
+  std::vector<std::vector<double>> A = C;
+  for (int i=0; i<n; i++) {
+    for (int j=0; j<n; j++) {
+      B[i][j] = i == j;
+    }
+  }
+  for (int sweep=0; sweep<50; sweep++) {
+    double offDiagonal = 0;
+    for (int p=0; p<n; p++) {
+      for (int q=p+1; q<n; q++) {
+        offDiagonal += A[p][q] * A[p][q];
+      }
+    }
+    if (offDiagonal < 1e-30) {
+      break;
+    }
+    for (int p=0; p<n; p++) {
+      for (int q=p+1; q<n; q++) {
+        if (fabs(A[p][q]) < 1e-300) {
+          continue;
+        }
+        double theta = (A[q][q] - A[p][p]) / (2*A[p][q]);
+        double t = (theta >= 0 ? 1 : -1) / (fabs(theta) + sqrt(theta*theta + 1));
+        double c = 1 / sqrt(t*t + 1);
+        double s = t * c;
+        for (int k=0; k<n; k++) {
+          double akp = A[k][p], akq = A[k][q];
+          A[k][p] = c*akp - s*akq;
+          A[k][q] = s*akp + c*akq;
+        }
+        for (int k=0; k<n; k++) {
+          double apk = A[p][k], aqk = A[q][k];
+          A[p][k] = c*apk - s*aqk;
+          A[q][k] = s*apk + c*aqk;
+        }
+        for (int k=0; k<n; k++) {
+          double bkp = B[k][p], bkq = B[k][q];
+          B[k][p] = c*bkp - s*bkq;
+          B[k][q] = s*bkp + c*bkq;
+        }
+      }
+    }
+  }
+  for (int i=0; i<n; i++) {
+    D[i] = sqrt(std::max(A[i][i], 1e-20));
+  }
+}
@@ -0,0 +1,74 @@
+#ifndef __Cmaes_H__
+#define __Cmaes_H__
+
+/*
+ * Covariance matrix adaptation evolution strategy (CMA-ES), minimises a cost without needing its gradient.
+ * Follows Hansen's "The CMA Evolution Strategy: A Tutorial", (mu/mu_w, lambda) with rank-one and rank-mu updates.
+ *
+ * Each generation ask() gives the candidates to evaluate, then tell() takes their costs in the same order.
+ * The candidates can be evaluated in any order or at the same time, and a seed always gives the same candidates.
+ */
+
+//Import libraries
+#include <stdint.h>
+#include <vector>
+
+/**
+ * @class Cmaes
+ * @brief Searches for the point with the lowest cost
+ */
+class Cmaes {
+  public:
+    /** Creates the search
+     *
+     *  @param[in] mean Starting point
+     *  @param[in] sigma Starting step size, the same for every dimension
+     *  @param[in] population Candidates per generation, 0 for the default of 4 + 3 ln(dimensions)
+     *  @param[in] seed Seed of the random samples
+     */
+    Cmaes(const std::vector<double> &mean, double sigma, int population, uint32_t seed);
+    /** Samples the candidates of the next generation */
+    const std::vector<std::vector<double>> &ask();
+    /** Moves the search towards the best candidates
+     *
+     *  @param[in] costs Cost of each candidate from ask()
+     */
+    void tell(const std::vector<double> &costs);
+
+    ///Candidates per generation
+    const int population;
+    ///Centre of the search
+    std::vector<double> mean;
+    ///Step size
+    double sigma;
+    ///Number of completed generations
+    int generation = 0;
+
+  private:
+    /** Recalculates the eigenvectors and eigenvalues of the covariance */
+    void decompose();
+    /** Gets a normally distributed random number */
+    double gaussian();
+
+    ///Number of dimensions
+    int n;
+    ///Number of candidates which move the mean, and their weights
+    int mu;
+    std::vector<double> weights;
+    ///Variance effective selection mass
+    double muEff;
+    ///Learning rates of the evolution paths, covariance and step size
+    double cc, cs, c1, cmu, damps;
+    ///Expected length of a normally distributed vector
+    double chiN;
+    ///Evolution paths of the covariance and step size
+    std::vector<double> pc, ps;
+    ///Covariance, and its eigenvectors (columns of B) and the square roots of its eigenvalues
+    std::vector<std::vector<double>> C, B;
+    std::vector<double> D;
+    ///Candidates of the current generation
+    std::vector<std::vector<double>> candidates;
+    ///State of the random number generator
+    uint64_t randomState;
+};
+#endif
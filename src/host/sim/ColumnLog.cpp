@@ -0,0 +1,267 @@
+#include "ColumnLog.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <atomic>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+/* Settings */
+///Records converted by a thread at a time
+const size_t chunkRecords = 1 << 16;
+/* Settings */
+
+/** Creates a file of a given length and maps it for writing, returns MAP_FAILED if it can not */
+static uint8_t *createMapped(const std::string &path, size_t length) {
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    return (uint8_t *)MAP_FAILED;
+  }
+  void *data = MAP_FAILED;
+  if (ftruncate(fd, length) == 0) {
+    //Empty files can not be mapped, but there is nothing to write
+    data = length ? mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : nullptr;
+  }
+  close(fd);
+  return (uint8_t *)data;
+}
+
+bool writeColumns(const FlightLog &log, const std::string &dir, int indexStep, int threads, std::string &error) {
+  if (mkdir(dir.c_str(), 0755) != 0 and errno != EEXIST) {
+    error = "cannot create " + dir;
+    return false;
+  }
+
+  //List the columns and create their files
+  int columnCount = log.types.size();
+  std::vector<uint8_t *> outputs(columnCount);
+  std::vector<int> bytes(columnCount);
+  std::string list = "Name,Type,Bytes,Scale,Format,File\n";
+  bool mapped = true;
+  for (int c=0; c<columnCount; c++) {
+    uint8_t type = log.types[c];
+    bytes[c] = type % 50 / 8;
+    std::string file = std::to_string(c) + ".bin";
+    char line[256];
+    snprintf(line, sizeof(line), "%s,%d,%d,%g,%s,%s\n", log.names[c].c_str(), type, bytes[c], columnScale(type),
+             columnFormat(type), file.c_str());
+    list += line;
+    outputs[c] = createMapped(dir + "/" + file, log.records * bytes[c]);
+    mapped &= outputs[c] != MAP_FAILED;
+  }
+
+  //Each thread takes the next chunk of records until there are none left, and copies every column of it
+  if (mapped) {
+    size_t chunks = (log.records + chunkRecords - 1) / chunkRecords;
+    std::atomic<size_t> nextChunk(0);
+    auto worker = [&]() {
+      for (size_t chunk=nextChunk++; chunk<chunks; chunk=nextChunk++) {
+        size_t first = chunk * chunkRecords;
+        size_t last = std::min(first + chunkRecords, log.records);
+        for (int c=0; c<columnCount; c++) {
+          int offset = log.offset(c);
+          uint8_t *out = outputs[c] + first*bytes[c];
+          for (size_t r=first; r<last; r++) {
+            memcpy(out, log.record(r) + offset, bytes[c]);
+            out += bytes[c];
+          }
+        }
+      }
+    };
+    std::vector<std::thread> pool;
+    for (int i=1; i<std::min<int>(threads, chunks); i++) {
+      pool.emplace_back(worker);
+    }
+    worker();
+    for (std::thread &thread : pool) {
+      thread.join();
+    }
+  }
+  for (int c=0; c<columnCount; c++) {
+    if (outputs[c] != MAP_FAILED and outputs[c]) {
+      munmap(outputs[c], log.records * bytes[c]);
+    }
+  }
+  if (!mapped) {
+    error = "cannot write the columns to " + dir;
+    return false;
+  }
+
+  //Index the time of every indexStep'th record
+  std::vector<TimeIndexEntry> index;
+  int timeColumn = log.types.find((char)typeID.time);
+  if (timeColumn >= 0) {
+    for (size_t r=0; r<log.records; r+=std::max(indexStep, 1)) {
+      index.push_back({(uint32_t)log.raw(r, timeColumn), (uint32_t)r});
+    }
+  }
+  std::string indexData((const char *)index.data(), index.size() * sizeof(TimeIndexEntry));
+  if (!writeAll(dir + "/time.idx", indexData) or !writeAll(dir + "/columns.csv", list)) {
+    error = "cannot write the index to " + dir;
+    return false;
+  }
+  return true;
+}
+
+ColumnLog::~ColumnLog() {
+  for (auto &mapping : maps) {
+    munmap((void *)mapping.first, mapping.second);
+  }
+}
+
+const uint8_t *ColumnLog::map(const std::string &path, size_t &length) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return nullptr;
+  }
+  struct stat info;
+  const uint8_t *data = nullptr;
+  if (fstat(fd, &info) == 0) {
+    length = info.st_size;
+    //Empty files can not be mapped, point them at something which is never read
+    data = (const uint8_t *)"";
+    if (length) {
+      void *mapping = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+      data = mapping == MAP_FAILED ? nullptr : (const uint8_t *)mapping;
+      if (data) {
+        maps.push_back({data, length});
+      }
+    }
+  }
+  close(fd);
+  return data;
+}
+
+bool ColumnLog::open(const std::string &dir, std::string &error) {
+  std::string list;
+  if (!readAll(dir + "/columns.csv", list)) {
+    error = "cannot open " + dir + "/columns.csv";
+    return false;
+  }
+
+  //Map the file of each column named in the list, skipping the line of column names
+  columns.clear();
+  records = 0;
+  timeColumn = -1;
+  size_t lineStart = list.find('\n') + 1;
+  while (lineStart > 0 and lineStart < list.size()) {
+    size_t lineEnd = std::min(list.find('\n', lineStart), list.size());
+    std::vector<std::string> fields;
+    for (size_t start=lineStart; start<=lineEnd;) {
+      size_t end = std::min(list.find(',', start), lineEnd);
+      fields.push_back(list.substr(start, end - start));
+      start = end + 1;
+    }
+    lineStart = lineEnd + 1;
+    if (fields.size() != 6) {
+      continue;
+    }
+
+    Column column;
+    column.name = fields[0];
+    column.type = atoi(fields[1].c_str());
+    column.bytes = atoi(fields[2].c_str());
+    size_t length = 0;
+    column.data = map(dir + "/" + fields[5], length);
+    if (!column.data or column.bytes <= 0 or length % column.bytes != 0
+        or (!columns.empty() and length / column.bytes != records)) {
+      error = dir + "/" + fields[5] + " is missing or has a different number of records";
+      return false;
+    }
+    records = length / column.bytes;
+    if (column.type == typeID.time and timeColumn < 0) {
+      timeColumn = columns.size();
+    }
+    columns.push_back(column);
+  }
+
+  size_t length = 0;
+  index = (const TimeIndexEntry *)map(dir + "/time.idx", length);
+  indexCount = index ? length / sizeof(TimeIndexEntry) : 0;
+  return true;
+}
+
+int ColumnLog::find(const std::string &name) const {
+  for (size_t i=0; i<columns.size(); i++) {
+    if (columns[i].name == name) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+int32_t ColumnLog::raw(int column, size_t record) const {
+  const Column &c = columns[column];
+  int bits = c.bytes * 8;
+  uint32_t value = 0;
+  memcpy(&value, c.data + record*c.bytes, c.bytes);
+  if (bits < 32 and c.type > 100 and (value >> (bits-1)) & 1) {
+    value |= ~0u << bits;
+  }
+  return value;
+}
+
+double ColumnLog::value(int column, size_t record) const {
+  return toNumber(raw(column, record), columns[column].type);
+}
+
+size_t ColumnLog::recordAt(uint32_t time) const {
+  if (timeColumn < 0) {
+    return 0;
+  }
+
+  //Narrow the search to the records between the last index entry before the time and the next one
+  size_t first = 0;
+  size_t last = records;
+  if (indexCount > 0) {
+    const TimeIndexEntry *next = std::lower_bound(index, index + indexCount, time,
+                                                  [](const TimeIndexEntry &e, uint32_t t) { return e.time < t; });
+    if (next != index) {
+      first = (next-1)->record;
+    }
+    if (next != index + indexCount) {
+      last = std::min<size_t>(next->record, records);
+    }
+  }
+  while (first < last) {
+    size_t middle = (first + last) / 2;
+    if ((uint32_t)raw(timeColumn, middle) < time) {
+      first = middle + 1;
+    } else {
+      last = middle;
+    }
+  }
+  return first;
+}
+
+const char *columnFormat(uint8_t type) {
+  if (type == typeID.float32) {
+    return "<f4";
+  } else if (type == typeID.int8) {
+    return "<i1";
+  } else if (type == typeID.int16 or type == typeID.float16 or type == typeID.float16k) {
+    return "<i2";
+  } else if (type == typeID.int32) {
+    return "<i4";
+  } else if (type == typeID.uint8) {
+    return "<u1";
+  } else if (type == typeID.uint16) {
+    return "<u2";
+  }
+  return "<u4";
+}
+
+double columnScale(uint8_t type) {
+  if (type == typeID.float16) {
+    return .1;
+  } else if (type == typeID.float16k) {
+    return .001;
+  }
+  return 1;
+}
@@ -0,0 +1,118 @@
+#ifndef __ColumnLog_H__
+#define __ColumnLog_H__
+
+/*
+ * Columnar copy of a flight log, so one variable or a time window can be read without parsing the whole log.
+ *
+ * A column directory holds one file per variable with the stored value of every record one after the other
+ * (little endian, the same types as log.bin), columns.csv listing the name, type and file of each variable, and
+ * time.idx with the time and record number of every indexStep'th record. columns.csv has a NumPy dtype for each
+ * file, so other tools can memory map them directly:
+ *
+ *   numpy.memmap("columns/7.bin", dtype="<f4") * scale
+ *
+ * ColumnLog memory maps the files, so only the pages of the variables and records read are loaded.
+ */
+
+//Import libraries
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//Import files
+#include "FlightLog.h"
+
+/**
+ * @struct TimeIndexEntry
+ * @brief Entry of time.idx
+ */
+struct TimeIndexEntry {
+  ///Logged time of the record (μs)
+  uint32_t time;
+  ///Record number
+  uint32_t record;
+};
+
+/**
+ * @struct Column
+ * @brief One variable of a column directory
+ */
+struct Column {
+  ///Column name in log_0.csv
+  std::string name;
+  ///TypeID of the stored values, see Logger.h
+  uint8_t type;
+  ///Bytes per value
+  int bytes;
+  ///Stored values, one per record
+  const uint8_t *data = nullptr;
+};
+
+/** Converts a flight log to a column directory
+ *
+ *  The records are split into chunks which are converted by several threads, each straight into the memory mapped files.
+ *
+ *  @param[in] log Flight log to convert
+ *  @param[in] dir Directory to write, created if it does not exist
+ *  @param[in] indexStep Records between entries of time.idx
+ *  @param[in] threads Number of threads to convert with
+ *  @param[out] error Reason the directory could not be written
+ *  @returns true if every file was written
+ */
+bool writeColumns(const FlightLog &log, const std::string &dir, int indexStep, int threads, std::string &error);
+
+/**
+ * @class ColumnLog
+ * @brief Reads a column directory through memory maps
+ */
+class ColumnLog {
+  public:
+    ColumnLog() = default;
+    ColumnLog(const ColumnLog &) = delete;
+    ColumnLog &operator=(const ColumnLog &) = delete;
+    ~ColumnLog();
+    /** Maps the files of a column directory
+     *
+     *  @param[in] dir Directory written by writeColumns()
+     *  @param[out] error Reason the directory could not be read
+     *  @returns true if every file was mapped
+     */
+    bool open(const std::string &dir, std::string &error);
+    /** Gets the index of a column from its name, -1 if it was not logged */
+    int find(const std::string &name) const;
+    /** Gets the stored bits of a value, sign extended for the signed types */
+    int32_t raw(int column, size_t record) const;
+    /** Gets a value */
+    double value(int column, size_t record) const;
+    /** Gets the first record logged at or after a time, using time.idx to only read the time of a few records
+     *
+     *  The logged times only increase, standby is taken out of them (see drone.ino).
+     *
+     *  @param[in] time Logged time (μs)
+     *  @returns Record number, records if every record is earlier
+     */
+    size_t recordAt(uint32_t time) const;
+
+    ///Number of records
+    size_t records = 0;
+    ///Every column, in the order of log.bin
+    std::vector<Column> columns;
+
+  private:
+    /** Maps a whole file read only, returns nullptr if it can not */
+    const uint8_t *map(const std::string &path, size_t &length);
+
+    ///Address and length of each mapping, unmapped by the destructor
+    std::vector<std::pair<const uint8_t *, size_t>> maps;
+    ///Entries of time.idx
+    const TimeIndexEntry *index = nullptr;
+    size_t indexCount = 0;
+    ///Column of the time of each loop, -1 if there is none
+    int timeColumn = -1;
+};
+
+/** Gets the NumPy dtype of the values of a type, e.g. "<i2" */
+const char *columnFormat(uint8_t type);
+/** Gets the value of one step of the stored values of a type, e.g. 0.1 for float16 */
+double columnScale(uint8_t type);
+#endif
@@ -0,0 +1,174 @@
+#include "DroneModel.h"
+
+#include <math.h>
+
+///Acceleration due to gravity (m/s²)
+static const float gravity = 9.81f;
+
+DroneModel::DroneModel(const ModelParams &params, uint32_t seed) : params(params), randomState(seed ? seed : 1) {
+  for (int i=0; i<motorCount; i++) {
+    float length = sqrtf(frameMatrix.roll[i]*frameMatrix.roll[i] + frameMatrix.pitch[i]*frameMatrix.pitch[i]);
+    motorX[i] = frameMatrix.pitch[i] / length * params.armLength;
+    motorY[i] = frameMatrix.roll[i] / length * params.armLength;
+  }
+}
+
+void DroneModel::step(const float throttle[motorCount], float dt) {
+  //Motors follow their command with a lag
+  float thrust[motorCount];
+  float totalThrust = 0;
+  float torque[3];
+  for (int i=0; i<3; i++) {
+    torque[i] = externalTorque[i] - params.rotationalDrag * rate[i];
+  }
+  for (int i=0; i<motorCount; i++) {
+    float target = fminf(fmaxf(throttle[i], 0), 1);
+    float timeConstant = target > motorSpeed[i] ? params.spinUpTime : params.spinDownTime;
+    motorSpeed[i] += (target - motorSpeed[i]) * fminf(dt / timeConstant, 1);
+    motorPhase[i] = fmodf(motorPhase[i] + 2*M_PI * motorSpeed[i] * params.maxRpm/60 * dt, 2*M_PI);
+
+    thrust[i] = params.maxThrust * motorSpeed[i] * motorSpeed[i];
+    totalThrust += thrust[i];
+    torque[0] += motorY[i] * thrust[i];
+    torque[1] -= motorX[i] * thrust[i];
+    torque[2] -= frameMatrix.yaw[i] * params.torqueRatio * thrust[i];
+  }
+
+  //Forces in the world frame
+  float bodyThrust[3] = {0, 0, totalThrust};
+  float force[3];
+  rotate(bodyThrust, force, false);
+  float speed = sqrtf(velocity[0]*velocity[0] + velocity[1]*velocity[1] + velocity[2]*velocity[2]);
+  for (int i=0; i<3; i++) {
+    force[i] += externalForce[i] - (params.linearDrag + params.quadraticDrag * speed) * velocity[i];
+  }
+  force[2] -= params.mass * gravity;
+
+  //Resting on the ground until there is enough force to lift off
+  float accel[3] = {};
+  if (grounded and force[2] <= 0) {
+    for (int i=0; i<3; i++) {
+      velocity[i] = 0;
+      rate[i] = 0;
+    }
+  } else {
+    grounded = false;
+    for (int i=0; i<3; i++) {
+      accel[i] = force[i] / params.mass;
+      velocity[i] += accel[i] * dt;
+      position[i] += velocity[i] * dt;
+    }
+
+    //Euler's rotation equation, I dω/dt = τ - ω × Iω
+    const float *I = params.inertia;
+    float Iw[3] = {I[0]*rate[0], I[1]*rate[1], I[2]*rate[2]};
+    float gyroscopic[3] = {rate[1]*Iw[2] - rate[2]*Iw[1], rate[2]*Iw[0] - rate[0]*Iw[2], rate[0]*Iw[1] - rate[1]*Iw[0]};
+    for (int i=0; i<3; i++) {
+      rate[i] += (torque[i] - gyroscopic[i]) / I[i] * dt;
+    }
+
+    //Integrate the orientation, dq/dt = q ⊗ (0, ω) / 2
+    float *q = attitude;
+    float dq[4] = {
+      -q[1]*rate[0] - q[2]*rate[1] - q[3]*rate[2],
+       q[0]*rate[0] + q[2]*rate[2] - q[3]*rate[1],
+       q[0]*rate[1] - q[1]*rate[2] + q[3]*rate[0],
+       q[0]*rate[2] + q[1]*rate[1] - q[2]*rate[0]
+    };
+    float norm = 0;
+    for (int i=0; i<4; i++) {
+      q[i] += dq[i] * dt/2;
+      norm += q[i]*q[i];
+    }
+    norm = 1/sqrtf(norm);
+    for (int i=0; i<4; i++) {
+      q[i] *= norm;
+    }
+
+    //Land, level with the same heading
+    if (position[2] <= 0) {
+      float angles[3];
+      eulerAngles(angles);
+      float halfYaw = angles[2] * M_PI/180 / 2;
+      q[0] = cosf(halfYaw);
+      q[1] = q[2] = 0;
+      q[3] = sinf(halfYaw);
+      position[2] = 0;
+      for (int i=0; i<3; i++) {
+        velocity[i] = 0;
+        rate[i] = 0;
+        accel[i] = 0;
+      }
+      grounded = true;
+    }
+  }
+
+  //The accelerometer measures the acceleration without gravity, in the body frame
+  float specificForce[3] = {accel[0]/gravity, accel[1]/gravity, accel[2]/gravity + 1};
+  float bodyAccel[3];
+  rotate(specificForce, bodyAccel, true);
+
+  //Each motor vibrates at its rotation rate, more at higher speeds
+  float bodyGyro[3];
+  for (int i=0; i<3; i++) {
+    bodyGyro[i] = rate[i] * 180/M_PI;
+  }
+  for (int i=0; i<motorCount; i++) {
+    float level = motorSpeed[i] * motorSpeed[i] / motorCount;
+    float s = sinf(motorPhase[i]), c = cosf(motorPhase[i]);
+    bodyAccel[0] += params.accelVibration * level * s;
+    bodyAccel[1] += params.accelVibration * level * c;
+    bodyAccel[2] += params.accelVibration * level * s * c;
+    bodyGyro[0] += params.gyroVibration * level * c;
+    bodyGyro[1] += params.gyroVibration * level * s;
+    bodyGyro[2] += params.gyroVibration * level * s * c;
+  }
+
+  //Sensor's digital low pass filter
+  float alpha = dt / (dt + 1/(2*M_PI*params.sensorCutoff));
+  for (int i=0; i<3; i++) {
+    filteredAccel[i] += alpha * (bodyAccel[i] - filteredAccel[i]);
+    filteredGyro[i] += alpha * (bodyGyro[i] - filteredGyro[i]);
+  }
+}
+
+void DroneModel::readSensors(float accel[3], float gyro[3]) {
+  for (int i=0; i<3; i++) {
+    int axis = params.mount[i][0];
+    int sign = params.mount[i][1];
+    accel[i] = sign * filteredAccel[axis] + params.accelBias[i] + params.accelNoise * gaussian();
+    gyro[i] = sign * filteredGyro[axis] + params.gyroBias[i] + params.gyroNoise * gaussian();
+  }
+}
+
+void DroneModel::eulerAngles(float angles[3]) const {
+  const float *q = attitude;
+  angles[0] = atan2f(2*(q[0]*q[1] + q[2]*q[3]), 1 - 2*(q[1]*q[1] + q[2]*q[2]));
+  angles[1] = -asinf(fminf(fmaxf(2*(q[0]*q[2] - q[3]*q[1]), -1), 1));
+  angles[2] = atan2f(2*(q[0]*q[3] + q[1]*q[2]), 1 - 2*(q[2]*q[2] + q[3]*q[3]));
+  for (int i=0; i<3; i++) {
+    angles[i] *= 180/M_PI;
+  }
+}
+
+void DroneModel::rotate(const float in[3], float out[3], bool inverse) const {
+  float w = attitude[0];
+  float x = inverse ? -attitude[1] : attitude[1];
+  float y = inverse ? -attitude[2] : attitude[2];
+  float z = inverse ? -attitude[3] : attitude[3];
+  out[0] = (1 - 2*(y*y + z*z))*in[0] + 2*(x*y - w*z)*in[1] + 2*(x*z + w*y)*in[2];
+  out[1] = 2*(x*y + w*z)*in[0] + (1 - 2*(x*x + z*z))*in[1] + 2*(y*z - w*x)*in[2];
+  out[2] = 2*(x*z - w*y)*in[0] + 2*(y*z + w*x)*in[1] + (1 - 2*(x*x + y*y))*in[2];
+}
+
+float DroneModel::gaussian() {
+  //Box-Muller transform of two uniform numbers from a xorshift generator
+  float u[2];
+  for (int i=0; i<2; i++) {
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    u[i] = (randomState >> 8) * (1.0f / 16777216.0f);
+  }
+  return sqrtf(-2 * logf(fmaxf(u[0], 1e-7f))) * cosf(2*M_PI * u[1]);
+}
@@ -0,0 +1,119 @@
+#ifndef __DroneModel_H__
+#define __DroneModel_H__
+
+/*
+ * Rigid body model of the drone used by the software in the loop simulator (sitl.cpp).
+ *
+ * The world frame is x forward, y left and z up, and so is the body frame when the drone is level.
+ * Motor positions come from the frame's mixing matrix (see Mixer.h): the roll column gives how far left a motor is,
+ * the pitch column how far forward, and motors with a yaw of 1 spin anticlockwise seen from above
+ * (see PIDcontroller::calcPID), so they twist the body clockwise.
+ */
+
+//Import libraries
+#include <stdint.h>
+
+//Import files
+#include "Mixer.h"
+
+/**
+ * @struct ModelParams
+ * @brief Physical and sensor properties of the simulated drone
+ */
+struct ModelParams {
+  ///Mass (kg)
+  float mass = 1.0;
+  ///Distance from the centre to each motor (m)
+  float armLength = .225;
+  ///Moment of inertia about the x, y and z axes (kg m²)
+  float inertia[3] = {.011, .011, .02};
+  ///Thrust of each motor at full speed (N)
+  float maxThrust = 16.5;
+  ///Yaw torque per thrust of each motor (m)
+  float torqueRatio = .016;
+  ///Time constant of the motor speeding up and slowing down (s)
+  float spinUpTime = .03, spinDownTime = .05;
+  ///Motor speed at full throttle (RPM)
+  float maxRpm = 12000;
+  ///Linear and quadratic air drag (N per m/s, N per (m/s)²)
+  float linearDrag = .1, quadraticDrag = .05;
+  ///Rotational drag (N m per rad/s)
+  float rotationalDrag = .002;
+
+  ///Rotation from the body frame to the sensor axes, each sensor axis is {body axis, sign}. Default: IMU facing backwards (see IMU::eulerToQuat)
+  int mount[3][2] = {{0, -1}, {1, -1}, {2, 1}};
+  ///Standard deviation of the noise of each reading (degrees per second, G)
+  float gyroNoise = .15, accelNoise = .01;
+  ///Constant error of each axis (degrees per second, G)
+  float gyroBias[3] = {.6, -.4, .25}, accelBias[3] = {.02, -.015, .03};
+  ///Vibration at full motor speed (degrees per second, G)
+  float gyroVibration = 3, accelVibration = .4;
+  ///Cut off of the sensor's digital low pass filter (Hz)
+  float sensorCutoff = 42;
+  ///Sensor temperature (degrees celsius)
+  float temperature = 30;
+};
+
+/**
+ * @class DroneModel
+ * @brief Motors, rigid body dynamics, ground contact and IMU of the simulated drone
+ */
+class DroneModel {
+  public:
+    /** Creates a drone resting level on the ground
+     *
+     *  @param[in] params Properties of the drone
+     *  @param[in] seed Seed of the sensor noise, the same seed always gives the same flight
+     */
+    DroneModel(const ModelParams &params, uint32_t seed);
+    /** Moves the simulation forward
+     *
+     *  @param[in] throttle Command of each motor, 0 - 1
+     *  @param[in] dt Time step (s)
+     */
+    void step(const float throttle[motorCount], float dt);
+    /** Takes a reading of the IMU, in the sensor axes
+     *
+     *  @param[out] accel Acceleration (G)
+     *  @param[out] gyro Rotation rate (degrees per second)
+     */
+    void readSensors(float accel[3], float gyro[3]);
+    /** Gets the roll (right side down), pitch (nose up) and yaw (anticlockwise from above) in degrees */
+    void eulerAngles(float angles[3]) const;
+
+    ///Force on the drone other than the motors, gravity and drag, world frame (N)
+    float externalForce[3] = {};
+    ///Torque on the drone other than the motors, body frame (N m)
+    float externalTorque[3] = {};
+
+    ///Position, world frame (m)
+    float position[3] = {};
+    ///Velocity, world frame (m/s)
+    float velocity[3] = {};
+    ///Orientation, rotates the body frame to the world frame {w, x, y, z}
+    float attitude[4] = {1, 0, 0, 0};
+    ///Rotation rate, body frame (rad/s)
+    float rate[3] = {};
+    ///Speed of each motor, 0 - 1 of maxRpm
+    float motorSpeed[motorCount] = {};
+    ///Whether the drone is resting on the ground
+    bool grounded = true;
+
+  private:
+    /** Rotates a vector from the body frame to the world frame, or back if inverse is true */
+    void rotate(const float in[3], float out[3], bool inverse) const;
+    /** Gets a normally distributed random number */
+    float gaussian();
+
+    ///Properties of the drone
+    ModelParams params;
+    ///Position of each motor, body frame (m)
+    float motorX[motorCount], motorY[motorCount];
+    ///Angle of each motor's rotor, for vibration (rad)
+    float motorPhase[motorCount] = {};
+    ///Acceleration and rotation rate through the sensor's low pass filter, body frame
+    float filteredAccel[3] = {0, 0, 1}, filteredGyro[3] = {};
+    ///State of the random number generator
+    uint32_t randomState;
+};
+#endif
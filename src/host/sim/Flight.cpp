@@ -0,0 +1,322 @@
+#include "Flight.h"
+#include "Memory.h"
+#include "MotorController.h"
+#include "MPU6050_kriswiner.h"
+#include "RF24.h"
+#include "SdFat.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <sys/stat.h>
+
+//The firmware
+void setup();
+void loop();
+
+const char defaultScript[] =
+  "0 pot .8\n"
+  "1.5 sticks 0 0 -55 0\n"
+  "3 sticks 40 0 -55 0\n"
+  "4 sticks 0 0 -55 0\n"
+  "5.5 sticks 0 40 -55 0\n"
+  "6.5 sticks 0 0 -55 0\n"
+  "8 sticks 0 0 -55 60\n"
+  "9 sticks 0 0 -55 0\n"
+  "10.5 torque .15 0 0 .05\n"
+  "12 force 3 0 0 .5\n"
+  "14 end\n";
+
+///Physics step (ns)
+static const uint64_t stepNanos = 125000;
+///Time between IMU readings (ns), the rate set by initMPU6050()
+static const uint64_t imuNanos = 5000000;
+///Time between packets from the controller (ns)
+static const uint64_t packetNanos = 10000000;
+///Time between flight samples (ns)
+static const uint64_t sampleNanos = samplePeriod * 1e9 + .5;
+///Time the firmware has to finish setup() and the flight after the script ends (ns)
+static const uint64_t timeoutNanos = 30000000000ULL;
+///Pin the radio's IRQ line is connected to, see DroneRadio
+static const int radioIrqPin = 24;
+
+/* Simulation state */
+static DroneModel *model;
+static const std::vector<ScriptEvent> *script;
+static size_t nextEvent = 0;
+///Time the first loop() started, 0 until setup() has finished (ns)
+static uint64_t flightStart = 0;
+///Controller input sent in each packet
+static int sticks[4] = {};
+static float pot = 0;
+static bool standbyButton = false, abortButton = false;
+static uint8_t packetSequence = 0;
+///Time the current force and torque end (ns)
+static uint64_t forceEnd = 0, torqueEnd = 0;
+///Extra time of each IMU and SD card transfer while stalled, and the time the stall ends (ns)
+static uint64_t imuStallNanos = 0, sdStallNanos = 0, stallEnd = 0;
+///Number of simulated IMUs, and the faulty one with its gyroscope offset (degrees per second) until faultEnd (ns)
+static int imuCount = 1, faultyImu = -1;
+static float faultOffset = 0;
+static uint64_t faultEnd = 0;
+///Motor command of each motor, held until the ESC signal changes
+static float throttle[motorCount] = {};
+static FlightResult *result;
+static float sensorTemperature;
+static bool timedOut = false;
+
+/** Reads the motor commands from the ESC signals, OneShot125 pulses of 125 - 250 μs */
+static void readESCs() {
+  for (int i=0; i<motorCount; i++) {
+    int pin = frameMatrix.pins[i];
+    if (hal::pwmFrequency[pin] > 0 and hal::clockNanos >= hal::pwmApplyNanos[pin]) {
+      float pulse = hal::pwmDutyCycle[pin] / 100 * 1e6f / hal::pwmFrequency[pin];
+      throttle[i] = min(max((pulse - 125) / 125, 0.0f), 1.0f);
+    }
+  }
+}
+
+/** Sends a packet from the controller with the current input */
+static void sendPacket() {
+  uint8_t packet[7];
+  packet[0] = sticks[0] + 127;
+  packet[1] = 127 - sticks[1]; //The firmware reverses the pitch
+  packet[2] = sticks[2] + 127;
+  packet[3] = sticks[3] + 127;
+  packet[4] = pot * 255;
+  packet[5] = packetSequence++;
+  packet[6] = abortButton | (standbyButton << 1);
+  hal::radioReceive(packet, sizeof(packet));
+}
+
+/** Runs the script events which are due */
+static void runScript(uint64_t flightTime) {
+  while (nextEvent < script->size() and (*script)[nextEvent].time <= flightTime) {
+    const ScriptEvent &event = (*script)[nextEvent++];
+    const float *a = event.args;
+    if (event.command == "sticks") {
+      for (int i=0; i<4; i++) {
+        sticks[i] = min(max((int)a[i], -127), 127);
+      }
+    } else if (event.command == "pot") {
+      pot = min(max(a[0], 0.0f), 1.0f);
+    } else if (event.command == "standby") {
+      standbyButton = a[0] != 0;
+    } else if (event.command == "force") {
+      for (int i=0; i<3; i++) {
+        model->externalForce[i] = a[i];
+      }
+      forceEnd = hal::clockNanos + (uint64_t)(a[3] * 1e9);
+    } else if (event.command == "torque") {
+      for (int i=0; i<3; i++) {
+        model->externalTorque[i] = a[i];
+      }
+      torqueEnd = hal::clockNanos + (uint64_t)(a[3] * 1e9);
+    } else if (event.command == "stall") {
+      imuStallNanos = (uint64_t)max(a[0] * 1e3f, 0.0f);
+      sdStallNanos = (uint64_t)max(a[1] * 1e3f, 0.0f);
+      stallEnd = hal::clockNanos + (uint64_t)(a[2] * 1e9);
+    } else if (event.command == "fault") {
+      faultyImu = (int)a[0];
+      faultOffset = a[1];
+      faultEnd = hal::clockNanos + (uint64_t)(a[2] * 1e9);
+    } else if (event.command == "end") {
+      //The firmware stops at the next delay(), once ABORT() has written the log
+      abortButton = true;
+      hal::stop();
+    }
+  }
+}
+
+/** Records the true state of the drone */
+static void recordSample(uint64_t now) {
+  FlightSample sample;
+  sample.time = (now - flightStart) / 1e9;
+  model->eulerAngles(sample.angle);
+  sample.rate[0] = model->rate[0] * 180/M_PI;
+  sample.rate[1] = -model->rate[1] * 180/M_PI;
+  sample.rate[2] = model->rate[2] * 180/M_PI;
+  for (int i=0; i<3; i++) {
+    sample.position[i] = model->position[i];
+  }
+  for (int i=0; i<motorCount; i++) {
+    sample.throttle[i] = throttle[i];
+    sample.motorSpeed[i] = model->motorSpeed[i];
+  }
+  for (int i=0; i<4; i++) {
+    sample.sticks[i] = sticks[i];
+  }
+  sample.grounded = model->grounded;
+  if (!sample.grounded) {
+    result->maxTilt = max(result->maxTilt, max(fabsf(sample.angle[0]), fabsf(sample.angle[1])));
+  }
+  result->samples.push_back(sample);
+}
+
+/** Extra time a transfer takes during a stall, see hal::transferLatency */
+static uint64_t transferLatency(hal::Device device) {
+  if (hal::clockNanos >= stallEnd) {
+    return 0;
+  }
+  return device == hal::imuDevice ? imuStallNanos : sdStallNanos;
+}
+
+/** Simulation step, run by the HAL every stepNanos of simulated time */
+static void simulationStep() {
+  uint64_t now = hal::clockNanos;
+  if (now > timeoutNanos + script->back().time + flightStart) {
+    timedOut = true;
+    throw hal::Stopped();
+  }
+
+  if (flightStart) {
+    runScript(now - flightStart);
+  }
+  if (now >= forceEnd) {
+    std::fill(model->externalForce, model->externalForce + 3, 0.0f);
+  }
+  if (now >= torqueEnd) {
+    std::fill(model->externalTorque, model->externalTorque + 3, 0.0f);
+  }
+
+  readESCs();
+  model->step(throttle, stepNanos / 1e9f);
+
+  if (now % imuNanos == 0) {
+    //Each IMU reads the same motion with its own noise
+    for (int s=0; s<imuCount; s++) {
+      float accel[3], gyro[3];
+      model->readSensors(accel, gyro);
+      if (s == faultyImu and now < faultEnd) {
+        for (int i=0; i<3; i++) {
+          gyro[i] += faultOffset;
+        }
+      }
+      hal::imuSample(accel, gyro, sensorTemperature, s);
+    }
+  }
+  if (now % packetNanos == 0) {
+    sendPacket();
+  }
+  if (now % sampleNanos == 0 and flightStart) {
+    recordSample(now);
+  }
+}
+
+bool parseScript(const std::string &text, std::vector<ScriptEvent> &script, std::string &error) {
+  script.clear();
+  size_t start = 0;
+  int lineNumber = 0;
+  while (start < text.size()) {
+    size_t end = text.find('\n', start);
+    std::string line = text.substr(start, end == std::string::npos ? std::string::npos : end - start);
+    start = end == std::string::npos ? text.size() : end + 1;
+    lineNumber++;
+    if (line.find('#') != std::string::npos) {
+      line.erase(line.find('#'));
+    }
+
+    ScriptEvent event = {};
+    char command[32];
+    double time;
+    int count = sscanf(line.c_str(), "%lf %31s %f %f %f %f", &time, command, &event.args[0], &event.args[1], &event.args[2], &event.args[3]);
+    if (count <= 0) {
+      continue;
+    }
+    event.command = count >= 2 ? command : "";
+    static const struct {const char *name; int args;} commands[] = {
+      {"sticks", 4}, {"pot", 1}, {"standby", 1}, {"force", 4}, {"torque", 4}, {"stall", 3}, {"fault", 3}, {"end", 0}
+    };
+    bool valid = false;
+    for (const auto &c : commands) {
+      valid |= event.command == c.name and count == 2 + c.args;
+    }
+    if (time < 0 or !valid) {
+      error = "script line " + std::to_string(lineNumber) + " is not valid: " + line;
+      return false;
+    }
+    event.time = (uint64_t)(time * 1e9);
+    script.push_back(event);
+  }
+
+  std::stable_sort(script.begin(), script.end(), [](const ScriptEvent &a, const ScriptEvent &b) {
+    return a.time < b.time;
+  });
+  if (script.empty() or script.back().command != "end") {
+    error = "the script must finish with end";
+    return false;
+  }
+  return true;
+}
+
+bool writeSettings(const std::string &dir, const std::string &extra, bool replace) {
+  std::string path = dir + "/settings.json";
+  struct stat info;
+  if (!replace and stat(path.c_str(), &info) == 0) {
+    return true;
+  }
+  FILE *file = fopen(path.c_str(), "w");
+  if (!file) {
+    return false;
+  }
+  //The default angle offsets trim the real drone's frame, the model has none
+  fprintf(file, "{\n  \"angleOffset\": [0, 0, 0]%s%s\n}\n", extra.empty() ? "" : ",\n  ", extra.c_str());
+  return fclose(file) == 0;
+}
+
+FlightResult runFlight(const FlightOptions &options) {
+  FlightResult flight;
+  DroneModel drone(options.params, options.seed);
+  model = &drone;
+  script = &options.script;
+  result = &flight;
+  sensorTemperature = options.params.temperature;
+  imuCount = min(max(options.imuCount, 1), hal::imuDevices);
+  flight.samples.reserve((options.script.back().time / sampleNanos) + 1);
+
+  //Connect the model to the HAL, the output directory is the SD card
+  hal::storageDir = options.dir;
+  hal::radioIrqPin = radioIrqPin;
+  hal::clockReadNanos = 100;
+  hal::simulationPeriodNanos = stepNanos;
+  hal::simulationStep = simulationStep;
+  hal::transferLatency = transferLatency;
+  Serial.redirect(nullptr);
+
+  try {
+    setup();
+    flightStart = hal::clockNanos;
+    for (;;) {
+      loop();
+    }
+  } catch (hal::Stopped &) {
+  }
+  //The flight may have been stopped before the firmware unlocked the heap
+  unlockHeap();
+  hal::simulationStep = nullptr;
+  hal::transferLatency = nullptr;
+
+  flight.finished = !timedOut;
+  flight.simulatedTime = hal::clockNanos / 1e9;
+  flight.flightTime = flightStart ? (hal::clockNanos - flightStart) / 1e9 : 0;
+
+  if (options.writeTruth) {
+    FILE *file = fopen((options.dir + "/truth.csv").c_str(), "w");
+    if (file) {
+      fprintf(file, "Time (s),roll,pitch,yaw,roll rate,pitch rate,yaw rate,x,y,z");
+      for (int i=0; i<motorCount; i++) {
+        fprintf(file, ",motor %d", i);
+      }
+      fprintf(file, "\n");
+      for (const FlightSample &s : flight.samples) {
+        fprintf(file, "%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f", s.time, s.angle[0], s.angle[1], s.angle[2],
+                s.rate[0], s.rate[1], s.rate[2], s.position[0], s.position[1], s.position[2]);
+        for (int i=0; i<motorCount; i++) {
+          fprintf(file, ",%.3f", s.motorSpeed[i]);
+        }
+        fprintf(file, "\n");
+      }
+      fclose(file);
+    }
+  }
+  return flight;
+}
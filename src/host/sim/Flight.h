@@ -0,0 +1,134 @@
+#ifndef __Flight_H__
+#define __Flight_H__
+
+/*
+ * Simulated flight of the firmware (drone.ino) against DroneModel, through the simulated IMU (hal/MPU6050_kriswiner.h),
+ * ESCs (hal/Teensy_PWM.h), radio (hal/RF24.h) and SD card (hal/SdFat.h). Used by sitl.cpp and tune.cpp.
+ *
+ * Time is simulated, so a flight is deterministic for a seed and runs much faster than real time.
+ * The firmware keeps its state in globals, so only one flight can be run per process.
+ *
+ * Script lines are "<time (s)> <command> <arguments>", times start from the first loop() after setup():
+ *   sticks <roll> <pitch> <vertical> <yaw>    Joystick input as decoded by the firmware (-127 - 127)
+ *   pot <0 - 1>                               Potentiometer
+ *   standby <0 or 1>                          Standby button
+ *   force <x> <y> <z> <duration (s)>          Push in the world frame (N)
+ *   torque <x> <y> <z> <duration (s)>         Twist in the body frame (N m)
+ *   stall <imu (μs)> <sd (μs)> <duration (s)> Extra time each IMU status read and SD card write take, which makes the
+ *                                             loops overrun (see LoopWatchdog)
+ *   fault <imu> <offset> <duration (s)>       Adds an offset (degrees per second) to each gyroscope axis of one of the
+ *                                             IMUs, 0 - FlightOptions::imuCount-1
+ *   end                                       Press the abort button, which ends the flight
+ */
+
+//Import libraries
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//Import files
+#include "DroneModel.h"
+
+/**
+ * @struct ScriptEvent
+ * @brief One line of the flight script
+ */
+struct ScriptEvent {
+  ///Time from the start of the flight (ns)
+  uint64_t time;
+  ///Command name
+  std::string command;
+  ///Arguments of the command
+  float args[4];
+};
+
+/**
+ * @struct FlightSample
+ * @brief True state of the drone and the controller input at one time
+ */
+struct FlightSample {
+  ///Time from the start of the flight (s)
+  float time;
+  ///Roll (right side down), pitch (nose up) and yaw (anticlockwise) in degrees
+  float angle[3];
+  ///Rotation rate of roll, pitch and yaw in the same directions (degrees per second)
+  float rate[3];
+  ///Position in the world frame (m)
+  float position[3];
+  ///Command the ESCs received, 0 - 1
+  float throttle[motorCount];
+  ///Speed of each motor, 0 - 1
+  float motorSpeed[motorCount];
+  ///Joystick input being sent
+  int sticks[4];
+  ///True until the drone has lifted off
+  bool grounded;
+};
+
+/**
+ * @struct FlightOptions
+ * @brief What to fly and where to put the files
+ */
+struct FlightOptions {
+  ///Directory the firmware's SD card files are in
+  std::string dir = "sitl_out";
+  ///Seed of the sensor noise
+  uint32_t seed = 1;
+  ///Properties of the simulated drone
+  ModelParams params;
+  ///Number of simulated IMUs, settings.json should set the firmware's imuCount to the same (see IMU::imuCount)
+  int imuCount = 1;
+  ///Flight script, must finish with end
+  std::vector<ScriptEvent> script;
+  ///Whether to write the true state to truth.csv
+  bool writeTruth = true;
+};
+
+/**
+ * @struct FlightResult
+ * @brief Outcome of a simulated flight
+ */
+struct FlightResult {
+  ///False if the firmware did not reach the end of the script and write its log
+  bool finished = false;
+  ///Total simulated time, including setup() (s)
+  double simulatedTime = 0;
+  ///Time from the first loop() to the end (s)
+  double flightTime = 0;
+  ///Largest roll or pitch while off the ground (degrees)
+  float maxTilt = 0;
+  ///True state every samplePeriod while flying
+  std::vector<FlightSample> samples;
+};
+
+///Time between flight samples (s)
+const float samplePeriod = .002;
+
+/** Flight climbing, then stepping each axis and pushing the drone */
+extern const char defaultScript[];
+
+/** Parses a flight script
+ *
+ *  @param[in] text Script, one event per line, # starts a comment
+ *  @param[out] script Events, sorted by time
+ *  @param[out] error Description of the first problem
+ *  @returns false if a line is not valid or the script does not finish with end
+ */
+bool parseScript(const std::string &text, std::vector<ScriptEvent> &script, std::string &error);
+
+/** Writes a settings.json for the firmware, keeping one that is already there
+ *
+ *  @param[in] dir Directory of the SD card
+ *  @param[in] extra JSON members to add after the angle offsets, "" for none
+ *  @param[in] replace Replace a settings.json which is already there
+ *  @returns false if the file could not be written
+ */
+bool writeSettings(const std::string &dir, const std::string &extra="", bool replace=false);
+
+/** Flies the firmware through a script. Can only be called once per process
+ *
+ *  @param[in] options Script, model and output directory
+ *  @returns True state during the flight
+ */
+FlightResult runFlight(const FlightOptions &options);
+#endif
@@ -0,0 +1,138 @@
+#include "FlightLog.h"
+#include "Logger.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+bool FlightLog::load(const std::string &dir, std::string &error) {
+  //Read the variable types from the header of the binary log
+  std::string log;
+  if (!readAll(dir + "/log.bin", log) or log.size() < 4 or log.compare(0, 3, "LOG") != 0
+      or log.size() < 4 + (size_t)(uint8_t)log[3]) {
+    error = dir + "/log.bin is missing or has no header";
+    return false;
+  }
+  int varCount = (uint8_t)log[3];
+  types = log.substr(4, varCount);
+  offsets.clear();
+  recordBytes = 0;
+  for (int i=0; i<varCount; i++) {
+    offsets.push_back(recordBytes);
+    recordBytes += (uint8_t)types[i] % 50 / 8;
+  }
+  data = log.substr(4 + varCount);
+  records = recordBytes ? data.size() / recordBytes : 0;
+
+  //Get the names of the variables from the line of column names in the text log
+  std::string text;
+  if (!readAll(dir + "/log_0.csv", text)) {
+    error = "cannot open " + dir + "/log_0.csv";
+    return false;
+  }
+  size_t namesStart = text.rfind("Time (μs),");
+  if (namesStart == std::string::npos) {
+    error = dir + "/log_0.csv has no column names";
+    return false;
+  }
+  std::vector<std::string> columns;
+  std::string line = text.substr(namesStart, text.find('\n', namesStart) - namesStart);
+  for (size_t start=0; start<=line.size();) {
+    size_t end = std::min(line.find(',', start), line.size());
+    columns.push_back(line.substr(start, end - start));
+    start = end + 1;
+  }
+  names.clear();
+  for (int i=0, column=0; i<varCount; i++) {
+    names.push_back(column < (int)columns.size() ? columns[column] : "");
+    column += types[i] == typeID.time ? 2 : 1;
+  }
+  return true;
+}
+
+int FlightLog::find(const std::string &name) const {
+  for (size_t i=0; i<names.size(); i++) {
+    if (names[i] == name) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+int32_t FlightLog::raw(size_t record, int variable) const {
+  //Every type is a whole number of bytes, stored least significant byte first
+  const uint8_t *bytes = this->record(record) + offsets[variable];
+  uint8_t type = types[variable];
+  int bits = type % 50;
+  uint32_t value = 0;
+  for (int i=0; i<bits/8; i++) {
+    value |= (uint32_t)bytes[i] << (i*8);
+  }
+  if (bits < 32 and type > 100 and (value >> (bits-1)) & 1) {
+    value |= ~0u << bits;
+  }
+  return value;
+}
+
+double FlightLog::value(size_t record, int variable) const {
+  return toNumber(raw(record, variable), types[variable]);
+}
+
+const uint8_t *FlightLog::record(size_t record) const {
+  return (const uint8_t *)data.data() + record*recordBytes;
+}
+
+int FlightLog::offset(int variable) const {
+  return offsets[variable];
+}
+
+int32_t quantise(float value, uint8_t type) {
+  int32_t raw;
+  if (type == typeID.float16) {
+    raw = (int16_t)round(value*10);
+  } else if (type == typeID.float16k) {
+    raw = (int16_t)round(value*1000);
+  } else {
+    memcpy(&raw, &value, sizeof(raw));
+  }
+  return raw;
+}
+
+double toNumber(int32_t raw, uint8_t type) {
+  if (type == typeID.float16) {
+    return raw / 10.0;
+  } else if (type == typeID.float16k) {
+    return raw / 1000.0;
+  } else if (type == typeID.float32) {
+    float value;
+    memcpy(&value, &raw, sizeof(value));
+    return value;
+  } else if (type == typeID.time or type == typeID.uint32) {
+    return (uint32_t)raw;
+  }
+  return raw;
+}
+
+bool readAll(const std::string &path, std::string &data) {
+  FILE *file = fopen(path.c_str(), "rb");
+  if (!file) {
+    return false;
+  }
+  data.clear();
+  char buf[4096];
+  size_t len;
+  while ((len = fread(buf, 1, sizeof(buf), file)) > 0) {
+    data.append(buf, len);
+  }
+  fclose(file);
+  return true;
+}
+
+bool writeAll(const std::string &path, const std::string &data) {
+  FILE *file = fopen(path.c_str(), "wb");
+  if (!file) {
+    return false;
+  }
+  bool success = fwrite(data.data(), 1, data.size(), file) == data.size();
+  return fclose(file) == 0 and success;
+}
@@ -0,0 +1,65 @@
+#ifndef __FlightLog_H__
+#define __FlightLog_H__
+
+/*
+ * Reads the firmware's binary flight log (log.bin, see Logger::write) without the firmware.
+ *
+ * The types of the variables come from the header of log.bin and their names from the line of column names in
+ * log_0.csv. Used by replay.cpp, refilter.cpp and columns.cpp.
+ */
+
+//Import libraries
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+ * @class FlightLog
+ * @brief Every record of a flight log
+ */
+class FlightLog {
+  public:
+    /** Reads the log of a flight
+     *
+     *  @param[in] dir Directory with log.bin and log_0.csv, usually a copy of the SD card
+     *  @param[out] error Reason the log could not be read
+     *  @returns true if the log was read
+     */
+    bool load(const std::string &dir, std::string &error);
+    /** Gets the index of a variable from its column name, -1 if it was not logged */
+    int find(const std::string &name) const;
+    /** Gets the stored bits of a variable, sign extended for the signed types */
+    int32_t raw(size_t record, int variable) const;
+    /** Gets the value of a variable */
+    double value(size_t record, int variable) const;
+    /** Gets the stored bytes of a record */
+    const uint8_t *record(size_t record) const;
+    /** Gets the position of a variable in a record (bytes) */
+    int offset(int variable) const;
+
+    ///Number of records, one per logged loop
+    size_t records = 0;
+    ///TypeID of each variable
+    std::string types;
+    ///Column name of each variable, times have two columns and are named after the first
+    std::vector<std::string> names;
+
+  private:
+    ///Records, without the header
+    std::string data;
+    ///Bytes per record
+    size_t recordBytes = 0;
+    ///Byte offset of each variable in a record
+    std::vector<int> offsets;
+};
+
+/** Converts a value to the bits the log stores for a type (see Logger::logData) */
+int32_t quantise(float value, uint8_t type);
+/** Converts the bits stored for a type to a value */
+double toNumber(int32_t raw, uint8_t type);
+
+/** Reads a whole file, returns false if it can not be opened */
+bool readAll(const std::string &path, std::string &data);
+/** Writes a whole file, returns false on failure */
+bool writeAll(const std::string &path, const std::string &data);
+#endif
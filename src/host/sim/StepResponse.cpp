@@ -0,0 +1,122 @@
+#include "StepResponse.h"
+
+#include <math.h>
+#include <stdio.h>
+
+/** Gets the target of roll, pitch (angle) and yaw (rate) for the sticks being sent */
+static void getTargets(const FlightSample &sample, float maxAngle, float maxYawRate, float target[3]) {
+  const int axisSticks[3] = {0, 1, 3};
+  for (int axis=0; axis<3; axis++) {
+    int stick = sample.sticks[axisSticks[axis]];
+    if (stick > -5 and stick < 5) { //Joystick deadzone, see decodePacket()
+      stick = 0;
+    }
+    target[axis] = -stick * (axis < 2 ? maxAngle : maxYawRate) / 127;
+  }
+}
+
+/** Gets the value a step on an axis is measured on */
+static float measured(const FlightSample &sample, int axis) {
+  return axis < 2 ? sample.angle[axis] : sample.rate[2];
+}
+
+FlightScore scoreFlight(const FlightResult &flight, float maxAngle, float maxYawRate) {
+  FlightScore score;
+  const std::vector<FlightSample> &samples = flight.samples;
+  score.crashed = !flight.finished or flight.maxTilt > crashTilt;
+
+  //Only score the flight once the drone has lifted off
+  size_t first = 0;
+  while (first < samples.size() and samples[first].grounded) {
+    first++;
+  }
+  if (first == samples.size()) {
+    score.crashed = true;
+  }
+
+  float lastTarget[3] = {};
+  size_t maxStepSamples = maxStepTime / samplePeriod;
+  double errorSum = 0;
+  int saturated = 0;
+  double changeSum = 0;
+  for (size_t k=first; k<samples.size(); k++) {
+    const FlightSample &sample = samples[k];
+    score.crashed |= sample.grounded;
+
+    float target[3];
+    getTargets(sample, maxAngle, maxYawRate, target);
+    errorSum += powf(target[0] - sample.angle[0], 2) + powf(target[1] - sample.angle[1], 2);
+    bool saturatedMotor = false;
+    for (int i=0; i<motorCount; i++) {
+      saturatedMotor |= sample.throttle[i] <= .001f or sample.throttle[i] >= .999f;
+      if (k > first) {
+        changeSum += fabsf(sample.throttle[i] - samples[k-1].throttle[i]);
+      }
+    }
+    saturated += saturatedMotor;
+
+    for (int axis=0; axis<3; axis++) {
+      float size = target[axis] - lastTarget[axis];
+      if (k == first or fabsf(size) < 1e-3f) {
+        continue;
+      }
+
+      //Measure the response until the target changes again
+      size_t end = k;
+      float riseTime = -1;
+      float peak = 0;
+      float settledTime = 0;
+      while (end < samples.size() and end - k < maxStepSamples) {
+        float endTarget[3];
+        getTargets(samples[end], maxAngle, maxYawRate, endTarget);
+        if (endTarget[axis] != target[axis]) {
+          break;
+        }
+        float progress = (measured(samples[end], axis) - lastTarget[axis]) / size;
+        float time = (end - k + 1) * samplePeriod;
+        if (riseTime < 0 and progress >= riseFraction) {
+          riseTime = time;
+        }
+        peak = fmaxf(peak, progress);
+        if (fabsf(progress - 1) > settleBand) {
+          settledTime = time;
+        }
+        end++;
+      }
+      float window = (end - k) * samplePeriod;
+      score.riseTime += riseTime < 0 ? window : riseTime;
+      score.overshoot += fmaxf(peak - 1, 0);
+      score.settlingTime += settledTime;
+      score.steps++;
+    }
+    for (int axis=0; axis<3; axis++) {
+      lastTarget[axis] = target[axis];
+    }
+  }
+
+  size_t count = samples.size() - first;
+  if (score.steps > 0) {
+    score.riseTime /= score.steps;
+    score.overshoot /= score.steps;
+    score.settlingTime /= score.steps;
+  }
+  if (count > 0) {
+    score.angleError = sqrt(errorSum / count / 2);
+    score.saturation = 100.0f * saturated / count;
+    score.noise = 1000 * changeSum / count / motorCount;
+  }
+
+  score.cost = score.riseTime * riseCost + score.overshoot * overshootCost + score.settlingTime * settleCost
+             + score.angleError * errorCost + score.saturation * saturationCost + score.noise * noiseCost
+             + (score.crashed ? crashCost : 0);
+  return score;
+}
+
+std::string describeScore(const FlightScore &score) {
+  char text[256];
+  snprintf(text, sizeof(text), "Cost,%.3f,Steps,%d,Rise time (s),%.3f,Overshoot (%%),%.1f,Settling time (s),%.3f,"
+           "Angle error (°),%.2f,Saturation (%%),%.1f,Motor noise (‰),%.2f,Crashed,%d",
+           score.cost, score.steps, score.riseTime, score.overshoot*100, score.settlingTime,
+           score.angleError, score.saturation, score.noise, score.crashed);
+  return text;
+}
@@ -0,0 +1,68 @@
+#ifndef __StepResponse_H__
+#define __StepResponse_H__
+
+/*
+ * Scores how well the controller followed the sticks during a simulated flight (see Flight.h).
+ *
+ * Every change of the roll, pitch or yaw stick is a step. Roll and pitch steps are measured on the true angle, yaw steps
+ * on the true yaw rate, against the target the firmware's angle and rate settings give for the stick.
+ * The cost combines the step responses with the angle error over the whole flight, motor saturation and motor noise.
+ */
+
+//Import libraries
+#include <string>
+
+//Import files
+#include "Flight.h"
+
+/* Settings */
+///Fraction of the step the response has to reach to have risen
+const float riseFraction = .9;
+///Band around the target the response has to stay in to have settled, fraction of the step
+const float settleBand = .1;
+///Longest time a step is measured for (s)
+const float maxStepTime = 1.5;
+///Tilt which counts as a crash (degrees)
+const float crashTilt = 60;
+///Cost of each part of the score: rise time (per s), overshoot (per fraction), settling time (per s),
+///angle error (per degree RMS), saturation (per %), motor noise (per ‰ of change per sample) and a crash
+const float riseCost = 10, overshootCost = 5, settleCost = 4, errorCost = .5, saturationCost = .05, noiseCost = .5, crashCost = 1000;
+/* Settings */
+
+/**
+ * @struct FlightScore
+ * @brief Step response and smoothness of a flight, lower cost is better
+ */
+struct FlightScore {
+  ///Number of steps measured
+  int steps = 0;
+  ///Mean time to reach riseFraction of each step (s)
+  float riseTime = 0;
+  ///Mean overshoot past each step, fraction of the step
+  float overshoot = 0;
+  ///Mean time to stay within settleBand of each step (s)
+  float settlingTime = 0;
+  ///RMS difference between the target and true roll and pitch while flying (degrees)
+  float angleError = 0;
+  ///Samples with a motor at zero or full power while flying (%)
+  float saturation = 0;
+  ///Mean change of each motor command between samples (‰)
+  float noise = 0;
+  ///Whether the flight did not finish, tilted more than crashTilt, or landed
+  bool crashed = false;
+  ///Weighted sum of the parts above
+  float cost = 0;
+};
+
+/** Scores a flight
+ *
+ *  @param[in] flight Result of runFlight()
+ *  @param[in] maxAngle Angle at full roll or pitch stick (degrees), see PIDcontroller
+ *  @param[in] maxYawRate Yaw rate at full yaw stick (degrees per second), see PIDcontroller
+ *  @returns Score of the flight
+ */
+FlightScore scoreFlight(const FlightResult &flight, float maxAngle, float maxYawRate);
+
+/** Describes a score as comma separated name, value pairs */
+std::string describeScore(const FlightScore &score);
+#endif
@@ -0,0 +1,169 @@
+/*
+ * Checks the in-flight auto-tune (see PIDcontroller and RelayTuner) end to end on the simulator (see Flight.h).
+ *
+ * The firmware hovers with autoTune set until it has measured every axis and stored the gains in autoTuneFile. The file
+ * is copied to a fresh SD card, where the firmware loads it at startup like on the real drone, and flown through the
+ * step script of sitl. The same steps are flown with the default gains to compare. Each flight runs in its own process,
+ * as the firmware keeps its state in globals.
+ *
+ *   autotune [--dir output directory] [--seed n] [--max-tilt degrees]
+ *
+ * The flights are in tune/, default/ and tuned/ in the output directory. Exits with 1 if the auto-tune does not finish,
+ * or the drone crashes or tilts more than --max-tilt with the tuned gains.
+ */
+#include "Flight.h"
+#include "PIDcontroller.h"
+#include "StepResponse.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+///Take off and hover with the sticks centred, long enough to tune every axis up to its timeout
+static const char hoverScript[] =
+  "0 pot .8\n"
+  "1.5 sticks 0 0 -55 0\n"
+  "22 end\n";
+
+/**
+ * @struct FlownResult
+ * @brief Outcome of a flight flown in a child process
+ */
+struct FlownResult {
+  ///Whether the firmware finished the flight
+  bool finished;
+  ///Largest roll or pitch while off the ground (degrees)
+  float maxTilt;
+  ///Step response of the flight
+  FlightScore score;
+};
+
+/** Reads or writes the gains stored by the auto-tune, returns false if it can not */
+static bool storedGains(const std::string &dir, TunedGains &gains, bool write) {
+  FILE *file = fopen((dir + "/" + autoTuneFile).c_str(), write ? "wb" : "rb");
+  if (!file) {
+    return false;
+  }
+  bool done = write ? fwrite(&gains, sizeof(gains), 1, file) == 1 : fread(&gains, sizeof(gains), 1, file) == 1;
+  return fclose(file) == 0 and done;
+}
+
+/** Flies a script in a child process on a fresh SD card
+ *
+ *  @param[in] dir Directory of the SD card, the files of an earlier flight are removed
+ *  @param[in] text Flight script
+ *  @param[in] settings JSON members of settings.json
+ *  @param[in] seed Seed of the sensor noise
+ *  @param[in] stored Gains to store on the SD card as if an earlier flight tuned them, nullptr for none
+ *  @param[out] result Outcome of the flight
+ *  @returns false if the flight could not be run
+ */
+static bool fly(const std::string &dir, const char *text, const std::string &settings, uint32_t seed,
+                const TunedGains *stored, FlownResult &result) {
+  FlightOptions options;
+  options.dir = dir;
+  options.seed = seed;
+  std::string error;
+  if (!parseScript(text, options.script, error)) {
+    fprintf(stderr, "%s\n", error.c_str());
+    return false;
+  }
+  mkdir(dir.c_str(), 0755);
+  const char *files[] = {"imuCal.bin", "imuState.bin", "log.bin", "log_0.csv", "truth.csv", autoTuneFile};
+  for (const char *file : files) {
+    remove((dir + "/" + file).c_str());
+  }
+  TunedGains gains = stored ? *stored : TunedGains();
+  if (!writeSettings(dir, settings, true) or (stored and !storedGains(dir, gains, true))) {
+    fprintf(stderr, "cannot write to %s\n", dir.c_str());
+    return false;
+  }
+
+  int fds[2];
+  if (pipe(fds) != 0) {
+    return false;
+  }
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+    FlightResult flight = runFlight(options);
+    PIDcontroller defaults;
+    FlownResult flown = {flight.finished, flight.maxTilt, scoreFlight(flight, defaults.maxAngle, defaults.maxRate[2])};
+    _exit(write(fds[1], &flown, sizeof(flown)) == sizeof(flown) ? 0 : 1);
+  }
+  close(fds[1]);
+  int status;
+  bool flown = pid > 0 and waitpid(pid, &status, 0) == pid and WIFEXITED(status) and WEXITSTATUS(status) == 0
+               and read(fds[0], &result, sizeof(result)) == sizeof(result);
+  close(fds[0]);
+  return flown;
+}
+
+int main(int argc, char **argv) {
+  std::string dir = "autotune_out";
+  uint32_t seed = 1;
+  float tiltLimit = 180;
+  bool valid = true;
+  for (int i=1; i<argc and valid; i++) {
+    if (!strcmp(argv[i], "--dir") and i+1 < argc) {
+      dir = argv[++i];
+    } else if (!strcmp(argv[i], "--seed") and i+1 < argc) {
+      seed = strtoul(argv[++i], nullptr, 0);
+    } else if (!strcmp(argv[i], "--max-tilt") and i+1 < argc) {
+      tiltLimit = atof(argv[++i]);
+    } else {
+      valid = false;
+    }
+  }
+  if (!valid) {
+    fprintf(stderr, "usage: %s [--dir output directory] [--seed n] [--max-tilt degrees]\n", argv[0]);
+    return 2;
+  }
+  if (mkdir(dir.c_str(), 0755) != 0 and errno != EEXIST) {
+    fprintf(stderr, "cannot create %s\n", dir.c_str());
+    return 2;
+  }
+
+  //Tune in flight, starting from the default gains
+  FlownResult tuneFlight;
+  TunedGains gains;
+  if (!fly(dir + "/tune", hoverScript, "\"autoTune\": true", seed, nullptr, tuneFlight) or !tuneFlight.finished) {
+    fprintf(stderr, "the auto-tune flight did not finish\n");
+    return 1;
+  }
+  if (!storedGains(dir + "/tune", gains, false) or gains.version != autoTuneVersion) {
+    fprintf(stderr, "the auto-tune did not finish, see the end of %s/tune/log_0.csv\n", dir.c_str());
+    return 1;
+  }
+  const char *axes[] = {"roll", "pitch", "yaw"};
+  for (int i=0; i<3; i++) {
+    printf("autotune: %-5s ultimate gain %.3f, period %.3f s, Pgain %.4g, Igain %.4g, Dgain %.4g\n", axes[i],
+           gains.ultimateGain[i], gains.ultimatePeriod[i], gains.Pgain[i], gains.Igain[i], gains.Dgain[i]);
+  }
+
+  //Fly the steps with the default gains, then with the stored ones on a fresh SD card
+  FlownResult defaultFlight, tunedFlight;
+  if (!fly(dir + "/default", defaultScript, "", seed, nullptr, defaultFlight)) {
+    return 1;
+  }
+  printf("autotune: default gains, %s\n", describeScore(defaultFlight.score).c_str());
+  if (!fly(dir + "/tuned", defaultScript, "", seed, &gains, tunedFlight)) {
+    return 1;
+  }
+  printf("autotune: tuned gains, %s\n", describeScore(tunedFlight.score).c_str());
+
+  if (!tunedFlight.finished or tunedFlight.score.crashed) {
+    fprintf(stderr, "the drone crashed with the tuned gains\n");
+    return 1;
+  }
+  if (tunedFlight.maxTilt > tiltLimit) {
+    fprintf(stderr, "the drone tilted %.1f° with the tuned gains, more than %.1f°\n", tunedFlight.maxTilt, tiltLimit);
+    return 1;
+  }
+  return 0;
+}
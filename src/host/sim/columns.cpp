@@ -0,0 +1,157 @@
+/*
+ * Converts a flight log to columns (see ColumnLog.h), or reads one variable over a time window from them.
+ *
+ * The text log of a 10 minute flight at 2 kHz has over a million lines, which have to be parsed to plot any one
+ * variable. The columns are read through memory maps, so only the variable and time window plotted are read.
+ *
+ *   columns --dir flight directory [--out directory] [--jobs n] [--index-step records] [--check]
+ *   columns --read column directory --column name [--from s] [--to s]
+ *
+ * The columns are written to <flight directory>/columns by default. With --check every value is read back through
+ * ColumnLog and compared with the log, and the time index is compared with a search of every record, exits with 1 if
+ * any differ. --read prints the time (s) and value of each record between --from and --to (s of logged time) as CSV.
+ */
+#include "ColumnLog.h"
+#include "FlightLog.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+/** Prints one column between two times as CSV */
+static int readColumn(const std::string &dir, const std::string &name, double from, double to) {
+  ColumnLog columns;
+  std::string error;
+  if (!columns.open(dir, error)) {
+    fprintf(stderr, "columns: %s\n", error.c_str());
+    return 1;
+  }
+  int column = columns.find(name);
+  int timeColumn = columns.find("Time (μs)");
+  if (column < 0 or timeColumn < 0) {
+    fprintf(stderr, "columns: %s has no column \"%s\"\n", dir.c_str(), column < 0 ? name.c_str() : "Time (μs)");
+    return 1;
+  }
+
+  size_t first = columns.recordAt((uint32_t)std::max(from * 1e6, 0.0));
+  size_t last = to < 0 ? columns.records : columns.recordAt((uint32_t)std::min(to * 1e6, 4294967295.0));
+  printf("Time (s),%s\n", name.c_str());
+  for (size_t r=first; r<last; r++) {
+    printf("%.6f,%g\n", columns.value(timeColumn, r) / 1e6, columns.value(column, r));
+  }
+  return 0;
+}
+
+/** Compares every value and the time index of the columns with the log, returns true if they match */
+static bool checkColumns(const FlightLog &log, const std::string &dir) {
+  ColumnLog columns;
+  std::string error;
+  if (!columns.open(dir, error)) {
+    fprintf(stderr, "columns: %s\n", error.c_str());
+    return false;
+  }
+  if (columns.records != log.records or columns.columns.size() != log.types.size()) {
+    fprintf(stderr, "columns: %zu records of %zu columns, the log has %zu of %zu\n", columns.records,
+            columns.columns.size(), log.records, log.types.size());
+    return false;
+  }
+
+  size_t different = 0;
+  for (size_t c=0; c<columns.columns.size(); c++) {
+    for (size_t r=0; r<log.records; r++) {
+      different += columns.raw(c, r) != log.raw(r, c);
+    }
+  }
+
+  //Look up the time of every record, and the times just before and after it
+  size_t wrongRecords = 0;
+  int timeColumn = log.types.find((char)typeID.time);
+  if (timeColumn >= 0) {
+    std::vector<uint32_t> times(log.records);
+    for (size_t r=0; r<log.records; r++) {
+      times[r] = log.raw(r, timeColumn);
+    }
+    for (size_t r=0; r<log.records; r++) {
+      for (uint32_t time : {times[r] - 1, times[r], times[r] + 1}) {
+        size_t expected = std::lower_bound(times.begin(), times.end(), time) - times.begin();
+        wrongRecords += columns.recordAt(time) != expected;
+      }
+    }
+  }
+  printf("columns: %zu values different, %zu time lookups wrong\n", different, wrongRecords);
+  return different == 0 and wrongRecords == 0;
+}
+
+int main(int argc, char **argv) {
+  std::string dir;
+  std::string outDir;
+  std::string readDir;
+  std::string columnName;
+  double from = 0;
+  double to = -1;
+  int jobs = std::max(1u, std::thread::hardware_concurrency());
+  int indexStep = 2000;
+  bool check = false;
+  bool valid = true;
+  for (int i=1; i<argc and valid; i++) {
+    if (!strcmp(argv[i], "--dir") and i+1 < argc) {
+      dir = argv[++i];
+    } else if (!strcmp(argv[i], "--out") and i+1 < argc) {
+      outDir = argv[++i];
+    } else if (!strcmp(argv[i], "--jobs") and i+1 < argc) {
+      jobs = std::max(1, atoi(argv[++i]));
+    } else if (!strcmp(argv[i], "--index-step") and i+1 < argc) {
+      indexStep = std::max(1, atoi(argv[++i]));
+    } else if (!strcmp(argv[i], "--check")) {
+      check = true;
+    } else if (!strcmp(argv[i], "--read") and i+1 < argc) {
+      readDir = argv[++i];
+    } else if (!strcmp(argv[i], "--column") and i+1 < argc) {
+      columnName = argv[++i];
+    } else if (!strcmp(argv[i], "--from") and i+1 < argc) {
+      from = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--to") and i+1 < argc) {
+      to = atof(argv[++i]);
+    } else {
+      valid = false;
+    }
+  }
+  if (!valid or (dir.empty() == readDir.empty()) or (!readDir.empty() and columnName.empty())) {
+    fprintf(stderr, "usage: %s --dir flight directory [--out directory] [--jobs n] [--index-step records] [--check]\n"
+            "       %s --read column directory --column name [--from s] [--to s]\n", argv[0], argv[0]);
+    return 2;
+  }
+  if (!readDir.empty()) {
+    return readColumn(readDir, columnName, from, to);
+  }
+  if (outDir.empty()) {
+    outDir = dir + "/columns";
+  }
+
+  //Convert the log
+  FlightLog log;
+  std::string error;
+  if (!log.load(dir, error)) {
+    fprintf(stderr, "columns: %s\n", error.c_str());
+    return 1;
+  }
+  auto startTime = std::chrono::steady_clock::now();
+  if (!writeColumns(log, outDir, indexStep, jobs, error)) {
+    fprintf(stderr, "columns: %s\n", error.c_str());
+    return 1;
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+  printf("columns: %zu records of %zu columns written to %s in %.3f s (%.1f M values/s), %d jobs\n", log.records,
+         log.types.size(), outDir.c_str(), seconds, log.records * log.types.size() / seconds / 1e6, jobs);
+
+  if (check and !checkColumns(log, outDir)) {
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,132 @@
+/*
+ * Checks the loop watchdog (see LoopWatchdog) on the simulator (see Flight.h) by slowing down the HAL's IMU and SD card.
+ *
+ * The drone hovers through two stalls. In the first each loop is slowed a little, and each log write, done while the loop
+ * waits for the next tick, runs past the tick. The loops only overrun while every loop is logged, so leaving loops out of
+ * the log should be enough. In the second each loop takes longer than the loop time, so only the reduced loop rate fits. After each stall the watchdog should
+ * climb back to full rate one level at a time.
+ *
+ *   overrun [--dir output directory] [--seed n] [--max-tilt degrees]
+ *
+ * The level of each logged loop is read back from the log. Exits with 1 if a stall does not reach the expected level,
+ * if the level is not back to 0 at the end, if a level change is missing from the log, or if the drone crashes or tilts
+ * more than --max-tilt.
+ */
+#include "Flight.h"
+#include "FlightLog.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <vector>
+
+///Hover through a stall relieved by logging less, then one which needs the reduced loop rate
+static const char stallScript[] =
+  "0 pot .8\n"
+  "1.5 sticks 0 0 -55 0\n"
+  "3 stall 350 200 3\n"
+  "9 stall 700 0 3\n"
+  "18 end\n";
+
+/**
+ * @struct Stall
+ * @brief Part of the flight and the deepest level the watchdog should reach in it
+ */
+struct Stall {
+  ///Start and end of the stall (s of flight)
+  float start, end;
+  ///Deepest level expected
+  int level;
+};
+
+int main(int argc, char **argv) {
+  FlightOptions options;
+  options.dir = "overrun_out";
+  float tiltLimit = 180;
+  bool valid = true;
+  for (int i=1; i<argc and valid; i++) {
+    if (!strcmp(argv[i], "--dir") and i+1 < argc) {
+      options.dir = argv[++i];
+    } else if (!strcmp(argv[i], "--seed") and i+1 < argc) {
+      options.seed = strtoul(argv[++i], nullptr, 0);
+    } else if (!strcmp(argv[i], "--max-tilt") and i+1 < argc) {
+      tiltLimit = atof(argv[++i]);
+    } else {
+      valid = false;
+    }
+  }
+  if (!valid) {
+    fprintf(stderr, "usage: %s [--dir output directory] [--seed n] [--max-tilt degrees]\n", argv[0]);
+    return 2;
+  }
+  std::string error;
+  if (!parseScript(stallScript, options.script, error)) {
+    fprintf(stderr, "%s\n", error.c_str());
+    return 2;
+  }
+  mkdir(options.dir.c_str(), 0755);
+  if (!writeSettings(options.dir, "", true)) {
+    fprintf(stderr, "cannot write to %s\n", options.dir.c_str());
+    return 2;
+  }
+
+  FlightResult flight = runFlight(options);
+  FlightLog log;
+  if (!flight.finished or !log.load(options.dir, error)) {
+    fprintf(stderr, "overrun: the flight did not finish %s\n", error.c_str());
+    return 1;
+  }
+  int timeColumn = log.find("Time (μs)");
+  int levelColumn = log.find("Degradation");
+  if (timeColumn < 0 or levelColumn < 0) {
+    fprintf(stderr, "overrun: the log has no time or degradation level\n");
+    return 1;
+  }
+
+  //Follow the level through the log
+  std::vector<Stall> stalls = {{3, 6, 1}, {9, 12, 3}};
+  std::vector<int> deepest(stalls.size(), 0);
+  int changes = 0;
+  int level = 0;
+  for (size_t r=0; r<log.records; r++) {
+    double time = log.raw(r, timeColumn) / 1e6;
+    int now = log.raw(r, levelColumn);
+    changes += now != level;
+    level = now;
+    for (size_t s=0; s<stalls.size(); s++) {
+      if (time >= stalls[s].start and time < stalls[s].end) {
+        deepest[s] = std::max(deepest[s], now);
+      }
+    }
+  }
+
+  //The firmware counts the changes in the summary at the end of the log
+  std::string text;
+  readAll(options.dir + "/log_0.csv", text);
+  size_t summary = text.find("Watchdog,Level changes,");
+  int counted = summary == std::string::npos ? -1 : atoi(text.c_str() + summary + strlen("Watchdog,Level changes,"));
+
+  bool pass = true;
+  for (size_t s=0; s<stalls.size(); s++) {
+    printf("overrun: stall %zu (%.0f - %.0f s) reached level %d, expected %d\n", s+1, stalls[s].start, stalls[s].end,
+           deepest[s], stalls[s].level);
+    pass &= deepest[s] == stalls[s].level;
+  }
+  printf("overrun: level %d at the end, %d changes in the log, %d counted by the firmware, max tilt %.1f°\n", level,
+         changes, counted, flight.maxTilt);
+  if (level != 0) {
+    fprintf(stderr, "overrun: the watchdog did not recover\n");
+    pass = false;
+  }
+  if (changes != counted) {
+    fprintf(stderr, "overrun: level changes are missing from the log\n");
+    pass = false;
+  }
+  if (flight.maxTilt > tiltLimit) {
+    fprintf(stderr, "overrun: the drone tilted %.1f°, more than %.1f°\n", flight.maxTilt, tiltLimit);
+    pass = false;
+  }
+  return pass ? 0 : 1;
+}
@@ -0,0 +1,230 @@
+/*
+ * Checks the averaging of several IMUs (see IMU::fuseSensors) end to end on the simulator (see Flight.h).
+ *
+ * The drone hovers once with one IMU and once with redundantIMUs, each with its own noise, with the same seed. The noise
+ * of the logged gyroscope readings is the RMS change between new readings while hovering, which the motion hardly
+ * changes, so with several IMUs it should drop by about the square root of their number. Halfway through the gyroscope
+ * of one of the IMUs fails with a large offset, which should leave it out of the average without upsetting the drone.
+ * Each flight runs in its own process, as the firmware keeps its state in globals.
+ *
+ *   redundancy [--dir output directory] [--seed n] [--max-tilt degrees]
+ *
+ * The flights are in single/ and fused/ in the output directory. Exits with 1 if the noise does not drop below
+ * maxNoiseRatio of one IMU's, if the failed IMU is not left out for most of the fault or a working one is left out, or
+ * if the drone crashes or tilts more than --max-tilt.
+ */
+#include "Flight.h"
+#include "FlightLog.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+///Number of IMUs averaged in the second flight
+static const int redundantIMUs = 3;
+///IMU which fails, and when and for how long (s)
+static const int faultyIMU = 1;
+static const float faultStart = 6, faultLength = 3;
+///Noise of the average of the IMUs allowed, as a part of one IMU's
+static const double maxNoiseRatio = .75;
+///Part of the readings of the failed IMU during the fault which have to be left out
+static const double minRejected = .9;
+///Part of the readings of a working IMU which can be left out
+static const double maxFalseRejected = .01;
+///Gyroscope noise of each IMU (degrees per second), more than the model's default so it is more than the vibration
+static const float gyroNoise = 1;
+
+///Hover, with one gyroscope failing with a 30°/s offset when there are several IMUs
+static const char hoverScript[] =
+  "0 pot .8\n"
+  "1.5 sticks 0 0 -55 0\n"
+  "6 fault 1 30 3\n"
+  "12 end\n";
+
+/**
+ * @struct FlownResult
+ * @brief Outcome of a flight flown in a child process
+ */
+struct FlownResult {
+  ///Whether the firmware finished the flight
+  bool finished;
+  ///Largest roll or pitch while off the ground (degrees)
+  float maxTilt;
+};
+
+/** Flies the hover script in a child process on a fresh SD card
+ *
+ *  @param[in] dir Directory of the SD card, the files of an earlier flight are removed
+ *  @param[in] imuCount Number of IMUs
+ *  @param[in] seed Seed of the sensor noise
+ *  @param[out] result Outcome of the flight
+ *  @returns false if the flight could not be run
+ */
+static bool fly(const std::string &dir, int imuCount, uint32_t seed, FlownResult &result) {
+  FlightOptions options;
+  options.dir = dir;
+  options.seed = seed;
+  options.imuCount = imuCount;
+  options.params.gyroNoise = gyroNoise;
+  options.writeTruth = false;
+  std::string error;
+  if (!parseScript(hoverScript, options.script, error)) {
+    fprintf(stderr, "%s\n", error.c_str());
+    return false;
+  }
+  mkdir(dir.c_str(), 0755);
+  const char *files[] = {"imuCal.bin", "imuState.bin", "log.bin", "log_0.csv"};
+  for (const char *file : files) {
+    remove((dir + "/" + file).c_str());
+  }
+  if (!writeSettings(dir, "\"imuCount\": " + std::to_string(imuCount), true)) {
+    fprintf(stderr, "cannot write to %s\n", dir.c_str());
+    return false;
+  }
+
+  int fds[2];
+  if (pipe(fds) != 0) {
+    return false;
+  }
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+    FlightResult flight = runFlight(options);
+    FlownResult flown = {flight.finished, flight.maxTilt};
+    _exit(write(fds[1], &flown, sizeof(flown)) == sizeof(flown) ? 0 : 1);
+  }
+  close(fds[1]);
+  int status;
+  bool flown = pid > 0 and waitpid(pid, &status, 0) == pid and WIFEXITED(status) and WEXITSTATUS(status) == 0
+               and read(fds[0], &result, sizeof(result)) == sizeof(result);
+  close(fds[0]);
+  return flown;
+}
+
+/** Gets the RMS change of the logged gyroscope between new readings (degrees per second) from start to end (s) */
+static bool gyroNoiseOf(const std::string &dir, double start, double end, double &noise) {
+  FlightLog log;
+  std::string error;
+  if (!log.load(dir, error)) {
+    fprintf(stderr, "%s\n", error.c_str());
+    return false;
+  }
+  const char *names[] = {"Time (μs)", "New sample", "Gyro x", "Gyro y", "Gyro z"};
+  int column[5];
+  for (int i=0; i<5; i++) {
+    column[i] = log.find(names[i]);
+    if (column[i] < 0) {
+      fprintf(stderr, "%s/log_0.csv has no \"%s\" column\n", dir.c_str(), names[i]);
+      return false;
+    }
+  }
+  double sum = 0;
+  long count = 0;
+  int32_t last[3];
+  bool haveLast = false;
+  for (size_t r=0; r<log.records; r++) {
+    double time = log.raw(r, column[0]) / 1e6;
+    if (time < start or time >= end or !log.raw(r, column[1])) {
+      continue;
+    }
+    for (int i=0; i<3; i++) {
+      int32_t gyro = log.raw(r, column[2 + i]);
+      if (haveLast) {
+        double change = (gyro - last[i]) * 250.0 / 32768;
+        sum += change * change;
+        count++;
+      }
+      last[i] = gyro;
+    }
+    haveLast = true;
+  }
+  noise = count > 0 ? sqrt(sum / count) : 0;
+  return count > 0;
+}
+
+int main(int argc, char **argv) {
+  std::string dir = "redundancy_out";
+  uint32_t seed = 1;
+  float tiltLimit = 180;
+  bool valid = true;
+  for (int i=1; i<argc and valid; i++) {
+    if (!strcmp(argv[i], "--dir") and i+1 < argc) {
+      dir = argv[++i];
+    } else if (!strcmp(argv[i], "--seed") and i+1 < argc) {
+      seed = strtoul(argv[++i], nullptr, 0);
+    } else if (!strcmp(argv[i], "--max-tilt") and i+1 < argc) {
+      tiltLimit = atof(argv[++i]);
+    } else {
+      valid = false;
+    }
+  }
+  if (!valid) {
+    fprintf(stderr, "usage: %s [--dir output directory] [--seed n] [--max-tilt degrees]\n", argv[0]);
+    return 2;
+  }
+  if (mkdir(dir.c_str(), 0755) != 0 and errno != EEXIST) {
+    fprintf(stderr, "cannot create %s\n", dir.c_str());
+    return 2;
+  }
+
+  FlownResult single, fused;
+  if (!fly(dir + "/single", 1, seed, single) or !single.finished) {
+    fprintf(stderr, "the flight with one IMU did not finish\n");
+    return 1;
+  }
+  if (!fly(dir + "/fused", redundantIMUs, seed, fused) or !fused.finished) {
+    fprintf(stderr, "the flight with %d IMUs did not finish\n", redundantIMUs);
+    return 1;
+  }
+
+  //Compare the noise while hovering before the fault
+  double singleNoise, fusedNoise;
+  if (!gyroNoiseOf(dir + "/single", 3, faultStart, singleNoise) or !gyroNoiseOf(dir + "/fused", 3, faultStart, fusedNoise)) {
+    return 1;
+  }
+  double ratio = fusedNoise / singleNoise;
+  printf("redundancy: gyroscope noise %.3f°/s with 1 IMU, %.3f°/s with %d (%.2f, 1/√%d is %.2f)\n", singleNoise,
+         fusedNoise, redundantIMUs, ratio, redundantIMUs, 1 / sqrt(redundantIMUs));
+  bool pass = true;
+  if (ratio > maxNoiseRatio) {
+    fprintf(stderr, "redundancy: averaging the IMUs only brought the noise down to %.2f of one IMU's\n", ratio);
+    pass = false;
+  }
+
+  //The firmware counts the readings of each IMU which were left out in the summary at the end of the log
+  std::string text;
+  readAll(dir + "/fused/log_0.csv", text);
+  size_t line = text.find("\nIMU,Address,");
+  for (int s=0; s<redundantIMUs; s++) {
+    line = line == std::string::npos ? line : text.find("\n,", line + 1);
+    int address = 0;
+    long readings = 0, rejected = 0;
+    if (line == std::string::npos or sscanf(text.c_str() + line, "\n,%d,%ld,%ld", &address, &readings, &rejected) != 3) {
+      fprintf(stderr, "redundancy: IMU %d is missing from the summary at the end of the log\n", s);
+      return 1;
+    }
+    printf("redundancy: IMU %d at 0x%02X, %ld readings, %ld left out\n", s, address, readings, rejected);
+    //The IMUs are read at 200 Hz
+    if (s == faultyIMU and rejected < minRejected * faultLength * 200) {
+      fprintf(stderr, "redundancy: the failed IMU was only left out of %ld readings\n", rejected);
+      pass = false;
+    } else if (s != faultyIMU and rejected > maxFalseRejected * readings) {
+      fprintf(stderr, "redundancy: IMU %d was left out of %ld readings while working\n", s, rejected);
+      pass = false;
+    }
+  }
+
+  printf("redundancy: max tilt %.1f° with 1 IMU, %.1f° with %d\n", single.maxTilt, fused.maxTilt, redundantIMUs);
+  if (fused.maxTilt > tiltLimit) {
+    fprintf(stderr, "redundancy: the drone tilted %.1f° with %d IMUs, more than %.1f°\n", fused.maxTilt, redundantIMUs,
+            tiltLimit);
+    pass = false;
+  }
+  return pass ? 0 : 1;
+}
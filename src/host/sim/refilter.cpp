@@ -0,0 +1,316 @@
+/*
+ * Chooses the settings of the angle estimate (beta, zeta and kalmanParams, see IMU.h) by running it over a recorded
+ * flight with every combination of a grid of settings (see BatchEstimator.h).
+ *
+ * The estimated roll and pitch are compared to a reference, by default the true angles in truth.csv of a simulated
+ * flight (see sitl.cpp), or the logged angles with --reference log. Each range is "min max count", spaced evenly on a
+ * log scale, and the firmware's default settings are always included.
+ *
+ *   refilter --dir flight directory [--reference truth|log] [--beta min max count] [--zeta min max count]
+ *            [--measurement-error min max count] [--process-noise min max count] [--jobs n] [--top n] [--out file]
+ *            [--check]
+ *
+ * The ranking of every combination is written to --out. With --check the batch estimate is compared to the firmware's
+ * IMU class for a few of the combinations, and exits with 1 if they differ by more than maxScalarDiff.
+ */
+#include "BatchEstimator.h"
+#include "FlightLog.h"
+#include "IMU.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <numeric>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+
+/* Settings */
+///Largest difference allowed between the batch and firmware angles with --check (degrees)
+const float maxScalarDiff = .01;
+///Number of parameter sets run through the firmware's IMU class with --check
+const int scalarChecks = 4;
+/* Settings */
+
+//Symbols the modules take from drone.ino
+extern const int lightPin = 5;
+extern const int loopRate = 2000; //Only sizes the log file, which is not written here
+
+///Loop time given to the firmware (μs)
+static unsigned long replayLoopTime = 0;
+
+void blink(int d) {
+  delay(d);
+  delay(d);
+}
+
+float loopTime() {
+  return replayLoopTime / 1000.0;
+}
+
+/**
+ * @struct Range
+ * @brief Values of one setting in the grid
+ */
+struct Range {
+  float min, max;
+  int count;
+};
+
+/** Gets the values of a range, evenly spaced on a log scale */
+static std::vector<float> rangeValues(const Range &range) {
+  std::vector<float> values;
+  for (int i=0; i<range.count; i++) {
+    values.push_back(range.count == 1 ? range.min : range.min * pow(range.max / range.min, (double)i / (range.count - 1)));
+  }
+  return values;
+}
+
+/** Sets the reference to the true angles of a simulated flight, interpolated to the time of each loop */
+static bool loadTruth(const std::string &dir, const FlightLog &log, EstimatorInput &input, std::string &error) {
+  std::string text;
+  if (!readAll(dir + "/truth.csv", text)) {
+    error = "cannot open " + dir + "/truth.csv, use --reference log for flights which were not simulated";
+    return false;
+  }
+  std::vector<float> times, angles[2];
+  size_t start = text.find('\n');
+  while (start != std::string::npos and start + 1 < text.size()) {
+    float time, roll, pitch;
+    if (sscanf(text.c_str() + start + 1, "%f,%f,%f", &time, &roll, &pitch) == 3) {
+      times.push_back(time);
+      angles[0].push_back(roll);
+      angles[1].push_back(pitch);
+    }
+    start = text.find('\n', start + 1);
+  }
+
+  int timeColumn = log.find("Time (μs)");
+  size_t k = 0;
+  for (size_t r=0; r<log.records; r++) {
+    float time = log.value(r, timeColumn) / 1e6;
+    while (k + 1 < times.size() and times[k + 1] < time) {
+      k++;
+    }
+    bool inside = k + 1 < times.size() and times[k] <= time;
+    input.scored[r] = inside;
+    if (inside) {
+      float fraction = (time - times[k]) / (times[k + 1] - times[k]);
+      for (int i=0; i<2; i++) {
+        input.reference[i][r] = angles[i][k] + fraction * (angles[i][k + 1] - angles[i][k]);
+      }
+    }
+  }
+  return true;
+}
+
+/** Runs the firmware's estimate over the log for one parameter set
+ *
+ *  @param[in] log Flight log
+ *  @param[in] params Parameter set
+ *  @param[out] angles Roll and pitch of each loop
+ */
+static void runScalar(const FlightLog &log, const EstimatorParams &params, std::vector<float> &angles) {
+  const char *names[] = {"Time (μs)", "Accel x", "Accel y", "Accel z", "Gyro x", "Gyro y", "Gyro z", "New sample"};
+  int column[8];
+  for (int i=0; i<8; i++) {
+    column[i] = log.find(names[i]);
+  }
+
+  Logger logger;
+  IMU imu;
+  SharedState<AttitudeState> attitude;
+  logger.init();
+  imu.init(logger);
+  imu.beta = params.beta;
+  imu.zeta = params.zeta;
+  imu.kalmanParams[0] = params.measurementError;
+  imu.kalmanParams[2] = params.processNoise;
+  imu.loadEstimator(logger);
+
+  angles.assign(log.records * 2, 0);
+  uint32_t lastTime = 0;
+  unsigned long lastLoopTime = 0;
+  for (size_t r=0; r<log.records; r++) {
+    int16_t accel[3], gyro[3];
+    for (int i=0; i<3; i++) {
+      accel[i] = log.raw(r, column[1 + i]);
+      gyro[i] = log.raw(r, column[4 + i]);
+    }
+    hal::imuRaw(accel, gyro, log.raw(r, column[7]));
+    replayLoopTime = lastLoopTime;
+    imu.updateAngle(attitude);
+    uint32_t time = log.raw(r, column[0]);
+    lastLoopTime = time - lastTime;
+    lastTime = time;
+    angles[r*2] = attitude.get().angle[0];
+    angles[r*2 + 1] = attitude.get().angle[1];
+  }
+}
+
+/** Gets the settings of a parameter set as settings.json entries, the starting estimate error is not changed */
+static std::string paramsJson(const EstimatorParams &params, float estimateError) {
+  char text[160];
+  snprintf(text, sizeof(text), "\"beta\": %.4g, \"zeta\": %.4g, \"kalmanParams\": [%.4g, %.4g, %.4g]",
+           params.beta, params.zeta, params.measurementError, estimateError, params.processNoise);
+  return text;
+}
+
+int main(int argc, char **argv) {
+  std::string dir;
+  bool logReference = false;
+  IMU defaults;
+  EstimatorParams current = {defaults.beta, defaults.zeta, defaults.kalmanParams[0], defaults.kalmanParams[2]};
+  Range beta = {current.beta / 4, current.beta * 4, 5};
+  Range zeta = {current.zeta / 4, current.zeta * 4, 5};
+  Range measurementError = {.1, 2, 4};
+  Range processNoise = {.1, 2, 4};
+  int jobs = std::max(1u, std::thread::hardware_concurrency());
+  int top = 5;
+  const char *outFile = nullptr;
+  bool check = false;
+  bool valid = true;
+  for (int i=1; i<argc and valid; i++) {
+    Range *range = !strcmp(argv[i], "--beta") ? &beta : !strcmp(argv[i], "--zeta") ? &zeta
+                 : !strcmp(argv[i], "--measurement-error") ? &measurementError
+                 : !strcmp(argv[i], "--process-noise") ? &processNoise : nullptr;
+    if (range and i+3 < argc) {
+      range->min = atof(argv[i+1]);
+      range->max = atof(argv[i+2]);
+      range->count = atoi(argv[i+3]);
+      valid = range->min > 0 and range->max > 0 and range->count > 0;
+      i += 3;
+    } else if (!strcmp(argv[i], "--dir") and i+1 < argc) {
+      dir = argv[++i];
+    } else if (!strcmp(argv[i], "--reference") and i+1 < argc) {
+      i++;
+      logReference = !strcmp(argv[i], "log");
+      valid = logReference or !strcmp(argv[i], "truth");
+    } else if (!strcmp(argv[i], "--jobs") and i+1 < argc) {
+      jobs = std::max(1, atoi(argv[++i]));
+    } else if (!strcmp(argv[i], "--top") and i+1 < argc) {
+      top = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--out") and i+1 < argc) {
+      outFile = argv[++i];
+    } else if (!strcmp(argv[i], "--check")) {
+      check = true;
+    } else {
+      valid = false;
+    }
+  }
+  if (dir.empty() or !valid) {
+    fprintf(stderr, "usage: %s --dir flight directory [--reference truth|log] [--beta min max count] [--zeta min max count]\n"
+            "       [--measurement-error min max count] [--process-noise min max count] [--jobs n] [--top n] [--out file] [--check]\n", argv[0]);
+    return 2;
+  }
+
+  //Read the flight
+  FlightLog log;
+  std::string error;
+  std::string estimator;
+  EstimatorState state;
+  EstimatorInput input;
+  if (!log.load(dir, error)) {
+    fprintf(stderr, "%s\n", error.c_str());
+    return 1;
+  }
+  if (!readAll(dir + "/" + estimatorFile, estimator) or estimator.size() != sizeof(state)) {
+    fprintf(stderr, "cannot read %s/%s\n", dir.c_str(), estimatorFile);
+    return 1;
+  }
+  memcpy(&state, estimator.data(), sizeof(state));
+  if (!makeEstimatorInput(log, state, input, error) or (!logReference and !loadTruth(dir, log, input, error))) {
+    fprintf(stderr, "%s\n", error.c_str());
+    return 1;
+  }
+
+  //Every combination of the ranges, after the current settings
+  std::vector<EstimatorParams> params = {current};
+  for (float b : rangeValues(beta)) {
+    for (float z : rangeValues(zeta)) {
+      for (float m : rangeValues(measurementError)) {
+        for (float p : rangeValues(processNoise)) {
+          params.push_back({b, z, m, p});
+        }
+      }
+    }
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<EstimatorError> errors = runEstimators(input, params, jobs);
+  double batchTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  //Time the firmware's estimate, and check the batch estimate against it
+  std::string scratchDir = dir + "/refilter";
+  mkdir(scratchDir.c_str(), 0755);
+  if (!writeAll(scratchDir + "/" + estimatorFile, estimator)) {
+    fprintf(stderr, "cannot write to %s\n", scratchDir.c_str());
+    return 1;
+  }
+  hal::storageDir = scratchDir;
+  Serial.redirect(nullptr);
+  std::vector<EstimatorParams> checked;
+  for (int i=0; i<(check ? scalarChecks : 1); i++) {
+    checked.push_back(params[i * (params.size() - 1) / std::max(1, scalarChecks - 1)]);
+  }
+  std::vector<std::vector<float>> batchAngles;
+  runEstimators(input, checked, 1, &batchAngles);
+  float maxDiff = 0;
+  double scalarTime = 0;
+  for (size_t i=0; i<checked.size(); i++) {
+    std::vector<float> scalarAngles;
+    start = std::chrono::steady_clock::now();
+    runScalar(log, checked[i], scalarAngles);
+    scalarTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    for (size_t k=0; k<scalarAngles.size(); k++) {
+      maxDiff = std::max(maxDiff, fabsf(scalarAngles[k] - batchAngles[i][k]));
+    }
+  }
+  scalarTime /= checked.size();
+
+  //Rank the parameter sets
+  std::vector<size_t> order(params.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return errors[a].cost < errors[b].cost;
+  });
+  if (outFile) {
+    FILE *out = fopen(outFile, "w");
+    if (!out) {
+      fprintf(stderr, "cannot open %s\n", outFile);
+      return 1;
+    }
+    fprintf(out, "Rank,beta,zeta,Measurement error,Process noise,Cost (°),Roll RMS (°),Pitch RMS (°),Roll max (°),Pitch max (°)\n");
+    for (size_t rank=0; rank<order.size(); rank++) {
+      const EstimatorParams &p = params[order[rank]];
+      const EstimatorError &e = errors[order[rank]];
+      fprintf(out, "%zu,%g,%g,%g,%g,%.4f,%.4f,%.4f,%.3f,%.3f\n", rank + 1, p.beta, p.zeta, p.measurementError, p.processNoise,
+              e.cost, e.rms[0], e.rms[1], e.max[0], e.max[1]);
+    }
+    fclose(out);
+  }
+
+  size_t loops = input.dt.size();
+  printf("refilter: %zu parameter sets over %zu loops against the %s angles, %d jobs\n",
+         params.size(), loops, logReference ? "logged" : "true", jobs);
+  printf("refilter: batch %.3f s (%.1f M loops/s), firmware IMU class %.3f s per set, %.0fx faster\n",
+         batchTime, params.size() * loops / batchTime / 1e6, scalarTime, scalarTime * params.size() / batchTime);
+  printf("refilter: current settings, cost %.4f°, roll RMS %.4f° max %.3f°, pitch RMS %.4f° max %.3f°\n",
+         errors[0].cost, errors[0].rms[0], errors[0].max[0], errors[0].rms[1], errors[0].max[1]);
+  for (int rank=0; rank<top and rank<(int)order.size(); rank++) {
+    const EstimatorError &e = errors[order[rank]];
+    printf("refilter: %d. cost %.4f°, roll RMS %.4f°, pitch RMS %.4f°, %s\n", rank + 1, e.cost, e.rms[0], e.rms[1],
+           paramsJson(params[order[rank]], defaults.kalmanParams[1]).c_str());
+  }
+  printf("refilter: largest difference from the firmware IMU class over %zu sets %.2g°\n", checked.size(), maxDiff);
+  if (check and !(maxDiff <= maxScalarDiff)) {
+    fprintf(stderr, "refilter: the batch estimate differs from the firmware by more than %g°\n", maxScalarDiff);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,279 @@
+/*
+ * Replays a flight log through the firmware's angle estimate and PID controller, much faster than real time.
+ *
+ * The firmware logs the raw IMU readings, the sticks and the timestamp of every loop (see drone.ino), and stores the
+ * state of the angle estimate when the flight starts (see IMU::saveEstimator). The logged readings are fed back into
+ * IMU::updateAngle() and PIDcontroller::calcPID() with the logged loop times and gain schedule inputs, and the
+ * recalculated angles, PID outputs and gain multipliers are compared with the logged ones. With unchanged code and
+ * settings they should be identical, so a change to the estimator or controller can be checked against real flights
+ * (A/B testing) without flying.
+ *
+ * The log is read from log.bin and the column names from log_0.csv. The flight directory is not changed, the settings
+ * and estimator state are copied to a "replay" directory inside it, which acts as the SD card.
+ *
+ *   replay --dir flight directory [--settings file] [--out file] [--check] [--quiet]
+ *
+ * --settings replays with a different settings.json, --out writes the logged and recalculated values to a CSV file.
+ * With --check, exits with 1 if any recalculated value is different from the logged one. The replay stops where the
+ * loop watchdog started leaving loops out of the log (see LoopWatchdog), as the readings of those loops are lost.
+ */
+#include "FlightLog.h"
+#include "IMU.h"
+#include "Logger.h"
+#include "PIDcontroller.h"
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+//Symbols the modules take from drone.ino
+extern const int lightPin = 5;
+extern const int loopRate = 2000; //Only sizes the log file, which is not written here
+
+///Loop time given to the firmware (μs)
+static unsigned long replayLoopTime = 0;
+
+void blink(int d) {
+  delay(d);
+  delay(d);
+}
+
+float loopTime() {
+  return replayLoopTime / 1000.0;
+}
+
+/**
+ * @struct Column
+ * @brief A logged value which is recalculated, with the type it was logged with
+ */
+struct Column {
+  ///Name in the log
+  const char *name;
+  ///Index of the variable in each record, -1 if not logged
+  int index;
+  ///Number of records where the recalculated value is different
+  long mismatches;
+  ///Largest difference from the logged value
+  double maxDiff;
+};
+
+int main(int argc, char **argv) {
+  std::string dir;
+  const char *settingsFile = nullptr;
+  const char *outFile = nullptr;
+  bool check = false;
+  bool quiet = false;
+  for (int i=1; i<argc; i++) {
+    if (!strcmp(argv[i], "--dir") and i+1 < argc) {
+      dir = argv[++i];
+    } else if (!strcmp(argv[i], "--settings") and i+1 < argc) {
+      settingsFile = argv[++i];
+    } else if (!strcmp(argv[i], "--out") and i+1 < argc) {
+      outFile = argv[++i];
+    } else if (!strcmp(argv[i], "--check")) {
+      check = true;
+    } else if (!strcmp(argv[i], "--quiet")) {
+      quiet = true;
+    } else {
+      dir.clear();
+      break;
+    }
+  }
+  if (dir.empty()) {
+    fprintf(stderr, "usage: %s --dir flight directory [--settings file] [--out file] [--check] [--quiet]\n", argv[0]);
+    return 2;
+  }
+
+  FlightLog log;
+  std::string error;
+  if (!log.load(dir, error)) {
+    fprintf(stderr, "%s\n", error.c_str());
+    return 1;
+  }
+
+  //Find the inputs and outputs in the log
+  const char *inputNames[] = {"Time (μs)", "Roll input", "Pitch input", "Vertical input", "Yaw input",
+                              "Accel x", "Accel y", "Accel z", "Gyro x", "Gyro y", "Gyro z", "New sample", "Resumed"};
+  const int inputCount = sizeof(inputNames) / sizeof(inputNames[0]);
+  int input[inputCount];
+  for (int i=0; i<inputCount; i++) {
+    input[i] = log.find(inputNames[i]);
+    if (input[i] < 0) {
+      fprintf(stderr, "the log has no \"%s\" column, it was written by older firmware\n", inputNames[i]);
+      return 1;
+    }
+  }
+  std::vector<Column> columns = {{"roll"}, {"pitch"}, {"yaw"}, {"Pr"}, {"Pp"}, {"Ir"}, {"Ip"}, {"Dr"}, {"Dp"},
+                                 {"P scale"}, {"I scale"}, {"D scale"}, {"D cutoff scale"}};
+  for (Column &column : columns) {
+    column.index = log.find(column.name);
+  }
+  //Logs from before the gain schedule have no throttle or voltage, their gains were not scaled
+  int throttleColumn = log.find("Throttle");
+  int voltageColumn = log.find("Battery (V)");
+  int degradationColumn = log.find("Degradation");
+  //Logs from before the integral was held on saturated motors have no saturation
+  int saturatedColumn = log.find("Saturated");
+
+  //Use a copy of the flight's settings and starting state, so the flight's files are left as they are
+  std::string replayDir = dir + "/replay";
+  mkdir(replayDir.c_str(), 0755);
+  std::string settings, estimator;
+  if (!readAll(settingsFile ? settingsFile : dir + "/settings.json", settings)) {
+    settings = "{}";
+  }
+  if (!readAll(dir + "/" + estimatorFile, estimator)) {
+    fprintf(stderr, "cannot open %s/%s\n", dir.c_str(), estimatorFile);
+    return 1;
+  }
+  remove((replayDir + "/log_0.csv").c_str());
+  remove((replayDir + "/" + autoTuneFile).c_str());
+  //The gains of an auto-tune are only used if the flight loaded them at startup, a tuning flight stores them at the end
+  std::string header, tuned;
+  bool hasTuned = readAll(dir + "/log_0.csv", header) and header.find("tunedGainsLoaded,1") != std::string::npos
+                  and readAll(dir + "/" + autoTuneFile, tuned);
+  if (!writeAll(replayDir + "/settings.json", settings) or !writeAll(replayDir + "/" + estimatorFile, estimator)
+      or (hasTuned and !writeAll(replayDir + "/" + autoTuneFile, tuned))) {
+    fprintf(stderr, "cannot write to %s\n", replayDir.c_str());
+    return 1;
+  }
+
+  //Set up the modules like setup() does, then continue from the stored state of the estimate
+  hal::storageDir = replayDir;
+  Serial.redirect(nullptr);
+  Logger logger;
+  IMU imu;
+  PIDcontroller pid;
+  SharedState<AttitudeState> attitude;
+  logger.init();
+  pid.init(logger);
+  if (imu.init(logger) or !imu.loadEstimator(logger)) {
+    fprintf(stderr, "%s/%s is not valid for this IMU type\n", dir.c_str(), estimatorFile);
+    return 1;
+  }
+
+  FILE *out = nullptr;
+  if (outFile) {
+    out = fopen(outFile, "w");
+    if (!out) {
+      fprintf(stderr, "cannot open %s\n", outFile);
+      return 1;
+    }
+    fprintf(out, "Time (μs)");
+    for (const Column &column : columns) {
+      fprintf(out, ",%s,%s (replay)", column.name, column.name);
+    }
+    fprintf(out, "\n");
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  uint32_t lastTime = 0;
+  unsigned long lastLoopTime = 0;
+  size_t replayedRecords = log.records;
+  for (size_t r=0; r<log.records; r++) {
+    if (degradationColumn >= 0 and log.raw(r, degradationColumn) > 0) {
+      replayedRecords = r;
+      break;
+    }
+    int32_t value[inputCount];
+    for (int i=0; i<inputCount; i++) {
+      value[i] = log.raw(r, input[i]);
+    }
+    RcCommand rc = {};
+    for (int i=0; i<4; i++) {
+      rc.xyzr[i] = value[1 + i];
+    }
+    int16_t accel[3], gyro[3];
+    for (int i=0; i<3; i++) {
+      accel[i] = value[5 + i];
+      gyro[i] = value[8 + i];
+    }
+    hal::imuRaw(accel, gyro, value[11]);
+
+    //The controller is reset while on standby
+    if (value[12]) {
+      pid.reset();
+    }
+
+    //The angle is updated before the loop's timestamp, so it gets the time of the loop before
+    replayLoopTime = lastLoopTime;
+    imu.updateAngle(attitude);
+    replayLoopTime = (uint32_t)value[0] - lastTime;
+    if (throttleColumn >= 0 and voltageColumn >= 0) {
+      pid.scheduleGains(log.value(r, throttleColumn), log.value(r, voltageColumn));
+    }
+    pid.calcPID(attitude.get(), rc, saturatedColumn >= 0 and log.raw(r, saturatedColumn));
+    lastLoopTime = replayLoopTime;
+    lastTime = value[0];
+
+    //Compare with the log
+    float recalculated[13] = {attitude.get().angle[0], attitude.get().angle[1], attitude.get().angle[2]};
+    for (int i=0; i<3; i++) {
+      for (int j=0; j<2; j++) {
+        recalculated[3 + i*2 + j] = qToFloat(pid.PIDchange[i][j]);
+      }
+    }
+    recalculated[9] = pid.gainScale.P;
+    recalculated[10] = pid.gainScale.I;
+    recalculated[11] = pid.gainScale.D;
+    recalculated[12] = pid.gainScale.dCutoff;
+    if (out) {
+      fprintf(out, "%u", (uint32_t)value[0]);
+    }
+    for (size_t c=0; c<columns.size(); c++) {
+      Column &column = columns[c];
+      if (column.index < 0) {
+        continue;
+      }
+      uint8_t type = log.types[column.index];
+      int32_t logged = log.raw(r, column.index);
+      int32_t replayed = quantise(recalculated[c], type);
+      if (replayed != logged) {
+        column.mismatches++;
+        column.maxDiff = fmax(column.maxDiff, fabs(toNumber(replayed, type) - toNumber(logged, type)));
+      }
+      if (out) {
+        fprintf(out, ",%g,%g", toNumber(logged, type), toNumber(replayed, type));
+      }
+    }
+    if (out) {
+      fprintf(out, "\n");
+    }
+  }
+  double wallTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  if (out) {
+    fclose(out);
+  }
+
+  //Report how closely the replay matched the flight
+  long mismatches = 0;
+  for (const Column &column : columns) {
+    mismatches += column.mismatches;
+  }
+  double flightTime = lastTime / 1e6;
+  if (!quiet) {
+    printf("Replayed %zu loops (%.1f s of flight) in %.3f s, %.0fx real time\n",
+           replayedRecords, flightTime, wallTime, flightTime / fmax(wallTime, 1e-9));
+    if (replayedRecords < log.records) {
+      printf("Stopped where the loop watchdog started leaving loops out of the log, %zu records were not replayed\n",
+             log.records - replayedRecords);
+    }
+    for (const Column &column : columns) {
+      if (column.index < 0) {
+        printf("%-6s not logged\n", column.name);
+      } else {
+        printf("%-6s %ld different, largest difference %g\n", column.name, column.mismatches, column.maxDiff);
+      }
+    }
+  }
+  if (check and mismatches > 0) {
+    fprintf(stderr, "replay differs from the log in %ld values\n", mismatches);
+    return 1;
+  }
+  return 0;
+}
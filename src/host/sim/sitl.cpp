@@ -0,0 +1,89 @@
+/*
+ * Software in the loop simulator. Flies the flight controller (drone.ino) against the drone model, see Flight.h.
+ *
+ * The firmware writes its usual files (log_0.csv, log.bin, imuCal.bin and imuState.bin) to the output directory, and reads settings.json from it.
+ * If there is no settings.json, one with the angle offsets set to zero is written. The true state of the drone is written to truth.csv.
+ *
+ *   sitl [--script file] [--dir output directory] [--seed n] [--max-tilt degrees] [--quiet]
+ *
+ * Exits with 1 if the firmware does not finish the flight, or the drone tilts more than --max-tilt while flying.
+ */
+#include "Flight.h"
+
+#include <chrono>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+int main(int argc, char **argv) {
+  const char *scriptFile = nullptr;
+  FlightOptions options;
+  bool quiet = false;
+  float tiltLimit = 180;
+  for (int i=1; i<argc; i++) {
+    if (!strcmp(argv[i], "--script") and i+1 < argc) {
+      scriptFile = argv[++i];
+    } else if (!strcmp(argv[i], "--dir") and i+1 < argc) {
+      options.dir = argv[++i];
+    } else if (!strcmp(argv[i], "--seed") and i+1 < argc) {
+      options.seed = strtoul(argv[++i], nullptr, 0);
+    } else if (!strcmp(argv[i], "--max-tilt") and i+1 < argc) {
+      tiltLimit = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--quiet")) {
+      quiet = true;
+    } else {
+      fprintf(stderr, "usage: %s [--script file] [--dir output directory] [--seed n] [--max-tilt degrees] [--quiet]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  //Load the script
+  std::string text = defaultScript;
+  if (scriptFile) {
+    FILE *file = fopen(scriptFile, "r");
+    if (!file) {
+      fprintf(stderr, "cannot open %s\n", scriptFile);
+      return 2;
+    }
+    text.clear();
+    char buf[256];
+    size_t len;
+    while ((len = fread(buf, 1, sizeof(buf), file)) > 0) {
+      text.append(buf, len);
+    }
+    fclose(file);
+  }
+  std::string error;
+  if (!parseScript(text, options.script, error)) {
+    fprintf(stderr, "%s\n", error.c_str());
+    return 2;
+  }
+
+  if ((mkdir(options.dir.c_str(), 0755) != 0 and errno != EEXIST) or !writeSettings(options.dir)) {
+    fprintf(stderr, "cannot write to %s\n", options.dir.c_str());
+    return 2;
+  }
+
+  auto wallStart = std::chrono::steady_clock::now();
+  FlightResult flight = runFlight(options);
+  double wallTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+
+  if (!flight.finished) {
+    fprintf(stderr, "the firmware did not finish the flight\n");
+    return 1;
+  }
+  if (!quiet) {
+    const FlightSample &last = flight.samples.back();
+    printf("sitl: %.1f s simulated (%.1f s flying) in %.2f s, %.0fx real time\n",
+           flight.simulatedTime, flight.flightTime, wallTime, flight.simulatedTime / wallTime);
+    printf("sitl: final position %.2f, %.2f, %.2f m, attitude %.1f, %.1f, %.1f°, max tilt %.1f°\n",
+           last.position[0], last.position[1], last.position[2], last.angle[0], last.angle[1], last.angle[2], flight.maxTilt);
+  }
+  if (flight.maxTilt > tiltLimit) {
+    fprintf(stderr, "the drone tilted %.1f°, more than %.1f°\n", flight.maxTilt, tiltLimit);
+    return 1;
+  }
+  return 0;
+}
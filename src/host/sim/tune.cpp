@@ -0,0 +1,427 @@
+/*
+ * Automatic PID gain tuning on the software in the loop simulator (see Flight.h).
+ *
+ * Each candidate set of Pgain, Igain and Dgain is flown through a script of stick steps and disturbances, and scored on its
+ * step response, angle error, motor saturation and motor noise (see StepResponse.h). CMA-ES (see Cmaes.h) searches the
+ * gains on a log scale within the ranges below. Flights run in separate processes, as the firmware keeps its state in
+ * globals, so the search scales with the number of cores.
+ *
+ * The best gains are written to settings.json in the output directory, ready to copy to the SD card, and every candidate
+ * is ranked in ranking.csv. The best gains are flown once more into best/, which holds the flight log and truth.csv.
+ *
+ *   tune [--dir output directory] [--generations n] [--population n] [--jobs n] [--seeds n] [--sigma s] [--script file]
+ */
+#include "Cmaes.h"
+#include "Flight.h"
+#include "PIDcontroller.h"
+#include "StepResponse.h"
+
+#include <algorithm>
+#include <chrono>
+#include <errno.h>
+#include <map>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+///Flight each candidate is scored on: take off, then step roll, pitch and yaw both ways and push the drone
+static const char tuneScript[] =
+  "0 pot .8\n"
+  "1.5 sticks 0 0 -55 0\n"
+  "3 sticks 50 0 -55 0\n"
+  "4 sticks -50 0 -55 0\n"
+  "5 sticks 0 0 -55 0\n"
+  "6 sticks 0 50 -55 0\n"
+  "7 sticks 0 -50 -55 0\n"
+  "8 sticks 0 0 -55 0\n"
+  "9 sticks 0 0 -55 80\n"
+  "10 sticks 0 0 -55 -80\n"
+  "11 sticks 0 0 -55 0\n"
+  "12 torque .15 .15 0 .05\n"
+  "13.5 end\n";
+
+/**
+ * @struct TunedGain
+ * @brief One gain being tuned, searched on a log scale between min and max
+ */
+struct TunedGain {
+  ///Setting name and index of the axis
+  const char *setting;
+  int axis;
+  ///Range of the search
+  float min, max;
+};
+
+///Gains being tuned, the Igain and yaw Dgain default to zero so the lowest value stands in for it
+static const TunedGain tunedGains[] = {
+  {"Pgain", 0, .05, 5}, {"Pgain", 1, .05, 5}, {"Pgain", 2, .1, 10},
+  {"Igain", 0, .01, 20}, {"Igain", 1, .01, 20}, {"Igain", 2, .01, 20},
+  {"Dgain", 0, .0002, .05}, {"Dgain", 1, .0002, .05}, {"Dgain", 2, .0001, .02}
+};
+static const int tunedCount = sizeof(tunedGains) / sizeof(tunedGains[0]);
+///Cost of the squared distance the search goes outside the ranges, the flight uses the nearest gains inside them
+static const double boundCost = 100;
+
+/**
+ * @struct Candidate
+ * @brief A set of gains and how it flew
+ */
+struct Candidate {
+  int generation;
+  float gains[tunedCount];
+  FlightScore score;
+};
+
+/** Converts a search point (0 - 1 within the range of each gain) into gains */
+static void toGains(const std::vector<double> &x, float gains[tunedCount]) {
+  for (int i=0; i<tunedCount; i++) {
+    double position = std::min(std::max(x[i], 0.0), 1.0);
+    gains[i] = tunedGains[i].min * pow(tunedGains[i].max / tunedGains[i].min, position);
+  }
+}
+
+/** Gets the search point of a gain, limited to its range */
+static double fromGain(int i, float gain) {
+  double position = log(gain / tunedGains[i].min) / log(tunedGains[i].max / tunedGains[i].min);
+  return std::min(std::max(position, 0.0), 1.0);
+}
+
+/** Writes the gains as JSON members of the settings file */
+static std::string gainsJson(const float gains[tunedCount]) {
+  std::string json;
+  const char *settings[] = {"Pgain", "Igain", "Dgain"};
+  for (int s=0; s<3; s++) {
+    char member[128];
+    float values[3] = {};
+    for (int i=0; i<tunedCount; i++) {
+      if (!strcmp(tunedGains[i].setting, settings[s])) {
+        values[tunedGains[i].axis] = gains[i];
+      }
+    }
+    snprintf(member, sizeof(member), "%s\"%s\": [%.4g, %.4g, %.4g]", s ? ",\n  " : "", settings[s], values[0], values[1], values[2]);
+    json += member;
+  }
+  return json;
+}
+
+/**
+ * @class FlightPool
+ * @brief Flies candidates in child processes, up to a number at the same time
+ */
+class FlightPool {
+  public:
+    FlightPool(const std::string &dir, int jobs, const FlightOptions &options, float maxAngle, float maxYawRate) :
+        dir(dir), jobs(jobs), options(options), maxAngle(maxAngle), maxYawRate(maxYawRate) {}
+
+    /** Flies each candidate on every seed and sets its score to the mean */
+    void fly(std::vector<Candidate*> &candidates, int seeds) {
+      //Each task is one flight of a candidate on one seed
+      std::vector<FlightScore> scores(candidates.size() * seeds);
+      std::map<pid_t, Task> running;
+      std::vector<bool> slotBusy(jobs, false);
+      size_t next = 0;
+      while (next < scores.size() or !running.empty()) {
+        while (next < scores.size() and (int)running.size() < jobs) {
+          int slot = std::find(slotBusy.begin(), slotBusy.end(), false) - slotBusy.begin();
+          Task task = {next, slot, -1};
+          pid_t pid = start(candidates[next / seeds]->gains, 1 + next % seeds, slot, task.pipe);
+          if (pid < 0) {
+            scores[next].crashed = true;
+            scores[next].cost = crashCost;
+          } else {
+            slotBusy[slot] = true;
+            running[pid] = task;
+          }
+          next++;
+        }
+
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0) {
+          break;
+        }
+        auto it = running.find(pid);
+        if (it == running.end()) {
+          continue;
+        }
+        Task task = it->second;
+        FlightScore score;
+        if (!WIFEXITED(status) or WEXITSTATUS(status) != 0 or read(task.pipe, &score, sizeof(score)) != sizeof(score)) {
+          score = FlightScore();
+          score.crashed = true;
+          score.cost = crashCost;
+        }
+        close(task.pipe);
+        scores[task.index] = score;
+        slotBusy[task.slot] = false;
+        running.erase(it);
+      }
+
+      //Average the parts of the score over the seeds
+      for (size_t c=0; c<candidates.size(); c++) {
+        FlightScore mean;
+        for (int s=0; s<seeds; s++) {
+          const FlightScore &score = scores[c*seeds + s];
+          mean.steps = score.steps;
+          mean.riseTime += score.riseTime / seeds;
+          mean.overshoot += score.overshoot / seeds;
+          mean.settlingTime += score.settlingTime / seeds;
+          mean.angleError += score.angleError / seeds;
+          mean.saturation += score.saturation / seeds;
+          mean.noise += score.noise / seeds;
+          mean.crashed |= score.crashed;
+          mean.cost += score.cost / seeds;
+        }
+        candidates[c]->score = mean;
+      }
+      flights += scores.size();
+    }
+
+    /** Flies a set of gains into a directory, keeping the log and truth.csv */
+    bool flyInto(const float gains[tunedCount], const std::string &flightDir) {
+      return run(gains, options.seed, flightDir, true, -1) == 0;
+    }
+
+    ///Number of flights flown
+    size_t flights = 0;
+
+  private:
+    /**
+     * @struct Task
+     * @brief Flight running in a child process
+     */
+    struct Task {
+      ///Index of the flight
+      size_t index;
+      ///Worker directory being used
+      int slot;
+      ///Pipe the score is read from
+      int pipe;
+    };
+
+    /** Starts a flight in a child process, returns its process ID or -1 */
+    pid_t start(const float gains[tunedCount], uint32_t seed, int slot, int &readEnd) {
+      int fds[2];
+      if (pipe(fds) != 0) {
+        return -1;
+      }
+      fflush(stdout);
+      pid_t pid = fork();
+      if (pid == 0) {
+        close(fds[0]);
+        _exit(run(gains, seed, dir + "/worker_" + std::to_string(slot), false, fds[1]));
+      }
+      close(fds[1]);
+      if (pid < 0) {
+        close(fds[0]);
+        return -1;
+      }
+      readEnd = fds[0];
+      return pid;
+    }
+
+    /** Runs one flight in this process, writing the score to a pipe. Returns an exit status */
+    int run(const float gains[tunedCount], uint32_t seed, const std::string &flightDir, bool writeTruth, int scorePipe) {
+      if (scorePipe < 0) {
+        //Keep the search's process free of the firmware's state
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid != 0) {
+          int status;
+          return pid < 0 or waitpid(pid, &status, 0) < 0 or !WIFEXITED(status) ? 1 : WEXITSTATUS(status);
+        }
+      }
+
+      //Start each flight from a fresh SD card so it does not depend on the flight before
+      mkdir(flightDir.c_str(), 0755);
+      const char *files[] = {"imuCal.bin", "imuState.bin", "log.bin", "log_0.csv", "truth.csv"};
+      for (const char *file : files) {
+        remove((flightDir + "/" + file).c_str());
+      }
+      FlightOptions flightOptions = options;
+      flightOptions.dir = flightDir;
+      flightOptions.seed = seed;
+      flightOptions.writeTruth = writeTruth;
+      if (!writeSettings(flightDir, gainsJson(gains), true)) {
+        _exit(1);
+      }
+
+      FlightResult flight = runFlight(flightOptions);
+      FlightScore score = scoreFlight(flight, maxAngle, maxYawRate);
+      if (scorePipe >= 0 and write(scorePipe, &score, sizeof(score)) != sizeof(score)) {
+        _exit(1);
+      }
+      _exit(0);
+    }
+
+    std::string dir;
+    int jobs;
+    FlightOptions options;
+    float maxAngle, maxYawRate;
+};
+
+int main(int argc, char **argv) {
+  std::string dir = "tune_out";
+  int generations = 15;
+  int population = 0;
+  int jobs = sysconf(_SC_NPROCESSORS_ONLN);
+  int seeds = 1;
+  double sigma = .15;
+  const char *scriptFile = nullptr;
+  for (int i=1; i<argc; i++) {
+    if (!strcmp(argv[i], "--dir") and i+1 < argc) {
+      dir = argv[++i];
+    } else if (!strcmp(argv[i], "--generations") and i+1 < argc) {
+      generations = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--population") and i+1 < argc) {
+      population = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--jobs") and i+1 < argc) {
+      jobs = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--seeds") and i+1 < argc) {
+      seeds = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--sigma") and i+1 < argc) {
+      sigma = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--script") and i+1 < argc) {
+      scriptFile = argv[++i];
+    } else {
+      fprintf(stderr, "usage: %s [--dir output directory] [--generations n] [--population n] [--jobs n] [--seeds n] "
+              "[--sigma s] [--script file]\n", argv[0]);
+      return 2;
+    }
+  }
+  jobs = std::max(jobs, 1);
+  seeds = std::max(seeds, 1);
+
+  //Load the script
+  std::string text = tuneScript;
+  if (scriptFile) {
+    FILE *file = fopen(scriptFile, "r");
+    if (!file) {
+      fprintf(stderr, "cannot open %s\n", scriptFile);
+      return 2;
+    }
+    text.clear();
+    char buf[256];
+    size_t len;
+    while ((len = fread(buf, 1, sizeof(buf), file)) > 0) {
+      text.append(buf, len);
+    }
+    fclose(file);
+  }
+  FlightOptions options;
+  std::string error;
+  if (!parseScript(text, options.script, error)) {
+    fprintf(stderr, "%s\n", error.c_str());
+    return 2;
+  }
+  if (mkdir(dir.c_str(), 0755) != 0 and errno != EEXIST) {
+    fprintf(stderr, "cannot create %s\n", dir.c_str());
+    return 2;
+  }
+
+  //Start from the firmware's default gains, and score the targets with its stick settings
+  PIDcontroller defaults;
+  std::vector<double> start(tunedCount);
+  for (int i=0; i<tunedCount; i++) {
+    const TunedGain &gain = tunedGains[i];
+    float value = !strcmp(gain.setting, "Pgain") ? defaults.Pgain[gain.axis] :
+                  !strcmp(gain.setting, "Igain") ? defaults.Igain[gain.axis] : defaults.Dgain[gain.axis];
+    start[i] = fromGain(i, std::max(value, gain.min));
+  }
+  FlightPool pool(dir, jobs, options, defaults.maxAngle, defaults.maxRate[2]);
+  Cmaes search(start, sigma, population, options.seed);
+  printf("tune: %d gains, %d generations of %d, %d seeds, %d jobs\n", tunedCount, generations, search.population, seeds, jobs);
+
+  //The default gains are the first candidate, so the result is never worse than them
+  std::vector<Candidate> all;
+  Candidate initial = {0, {}, {}};
+  toGains(start, initial.gains);
+  std::vector<Candidate*> batch = {&initial};
+  auto wallStart = std::chrono::steady_clock::now();
+  pool.fly(batch, seeds);
+  all.push_back(initial);
+  printf("tune: default gains, %s\n", describeScore(initial.score).c_str());
+
+  for (int g=1; g<=generations; g++) {
+    auto generationStart = std::chrono::steady_clock::now();
+    const std::vector<std::vector<double>> &points = search.ask();
+    std::vector<Candidate> candidates(points.size());
+    batch.clear();
+    for (size_t c=0; c<points.size(); c++) {
+      candidates[c].generation = g;
+      toGains(points[c], candidates[c].gains);
+      batch.push_back(&candidates[c]);
+    }
+    pool.fly(batch, seeds);
+
+    //Keep the search inside the ranges
+    std::vector<double> costs;
+    float generationBest = INFINITY;
+    for (size_t c=0; c<points.size(); c++) {
+      double outside = 0;
+      for (double x : points[c]) {
+        outside += pow(std::max(0.0, -x) + std::max(0.0, x - 1), 2);
+      }
+      costs.push_back(candidates[c].score.cost + outside * boundCost);
+      generationBest = std::min(generationBest, candidates[c].score.cost);
+      all.push_back(candidates[c]);
+    }
+    search.tell(costs);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - generationStart).count();
+    const Candidate &best = *std::min_element(all.begin(), all.end(), [](const Candidate &a, const Candidate &b) {
+      return a.score.cost < b.score.cost;
+    });
+    printf("tune: generation %d, best cost %.3f, generation best %.3f, sigma %.3f, %.1f s (%.1f flights/s)\n",
+           g, best.score.cost, generationBest, search.sigma,
+           seconds, points.size() * seeds / seconds);
+  }
+  double wallTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+
+  //Rank every candidate
+  std::stable_sort(all.begin(), all.end(), [](const Candidate &a, const Candidate &b) {
+    return a.score.cost < b.score.cost;
+  });
+  FILE *ranking = fopen((dir + "/ranking.csv").c_str(), "w");
+  if (!ranking) {
+    fprintf(stderr, "cannot write to %s\n", dir.c_str());
+    return 2;
+  }
+  fprintf(ranking, "Rank,Generation");
+  for (const TunedGain &gain : tunedGains) {
+    fprintf(ranking, ",%s %d", gain.setting, gain.axis);
+  }
+  fprintf(ranking, ",Score\n");
+  for (size_t r=0; r<all.size(); r++) {
+    fprintf(ranking, "%zu,%d", r+1, all[r].generation);
+    for (float gain : all[r].gains) {
+      fprintf(ranking, ",%.4g", gain);
+    }
+    fprintf(ranking, ",%s\n", describeScore(all[r].score).c_str());
+  }
+  fclose(ranking);
+
+  //The settings only hold the gains, so the real drone keeps its other settings
+  const Candidate &best = all.front();
+  FILE *settings = fopen((dir + "/settings.json").c_str(), "w");
+  if (!settings) {
+    fprintf(stderr, "cannot write to %s\n", dir.c_str());
+    return 2;
+  }
+  fprintf(settings, "{\n  %s\n}\n", gainsJson(best.gains).c_str());
+  fclose(settings);
+  bool bestFlown = pool.flyInto(best.gains, dir + "/best");
+
+  printf("tune: %zu flights on %d jobs in %.1f s (%.2f flights/s)\n", pool.flights, jobs, wallTime, pool.flights / wallTime);
+  printf("tune: best of generation %d, %s\n", best.generation, describeScore(best.score).c_str());
+  printf("tune: {\n  %s\n}\n", gainsJson(best.gains).c_str());
+  if (!bestFlown) {
+    fprintf(stderr, "the best gains could not be flown again\n");
+    return 1;
+  }
+  return best.score.crashed ? 1 : 0;
+}